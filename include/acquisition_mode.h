@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+
+namespace sensesp {
+
+// Adaptive acquisition (compile out with -D BATTERY_ADAPTIVE_ACQUISITION=0)
+// Each INA226 runs in one of two modes (register settings and read intervals
+// in ina226_sampler.h):
+// - steady: long averaging, slow reads; for idle or constant loads,
+// - fast:   short conversions, fast reads; while the current changes.
+// With BATTERY_ADAPTIVE_ACQUISITION=0 the chip stays at 256 samples and the
+// bank's read interval.
+#ifndef BATTERY_ADAPTIVE_ACQUISITION
+#define BATTERY_ADAPTIVE_ACQUISITION 1
+#endif
+
+// Current slope that switches to fast mode (A/s between consecutive samples)
+#ifndef BATTERY_ADAPTIVE_SLOPE_A_PER_S
+#define BATTERY_ADAPTIVE_SLOPE_A_PER_S 1.0f
+#endif
+
+// Back to steady mode once the current stayed within +-band of one value for
+// the hold time
+#ifndef BATTERY_ADAPTIVE_STEADY_BAND_A
+#define BATTERY_ADAPTIVE_STEADY_BAND_A 0.25f
+#endif
+
+#ifndef BATTERY_ADAPTIVE_HOLD_MS
+#define BATTERY_ADAPTIVE_HOLD_MS 30000UL
+#endif
+
+enum class AcquisitionMode : uint8_t {
+  kSteady = 0,
+  kFast = 1,
+};
+
+// Decides the acquisition mode from the sample stream. Enters fast mode on a
+// slope of at least slope_a_per_s with a step larger than steady_band_a;
+// leaves it after the current stayed within +-steady_band_a for hold_ms. The
+// band keeps noise at short read intervals (short averaging) from triggering
+// or holding fast mode. Timestamps are micros() and may wrap.
+// Host-portable: no Arduino dependencies.
+class AcquisitionModeController {
+ public:
+  AcquisitionModeController(float slope_a_per_s = BATTERY_ADAPTIVE_SLOPE_A_PER_S,
+                            float steady_band_a = BATTERY_ADAPTIVE_STEADY_BAND_A,
+                            uint32_t hold_ms = BATTERY_ADAPTIVE_HOLD_MS)
+      : slope_a_per_s_(slope_a_per_s), steady_band_a_(steady_band_a), hold_us_(hold_ms * 1000UL) {}
+
+  // Feed one sample; returns true if the mode changed
+  bool update(uint32_t timestamp_us, float current_a) {
+    if (!has_sample_) {
+      has_sample_ = true;
+      last_us_ = timestamp_us;
+      last_a_ = current_a;
+      reference_us_ = timestamp_us;
+      reference_a_ = current_a;
+      return false;
+    }
+    uint32_t dt_us = timestamp_us - last_us_;
+    float step = fabsf(current_a - last_a_);
+    float slope = dt_us > 0 ? step * 1e6f / dt_us : 0.0f;
+    last_us_ = timestamp_us;
+    last_a_ = current_a;
+
+    // Restart the hold time whenever the current leaves the band
+    if (fabsf(current_a - reference_a_) > steady_band_a_) {
+      reference_us_ = timestamp_us;
+      reference_a_ = current_a;
+    }
+
+    if (mode_ == AcquisitionMode::kSteady && slope >= slope_a_per_s_ && step > steady_band_a_) {
+      mode_ = AcquisitionMode::kFast;
+      reference_us_ = timestamp_us;
+      reference_a_ = current_a;
+      switch_count_++;
+      return true;
+    }
+    if (mode_ == AcquisitionMode::kFast && timestamp_us - reference_us_ >= hold_us_) {
+      mode_ = AcquisitionMode::kSteady;
+      switch_count_++;
+      return true;
+    }
+    return false;
+  }
+
+  AcquisitionMode mode() const { return mode_; }
+
+  // Mode changes since boot (both directions)
+  uint32_t get_switch_count() const { return switch_count_; }
+
+ private:
+  float slope_a_per_s_;
+  float steady_band_a_;
+  uint32_t hold_us_;
+  AcquisitionMode mode_ = AcquisitionMode::kSteady;
+  bool has_sample_ = false;
+  uint32_t last_us_ = 0;
+  float last_a_ = 0;
+  uint32_t reference_us_ = 0;  // Start of the current hold period
+  float reference_a_ = 0;
+  uint32_t switch_count_ = 0;
+};
+
+}  // namespace sensesp
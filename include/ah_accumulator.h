@@ -0,0 +1,168 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+
+namespace sensesp {
+
+// Numeric cores for AmpHourIntegrator. Both classes expose the same interface
+// so the integrator can pick one at compile time (see AH_FIXED_POINT in
+// ah_integrator.h). Neither depends on Arduino, so both can be built on a host.
+//
+// Efficiencies are applied by sign of the Ah delta: charge efficiency for
+// positive deltas, discharge efficiency for negative ones. Trapezoid segments
+// that cross zero are split at the crossing point first.
+
+// Reference core: double-precision Ah. Every operation is software-emulated on
+// the ESP32 (its FPU is single precision only).
+class DoubleAhAccumulator {
+ public:
+  void set_efficiencies(float charge_pct, float discharge_pct) {
+    charge_factor_ = charge_pct / 100.0;
+    discharge_factor_ = discharge_pct / 100.0;
+  }
+
+  // capacity_ah <= 0 disables clamping
+  void set_capacity(float capacity_ah) { capacity_ah_ = capacity_ah; }
+
+  void set_ah(double ah) {
+    ah_ = ah;
+    clamp();
+  }
+  double get_ah() const { return ah_; }
+  float get_ah_float() const { return static_cast<float>(ah_); }
+
+  // Current held constant for dt_us (rectangle rule)
+  void add_hold(float current_a, uint32_t dt_us) {
+    add(current_a * (static_cast<double>(dt_us) / kUsPerHour));
+  }
+
+  // Linear current change from i0_a to i1_a over dt_us (trapezoidal rule)
+  void add_trapezoid(float i0_a, float i1_a, uint32_t dt_us) {
+    double dt_hours = static_cast<double>(dt_us) / kUsPerHour;
+    double i0 = i0_a;
+    double i1 = i1_a;
+    if ((i0 > 0 && i1 < 0) || (i0 < 0 && i1 > 0)) {
+      // Zero crossing at fraction f = i0 / (i0 - i1) of the segment
+      double f = i0 / (i0 - i1);
+      add(0.5 * i0 * f * dt_hours);
+      add(0.5 * i1 * (1.0 - f) * dt_hours);
+    } else {
+      add(0.5 * (i0 + i1) * dt_hours);
+    }
+  }
+
+ private:
+  static constexpr double kUsPerHour = 3600000000.0;
+
+  void add(double delta_ah) {
+    ah_ += delta_ah * ((delta_ah > 0) ? charge_factor_ : discharge_factor_);
+    clamp();
+  }
+
+  void clamp() {
+    if (capacity_ah_ > 0) {
+      if (ah_ < 0.0) {
+        ah_ = 0.0;
+      } else if (ah_ > capacity_ah_) {
+        ah_ = capacity_ah_;
+      }
+    }
+  }
+
+  double ah_ = 0.0;
+  double capacity_ah_ = 0.0;
+  double charge_factor_ = 1.0;
+  double discharge_factor_ = 1.0;
+};
+
+// Fixed-point core: int64 accumulator in nano-ampere-seconds (mA * us), so one
+// integration step is an int32 x uint32 multiply and never divides. Range is
+// about +-2.5 million Ah. Efficiencies are Q24 factors applied with a multiply
+// and shift (Q16 was too coarse: 95% rounds off by 3e-6, which adds up to
+// ~0.02 Ah per month of cycling). Steps larger than kMaxStepNas (~275 As) are
+// applied in chunks so the Q24 product stays within int64.
+// Only set_ah(), set_capacity() and get_ah() touch double; they run on
+// configuration changes and at the Signal K output rate, not per sample.
+class FixedAhAccumulator {
+ public:
+  void set_efficiencies(float charge_pct, float discharge_pct) {
+    charge_q24_ = to_q24(charge_pct);
+    discharge_q24_ = to_q24(discharge_pct);
+  }
+
+  // capacity_ah <= 0 disables clamping
+  void set_capacity(float capacity_ah) {
+    capacity_nas_ = (capacity_ah > 0) ? static_cast<int64_t>(static_cast<double>(capacity_ah) * kNasPerAh) : 0;
+  }
+
+  void set_ah(double ah) {
+    nas_ = static_cast<int64_t>(ah * kNasPerAh);
+    clamp();
+  }
+  double get_ah() const { return static_cast<double>(nas_) / kNasPerAh; }
+  float get_ah_float() const { return static_cast<float>(nas_) * (1.0f / static_cast<float>(kNasPerAh)); }
+
+  // Current held constant for dt_us (rectangle rule)
+  void add_hold(float current_a, uint32_t dt_us) {
+    add(static_cast<int64_t>(to_ma(current_a)) * dt_us);
+  }
+
+  // Linear current change from i0_a to i1_a over dt_us (trapezoidal rule)
+  void add_trapezoid(float i0_a, float i1_a, uint32_t dt_us) {
+    int64_t i0 = to_ma(i0_a);
+    int64_t i1 = to_ma(i1_a);
+    if ((i0 > 0 && i1 < 0) || (i0 < 0 && i1 > 0)) {
+      // Areas either side of the zero crossing: i^2 * dt / (2 * (i0 - i1)).
+      // Only crossing segments pay for the int64 divisions.
+      int64_t span = 2 * (i0 - i1);
+      add(crossing_area(i0, dt_us, span));
+      add(-crossing_area(i1, dt_us, span));
+    } else {
+      add(((i0 + i1) * dt_us) / 2);
+    }
+  }
+
+ private:
+  static constexpr int64_t kNasPerAh = 3600000000000LL;  // 1 Ah = 3.6e12 mA*us
+  static constexpr int64_t kMaxStepNas = 1LL << 38;      // |step| * 2^24 must fit in int64
+
+  // i * i * dt / span without forming i * i * dt, which leaves int64 at
+  // 100 A once dt exceeds ~15 minutes: split i * dt by span into quotient
+  // and remainder first
+  static int64_t crossing_area(int64_t i, uint32_t dt_us, int64_t span) {
+    int64_t charge = i * dt_us;
+    return i * (charge / span) + i * (charge % span) / span;
+  }
+
+  static int32_t to_ma(float current_a) { return static_cast<int32_t>(lroundf(current_a * 1000.0f)); }
+  static int32_t to_q24(float pct) { return static_cast<int32_t>(lroundf(pct * (16777216.0f / 100.0f))); }
+
+  void add(int64_t delta_nas) {
+    int64_t q = (delta_nas > 0) ? charge_q24_ : discharge_q24_;
+    while (delta_nas > kMaxStepNas || delta_nas < -kMaxStepNas) {
+      int64_t chunk = (delta_nas > 0) ? kMaxStepNas : -kMaxStepNas;
+      nas_ += (chunk * q) >> 24;
+      delta_nas -= chunk;
+    }
+    nas_ += (delta_nas * q) >> 24;
+    clamp();
+  }
+
+  void clamp() {
+    if (capacity_nas_ > 0) {
+      if (nas_ < 0) {
+        nas_ = 0;
+      } else if (nas_ > capacity_nas_) {
+        nas_ = capacity_nas_;
+      }
+    }
+  }
+
+  int64_t nas_ = 0;
+  int64_t capacity_nas_ = 0;
+  int32_t charge_q24_ = 1 << 24;
+  int32_t discharge_q24_ = 1 << 24;
+};
+
+}  // namespace sensesp
@@ -1,5 +1,9 @@
 #pragma once
 
+#include "ah_accumulator.h"
+#include "ah_journal.h"
+#include "ah_persist_policy.h"
+#include "ah_rtc_snapshot.h"
 #include "sensesp/transforms/transform.h"
 #include "sensesp_base_app.h"
 
@@ -16,20 +20,56 @@ namespace sensesp {
 #define AH_PERSIST_CHECK_INTERVAL_MS 5000
 #endif
 
+// Numeric core (select at compile time with -D AH_FIXED_POINT)
+// Default: double-precision accumulator (software-emulated on the ESP32).
+// AH_FIXED_POINT: int64 fixed-point accumulator, no double math per sample.
+#ifdef AH_FIXED_POINT
+using AhAccumulator = FixedAhAccumulator;
+#else
+using AhAccumulator = DoubleAhAccumulator;
+#endif
+
 
 // Integrates current (A) over time to produce Amp-hours (Ah).
-// Runs internal integration at a configurable interval (default 1 Hz via AH_INTEGRATION_INTERVAL_MS).
+// Two integration modes:
+// - Timer mode (default): runs internal integration at a configurable interval
+//   (default 1 Hz via AH_INTEGRATION_INTERVAL_MS), holding the last current
+//   written by set() for the whole interval.
+// - Sample-synchronous mode: no timers at all; every sample passed to
+//   add_sample() is integrated against the previous one using the trapezoidal
+//   rule and the samples' own timestamps, so the result does not depend on the
+//   sample rate lining up with a timer. The owner calls maybe_persist_ah()
+//   periodically instead of the internal persist-check timer.
+// With AH_RTC_SNAPSHOT every integration step and setting change is also
+// mirrored to the RTC snapshot, and after a warm reset the integrator starts
+// from there instead of the state store (see ah_rtc_snapshot.h).
 // Exposes Ah to consumers at their own polling rate (e.g., Signal K output).
 class AmpHourIntegrator : public FloatTransform {
  public:
-  // config_path is unused for now but kept for consistency with other transforms
+  // config_path: also the state store key (short, e.g. "house"; see AhStateStore)
   // battery_capacity_ah: capacity in Ah, used to clamp Ah between 0 and capacity
+  // sample_synchronous: integrate per sample via add_sample() instead of on a timer
   explicit AmpHourIntegrator(const String& config_path = "", float initial_ah = 0.0f, 
-                             float battery_capacity_ah = 0.0f);
+                             float battery_capacity_ah = 0.0f, bool sample_synchronous = false);
 
+  // Timer mode: store the current reading for the next integration step.
+  // Sample-synchronous mode: same as add_sample(micros(), new_value).
   void set(const float& new_value) override;
 
-  double get_ah() const { return ah_output_; }
+  // Integrate one timestamped current sample (A) in sample-synchronous mode.
+  // Segments that cross zero are split at the crossing so charge and discharge
+  // efficiencies are applied to the correct portions.
+  void add_sample(uint32_t timestamp_us, float current_a);
+
+  // The next sample only starts a segment: the time since the last one is
+  // not integrated (no measurement in between, e.g. the INA226 was offline)
+  void restart_segment() { has_sample_ = false; }
+
+  // Stage Ah for persistence if it changed enough since the last persist.
+  // Called by the internal timer in timer mode, by the owner otherwise.
+  void maybe_persist_ah();
+
+  double get_ah() const { return ah_acc_.get_ah(); }
   
   // Set the current Ah value (e.g., from Signal K reset command)
   // Clamped between 0 and battery_capacity_ah
@@ -53,22 +93,29 @@ class AmpHourIntegrator : public FloatTransform {
 
  private:
   void integrate();  // Called by internal timer (interval set by AH_INTEGRATION_INTERVAL_MS)
+  void after_accumulate(unsigned long now);  // Sync output and persist after an integration step
   unsigned long last_update_ms_ = 0;
-  double current_a_ = 0.0;  // Most recent current reading (A) - double for precision
-  double ah_output_ = 0.0;  // Accumulated Ah value - double for precision
+  bool sample_synchronous_ = false;
+  bool has_sample_ = false;       // Whether add_sample() has seen a first sample
+  uint32_t last_sample_us_ = 0;   // Timestamp of the previous sample
+  float last_sample_a_ = 0.0f;    // Current of the previous sample (A)
+  float current_a_ = 0.0f;  // Most recent current reading (A)
+  AhAccumulator ah_acc_;    // Accumulated Ah (numeric core selected by AH_FIXED_POINT)
   float charge_efficiency_ = 100.0f;    // Efficiency % when charging (current > 0)
   float discharge_efficiency_ = 100.0f; // Efficiency % when discharging (current < 0)
   float marked_capacity_ah_ = 0.0f;     // Marked/nameplate capacity in Ah
   float battery_capacity_ah_ = 0.0f;    // Current capacity in Ah (used for clamping)
-  // Config path used to create unique NVS keys for persistence
-  String config_path_;
+  // State store key: config path with '/' replaced, built once in the constructor
+  char persist_key_[AhStateStore::kKeyLength + 1];
+  AhPersistedState snapshot() const;         // Current state for the state store
+  void stage_state();                        // Stage snapshot() in the state store (flushed in batches)
+  void mirror_state(unsigned long now);      // Copy snapshot() to the RTC snapshot (AH_RTC_SNAPSHOT)
+#if AH_RTC_SNAPSHOT
+  int rtc_handle_ = -1;                      // Slot pair in ah_rtc_snapshot()
+#endif
   // Ah persistence helpers
   bool ah_dirty_ = false;                    // Whether Ah has changed since last persisted
-  unsigned long last_ah_persist_ms_ = 0;     // Timestamp of last Ah persist
-  double last_persisted_ah_ = 0.0;           // Last persisted Ah value - double for precision
-  unsigned long ah_persist_interval_ms_ = 600000; // Default persist interval (10 minutes)
-  double ah_persist_delta_ = 0.5;            // Minimum Ah delta to trigger persist - double for precision
-  void maybe_persist_ah();                   // Called periodically to flush Ah to NVS
+  AhPersistPolicy persist_policy_;           // Delta/interval rules (AH_PERSIST_DELTA_AH, AH_PERSIST_INTERVAL_MS)
 };
 
 }  // namespace sensesp
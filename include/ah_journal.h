@@ -0,0 +1,140 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace sensesp {
+
+// Flush interval for staged integrator state in milliseconds (default 2 seconds)
+#ifndef AH_JOURNAL_FLUSH_INTERVAL_MS
+#define AH_JOURNAL_FLUSH_INTERVAL_MS 2000
+#endif
+
+// Maximum number of batteries (keys) a state store can hold
+#ifndef AH_STORE_MAX_ENTRIES
+#define AH_STORE_MAX_ENTRIES 16
+#endif
+
+// Persisted AmpHourIntegrator state for one battery, or the membership of
+// one virtual bank (members only, under the bank's own key)
+struct AhPersistedState {
+  float ah = 0.0f;
+  float marked_capacity_ah = 0.0f;
+  float current_capacity_ah = 0.0f;
+  float charge_efficiency = 100.0f;
+  float discharge_efficiency = 100.0f;
+  uint32_t members = 0;  // Virtual bank: bit i set while member i is joined
+};
+
+// Keyed store for integrator state. Integrators stage changes with update();
+// nothing touches flash until flush(), which commits every staged entry of
+// every battery in one batch. Keys are short names (e.g. "house"); only the
+// first kKeyLength characters are significant.
+class AhStateStore {
+ public:
+  static constexpr size_t kKeyLength = 8;
+
+  virtual ~AhStateStore() {}
+
+  // Latest state for key (staged or persisted). Returns false if unknown.
+  bool restore(const char* key, AhPersistedState* state);
+
+  // Stage state for key; written on the next flush()
+  void update(const char* key, const AhPersistedState& state);
+
+  // Commit all staged entries at once. Cheap no-op when nothing is staged.
+  void flush();
+
+  uint32_t get_commit_count() const { return commit_count_; }
+
+ protected:
+  struct Entry {
+    char key[kKeyLength];
+    AhPersistedState state;
+    bool dirty;
+  };
+
+  Entry* find(const char* key);
+  Entry* add(const char* key);
+
+  // Persist the given entries in one batch. Returns false on failure; the
+  // entries then stay staged and are retried on the next flush().
+  virtual bool commit(Entry* const* entries, size_t count) = 0;
+
+  // Lookup for keys not held in RAM (e.g. legacy storage). Default: none.
+  virtual bool load(const char* /*key*/, AhPersistedState* /*state*/) { return false; }
+
+  Entry entries_[AH_STORE_MAX_ENTRIES];
+  size_t entry_count_ = 0;
+  uint32_t commit_count_ = 0;
+};
+
+// Raw flash region used by AhJournal: a data partition on the ESP32, or a
+// simulated flash off-target.
+class JournalFlash {
+ public:
+  virtual ~JournalFlash() {}
+  virtual size_t size() const = 0;
+  virtual size_t sector_size() const = 0;
+  virtual bool read(size_t offset, void* data, size_t length) = 0;
+  virtual bool write(size_t offset, const void* data, size_t length) = 0;
+  virtual bool erase_sector(size_t offset) = 0;
+};
+
+// Append-only, CRC-protected journal of AhPersistedState records.
+//
+// The flash region is a ring of sectors. Each flush appends one record per
+// staged battery with a single write; records are never rewritten in place.
+// When the active sector is full the next sector is erased and the current
+// state of every battery is written to it first, so erasing the oldest sector
+// never loses the newest record of any battery. At boot the whole region is
+// scanned and the record with the highest sequence number wins for each key;
+// torn or corrupted records fail their CRC and are skipped.
+//
+// Keys not found in the journal are looked up in the optional fallback store
+// (used to migrate state written by earlier firmware).
+class AhJournal : public AhStateStore {
+ public:
+  explicit AhJournal(JournalFlash* flash, AhStateStore* fallback = nullptr);
+
+  uint32_t get_erase_count() const { return erase_count_; }
+  uint32_t get_record_count() const { return record_count_; }
+
+ protected:
+  bool commit(Entry* const* entries, size_t count) override;
+  bool load(const char* key, AhPersistedState* state) override;
+
+ private:
+  struct Record {
+    uint32_t sequence;  // 0xFFFFFFFF = erased
+    char key[kKeyLength];
+    AhPersistedState state;
+    uint32_t crc;
+  };
+
+  void scan();
+  bool is_erased(const Record& record) const;
+  bool write_records(Entry* const* entries, size_t count);
+  bool start_next_sector();
+  size_t records_per_sector() const;
+  size_t sector_count() const;
+
+  JournalFlash* flash_;
+  AhStateStore* fallback_;
+  size_t active_sector_ = 0;      // Sector currently appended to
+  size_t next_slot_ = 0;          // Record index of the next append in that sector
+  bool needs_erase_ = false;      // Region holds no journal yet; erase before first write
+  uint32_t next_sequence_ = 0;
+  uint32_t erase_count_ = 0;     // Sector erases since boot
+  uint32_t record_count_ = 0;    // Records written since boot
+};
+
+// CRC-32 (IEEE 802.3) used to protect journal records
+uint32_t journal_crc32(const void* data, size_t length);
+
+// Process-wide store used by AmpHourIntegrator. Uses the "ahjournal" data
+// partition when present, otherwise falls back to batched Preferences writes.
+// Registers the periodic flush on first use.
+AhStateStore* ah_state_store();
+
+}  // namespace sensesp
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cmath>
+
+namespace sensesp {
+
+// Minimum Ah change before the integrator stages Ah for persistence (default 0.5 Ah)
+#ifndef AH_PERSIST_DELTA_AH
+#define AH_PERSIST_DELTA_AH 0.5f
+#endif
+
+// Minimum time between periodic Ah persists in milliseconds (default 10 minutes)
+#ifndef AH_PERSIST_INTERVAL_MS
+#define AH_PERSIST_INTERVAL_MS 600000UL
+#endif
+
+// Decides when AmpHourIntegrator stages its Ah value for persistence. Kept
+// free of Arduino so tools/ah_replay counts writes with the same rules.
+struct AhPersistPolicy {
+  float delta_ah = AH_PERSIST_DELTA_AH;
+  unsigned long interval_ms = AH_PERSIST_INTERVAL_MS;
+  float last_persisted_ah = 0.0f;     // Last staged Ah value (stored as float)
+  unsigned long last_persist_ms = 0;  // Time of the last stage
+
+  bool delta_reached(float ah) const { return fabsf(ah - last_persisted_ah) >= delta_ah; }
+  bool interval_elapsed(unsigned long now_ms) const { return now_ms - last_persist_ms >= interval_ms; }
+  void mark(float ah, unsigned long now_ms) {
+    last_persisted_ah = ah;
+    last_persist_ms = now_ms;
+  }
+};
+
+}  // namespace sensesp
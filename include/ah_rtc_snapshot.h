@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "ah_journal.h"
+
+// Mirror integrator state in RTC memory for warm restarts (compile out with
+// -D AH_RTC_SNAPSHOT=0)
+#ifndef AH_RTC_SNAPSHOT
+#define AH_RTC_SNAPSHOT 1
+#endif
+
+namespace sensesp {
+
+// Copy of every battery's integrator state in memory that survives a warm
+// reset (RTC_NOINIT on the ESP32: software reset, panic, watchdog, brown-out),
+// written on every integration step. After a warm reset the integrators
+// restore from it instead of the state store, so the Ah integrated since the
+// last flash persist is not lost and boot does not wait for the store.
+//
+// Each battery has two slots written alternately, each with a sequence
+// number and a CRC-32 over its contents; restore() takes the newest valid
+// one, so a reset in the middle of a write falls back to the previous step.
+// Memory that was not written by this layout (power-on, different firmware)
+// fails the magic or the CRC, and the battery restores from the store.
+//
+// Host-portable: the region is plain memory supplied by the caller.
+class AhRtcSnapshot {
+ public:
+  struct Slot {
+    uint32_t magic;
+    uint32_t sequence;
+    char key[AhStateStore::kKeyLength];
+    AhPersistedState state;
+    uint32_t integrated_ms;  // Uptime of the integration step that wrote it
+    uint32_t crc;            // CRC-32 of everything above
+  };
+
+  struct Region {
+    Slot slots[AH_STORE_MAX_ENTRIES][2];
+  };
+
+  // warm: the region may hold state of the previous boot; false (power-on)
+  // clears it
+  AhRtcSnapshot(Region* region, bool warm);
+
+  // Slot pair of key: the one it used before the reset, else a free one.
+  // Returns -1 if all AH_STORE_MAX_ENTRIES are taken.
+  int attach(const char* key);
+
+  // Newest valid state of the previous boot for a handle from attach().
+  // *integrated_ms (optional) receives the uptime at which it was written.
+  bool restore(int handle, AhPersistedState* state, uint32_t* integrated_ms = nullptr) const;
+
+  // Mirror state (cheap: writes one 44 byte slot and its CRC)
+  void update(int handle, const AhPersistedState& state, uint32_t integrated_ms);
+
+  bool is_warm() const { return warm_; }
+  // Batteries restored by restore() since boot
+  uint32_t get_restore_count() const { return restore_count_; }
+
+ private:
+  static uint32_t slot_crc(const Slot& slot);
+  bool is_valid(const Slot& slot) const;
+  // Index (0 or 1) of the newest valid slot of a pair, -1 if neither is valid
+  int newest(int handle) const;
+
+  Region* region_;
+  bool warm_;
+  bool attached_[AH_STORE_MAX_ENTRIES] = {};
+  char keys_[AH_STORE_MAX_ENTRIES][AhStateStore::kKeyLength] = {};
+  uint32_t sequence_[AH_STORE_MAX_ENTRIES] = {};  // Next sequence per pair
+  uint8_t next_slot_[AH_STORE_MAX_ENTRIES] = {};  // Slot the next update() overwrites
+  mutable uint32_t restore_count_ = 0;
+};
+
+#if AH_RTC_SNAPSHOT
+// Process-wide snapshot in RTC_NOINIT memory, warm unless the chip was
+// powered on
+AhRtcSnapshot* ah_rtc_snapshot();
+#endif
+
+}  // namespace sensesp
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+
+#include "soc.h"
+
+namespace sensesp {
+
+// Latest values of one member battery, as fed to BankAggregate
+struct BankMemberState {
+  float voltage_v;
+  float current_a;  // Positive = charging
+  float power_w;
+  float ah;
+  float capacity_ah;
+  bool measured;  // voltage/current/power are valid (has a sample, online)
+};
+
+// Combined voltage, current, power, Ah, capacity and SOC of a set of member
+// batteries (a virtual bank, see VirtualBank).
+//
+// Members are slots (the monitor index in the bank). update() replaces one
+// member's values and adjusts the sums by the difference, so each member
+// sample costs a constant few integer operations and needs no pass over the
+// other members. The values are kept in fixed point (uA, mW, uV, uAh) with
+// 64-bit sums: adding and later subtracting the same member restores the sums
+// exactly, however often members join and leave or samples arrive, with no
+// float drift and no double math.
+//
+// - Ah and capacity are the sums over the members, so a join adds the
+//   member's Ah at that moment and a leave removes exactly what it
+//   contributed last; the members' own integrators are never touched.
+// - Current and power are the sums of the members' latest samples, NaN while
+//   any member is unmeasured (no sample yet, or offline): a partial sum would
+//   look like a real load change.
+// - Voltage is the mean over the measured members (paralleled banks share it).
+//
+// Host-portable: no Arduino dependencies.
+class BankAggregate {
+ public:
+  static constexpr int kMaxMembers = 16;
+
+  // Add slot with its current state; no-op if it is already a member
+  void join(int slot, const BankMemberState& state) {
+    if (slot < 0 || slot >= kMaxMembers || is_member(slot)) {
+      return;
+    }
+    members_ |= 1u << slot;
+    member_count_++;
+    Member empty = {};
+    replace(slot, empty, to_fixed(state));
+  }
+
+  // Remove slot and everything it contributed
+  void leave(int slot) {
+    if (!is_member(slot)) {
+      return;
+    }
+    Member empty = {};
+    replace(slot, slots_[slot], empty);
+    members_ &= ~(1u << slot);
+    member_count_--;
+  }
+
+  // New values of slot (after each of its samples); ignored unless a member
+  void update(int slot, const BankMemberState& state) {
+    if (is_member(slot)) {
+      replace(slot, slots_[slot], to_fixed(state));
+    }
+  }
+
+  bool is_member(int slot) const { return slot >= 0 && slot < kMaxMembers && (members_ & (1u << slot)) != 0; }
+  int member_count() const { return member_count_; }
+
+  // Mean over measured members, NaN if there is none
+  float voltage_v() const { return measured_count_ > 0 ? voltage_uv_sum_ / 1e6f / measured_count_ : NAN; }
+  // Sums, NaN unless every member is measured (and there is one)
+  float current_a() const { return all_measured() ? current_ua_sum_ / 1e6f : NAN; }
+  float power_w() const { return all_measured() ? power_mw_sum_ / 1e3f : NAN; }
+  float ah() const { return ah_uah_sum_ / 1e6f; }
+  float capacity_ah() const { return capacity_uah_sum_ / 1e6f; }
+  // SOC (%) of the combined bank: combined Ah / combined capacity
+  float soc_pct() const { return soc_percent(ah(), capacity_ah()); }
+
+ private:
+  struct Member {
+    int64_t ah_uah;
+    int64_t capacity_uah;
+    int32_t voltage_uv;
+    int32_t current_ua;
+    int32_t power_mw;
+    bool measured;
+  };
+
+  bool all_measured() const { return member_count_ > 0 && measured_count_ == member_count_; }
+
+  static int32_t to_int32(float value, float scale) {
+    float scaled = value * scale;
+    return scaled > 2.0e9f ? 2000000000 : (scaled < -2.0e9f ? -2000000000 : static_cast<int32_t>(lrintf(scaled)));
+  }
+
+  static Member to_fixed(const BankMemberState& state) {
+    Member member = {};
+    member.ah_uah = std::isnan(state.ah) ? 0 : llrintf(state.ah * 1e6f);
+    member.capacity_uah = std::isnan(state.capacity_ah) ? 0 : llrintf(state.capacity_ah * 1e6f);
+    member.measured = state.measured && !std::isnan(state.voltage_v) && !std::isnan(state.current_a) &&
+                      !std::isnan(state.power_w);
+    if (member.measured) {
+      member.voltage_uv = to_int32(state.voltage_v, 1e6f);
+      member.current_ua = to_int32(state.current_a, 1e6f);
+      member.power_mw = to_int32(state.power_w, 1e3f);
+    }
+    return member;
+  }
+
+  // Swap the contribution of slot from old_member to new_member
+  void replace(int slot, const Member& old_member, const Member& new_member) {
+    ah_uah_sum_ += new_member.ah_uah - old_member.ah_uah;
+    capacity_uah_sum_ += new_member.capacity_uah - old_member.capacity_uah;
+    voltage_uv_sum_ += static_cast<int64_t>(new_member.voltage_uv) - old_member.voltage_uv;
+    current_ua_sum_ += static_cast<int64_t>(new_member.current_ua) - old_member.current_ua;
+    power_mw_sum_ += static_cast<int64_t>(new_member.power_mw) - old_member.power_mw;
+    measured_count_ += (new_member.measured ? 1 : 0) - (old_member.measured ? 1 : 0);
+    slots_[slot] = new_member;
+  }
+
+  Member slots_[kMaxMembers] = {};
+  uint32_t members_ = 0;  // Bit per slot
+  int member_count_ = 0;
+  int measured_count_ = 0;
+  int64_t ah_uah_sum_ = 0;
+  int64_t capacity_uah_sum_ = 0;
+  int64_t voltage_uv_sum_ = 0;
+  int64_t current_ua_sum_ = 0;
+  int64_t power_mw_sum_ = 0;
+};
+
+}  // namespace sensesp
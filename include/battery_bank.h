@@ -0,0 +1,407 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#include "ah_integrator.h"
+#include "battery_history.h"
+#include "battery_log_esp32.h"
+#include "bank_aggregate.h"
+#include "battery_sample.h"
+#include "diagnostics.h"
+#include "i2c_bus.h"
+#include "ina226_device.h"
+#include "ina226_sampler.h"
+#include "pipeline_arena.h"
+#include "runtime_estimator.h"
+#include "sk_delta_emitter.h"
+#include "soc_ekf.h"
+#include "spsc_ring.h"
+#include "telemetry_stream.h"
+#include "sensesp/signalk/signalk_output.h"
+#include "sensesp/signalk/signalk_put_request_listener.h"
+#include "sensesp/system/lambda_consumer.h"
+
+namespace sensesp {
+
+class VirtualBank;
+struct VirtualBankConfig;
+
+// Static description of one INA226 battery monitor. Meant to live in a
+// constexpr table (see src/main.cpp).
+struct BatteryConfig {
+  const char* name;          // Signal K battery instance: electrical.batteries.<name>.*
+  const char* key;           // Short persistence key (max 8 chars), e.g. "house"
+  uint8_t i2c_address;       // INA226 address (0x40-0x4F)
+  float shunt_resistance;    // Ohm
+  float current_lsb_ma;      // Current LSB in mA
+  float capacity_ah;         // Nameplate capacity, used until a persisted value exists
+  float initial_ah;          // Ah at first boot (no persisted state)
+  int alert_pin;             // GPIO wired to ALERT for conversion-ready sampling, -1 to poll
+  bool crank_capture;        // Record engine crank transients (starter battery)
+  BatteryChemistry chemistry;  // OCV curve and circuit model of the SOC filter (BATTERY_SOC_EKF)
+  uint8_t cells;               // Cells in series
+};
+
+// Integrator configuration of one battery, as set in one go by
+// BatteryBank::apply_settings(). NaN leaves a value unchanged.
+struct BatterySettings {
+  float ah = NAN;
+  float charge_efficiency = NAN;     // %
+  float discharge_efficiency = NAN;  // %
+  float capacity_ah = NAN;           // Current (usable) capacity
+  float marked_capacity_ah = NAN;    // Nameplate capacity
+};
+
+// Virtual banks per BatteryBank (BatteryBank::add_virtual_bank())
+#ifndef BATTERY_VIRTUAL_BANK_MAX
+#define BATTERY_VIRTUAL_BANK_MAX 4
+#endif
+
+// Heartbeat of measured values (voltage, current, power, Ah, SOC) whose change
+// stays within their deadband
+#ifndef BATTERY_SK_HEARTBEAT_MS
+#define BATTERY_SK_HEARTBEAT_MS 10000UL
+#endif
+
+// Heartbeat of unchanged configuration values (efficiencies, capacities)
+#ifndef BATTERY_SK_CONFIG_HEARTBEAT_MS
+#define BATTERY_SK_CONFIG_HEARTBEAT_MS 60000UL
+#endif
+
+// Output interval while every battery is in steady acquisition mode
+// (BATTERY_ADAPTIVE_ACQUISITION)
+#ifndef BATTERY_STEADY_OUTPUT_INTERVAL_MS
+#define BATTERY_STEADY_OUTPUT_INTERVAL_MS 5000UL
+#endif
+
+// Acquisition task (select at compile time with -D BATTERY_ACQUISITION_TASK)
+// Default: INA226 sampling runs in the SensESP event loop.
+// BATTERY_ACQUISITION_TASK: a FreeRTOS task pinned to BATTERY_ACQ_TASK_CORE
+// does all INA226 I2C traffic and timestamps the samples; each monitor hands
+// them to the event loop through an SpscRing, where they are integrated.
+#ifndef BATTERY_ACQ_TASK_CORE
+#define BATTERY_ACQ_TASK_CORE 0
+#endif
+
+#ifndef BATTERY_ACQ_TASK_PRIORITY
+#define BATTERY_ACQ_TASK_PRIORITY 10
+#endif
+
+#ifndef BATTERY_ACQ_TASK_STACK_SIZE
+#define BATTERY_ACQ_TASK_STACK_SIZE 4096
+#endif
+
+// Samples buffered per monitor between the task and the event loop
+#ifndef BATTERY_SAMPLE_RING_SIZE
+#define BATTERY_SAMPLE_RING_SIZE 128
+#endif
+
+// How often the event loop drains the rings
+#ifndef BATTERY_RING_DRAIN_INTERVAL_MS
+#define BATTERY_RING_DRAIN_INTERVAL_MS 100
+#endif
+
+// One battery: INA226, sampler, Ah integrator and its Signal K outputs and
+// PUT listeners. Every member is held by value, so a monitor has a fixed
+// footprint and is created with a single allocation.
+//
+// An INA226 that does not answer at boot, or goes offline later (see
+// I2CBus), does not stop the node: voltage, current and power go out as NaN
+// (null) and the bank brings the chip up again with backoff. Ah integration
+// (and the runtime and SOC filters) restart with the first sample after
+// that: the time the chip was down is not integrated.
+class BatteryMonitor : public ValueConsumer<BatterySample> {
+ public:
+  // Signal K outputs registered with the emitter (attach()), each with metadata
+  static constexpr size_t kOutputCount = 11;
+  // Crank summary outputs of monitors with crank_capture, each with metadata
+  static constexpr size_t kCrankOutputCount = 4;
+
+  // bus: shared I2C bus manager of all monitors
+  // log_max_bytes: flash budget of this battery's log (BATTERY_LOG)
+  BatteryMonitor(const BatteryConfig& config, I2CBus* bus, size_t log_max_bytes);
+
+  // Bring up the INA226 (if it answers) and start the sampler
+  void begin();
+
+  // Initialise and configure the INA226 and report the result to the bus.
+  // Called by begin() and by the bank when the bus says a retry is due.
+  bool bring_up();
+
+  // Sample from the sampler: feed the integrator (queued for drain() when
+  // sampling runs in the acquisition task)
+  void set(const BatterySample& sample) override;
+
+#ifdef BATTERY_ACQUISITION_TASK
+  // Integrate the samples queued by the acquisition task (event loop side)
+  void drain();
+
+  // Samples dropped because the event loop did not drain the ring in time
+  uint32_t get_ring_overflow_count() const { return ring_.get_overflow_count(); }
+#endif
+
+  // Register the Signal K outputs with the bank's emitter
+  void attach(SKDeltaEmitter& emitter);
+
+  // Stage the latest sample and the integrator state in the emitter
+  void emit_outputs(SKDeltaEmitter& emitter);
+
+  // Publish the summary of a crank capture that completed since the last call
+  void publish_crank_summary();
+
+  const BatteryConfig& config() const { return config_; }
+  INA226Sampler& sampler() { return sampler_; }
+  INA226Device& device() { return ina_; }
+  // nullptr unless BatteryConfig::crank_capture
+  CrankCapture* crank_capture() { return crank_; }
+  // Uptime when the last crank summary was published
+  uint32_t get_crank_uptime_s() const { return crank_uptime_s_; }
+  AmpHourIntegrator& integrator() { return integrator_; }
+
+  // Current integrator configuration (every field set)
+  BatterySettings settings() const;
+
+  // Latest sample and Ah as a virtual bank member
+  BankMemberState member_state() const;
+
+  // Feed every sample to aggregate as member slot (VirtualBank)
+  void add_aggregate(BankAggregate* aggregate, uint8_t slot);
+
+  // Set the given fields through the integrator setters (staged in the state
+  // store, not flushed). Capacity goes first, so Ah is clamped to the new one.
+  // Returns false if no field was set.
+  bool apply_settings(const BatterySettings& settings);
+#if BATTERY_HISTORY
+  BatteryHistory& history() { return history_; }
+#endif
+#ifdef BATTERY_SOC_EKF
+  SocEkf& soc_filter() { return soc_filter_; }
+#endif
+#ifdef BATTERY_TELEMETRY
+  // Send every sample to stream as battery number index
+  void set_telemetry(TelemetryStream* stream, uint8_t index) {
+    telemetry_ = stream;
+    telemetry_index_ = index;
+  }
+#endif
+
+  // Battery temperature in Kelvin (Signal K units), logged with the next
+  // interval. NaN or a reading older than one log interval logs no
+  // temperature. With BATTERY_SOC_EKF it also sets the filter's temperature.
+  void set_temperature(float kelvin);
+
+#if BATTERY_LOG
+  BatteryLog& log() { return log_; }
+
+  // End the current log interval: average voltage and current over its
+  // samples and keep the record until write_log()
+  void close_log_interval(uint32_t uptime_s, uint32_t epoch_s);
+
+  // Append the closed interval; the caller holds battery_log_mutex()
+  void write_log();
+#endif
+
+ private:
+  const BatteryConfig& config_;
+  INA226Device ina_;
+  INA226Sampler sampler_;
+  AmpHourIntegrator integrator_;
+  RuntimeEstimator runtime_;  // Load averages for time to empty/full
+#ifdef BATTERY_SOC_EKF
+  SocEkf soc_filter_;
+#endif
+  void handle_sample(const BatterySample& sample);
+  // Set Ah through the integrator (staged for persistence) and restart the
+  // SOC filter from it
+  void set_ah(float ah);
+#ifdef BATTERY_SOC_EKF
+  // Restart the SOC filter from the integrator's Ah, capacity and efficiencies
+  void reset_soc_filter();
+#endif
+  // Published state of charge (%)
+  float soc_pct() const;
+
+#if BATTERY_DIAGNOSTICS
+  DiagHistogram i2c_read_time_;  // <name>.i2cRead
+#endif
+#if BATTERY_HISTORY
+  BatteryHistory history_;
+#endif
+  // Crank capture buffer and its summary outputs, created in the pipeline
+  // arena by the constructor for monitors with crank_capture only
+  CrankCapture* crank_ = nullptr;
+  enum CrankOutput { kCrankMinVoltage, kCrankPeakCurrent, kCrankSagDuration, kCrankResistance };
+  SKOutputFloat* crank_outputs_[kCrankOutputCount] = {};
+  uint32_t crank_uptime_s_ = 0;
+  BatterySample last_sample_ = {};
+  bool has_sample_ = false;
+  // Virtual banks this monitor is a member candidate of
+  BankAggregate* aggregates_[BATTERY_VIRTUAL_BANK_MAX] = {};
+  uint8_t aggregate_slots_[BATTERY_VIRTUAL_BANK_MAX] = {};
+  size_t aggregate_count_ = 0;
+#if BATTERY_LOG
+  BatteryLog log_;
+  float log_voltage_sum_ = 0;
+  float log_current_sum_ = 0;
+  uint32_t log_sample_count_ = 0;
+  float temperature_k_ = NAN;
+  uint32_t temperature_uptime_s_ = 0;
+  bool log_pending_ = false;  // Closed interval waiting for write_log()
+  LogValues log_values_ = {};
+  uint32_t log_uptime_s_ = 0;
+  uint32_t log_epoch_s_ = 0;
+#endif
+#ifdef BATTERY_ACQUISITION_TASK
+  SpscRing<BatterySample, BATTERY_SAMPLE_RING_SIZE> ring_;
+#endif
+#ifdef BATTERY_TELEMETRY
+  TelemetryStream* telemetry_ = nullptr;
+  uint8_t telemetry_index_ = 0;
+#endif
+  int first_channel_ = -1;  // Emitter channel of voltage_output_; the others follow in order
+
+  // Measured values
+  SKOutputFloat voltage_output_;
+  SKOutputFloat current_output_;
+  SKOutputFloat power_output_;
+  SKOutputFloat ah_output_;
+  SKOutputFloat soc_output_;
+  SKOutputFloat time_remaining_output_;
+  SKOutputFloat time_to_full_output_;
+  // Configuration values (readable, and PUT targets below)
+  SKOutputFloat charge_efficiency_output_;
+  SKOutputFloat discharge_efficiency_output_;
+  SKOutputFloat capacity_output_;
+  SKOutputFloat marked_capacity_output_;
+
+  // Signal K PUT inputs for remote reset/calibration and configuration
+  SKPutRequestListener<float> ah_input_;
+  SKPutRequestListener<float> charge_efficiency_input_;
+  SKPutRequestListener<float> discharge_efficiency_input_;
+  SKPutRequestListener<float> capacity_input_;
+  SKPutRequestListener<float> marked_capacity_input_;
+  LambdaConsumer<float> ah_consumer_;
+  LambdaConsumer<float> charge_efficiency_consumer_;
+  LambdaConsumer<float> discharge_efficiency_consumer_;
+  LambdaConsumer<float> capacity_consumer_;
+  LambdaConsumer<float> marked_capacity_consumer_;
+};
+
+// Maximum number of monitors in a bank (INA226 has 16 addresses)
+#ifndef BATTERY_BANK_MAX_MONITORS
+#define BATTERY_BANK_MAX_MONITORS 16
+#endif
+
+// Owns all battery monitors and drives them from one shared scheduler:
+// - one timer polls every monitor without an ALERT pin (with
+//   BATTERY_ADAPTIVE_ACQUISITION it runs at BATTERY_FAST_READ_INTERVAL_MS and
+//   each monitor is read at its own mode's interval, else every
+//   BATTERY_FIXED_READ_INTERVAL_MS),
+// - one tick callback services conversion-ready interrupts of all others,
+// - one tick callback reads monitors in a crank capture burst
+//   (BATTERY_CRANK_READ_INTERVAL_US),
+// - one timer publishes all Signal K outputs and runs the Ah persist checks
+//   (output_interval_ms). Outputs pass through one SKDeltaEmitter, so each
+//   output tick sends at most one delta for all batteries. The same timer
+//   closes the flash log intervals (BATTERY_LOG_INTERVAL_S) and brings up
+//   offline INA226s whose retry is due (in the acquisition task with
+//   BATTERY_ACQUISITION_TASK, which owns the I2C traffic).
+// The number of event loop callbacks is therefore constant, independent of
+// the number of batteries. With BATTERY_ACQUISITION_TASK the first two are
+// replaced by the acquisition task plus one ring drain timer.
+class BatteryBank {
+ public:
+  BatteryBank(const BatteryConfig* configs, size_t count, I2CBus* bus, unsigned int output_interval_ms = 1000);
+
+  size_t size() const { return count_; }
+  BatteryMonitor& monitor(size_t index) { return *monitors_[index]; }
+  // Monitor by BatteryConfig::name, nullptr if there is none
+  BatteryMonitor* find(const char* name);
+
+  // Combine member monitors into a virtual battery published with the
+  // monitors' outputs (see VirtualBank). Call after construction, during
+  // setup. nullptr if BATTERY_VIRTUAL_BANK_MAX are in use.
+  VirtualBank* add_virtual_bank(const VirtualBankConfig& config);
+  size_t virtual_bank_count() const { return virtual_bank_count_; }
+  VirtualBank& virtual_bank(size_t index) { return *virtual_banks_[index]; }
+  const SKDeltaEmitter& emitter() const { return emitter_; }
+  I2CBus* bus() { return bus_; }
+
+  // Apply settings[i] to monitor(i) for every monitor, then commit them with
+  // one state store flush. Event loop only. Returns false if the commit
+  // failed; the settings are applied anyway and stay staged for the next
+  // periodic flush.
+  bool apply_settings(const BatterySettings* settings);
+
+#ifdef BATTERY_TELEMETRY
+  // Stream every sample of every monitor (battery number = monitor index);
+  // the output timer sends datagrams that reach their latency between
+  // samples
+  void set_telemetry(TelemetryStream* stream);
+  TelemetryStream* telemetry() { return telemetry_; }
+#endif
+
+ private:
+  void poll();
+  void retry_offline();
+  void service_alerts();
+  void service_bursts();
+  void emit_outputs();
+#if BATTERY_LOG
+  void update_logs();
+#endif
+#ifdef BATTERY_ACQUISITION_TASK
+  static void acquisition_task(void* arg);
+  void acquire();
+  void drain();
+#endif
+
+  BatteryMonitor* monitors_[BATTERY_BANK_MAX_MONITORS];
+  size_t count_ = 0;
+  VirtualBank* virtual_banks_[BATTERY_VIRTUAL_BANK_MAX];
+  size_t virtual_bank_count_ = 0;
+  I2CBus* bus_;
+  unsigned int read_interval_ms_;
+  unsigned int output_interval_ms_;
+  bool any_polled_ = false;
+  bool any_polled_crank_ = false;
+  SKDeltaEmitter emitter_;
+  unsigned long last_persist_check_ms_ = 0;
+  unsigned long last_emit_ms_ = 0;
+#if BATTERY_LOG
+  uint32_t next_log_uptime_s_ = BATTERY_LOG_INTERVAL_S;
+  bool log_pending_ = false;  // Closed intervals not yet written (log busy)
+#endif
+#if BATTERY_DIAGNOSTICS
+  uint32_t last_output_us_ = 0;
+#endif
+#ifdef BATTERY_ACQUISITION_TASK
+  TaskHandle_t task_ = nullptr;
+#endif
+#ifdef BATTERY_TELEMETRY
+  TelemetryStream* telemetry_ = nullptr;
+#endif
+};
+
+// Pipeline arena bytes of one monitor: itself, the metadata of its outputs
+// and, with crank_capture, the capture, its buffer and its summary outputs
+constexpr size_t battery_monitor_arena_bytes(const BatteryConfig& config) {
+  return PipelineArena::arena_bytes<BatteryMonitor>() +
+         PipelineArena::arena_bytes<SKMetadata>(BatteryMonitor::kOutputCount) +
+         (config.crank_capture ? PipelineArena::arena_bytes<CrankCapture>() +
+                                     PipelineArena::arena_array_bytes<CrankCapture::Point>(BATTERY_CRANK_MAX_POINTS) +
+                                     PipelineArena::arena_bytes<SKOutputFloat>(BatteryMonitor::kCrankOutputCount) +
+                                     PipelineArena::arena_bytes<SKMetadata>(BatteryMonitor::kCrankOutputCount)
+                               : 0);
+}
+
+// Pipeline arena bytes of a BatteryBank created from configs, including the
+// bank itself (sizes kPipelineArenaBytes in src/main.cpp)
+constexpr size_t battery_bank_arena_bytes(const BatteryConfig* configs, size_t count) {
+  return count == 0 ? PipelineArena::arena_bytes<BatteryBank>()
+                    : battery_monitor_arena_bytes(configs[0]) + battery_bank_arena_bytes(configs + 1, count - 1);
+}
+
+}  // namespace sensesp
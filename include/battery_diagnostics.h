@@ -0,0 +1,108 @@
+#pragma once
+
+#include "battery_bank.h"
+#include "diagnostics.h"
+#include "onewire_bus.h"
+
+namespace sensesp {
+
+#if BATTERY_DIAGNOSTICS
+
+// Publishes the instrumentation on diagnostics.batterySensors.* every
+// interval_ms, all in one callback (one delta):
+// - <histogram>.mean / .p99 / .max (s) and .count for every DiagHistogram,
+//   over the samples recorded since the previous publish,
+// - eventLoop.tickInterval: time between event loop ticks (jitter),
+// - heap.free / heap.minFree / heap.largestBlock (bytes),
+// - delta.* counters of the bank's SKDeltaEmitter, per battery sample and
+//   missed-alert counters, and the state store's commit count,
+// - per battery: i2cErrors (NACKs and bus errors), i2cTimeouts, i2cOffline
+//   (times the INA226 went offline) and online (1/0), and i2c.recoveries of
+//   the shared bus (the read latency is the <name>.i2cRead histogram),
+// - per battery with BATTERY_ADAPTIVE_ACQUISITION: acquisitionMode (0 steady,
+//   1 fast), modeSwitches and sampleRate (Hz over the publish interval),
+// - onewire.crcErrors / onewire.missedReads of an added OneWireBus (its bus
+//   time per cycle is the onewire.busTime histogram),
+// - telemetry.records / .datagrams / .sendFailures of the bank's
+//   TelemetryStream (BATTERY_TELEMETRY, set before the diagnostics are
+//   created),
+// - arena.used (bytes) and arena.overflows (objects that did not fit and
+//   went to the heap) of the pipeline arena.
+class BatteryDiagnostics {
+ public:
+  BatteryDiagnostics(BatteryBank* bank, unsigned int interval_ms = DIAGNOSTICS_PUBLISH_INTERVAL_MS);
+
+  // Also publish the error counters of a OneWire bus
+  void add_onewire_bus(OneWireBus* bus);
+
+ private:
+  struct HistogramOutputs {
+    DiagHistogram* histogram;
+    SKOutputFloat* mean;
+    SKOutputFloat* p99;
+    SKOutputFloat* max;
+    SKOutputInt* count;
+  };
+
+  struct MonitorOutputs {
+    SKOutputInt* samples;
+    SKOutputInt* missed_alerts;
+    SKOutputInt* i2c_errors;
+    SKOutputInt* i2c_timeouts;
+    SKOutputInt* i2c_offline;
+    SKOutputInt* online;
+#ifdef BATTERY_ACQUISITION_TASK
+    SKOutputInt* ring_overflows;
+#endif
+#if BATTERY_ADAPTIVE_ACQUISITION
+    SKOutputInt* mode;
+    SKOutputInt* mode_switches;
+    SKOutputFloat* sample_rate;
+    uint32_t last_sample_count;
+#endif
+  };
+
+  void publish();
+
+  BatteryBank* bank_;
+  HistogramOutputs* histograms_ = nullptr;
+  size_t histogram_count_ = 0;
+  MonitorOutputs* monitors_ = nullptr;
+  SKOutputFloat* heap_free_;
+  SKOutputFloat* heap_min_free_;
+  SKOutputFloat* heap_largest_block_;
+  SKOutputInt* delta_messages_;
+  SKOutputInt* delta_values_;
+  SKOutputInt* delta_suppressed_;
+  SKOutputInt* delta_bytes_;
+  SKOutputInt* delta_unregistered_;
+  SKOutputInt* journal_commits_;
+  SKOutputInt* i2c_recoveries_;
+  SKOutputFloat* arena_used_;
+  SKOutputInt* arena_overflows_;
+  OneWireBus* onewire_bus_ = nullptr;
+  SKOutputInt* onewire_crc_errors_ = nullptr;
+  SKOutputInt* onewire_missed_reads_ = nullptr;
+#ifdef BATTERY_TELEMETRY
+  SKOutputInt* telemetry_records_ = nullptr;
+  SKOutputInt* telemetry_datagrams_ = nullptr;
+  SKOutputInt* telemetry_failures_ = nullptr;
+#endif
+  uint32_t last_tick_us_ = 0;
+#if BATTERY_ADAPTIVE_ACQUISITION
+  uint32_t last_publish_us_ = 0;
+#endif
+};
+
+#else
+
+// Compiled out (BATTERY_DIAGNOSTICS=0)
+class BatteryDiagnostics {
+ public:
+  BatteryDiagnostics(BatteryBank*, unsigned int = 0) {}
+  void add_onewire_bus(OneWireBus*) {}
+};
+
+#endif
+
+}  // namespace sensesp
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+#include "battery_sample.h"
+#include "history_ring.h"
+
+// On-device history (compile out with -D BATTERY_HISTORY=0)
+// Allocates the HISTORY_*_BLOCKS tiers of history_ring.h per battery at
+// startup and serves them on /api/batteries/history (see history_http.h).
+#ifndef BATTERY_HISTORY
+#define BATTERY_HISTORY 1
+#endif
+
+#if BATTERY_HISTORY
+
+namespace sensesp {
+
+// HistoryTiers shared between the event loop (append) and the HTTP server
+// task (readers). Readers copy one block at a time under the mutex and decode
+// the copy, so streaming a tier never blocks sampling for long.
+class BatteryHistory {
+ public:
+  enum Tier { kRaw, kMinute, kHour };
+
+  BatteryHistory();
+
+  void append(uint32_t time_s, const BatterySample& sample, float ah);
+
+  // Sequence number of the oldest block held in a tier
+  uint32_t first_sequence(Tier tier);
+
+  // Copy the block with the given sequence number, or the oldest block still
+  // held if it was evicted. Returns false once the sequence passes the
+  // newest block. *sequence is set to the copied block's number.
+  bool copy_raw_block(uint32_t* sequence, HistoryTiers::RawRing::Block* block);
+  bool copy_aggregate_block(Tier tier, uint32_t* sequence, HistoryTiers::AggregateRing::Block* block);
+
+ private:
+  template <typename Ring>
+  static bool copy_block(const Ring& ring, uint32_t* sequence, typename Ring::Block* block);
+
+  HistoryTiers tiers_;
+  SemaphoreHandle_t mutex_;
+};
+
+}  // namespace sensesp
+
+#endif
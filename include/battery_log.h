@@ -0,0 +1,163 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+namespace sensesp {
+
+// Interval between log records in seconds (default 5 minutes)
+#ifndef BATTERY_LOG_INTERVAL_S
+#define BATTERY_LOG_INTERVAL_S 300
+#endif
+
+// Flash budget for the logs of all batteries together. Shares the LittleFS
+// partition with the SensESP configuration, so leave room for it.
+#ifndef BATTERY_LOG_MAX_BYTES
+#define BATTERY_LOG_MAX_BYTES (72 * 1024)
+#endif
+
+// Segment file size (one LittleFS block)
+#ifndef BATTERY_LOG_SEGMENT_BYTES
+#define BATTERY_LOG_SEGMENT_BYTES 4096
+#endif
+
+// Records are collected in RAM and written one page at a time
+#ifndef BATTERY_LOG_PAGE_BYTES
+#define BATTERY_LOG_PAGE_BYTES 256
+#endif
+
+// Longest time records may wait in RAM before a (partial page) write. The
+// default lets a page fill at the default interval (32 records, 2.7 h); records
+// still in RAM are lost on a reset.
+#ifndef BATTERY_LOG_MAX_BUFFER_AGE_S
+#define BATTERY_LOG_MAX_BUFFER_AGE_S 10800
+#endif
+
+// Directory holding the segment files
+#ifndef BATTERY_LOG_DIR
+#define BATTERY_LOG_DIR "/batlog"
+#endif
+
+// File access used by BatteryLog (LittleFS on the device, see
+// src/battery_log_esp32.cpp). Paths are absolute.
+class LogFileSystem {
+ public:
+  virtual ~LogFileSystem() {}
+  virtual bool make_dir(const char* path) = 0;
+  // Calls fn(name, size) for every file in dir; name is without the directory
+  virtual void list(const char* dir, const std::function<void(const char* name, size_t size)>& fn) = 0;
+  // Size of a file, 0 if it does not exist
+  virtual size_t size(const char* path) = 0;
+  virtual bool append(const char* path, const void* data, size_t length) = 0;
+  // Returns the number of bytes read
+  virtual size_t read(const char* path, size_t offset, void* data, size_t length) = 0;
+  virtual bool remove(const char* path) = 0;
+};
+
+// One logged interval. NaN temperature = no reading.
+struct LogValues {
+  float voltage_v;
+  float current_a;
+  float ah;
+  float soc_pct;
+  float temperature_c;
+};
+
+// Segment file layout (little-endian):
+//   LogSegmentHeader: absolute values of the first record
+//   LogRecord[]:      deltas against the previous record
+// Record i of a segment belongs to uptime_s + i * interval_s. A gap (reboot,
+// missed interval) or a value that cannot be encoded starts a new segment, so
+// every segment decodes on its own.
+struct LogSegmentHeader {
+  char magic[4];         // "BLG1"
+  uint16_t interval_s;
+  uint16_t reserved;
+  uint32_t epoch_s;      // Wall clock of the first record, 0 if not set
+  uint32_t uptime_s;     // Uptime of the first record
+  int32_t voltage;       // mV
+  int32_t current;       // 10 mA
+  int32_t ah;            // 10 mAh
+  int16_t soc;           // 0.1 %
+  int16_t temperature;   // 0.1 degC, kNoTemperature if none
+};
+
+struct LogRecord {
+  int16_t voltage;      // mV
+  int16_t current;      // 10 mA
+  int16_t ah;           // 10 mAh
+  int8_t soc;           // 0.1 %
+  int8_t temperature;   // 0.1 degC, kNoTemperatureDelta if no reading
+};
+
+static_assert(sizeof(LogSegmentHeader) == 32, "segment header layout");
+static_assert(sizeof(LogRecord) == 8, "record layout");
+
+// Append-only, size-capped log of one battery in rotating segment files
+// <dir>/<key>.<sequence>. Deltas that overflow their field are saturated and
+// the error carries into the next record (the encoder tracks the decoded
+// values), so it never accumulates. Not thread-safe; the owner serialises
+// access.
+class BatteryLog {
+ public:
+  static constexpr int16_t kNoTemperature = INT16_MIN;
+  static constexpr int8_t kNoTemperatureDelta = INT8_MIN;
+
+  BatteryLog(LogFileSystem* fs, const char* key, size_t max_bytes, uint32_t interval_s = BATTERY_LOG_INTERVAL_S);
+
+  // Find existing segments. Appends always start a new segment after a boot.
+  void begin();
+
+  void append(const LogValues& values, uint32_t uptime_s, uint32_t epoch_s);
+
+  // Write buffered records now (partial page)
+  void flush();
+
+  // Stream the whole log, oldest segment first, as
+  //   [uint32 length][segment bytes] ...
+  // including records still buffered in RAM. Files are read into chunk
+  // (chunk_size bytes) piece by piece and passed to sink; nothing else is
+  // buffered. Stops and returns false when sink returns false.
+  bool export_to(uint8_t* chunk, size_t chunk_size, const std::function<bool(const void*, size_t)>& sink) const;
+
+  size_t stored_bytes() const { return stored_bytes_; }
+  uint32_t get_write_count() const { return write_count_; }
+
+ private:
+  struct Quantized {
+    int32_t voltage;
+    int32_t current;
+    int32_t ah;
+    int32_t soc;
+    int32_t temperature;
+  };
+
+  static Quantized quantize(const LogValues& values);
+  void segment_path(uint32_t sequence, char* path, size_t length) const;
+  void start_segment(const Quantized& values, uint32_t uptime_s, uint32_t epoch_s);
+  bool encode(const Quantized& values, LogRecord* record);
+  void put(const void* data, size_t length);
+  void write_buffer();
+  void enforce_budget();
+
+  LogFileSystem* fs_;
+  char key_[9];
+  size_t max_bytes_;
+  uint32_t interval_s_;
+
+  bool has_segment_ = false;      // A segment is open for appending
+  uint32_t first_sequence_ = 0;   // Oldest segment on flash
+  uint32_t next_sequence_ = 0;    // Sequence of the next new segment
+  size_t segment_bytes_ = 0;      // Bytes of the open segment (flash + buffer)
+  size_t stored_bytes_ = 0;       // Bytes of all segments on flash
+  uint32_t next_uptime_s_ = 0;    // Expected uptime of the next record
+  Quantized last_ = {};           // Decoded values of the last record
+
+  uint8_t buffer_[BATTERY_LOG_PAGE_BYTES];
+  size_t buffer_used_ = 0;
+  uint32_t buffer_since_s_ = 0;   // Uptime of the oldest buffered record
+  uint32_t write_count_ = 0;      // Flash writes since boot
+};
+
+}  // namespace sensesp
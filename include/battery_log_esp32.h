@@ -0,0 +1,22 @@
+#pragma once
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+#include "battery_log.h"
+
+// Flash logging (compile out with -D BATTERY_LOG=0)
+#ifndef BATTERY_LOG
+#define BATTERY_LOG 1
+#endif
+
+namespace sensesp {
+
+// LittleFS file access for BatteryLog
+LogFileSystem* battery_log_fs();
+
+// Serialises all BatteryLog access between the event loop (append, which
+// only tries the lock and retries on the next tick) and the HTTP export
+SemaphoreHandle_t battery_log_mutex();
+
+}  // namespace sensesp
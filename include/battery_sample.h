@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstdint>
+
+namespace sensesp {
+
+// One coherent reading from a battery monitor. All values belong to the same
+// INA226 conversion, so consumers (SK outputs, Ah integrator) never mix
+// voltage and current from different conversion windows.
+struct BatterySample {
+  uint32_t timestamp_us = 0;  // micros() at conversion-ready (or poll) time
+  float voltage_v = 0.0f;     // Bus voltage in V
+  float current_a = 0.0f;     // Current in A (positive = charging)
+  float power_w = 0.0f;       // Power in W (signed, derived from V * I)
+  // First sample after the chip was (re)configured: the time since the
+  // previous one was not measured and must not be integrated
+  bool segment_start = false;
+};
+
+}  // namespace sensesp
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "battery_bank.h"
+
+// Largest accepted configuration document in bytes
+#ifndef CONFIG_HTTP_MAX_BODY_BYTES
+#define CONFIG_HTTP_MAX_BODY_BYTES 2048
+#endif
+
+// How long a PUT waits for the event loop to apply the document
+#ifndef CONFIG_HTTP_APPLY_TIMEOUT_MS
+#define CONFIG_HTTP_APPLY_TIMEOUT_MS 2000
+#endif
+
+namespace sensesp {
+
+// Integrator configuration of every battery as one JSON document:
+//   GET /api/batteries/config
+//   PUT /api/batteries/config
+//
+//   {"batteries":{"house":{"ah":150,"chargeEfficiency":95,
+//     "dischargeEfficiency":98,"capacity":190,"markedCapacity":200},
+//    "starter":{...}}}
+//
+// A PUT may leave out batteries and fields; those keep their value. The whole
+// document is validated first (unknown battery or field, non-number, out of
+// range, Ah above the capacity: 400 and nothing changes), then the event loop
+// applies all of it in one step with one state store commit (see
+// BatteryBank::apply_settings). The reply is the resulting document (as for
+// GET) with "persisted": false if the commit failed; the values are applied
+// and retried with the next periodic flush. 503 if the event loop did not
+// pick the document up within CONFIG_HTTP_APPLY_TIMEOUT_MS (nothing changed).
+//
+// The per-value Signal K PUT paths stay available.
+void add_config_http_handler(BatteryBank* bank);
+
+}  // namespace sensesp
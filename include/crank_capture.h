@@ -0,0 +1,147 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace sensesp {
+
+// Crank capture trigger: bus voltage below this, or current magnitude above
+// BATTERY_CRANK_TRIGGER_A
+#ifndef BATTERY_CRANK_TRIGGER_V
+#define BATTERY_CRANK_TRIGGER_V 11.5f
+#endif
+
+#ifndef BATTERY_CRANK_TRIGGER_A
+#define BATTERY_CRANK_TRIGGER_A 50.0f
+#endif
+
+// Length of one capture after the trigger
+#ifndef BATTERY_CRANK_CAPTURE_MS
+#define BATTERY_CRANK_CAPTURE_MS 4000
+#endif
+
+// Capture buffer size (8 bytes per point, allocated once at setup or supplied
+// by the caller). Must hold BATTERY_CRANK_CAPTURE_MS at the burst read interval.
+#ifndef BATTERY_CRANK_MAX_POINTS
+#define BATTERY_CRANK_MAX_POINTS 2048
+#endif
+
+// Samples kept from before the trigger; they give the rest voltage and current
+#ifndef BATTERY_CRANK_PRE_TRIGGER_POINTS
+#define BATTERY_CRANK_PRE_TRIGGER_POINTS 8
+#endif
+
+// The sag lasts while the voltage is this far below the rest voltage
+#ifndef BATTERY_CRANK_SAG_MARGIN_V
+#define BATTERY_CRANK_SAG_MARGIN_V 0.3f
+#endif
+
+// The internal resistance fit uses the pre-trigger samples and the samples
+// discharging at least this much more than at rest
+#ifndef BATTERY_CRANK_FIT_MIN_DISCHARGE_A
+#define BATTERY_CRANK_FIT_MIN_DISCHARGE_A 5.0f
+#endif
+
+// Triggered burst recorder for engine crank transients on a starter battery.
+//
+// The producer (the sampler, in whichever task reads the INA226) feeds every
+// sample to add(). While armed the last BATTERY_CRANK_PRE_TRIGGER_POINTS
+// samples are kept; a trigger copies them into the capture buffer and records
+// until capture_ms after the trigger (or the buffer is full). The summary is
+// computed by the producer when the capture ends. A new capture can only be
+// triggered after a sample that does not meet the trigger, so a battery
+// resting below the voltage threshold does not capture in a loop.
+//
+// The consumer (event loop, HTTP handler) polls take_completed() for new
+// summaries. To read the waveform it calls begin_read(), which blocks new
+// triggers until end_read(); a crank during a download is not captured.
+// Host-portable: only needs <atomic>.
+class CrankCapture {
+ public:
+  struct Point {
+    int32_t time_us;      // Relative to the trigger (negative: pre-trigger)
+    uint16_t voltage_mv;
+    int16_t current_da;   // 0.1 A, positive = charging
+  };
+
+  struct Summary {
+    uint32_t trigger_us;          // micros() of the trigger
+    float rest_voltage_v;         // Mean of the pre-trigger samples
+    float rest_current_a;
+    float min_voltage_v;
+    float peak_current_a;         // Largest current magnitude
+    float sag_duration_s;         // Voltage below rest - BATTERY_CRANK_SAG_MARGIN_V
+    float internal_resistance_ohm;  // |dV/dI| fit over the capture, NaN if the current hardly changed
+    uint32_t point_count;
+  };
+
+  // points: capture buffer of max_points (not owned, e.g. from the pipeline
+  // arena); nullptr allocates one
+  CrankCapture(float trigger_voltage_v = BATTERY_CRANK_TRIGGER_V, float trigger_current_a = BATTERY_CRANK_TRIGGER_A,
+               uint32_t capture_ms = BATTERY_CRANK_CAPTURE_MS, size_t max_points = BATTERY_CRANK_MAX_POINTS,
+               Point* points = nullptr);
+  ~CrankCapture() {
+    if (owns_points_) {
+      delete[] points_;
+    }
+  }
+  CrankCapture(const CrankCapture&) = delete;
+  CrankCapture& operator=(const CrankCapture&) = delete;
+
+  // Producer: feed one sample. Returns true while capturing (the sampler
+  // then reads at the burst rate).
+  bool add(uint32_t timestamp_us, float voltage_v, float current_a);
+
+  bool is_capturing() const { return state_.load(std::memory_order_relaxed) == kCapturing; }
+
+  // Consumer: true once per completed capture; *summary receives its summary
+  bool take_completed(Summary* summary);
+
+  // Consumer: hold the last capture for reading. Returns false (and holds
+  // nothing) if there is no complete capture or one is being recorded.
+  bool begin_read();
+  void end_read();
+  const Point* points() const { return points_; }
+  size_t size() const { return count_; }
+  Summary summary() const { return summary_; }
+
+  // Captures completed since boot
+  uint32_t get_capture_count() const { return capture_count_.load(std::memory_order_relaxed); }
+
+ private:
+  enum State : uint8_t {
+    kWaiting,    // Needs a sample below the trigger before arming
+    kArmed,
+    kCapturing,
+    kReading,    // A consumer holds the buffer
+  };
+
+  bool triggers(float voltage_v, float current_a) const;
+  static Point make_point(int32_t time_us, float voltage_v, float current_a);
+  void push_pre_trigger(uint32_t timestamp_us, float voltage_v, float current_a);
+  void start(uint32_t timestamp_us);
+  void finish();
+
+  float trigger_voltage_v_;
+  float trigger_current_a_;
+  uint32_t capture_us_;
+  size_t max_points_;
+
+  bool owns_points_;
+  Point* points_;
+  size_t count_ = 0;
+  Point pre_[BATTERY_CRANK_PRE_TRIGGER_POINTS];  // Ring of the last samples before a trigger
+  uint32_t pre_time_us_[BATTERY_CRANK_PRE_TRIGGER_POINTS];  // Their micros() timestamps
+  size_t pre_count_ = 0;
+  size_t pre_head_ = 0;
+  uint32_t trigger_us_ = 0;
+  bool has_capture_ = false;
+  Summary summary_ = {};
+
+  std::atomic<uint8_t> state_{kWaiting};
+  std::atomic<bool> completed_{false};
+  std::atomic<uint32_t> capture_count_{0};
+};
+
+}  // namespace sensesp
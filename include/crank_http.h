@@ -0,0 +1,20 @@
+#pragma once
+
+#include "battery_bank.h"
+
+namespace sensesp {
+
+// Serves the last crank capture of a battery as CSV:
+//   GET /api/batteries/crank?battery=<name>
+//
+// A leading "#" line carries the summary (also published on
+// electrical.batteries.<name>.crank.*) and the uptime at which it was
+// captured, followed by one row per point:
+//   time_ms,voltage_v,current_a
+// time_ms is relative to the trigger; negative rows are the pre-trigger
+// samples. 404 if the battery has no crank capture, 409 while a capture is
+// being recorded or before the first one. New cranks are not captured while
+// the waveform is being sent.
+void add_crank_http_handler(BatteryBank* bank);
+
+}  // namespace sensesp
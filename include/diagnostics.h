@@ -0,0 +1,70 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "latency_histogram.h"
+
+// Instrumentation (compile out with -D BATTERY_DIAGNOSTICS=0)
+// Execution-time histograms for callbacks and I/O, published with heap and
+// counter watermarks on diagnostics.batterySensors.* (see
+// battery_diagnostics.h). With BATTERY_DIAGNOSTICS=0 the macros below expand
+// to nothing and no histogram, timer or Signal K output is built.
+#ifndef BATTERY_DIAGNOSTICS
+#define BATTERY_DIAGNOSTICS 1
+#endif
+
+// Publish interval of the diagnostics subtree
+#ifndef DIAGNOSTICS_PUBLISH_INTERVAL_MS
+#define DIAGNOSTICS_PUBLISH_INTERVAL_MS 30000
+#endif
+
+#if BATTERY_DIAGNOSTICS
+
+namespace sensesp {
+
+// Named histogram, published as diagnostics.batterySensors.<name>.*. Every
+// instance adds itself to a global list when constructed; create them during
+// setup (or as statics) and never destroy them.
+class DiagHistogram : public LatencyHistogram {
+ public:
+  explicit DiagHistogram(const String& name) : name_(name), next_(head_) { head_ = this; }
+
+  const String& name() const { return name_; }
+  DiagHistogram* next() const { return next_; }
+  static DiagHistogram* first() { return head_; }
+
+ private:
+  String name_;
+  DiagHistogram* next_;
+  static DiagHistogram* head_;
+};
+
+// Records the lifetime of the enclosing scope
+class DiagTimer {
+ public:
+  explicit DiagTimer(LatencyHistogram& histogram) : histogram_(histogram), start_us_(micros()) {}
+  ~DiagTimer() { histogram_.record(micros() - start_us_); }
+
+ private:
+  LatencyHistogram& histogram_;
+  uint32_t start_us_;
+};
+
+}  // namespace sensesp
+
+#define DIAG_CONCAT_INNER(a, b) a##b
+#define DIAG_CONCAT(a, b) DIAG_CONCAT_INNER(a, b)
+// File-scope histogram: DIAG_HISTOGRAM(poll_time, "callbacks.poll");
+#define DIAG_HISTOGRAM(var, name) static ::sensesp::DiagHistogram var(name)
+// Time the rest of the enclosing scope: DIAG_SCOPE(poll_time);
+#define DIAG_SCOPE(histogram) ::sensesp::DiagTimer DIAG_CONCAT(diag_timer_, __LINE__)(histogram)
+// Record a duration measured by other means
+#define DIAG_RECORD(histogram, duration_us) (histogram).record(duration_us)
+
+#else
+
+#define DIAG_HISTOGRAM(var, name) static_assert(true, "")
+#define DIAG_SCOPE(histogram) do { } while (0)
+#define DIAG_RECORD(histogram, duration_us) do { } while (0)
+
+#endif
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "battery_bank.h"
+#include "battery_history.h"
+
+namespace sensesp {
+
+#if BATTERY_HISTORY
+
+// Streams battery history over HTTP:
+//   GET /api/batteries/history?battery=<name>[&tier=raw|minute|hour][&format=csv|bin]
+//
+// csv (default): one row per record, decoded; a leading "#" line carries the
+// current uptime and epoch (0 until the clock is set) to map the uptime
+// timestamps to wall time.
+//   raw:          uptime_s,voltage_v,current_a,ah
+//   minute/hour:  uptime_s,voltage_mean,voltage_min,voltage_max,
+//                 current_mean,current_min,current_max,ah
+// bin: a HistoryStreamHeader followed by the tier's blocks as stored (block
+// header, then `used` bytes of varint deltas; see DeltaBlockRing), oldest
+// first, little-endian.
+//
+// Both formats are sent in chunks, one block at a time, without buffering the
+// tier.
+void add_history_http_handler(BatteryBank* bank);
+
+struct HistoryStreamHeader {
+  char magic[4];               // "BHS1"
+  uint8_t channels;            // Values per record
+  uint8_t reserved;
+  uint16_t block_header_bytes; // Bytes before the varint data of each block
+  uint32_t step_s;             // Nominal record interval
+  uint32_t uptime_s;           // Device uptime when the stream started
+  uint32_t epoch_s;            // Wall clock at that time, 0 if unknown
+};
+
+#else
+
+inline void add_history_http_handler(BatteryBank*) {}
+
+#endif
+
+}  // namespace sensesp
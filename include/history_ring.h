@@ -0,0 +1,375 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+
+namespace sensesp {
+
+// Delta-encoded time-series storage for the on-device history. Pure C++ so it
+// can be built and benchmarked on a host (tools/history_bench).
+
+namespace history {
+
+inline uint32_t zigzag(int32_t value) {
+  return (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+}
+
+inline int32_t unzigzag(uint32_t value) {
+  return static_cast<int32_t>(value >> 1) ^ -static_cast<int32_t>(value & 1);
+}
+
+// LEB128: 7 bits per byte, high bit set on all but the last byte
+inline size_t put_varint(uint8_t* out, uint32_t value) {
+  size_t length = 0;
+  while (value >= 0x80) {
+    out[length++] = static_cast<uint8_t>(value) | 0x80;
+    value >>= 7;
+  }
+  out[length++] = static_cast<uint8_t>(value);
+  return length;
+}
+
+// Returns the number of bytes read, 0 if the input ended mid-value
+inline size_t get_varint(const uint8_t* in, size_t available, uint32_t* value) {
+  uint32_t result = 0;
+  for (size_t i = 0; i < available && i < 5; i++) {
+    result |= static_cast<uint32_t>(in[i] & 0x7F) << (7 * i);
+    if ((in[i] & 0x80) == 0) {
+      *value = result;
+      return i + 1;
+    }
+  }
+  return 0;
+}
+
+}  // namespace history
+
+// Ring of fixed-size blocks holding records of Channels int32 values plus a
+// timestamp in seconds.
+//
+// The first record of a block is stored verbatim in the block header; every
+// following record is stored as varint deltas against the previous one. The
+// first varint carries the zigzagged delta of channel 0 shifted left by one;
+// its low bit is set when the time step differs from step_s, in which case the
+// time delta follows. Records at the nominal rate therefore cost no time
+// bytes. A record that does not fit the current block starts the next one,
+// evicting the oldest block when the ring is full, so append() is O(1) and
+// every block can be decoded on its own.
+template <size_t Channels, size_t BlockBytes>
+class DeltaBlockRing {
+ public:
+  struct Block {
+    uint32_t first_time_s;
+    int32_t first[Channels];
+    uint16_t count;  // Records in the block, including the header record
+    uint16_t used;   // Bytes of data in use
+    uint8_t data[BlockBytes];
+  };
+
+  static constexpr size_t kChannels = Channels;
+
+  // Worst case: flag/channel 0 varint, time delta, one varint per channel
+  static constexpr size_t kMaxRecordBytes = 5 * (Channels + 1);
+  static_assert(BlockBytes >= kMaxRecordBytes, "block too small for one record");
+
+  // Allocates block_count blocks; on allocation failure the ring stays empty
+  // and append() is a no-op
+  DeltaBlockRing(size_t block_count, uint32_t step_s) : step_s_(step_s) {
+    blocks_ = new (std::nothrow) Block[block_count];
+    block_count_ = blocks_ != nullptr ? block_count : 0;
+  }
+  ~DeltaBlockRing() { delete[] blocks_; }
+  DeltaBlockRing(const DeltaBlockRing&) = delete;
+  DeltaBlockRing& operator=(const DeltaBlockRing&) = delete;
+
+  void append(uint32_t time_s, const int32_t* values) {
+    if (block_count_ == 0) {
+      return;
+    }
+    if (used_blocks_ == 0) {
+      start_block(time_s, values);
+      return;
+    }
+
+    // Timestamps never go backwards within the ring
+    uint32_t dt = time_s >= last_time_s_ ? time_s - last_time_s_ : 0;
+    uint8_t record[kMaxRecordBytes];
+    size_t length = 0;
+    uint32_t first = history::zigzag(static_cast<int32_t>(static_cast<uint32_t>(values[0]) -
+                                                          static_cast<uint32_t>(last_[0])));
+    bool explicit_time = dt != step_s_;
+    length += history::put_varint(record + length, (first << 1) | (explicit_time ? 1 : 0));
+    if (explicit_time) {
+      length += history::put_varint(record + length, dt);
+    }
+    for (size_t ch = 1; ch < Channels; ch++) {
+      int32_t delta = static_cast<int32_t>(static_cast<uint32_t>(values[ch]) - static_cast<uint32_t>(last_[ch]));
+      length += history::put_varint(record + length, history::zigzag(delta));
+    }
+
+    Block& block = blocks_[head_];
+    if (block.used + length > BlockBytes || block.count == UINT16_MAX || (first >> 31) != 0) {
+      // Channel 0 deltas beyond 31 bits cannot carry the flag; start a block
+      start_block(time_s, values);
+      return;
+    }
+    memcpy(block.data + block.used, record, length);
+    block.used += length;
+    block.count++;
+    data_bytes_ += length;
+    record_count_++;
+    remember(time_s, values);
+  }
+
+  // Blocks in use, oldest first: block(0) ... block(block_count() - 1)
+  size_t block_count() const { return used_blocks_; }
+  const Block& block(size_t index) const {
+    return blocks_[(head_ + block_count_ - used_blocks_ + 1 + index) % block_count_];
+  }
+
+  // Calls fn(time_s, values) for every record of the block, oldest first
+  template <typename Fn>
+  static void decode(const Block& block, Fn&& fn, uint32_t step_s) {
+    uint32_t time_s = block.first_time_s;
+    int32_t values[Channels];
+    memcpy(values, block.first, sizeof(values));
+    fn(time_s, static_cast<const int32_t*>(values));
+    size_t offset = 0;
+    for (uint16_t i = 1; i < block.count; i++) {
+      uint32_t raw;
+      size_t n = history::get_varint(block.data + offset, block.used - offset, &raw);
+      if (n == 0) {
+        return;
+      }
+      offset += n;
+      uint32_t dt = step_s;
+      if (raw & 1) {
+        n = history::get_varint(block.data + offset, block.used - offset, &dt);
+        if (n == 0) {
+          return;
+        }
+        offset += n;
+      }
+      time_s += dt;
+      values[0] = static_cast<int32_t>(static_cast<uint32_t>(values[0]) +
+                                       static_cast<uint32_t>(history::unzigzag(raw >> 1)));
+      for (size_t ch = 1; ch < Channels; ch++) {
+        n = history::get_varint(block.data + offset, block.used - offset, &raw);
+        if (n == 0) {
+          return;
+        }
+        offset += n;
+        values[ch] = static_cast<int32_t>(static_cast<uint32_t>(values[ch]) +
+                                          static_cast<uint32_t>(history::unzigzag(raw)));
+      }
+      fn(time_s, static_cast<const int32_t*>(values));
+    }
+  }
+
+  // Sequence number of block(0). Every started block takes the next number,
+  // so a reader can walk the ring across appends and evictions.
+  uint32_t first_sequence() const { return started_blocks_ - used_blocks_; }
+  uint32_t end_sequence() const { return started_blocks_; }
+
+  template <typename Fn>
+  void for_each(Fn&& fn) const {
+    for (size_t i = 0; i < used_blocks_; i++) {
+      decode(block(i), fn, step_s_);
+    }
+  }
+
+  uint32_t step_s() const { return step_s_; }
+  size_t capacity_blocks() const { return block_count_; }
+  uint32_t record_count() const { return record_count_; }
+  // Bytes allocated for the ring
+  size_t allocated_bytes() const { return block_count_ * sizeof(Block); }
+  // Header and data bytes holding records
+  size_t stored_bytes() const { return used_blocks_ * offsetof(Block, data) + data_bytes_; }
+
+ private:
+  void start_block(uint32_t time_s, const int32_t* values) {
+    if (used_blocks_ == 0) {
+      head_ = 0;
+      used_blocks_ = 1;
+    } else {
+      head_ = (head_ + 1) % block_count_;
+      if (used_blocks_ < block_count_) {
+        used_blocks_++;
+      } else {
+        // Evict the oldest block (the slot being reused)
+        record_count_ -= blocks_[head_].count;
+        data_bytes_ -= blocks_[head_].used;
+      }
+    }
+    started_blocks_++;
+    Block& block = blocks_[head_];
+    block.first_time_s = time_s;
+    memcpy(block.first, values, sizeof(block.first));
+    block.count = 1;
+    block.used = 0;
+    record_count_++;
+    remember(time_s, values);
+  }
+
+  void remember(uint32_t time_s, const int32_t* values) {
+    last_time_s_ = time_s;
+    memcpy(last_, values, sizeof(last_));
+  }
+
+  Block* blocks_ = nullptr;
+  size_t block_count_ = 0;
+  size_t head_ = 0;
+  size_t used_blocks_ = 0;
+  uint32_t step_s_;
+  uint32_t last_time_s_ = 0;
+  int32_t last_[Channels] = {};
+  uint32_t record_count_ = 0;
+  uint32_t started_blocks_ = 0;
+  size_t data_bytes_ = 0;
+};
+
+// Sizes of the history tiers (can be overridden at compile time). The
+// defaults cover one hour of 1 s records, one day of 1 min aggregates and 30
+// days of 1 h aggregates for a typical house battery signal (see
+// tools/history_bench); noisier signals cover less.
+#ifndef HISTORY_BLOCK_BYTES
+#define HISTORY_BLOCK_BYTES 240
+#endif
+
+#ifndef HISTORY_RAW_BLOCKS
+#define HISTORY_RAW_BLOCKS 50
+#endif
+
+#ifndef HISTORY_MINUTE_BLOCKS
+#define HISTORY_MINUTE_BLOCKS 50
+#endif
+
+#ifndef HISTORY_HOUR_BLOCKS
+#define HISTORY_HOUR_BLOCKS 32
+#endif
+
+// Per-battery history in three tiers, updated in O(1) per sample:
+// - raw: the first sample of every second (voltage, current, Ah),
+// - minute / hour: min, max and mean of voltage and current over all samples
+//   of the window, and Ah at its end.
+// Values are quantized to mV, 10 mA and mAh. Aggregates store min and max as
+// offsets from the mean, which keeps their deltas small.
+class HistoryTiers {
+ public:
+  enum RawChannel { kRawVoltage, kRawCurrent, kRawAh, kRawChannels };
+  enum AggregateChannel {
+    kVoltageMean,
+    kVoltageAboveMean,  // max - mean
+    kVoltageBelowMean,  // mean - min
+    kCurrentMean,
+    kCurrentAboveMean,
+    kCurrentBelowMean,
+    kAggregateAh,
+    kAggregateChannels
+  };
+
+  static constexpr float kVoltageScale = 1000.0f;  // mV
+  static constexpr float kCurrentScale = 100.0f;   // 10 mA
+  static constexpr float kAhScale = 1000.0f;       // mAh
+
+  using RawRing = DeltaBlockRing<kRawChannels, HISTORY_BLOCK_BYTES>;
+  using AggregateRing = DeltaBlockRing<kAggregateChannels, HISTORY_BLOCK_BYTES>;
+
+  HistoryTiers(size_t raw_blocks = HISTORY_RAW_BLOCKS, size_t minute_blocks = HISTORY_MINUTE_BLOCKS,
+               size_t hour_blocks = HISTORY_HOUR_BLOCKS)
+      : raw_(raw_blocks, 1), minute_(minute_blocks, 60), hour_(hour_blocks, 3600), minute_window_(60),
+        hour_window_(3600) {}
+
+  void append(uint32_t time_s, float voltage_v, float current_a, float ah) {
+    if (std::isnan(voltage_v) || std::isnan(current_a) || std::isnan(ah)) {
+      return;
+    }
+    int32_t values[kRawChannels];
+    values[kRawVoltage] = static_cast<int32_t>(lroundf(voltage_v * kVoltageScale));
+    values[kRawCurrent] = static_cast<int32_t>(lroundf(current_a * kCurrentScale));
+    values[kRawAh] = static_cast<int32_t>(lroundf(ah * kAhScale));
+
+    if (!has_raw_ || time_s != last_raw_s_) {
+      raw_.append(time_s, values);
+      has_raw_ = true;
+      last_raw_s_ = time_s;
+    }
+    minute_window_.add(time_s, values, minute_);
+    hour_window_.add(time_s, values, hour_);
+  }
+
+  const RawRing& raw() const { return raw_; }
+  const AggregateRing& minute() const { return minute_; }
+  const AggregateRing& hour() const { return hour_; }
+
+ private:
+  // Running min/max/sum over one window; flushed into its ring when a sample
+  // from a later window arrives
+  class Window {
+   public:
+    explicit Window(uint32_t length_s) : length_s_(length_s) {}
+
+    void add(uint32_t time_s, const int32_t* values, AggregateRing& ring) {
+      uint32_t start_s = time_s - time_s % length_s_;
+      if (count_ > 0 && start_s != start_s_) {
+        flush(ring);
+      }
+      if (count_ == 0) {
+        start_s_ = start_s;
+        voltage_min_ = voltage_max_ = values[kRawVoltage];
+        current_min_ = current_max_ = values[kRawCurrent];
+        voltage_sum_ = current_sum_ = 0;
+      }
+      int32_t voltage = values[kRawVoltage];
+      int32_t current = values[kRawCurrent];
+      voltage_min_ = voltage < voltage_min_ ? voltage : voltage_min_;
+      voltage_max_ = voltage > voltage_max_ ? voltage : voltage_max_;
+      current_min_ = current < current_min_ ? current : current_min_;
+      current_max_ = current > current_max_ ? current : current_max_;
+      voltage_sum_ += voltage;
+      current_sum_ += current;
+      ah_ = values[kRawAh];
+      count_++;
+    }
+
+   private:
+    void flush(AggregateRing& ring) {
+      int32_t values[kAggregateChannels];
+      int32_t voltage_mean = static_cast<int32_t>(voltage_sum_ / static_cast<int64_t>(count_));
+      int32_t current_mean = static_cast<int32_t>(current_sum_ / static_cast<int64_t>(count_));
+      values[kVoltageMean] = voltage_mean;
+      values[kVoltageAboveMean] = voltage_max_ - voltage_mean;
+      values[kVoltageBelowMean] = voltage_mean - voltage_min_;
+      values[kCurrentMean] = current_mean;
+      values[kCurrentAboveMean] = current_max_ - current_mean;
+      values[kCurrentBelowMean] = current_mean - current_min_;
+      values[kAggregateAh] = ah_;
+      ring.append(start_s_, values);
+      count_ = 0;
+    }
+
+    uint32_t length_s_;
+    uint32_t start_s_ = 0;
+    uint32_t count_ = 0;
+    int32_t voltage_min_ = 0;
+    int32_t voltage_max_ = 0;
+    int32_t current_min_ = 0;
+    int32_t current_max_ = 0;
+    int64_t voltage_sum_ = 0;
+    int64_t current_sum_ = 0;
+    int32_t ah_ = 0;
+  };
+
+  RawRing raw_;
+  AggregateRing minute_;
+  AggregateRing hour_;
+  Window minute_window_;
+  Window hour_window_;
+  bool has_raw_ = false;
+  uint32_t last_raw_s_ = 0;
+};
+
+}  // namespace sensesp
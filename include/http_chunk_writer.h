@@ -0,0 +1,70 @@
+#pragma once
+
+#include <esp_http_server.h>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+namespace sensesp {
+
+// Collects response output and sends it as HTTP chunks of up to kChunkBytes.
+// After the client goes away every further write is dropped and returns
+// false.
+class ChunkWriter {
+ public:
+  static constexpr size_t kChunkBytes = 1024;
+
+  explicit ChunkWriter(httpd_req_t* req) : req_(req) {}
+
+  bool write(const void* data, size_t length) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    while (ok_ && length > 0) {
+      size_t n = length < kChunkBytes - used_ ? length : kChunkBytes - used_;
+      memcpy(buffer_ + used_, bytes, n);
+      used_ += n;
+      bytes += n;
+      length -= n;
+      if (used_ == kChunkBytes) {
+        flush();
+      }
+    }
+    return ok_;
+  }
+
+  bool printf(const char* format, ...) {
+    char line[160];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    if (length < 0) {
+      return ok_;
+    }
+    return write(line, static_cast<size_t>(length) < sizeof(line) ? length : sizeof(line) - 1);
+  }
+
+  // Send what is left and the terminating empty chunk
+  esp_err_t finish() {
+    flush();
+    if (ok_ && httpd_resp_send_chunk(req_, nullptr, 0) != ESP_OK) {
+      ok_ = false;
+    }
+    return ok_ ? ESP_OK : ESP_FAIL;
+  }
+
+ private:
+  void flush() {
+    if (ok_ && used_ > 0 && httpd_resp_send_chunk(req_, reinterpret_cast<const char*>(buffer_), used_) != ESP_OK) {
+      ok_ = false;  // Client went away
+    }
+    used_ = 0;
+  }
+
+  httpd_req_t* req_;
+  uint8_t buffer_[kChunkBytes];
+  size_t used_ = 0;
+  bool ok_ = true;
+};
+
+}  // namespace sensesp
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Per-transaction timeout (set on the Wire driver)
+#ifndef I2C_TIMEOUT_MS
+#define I2C_TIMEOUT_MS 10
+#endif
+
+// Consecutive failed transactions that take a device offline
+#ifndef I2C_DEVICE_MAX_FAILURES
+#define I2C_DEVICE_MAX_FAILURES 3
+#endif
+
+// Bring-up retry backoff of an offline device: doubles from min to max
+#ifndef I2C_RETRY_MIN_MS
+#define I2C_RETRY_MIN_MS 1000UL
+#endif
+
+#ifndef I2C_RETRY_MAX_MS
+#define I2C_RETRY_MAX_MS 60000UL
+#endif
+
+#ifndef I2C_MAX_DEVICES
+#define I2C_MAX_DEVICES 16
+#endif
+
+namespace sensesp {
+
+enum class I2CResult : uint8_t {
+  kOk,
+  kNack,      // Address or data not acknowledged (device absent or busy)
+  kTimeout,   // Transaction did not finish within I2C_TIMEOUT_MS
+  kBusError,  // SDA held low, arbitration lost or other bus fault
+  kOffline,   // Not attempted: the device is offline and not being brought up
+};
+
+// Raw bus access (Wire on the device, see src/i2c_bus_esp32.cpp; a fake in
+// test/fake_hal/fake_i2c.h). Implementations return within the transaction
+// timeout and serialise concurrent callers.
+class I2CTransport {
+ public:
+  virtual ~I2CTransport() {}
+  // Write tx_length bytes, then (repeated start) read rx_length bytes if
+  // rx_length > 0
+  virtual I2CResult transfer(uint8_t address, const uint8_t* tx, size_t tx_length, uint8_t* rx,
+                             size_t rx_length) = 0;
+  // Free a slave holding SDA low: clock SCL until it lets go, then STOP.
+  // Returns true if the bus is idle afterwards.
+  virtual bool recover() = 0;
+  virtual uint32_t now_ms() = 0;
+};
+
+struct I2CDeviceStats {
+  uint32_t transactions;
+  uint32_t nacks;
+  uint32_t timeouts;
+  uint32_t bus_errors;
+  uint32_t offline_count;      // Times the device went offline
+  uint32_t bring_up_failures;  // Failed configurations (boot or retry)
+};
+
+// Register access for all devices on one bus, with failure handling:
+// - a timeout or bus error triggers bus recovery (transport recover()) and
+//   one retry of the transaction,
+// - I2C_DEVICE_MAX_FAILURES consecutive failures take a device offline;
+//   its transactions then return kOffline without touching the bus,
+// - retry_due() tells the owner when to bring an offline device up again
+//   (reconfigure it); set_online() reports the result. Failed bring-ups back
+//   off exponentially up to I2C_RETRY_MAX_MS.
+// A device starts in bring-up, so its owner can configure it at boot and
+// report the result the same way.
+//
+// Not thread-safe itself: every device must be used from one task (the
+// transport serialises the bus between tasks). Host-portable.
+class I2CBus {
+ public:
+  explicit I2CBus(I2CTransport* transport) : transport_(transport) {}
+
+  // Register a device; returns its handle, -1 if I2C_MAX_DEVICES are in use
+  int add_device(uint8_t address);
+
+  // Big-endian 16-bit register access (INA226 and most sensors)
+  I2CResult read_register16(int device, uint8_t reg, uint16_t* value);
+  I2CResult write_register16(int device, uint8_t reg, uint16_t value);
+
+  bool is_online(int device) const { return devices_[device].state == kOnline; }
+
+  // True once an offline device's backoff has elapsed; the device is then in
+  // bring-up until set_online()
+  bool retry_due(int device);
+
+  // Result of a bring-up (configuration after boot or retry_due())
+  void set_online(int device, bool online);
+
+  const I2CDeviceStats& stats(int device) const { return devices_[device].stats; }
+  uint8_t address(int device) const { return devices_[device].address; }
+  uint32_t get_recovery_count() const { return recovery_count_; }
+
+ private:
+  enum State : uint8_t { kOnline, kOffline, kBringUp };
+
+  struct Device {
+    uint8_t address;
+    State state;
+    uint8_t consecutive_failures;
+    uint32_t retry_ms;       // Current backoff
+    uint32_t next_retry_ms;
+    I2CDeviceStats stats;
+  };
+
+  I2CResult transfer(int device, const uint8_t* tx, size_t tx_length, uint8_t* rx, size_t rx_length);
+  void count_failure(Device& device, I2CResult result);
+
+  I2CTransport* transport_;
+  Device devices_[I2C_MAX_DEVICES];
+  size_t device_count_ = 0;
+  uint32_t recovery_count_ = 0;
+};
+
+}  // namespace sensesp
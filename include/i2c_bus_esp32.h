@@ -0,0 +1,36 @@
+#pragma once
+
+#include <Wire.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+#include "i2c_bus.h"
+
+namespace sensesp {
+
+// I2CTransport on an Arduino TwoWire (ESP32). Owns the Wire instance: begin()
+// starts it, and nothing else may use it directly afterwards. A mutex queues
+// the transactions of all tasks (event loop, acquisition task) one at a time;
+// each holds the bus for at most timeout_ms (plus a recovery), so waiting for
+// it is bounded too.
+class WireTransport : public I2CTransport {
+ public:
+  WireTransport(TwoWire& wire, int sda_pin, int scl_pin, uint32_t frequency_hz = 100000,
+                uint16_t timeout_ms = I2C_TIMEOUT_MS);
+
+  void begin();
+
+  I2CResult transfer(uint8_t address, const uint8_t* tx, size_t tx_length, uint8_t* rx, size_t rx_length) override;
+  bool recover() override;
+  uint32_t now_ms() override;
+
+ private:
+  TwoWire& wire_;
+  int sda_pin_;
+  int scl_pin_;
+  uint32_t frequency_hz_;
+  uint16_t timeout_ms_;
+  SemaphoreHandle_t mutex_;
+};
+
+}  // namespace sensesp
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+
+#include "i2c_bus.h"
+
+namespace sensesp {
+
+// INA226 register access through an I2CBus (replaces the INA226 library, so
+// every transaction goes through the bus manager's timeouts and recovery).
+// Only what the battery monitors use: calibration, averaging and conversion
+// times, the conversion-ready alert and the bus voltage / current registers.
+// Host-portable.
+class INA226Device {
+ public:
+  // Averaging (configuration register AVG field)
+  enum Average : uint8_t {
+    kAverage1,
+    kAverage4,
+    kAverage16,
+    kAverage64,
+    kAverage128,
+    kAverage256,
+    kAverage512,
+    kAverage1024,
+  };
+
+  // Bus and shunt voltage conversion times (VBUSCT / VSHCT fields)
+  enum ConversionTime : uint8_t {
+    k140us,
+    k204us,
+    k332us,
+    k588us,
+    k1100us,
+    k2116us,
+    k4156us,
+    k8244us,
+  };
+
+  INA226Device(I2CBus* bus, uint8_t address) : bus_(bus), device_(bus->add_device(address)) {}
+
+  // Check the manufacturer ID, reset the chip and write the calibration.
+  // False if the chip does not answer or is not an INA226.
+  bool begin(float shunt_resistance_ohm, float current_lsb_a);
+
+  // Averaging and conversion times; continuous shunt and bus conversion
+  bool set_timing(Average average, ConversionTime bus_conversion, ConversionTime shunt_conversion);
+
+  // Route the conversion-ready flag to the ALERT pin
+  bool enable_conversion_ready_alert();
+
+  // Reading the Mask/Enable register clears the conversion-ready flag and
+  // releases ALERT
+  bool clear_alert();
+
+  // Bus voltage (V) and current (A, sign as wired on the shunt), read back to
+  // back. False (outputs untouched) if either read failed.
+  bool read(float* voltage_v, float* current_a);
+
+  bool is_online() const { return bus_->is_online(device_); }
+  I2CBus* bus() { return bus_; }
+  int device() const { return device_; }
+
+ private:
+  I2CBus* bus_;
+  int device_;
+  float current_lsb_a_ = 0;
+};
+
+}  // namespace sensesp
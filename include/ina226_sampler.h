@@ -0,0 +1,157 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "acquisition_mode.h"
+#include "battery_sample.h"
+#include "crank_capture.h"
+#include "diagnostics.h"
+#include "ina226_device.h"
+#include "sensesp/system/valueconsumer.h"
+
+// Adaptive acquisition modes (see acquisition_mode.h). Steady: 1024 samples,
+// 332 us bus / 1100 us shunt conversion = 1.47 s per result, read every
+// 2 s. Fast: 64 samples, 332 us / 588 us = 59 ms per result, read every
+// 100 ms. In both, a conversion completes between two reads, so the first read
+// after a mode change already returns a result of the new setting.
+#ifndef BATTERY_STEADY_READ_INTERVAL_MS
+#define BATTERY_STEADY_READ_INTERVAL_MS 2000
+#endif
+
+#ifndef BATTERY_FAST_READ_INTERVAL_MS
+#define BATTERY_FAST_READ_INTERVAL_MS 100
+#endif
+
+// Read interval with BATTERY_ADAPTIVE_ACQUISITION=0: 256 samples at 1100 us
+// bus / 1100 us shunt conversion = 563 ms per result
+#ifndef BATTERY_FIXED_READ_INTERVAL_MS
+#define BATTERY_FIXED_READ_INTERVAL_MS 1000
+#endif
+
+// Read interval while a crank capture runs: 4 samples at 140 us bus / 140 us
+// shunt conversion = 1.1 ms per result
+#ifndef BATTERY_CRANK_READ_INTERVAL_US
+#define BATTERY_CRANK_READ_INTERVAL_US 2000
+#endif
+
+namespace sensesp {
+
+// Reads an INA226 once per conversion and emits a single BatterySample.
+//
+// Two acquisition modes:
+// - Interrupt mode (alert_pin >= 0): the INA226 ALERT pin is configured as
+//   conversion-ready. The ISR only records the timestamp and raises a flag; the
+//   register reads happen on the next event loop tick. Sampling follows the
+//   chip's own conversion rate (set by averaging and conversion times).
+// - Polled mode (alert_pin < 0): one read every poll_interval_ms.
+//
+// In both modes bus voltage and current are read back to back and power is
+// derived locally, so one sample costs two register reads instead of the three
+// independent reads (each on its own timer) used previously.
+//
+// With BATTERY_ADAPTIVE_ACQUISITION the sampler also switches the chip's
+// averaging and conversion times between the steady and fast modes, right
+// after the sample that triggered the change (same task as the reads). The
+// integrator needs no special handling: every sample carries its timestamp, so
+// a rate change only changes the trapezoid widths.
+//
+// With a CrankCapture attached, every sample also goes to the capture. While
+// armed the chip is kept at the fast mode's settings (with
+// BATTERY_ADAPTIVE_ACQUISITION): a crank on an idle battery shows up within
+// one 59 ms conversion, not at the end of a 1.47 s steady average that would
+// hide the inrush. A trigger switches it to the burst settings until the
+// capture ends, and the owner reads it every BATTERY_CRANK_READ_INTERVAL_US
+// (is_burst_due()). get_mode() still follows the battery's current, so a
+// quiet starter does not hold the bank at the fast output interval.
+//
+// The constructor does not touch the hardware. configure() writes the chip's
+// settings (after INA226Device::begin(), again after every bring-up of an
+// offline chip); begin() attaches the ALERT interrupt and timers once. A
+// failed read emits no sample; a failed settings write is repeated after the
+// next sample, a failed ALERT release on the next tick. The first sample
+// after configure() has BatterySample::segment_start set. With
+// poll_interval_ms == 0 the sampler registers no event loop callbacks and
+// the owner drives it through poll() / service_alert() (used by BatteryBank
+// to share one scheduler between all monitors).
+class INA226Sampler : public ValueProducer<BatterySample> {
+ public:
+  INA226Sampler(INA226Device& ina, int alert_pin, unsigned int poll_interval_ms);
+
+  // Write averaging and conversion times and, in interrupt mode, route
+  // conversion-ready to ALERT. False if the chip did not take them.
+  bool configure();
+
+  // Attach the ALERT interrupt (interrupt mode) and register the sampler's
+  // own timers unless it is externally scheduled
+  void begin();
+
+  // Read one sample now (polled mode)
+  void poll();
+
+  // Read a sample if a conversion-ready interrupt is pending (interrupt mode)
+  void service_alert();
+
+  bool is_interrupt_driven() const { return alert_pin_ >= 0; }
+
+  // Record crank transients (starter battery). Call before begin().
+  void set_crank_capture(CrankCapture* crank) { crank_ = crank; }
+  CrankCapture* crank_capture() { return crank_; }
+  bool is_bursting() const { return crank_ != nullptr && crank_->is_capturing(); }
+  // Whether the next burst read is due (polled mode)
+  bool is_burst_due(uint32_t now_us) const;
+
+#if BATTERY_ADAPTIVE_ACQUISITION
+  // Whether the current mode's read interval has passed (polled mode,
+  // externally scheduled)
+  bool is_due(unsigned long now_ms) const;
+
+  AcquisitionMode get_mode() const { return mode_controller_.mode(); }
+  uint32_t get_mode_switch_count() const { return mode_controller_.get_switch_count(); }
+#endif
+
+  // Task to wake (task notification) on each conversion-ready interrupt, for
+  // samplers driven from a FreeRTOS task instead of the event loop
+  void set_alert_task(TaskHandle_t task) { alert_task_ = task; }
+
+#if BATTERY_DIAGNOSTICS
+  // Histogram receiving the duration of each sample's register reads
+  void set_read_histogram(LatencyHistogram* histogram) { read_histogram_ = histogram; }
+#endif
+
+  // Number of samples emitted since boot
+  uint32_t get_sample_count() const { return sample_count_; }
+
+  // Number of conversion-ready interrupts that arrived before the previous one
+  // was serviced (i.e. the event loop fell behind the conversion rate)
+  uint32_t get_missed_count() const { return missed_count_; }
+
+ private:
+  static void IRAM_ATTR on_alert(void* arg);
+  void read_sample(uint32_t timestamp_us);
+  int settings_index() const;
+  void apply_mode();
+
+  INA226Device& ina_;
+  int alert_pin_;
+  unsigned int poll_interval_ms_;
+  TaskHandle_t alert_task_ = nullptr;
+  // The ISR and service_alert() may run on different cores
+  portMUX_TYPE alert_mux_ = portMUX_INITIALIZER_UNLOCKED;
+  volatile bool alert_pending_ = false;
+  volatile uint32_t alert_us_ = 0;
+  volatile uint32_t missed_count_ = 0;
+  uint32_t sample_count_ = 0;
+  uint32_t last_read_us_ = 0;
+  int applied_settings_ = -1;  // Index of the settings written to the chip
+  bool segment_start_ = true;  // Mark the next sample (set by configure())
+  CrankCapture* crank_ = nullptr;
+#if BATTERY_ADAPTIVE_ACQUISITION
+  AcquisitionModeController mode_controller_;
+  unsigned long last_read_ms_ = 0;
+#endif
+#if BATTERY_DIAGNOSTICS
+  LatencyHistogram* read_histogram_ = nullptr;
+#endif
+};
+
+}  // namespace sensesp
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstdint>
+
+namespace sensesp {
+
+// Log2 histogram of durations in microseconds: bucket i counts durations in
+// [2^i, 2^(i+1)) us, the last bucket everything from 2^(kBuckets-1) us up.
+//
+// One writer calls record(); one reader calls take_window(), which reports the
+// samples recorded since its previous call. The writer only ever increments,
+// the reader keeps its own copy of the previous counts, so writer and reader
+// may run on different cores without a lock. Only the window maximum is reset
+// by the reader; a maximum recorded during that reset can be lost.
+//
+// Pure C++ so it can be built on a host.
+class LatencyHistogram {
+ public:
+  static constexpr int kBuckets = 24;  // Up to ~8 s, everything above in the last bucket
+
+  struct Window {
+    uint32_t count;
+    uint32_t mean_us;
+    uint32_t p50_us;  // Upper bound of the bucket holding the median
+    uint32_t p99_us;  // Upper bound of the bucket holding the 99th percentile
+    uint32_t max_us;
+  };
+
+  void record(uint32_t duration_us) {
+    int index = bucket(duration_us);
+    buckets_[index] = buckets_[index] + 1;
+    sum_us_ = sum_us_ + duration_us;
+    if (duration_us > max_us_) {
+      max_us_ = duration_us;
+    }
+  }
+
+  Window take_window() {
+    uint32_t counts[kBuckets];
+    uint32_t count = 0;
+    for (int i = 0; i < kBuckets; i++) {
+      uint32_t now = buckets_[i];
+      counts[i] = now - previous_[i];  // Wraps correctly
+      previous_[i] = now;
+      count += counts[i];
+    }
+    uint32_t sum = sum_us_;
+    uint32_t window_sum = sum - previous_sum_;
+    previous_sum_ = sum;
+
+    Window window = {};
+    window.count = count;
+    window.max_us = max_us_;
+    max_us_ = 0;
+    if (count == 0) {
+      return window;
+    }
+    window.mean_us = window_sum / count;
+    window.p50_us = percentile(counts, count, 50);
+    window.p99_us = percentile(counts, count, 99);
+    return window;
+  }
+
+ private:
+  static int bucket(uint32_t duration_us) {
+    int index = 0;
+    while (duration_us > 1 && index < kBuckets - 1) {
+      duration_us >>= 1;
+      index++;
+    }
+    return index;
+  }
+
+  static uint32_t percentile(const uint32_t* counts, uint32_t count, uint32_t pct) {
+    // Rank of the percentile sample, 1-based, rounded up
+    uint64_t rank = (static_cast<uint64_t>(count) * pct + 99) / 100;
+    uint64_t seen = 0;
+    for (int i = 0; i < kBuckets; i++) {
+      seen += counts[i];
+      if (seen >= rank) {
+        return i == kBuckets - 1 ? UINT32_MAX : (2UL << i) - 1;
+      }
+    }
+    return UINT32_MAX;
+  }
+
+  volatile uint32_t buckets_[kBuckets] = {};
+  volatile uint32_t sum_us_ = 0;
+  volatile uint32_t max_us_ = 0;
+  uint32_t previous_[kBuckets] = {};
+  uint32_t previous_sum_ = 0;
+};
+
+}  // namespace sensesp
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "battery_bank.h"
+#include "battery_log_esp32.h"
+
+namespace sensesp {
+
+#if BATTERY_LOG
+
+// Streams a battery's flash log over HTTP:
+//   GET /api/batteries/log?battery=<name>
+//
+// The body is BatteryLog's export format, oldest segment first:
+//   [uint32 length][segment: LogSegmentHeader, LogRecord[]] ...
+// little-endian, including the records still buffered in RAM. Decode with
+// tools/log_dump. Segment files are read and sent 1 KB at a time.
+void add_log_http_handler(BatteryBank* bank);
+
+#else
+
+inline void add_log_http_handler(BatteryBank*) {}
+
+#endif
+
+}  // namespace sensesp
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "sensesp/sensors/sensor.h"
+#include "sensesp_onewire/onewire_temperature.h"
+
+// Maximum number of probes on one bus
+#ifndef ONEWIRE_MAX_PROBES
+#define ONEWIRE_MAX_PROBES 16
+#endif
+
+// Scratchpad reads per probe and cycle before the reading is given up (CRC
+// or presence errors)
+#ifndef ONEWIRE_READ_ATTEMPTS
+#define ONEWIRE_READ_ATTEMPTS 3
+#endif
+
+namespace sensesp {
+
+// One DS18B20 on a OneWireBus. Emits the temperature in Kelvin after every
+// bus cycle that read it successfully.
+//
+// The address is configured as "address" ("28:ff:..."), the same key as
+// OneWireTemperature uses, so existing probe assignments are kept. A probe
+// without an address takes the next address found on the bus that no other
+// probe claims.
+class OneWireProbe : public FloatSensor {
+ public:
+  // resolution_bits: 9 (0.5 degC, 94 ms conversion) to 12 (0.0625 degC, 750 ms)
+  OneWireProbe(uint8_t resolution_bits, const String& config_path);
+
+  bool to_json(JsonObject& root) override;
+  bool from_json(const JsonObject& config) override;
+
+  uint8_t get_resolution_bits() const { return resolution_bits_; }
+  // Cycles without a valid reading since boot
+  uint32_t get_missed_count() const { return missed_count_; }
+
+ private:
+  friend class OneWireBus;
+
+  onewire::OWDevAddr address_ = {};
+  bool has_address_ = false;
+  uint8_t resolution_bits_;
+  uint32_t missed_count_ = 0;
+};
+
+inline const String ConfigSchema(const OneWireProbe&) {
+  return R"({"type":"object","properties":{"address":{"title":"OneWire address","type":"string"}}})";
+}
+
+// Reads all DS18B20 probes on one bus in a fixed cycle every read_interval_ms:
+// 1. one broadcast Convert T (Skip ROM) starts all conversions at once,
+// 2. an event loop delay waits for the slowest probe's resolution (the event
+//    loop keeps running meanwhile),
+// 3. the scratchpads are read back to back, each checked by CRC and retried
+//    up to ONEWIRE_READ_ATTEMPTS times.
+// The conversion wait is shared, so a cycle takes about the same time for one
+// probe as for sixteen; only step 3 grows (about 2.5 ms per probe). The bus
+// time of steps 1 and 3 is recorded in the "onewire.busTime" diagnostics
+// histogram.
+//
+// A probe whose configuration register does not match its resolution (new
+// probe, or its power was lost) is rewritten after the read; the setting is
+// kept in RAM only, not copied to the probe's EEPROM.
+//
+// Built around the DallasTemperatureSensors' OneWire instance; the bus must
+// have external power (no parasitic power).
+class OneWireBus {
+ public:
+  OneWireBus(onewire::DallasTemperatureSensors* dts, unsigned int read_interval_ms);
+
+  // Add a probe (during setup, before the first cycle); created in the
+  // pipeline arena
+  OneWireProbe* add_probe(const String& config_path, uint8_t resolution_bits = 12);
+
+  size_t size() const { return count_; }
+  OneWireProbe* probe(size_t index) { return probes_[index]; }
+
+  // Scratchpad reads that failed their CRC or presence check
+  uint32_t get_crc_error_count() const { return crc_error_count_; }
+  // Probe readings given up after ONEWIRE_READ_ATTEMPTS
+  uint32_t get_missed_count() const { return missed_count_; }
+  // Bus time of the last cycle (Convert T and scratchpad reads)
+  uint32_t get_last_bus_time_us() const { return last_bus_time_us_; }
+
+ private:
+  void start_cycle();
+  void read_probes();
+  void assign_addresses();
+  bool read_scratchpad(const onewire::OWDevAddr& address, uint8_t* data);
+  void write_configuration(const onewire::OWDevAddr& address, const uint8_t* data, uint8_t configuration);
+
+  OneWire* onewire_;
+  OneWireProbe* probes_[ONEWIRE_MAX_PROBES];
+  size_t count_ = 0;
+  bool addresses_assigned_ = false;
+  bool busy_ = false;               // Conversion in progress
+  uint32_t bus_time_us_ = 0;        // Bus time of the running cycle
+  uint32_t last_bus_time_us_ = 0;
+  uint32_t crc_error_count_ = 0;
+  uint32_t missed_count_ = 0;
+};
+
+}  // namespace sensesp
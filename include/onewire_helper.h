@@ -1,16 +1,26 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 
-namespace sensesp {
-namespace onewire {
-class DallasTemperatureSensors;
-}  // namespace onewire
-}  // namespace sensesp
+#include "onewire_bus.h"
+#include "pipeline_arena.h"
+#include "sensesp/signalk/signalk_output.h"
+#include "sensesp/transforms/linear.h"
 
-// Add a one-wire temperature sensor + Linear calibration + SK output
+// Add a one-wire temperature probe on the shared bus + Linear calibration +
+// SK output. resolution_bits (9-12) trades conversion time for precision.
 // See implementation in src/onewire_helper.cpp
-void add_onewire_temp(sensesp::onewire::DallasTemperatureSensors* dts,
-                      unsigned int read_delay, const char* base_name,
-                      const char* signal_k_path, const char* human_label,
-                      int sensor_sort, int linear_sort, int sk_sort);
+// Returns the calibrated temperature (Kelvin) for further consumers
+sensesp::Linear* add_onewire_temp(sensesp::OneWireBus* bus, const char* base_name,
+                                  const char* signal_k_path, const char* human_label,
+                                  int sensor_sort, int linear_sort, int sk_sort,
+                                  uint8_t resolution_bits = 12);
+
+// Pipeline arena bytes of count add_onewire_temp() probes (probe,
+// calibration and output)
+constexpr size_t onewire_temp_arena_bytes(size_t count) {
+  return count * (sensesp::PipelineArena::arena_bytes<sensesp::OneWireProbe>() +
+                  sensesp::PipelineArena::arena_bytes<sensesp::Linear>() +
+                  sensesp::PipelineArena::arena_bytes<sensesp::SKOutputFloat>());
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+
+namespace sensesp {
+
+// Bump allocator for the objects the pipeline creates once at setup
+// (monitors, virtual banks, their Signal K outputs and metadata, probes,
+// transports). They are never destroyed, so the arena only moves a pointer
+// forward: no per-object heap block or header, no fragmentation of the heap
+// that SensESP and the web server keep using, and the memory they take is
+// fixed at link time (see the *_arena_bytes() helpers next to each class and
+// kPipelineArenaBytes in src/main.cpp).
+//
+// Every allocation is rounded up to kAlignment, so the bytes needed for a set
+// of objects are exactly the sum of arena_bytes<T>() (arena_array_bytes<T>()
+// for create_array()) over them. When the storage is full (or none was set),
+// create() falls back to the heap and counts an overflow, published as
+// diagnostics.batterySensors.arena.overflows: the node keeps working, but the
+// size computed for the tables is wrong.
+//
+// Host-portable: the storage is plain memory supplied by the caller.
+class PipelineArena {
+ public:
+  static constexpr size_t kAlignment = alignof(std::max_align_t);
+
+  // Bytes taken by count objects of type T
+  template <typename T>
+  static constexpr size_t arena_bytes(size_t count = 1) {
+    return count * ((sizeof(T) + kAlignment - 1) / kAlignment * kAlignment);
+  }
+
+  // Bytes taken by one create_array<T>(count)
+  template <typename T>
+  static constexpr size_t arena_array_bytes(size_t count) {
+    return (count * sizeof(T) + kAlignment - 1) / kAlignment * kAlignment;
+  }
+
+  PipelineArena() {}
+  PipelineArena(void* storage, size_t size) { set_storage(storage, size); }
+  PipelineArena(const PipelineArena&) = delete;
+  PipelineArena& operator=(const PipelineArena&) = delete;
+
+  // Hand the arena its memory (aligned to kAlignment). Call before the first
+  // create(); objects created earlier stay on the heap.
+  void set_storage(void* storage, size_t size) {
+    storage_ = static_cast<uint8_t*>(storage);
+    size_ = size;
+    used_ = 0;
+  }
+
+  // Raw memory for size bytes, nullptr if the storage is full
+  void* allocate(size_t size) {
+    size_t rounded = (size + kAlignment - 1) / kAlignment * kAlignment;
+    if (storage_ == nullptr || rounded > size_ - used_) {
+      return nullptr;
+    }
+    void* memory = storage_ + used_;
+    used_ += rounded;
+    return memory;
+  }
+
+  // Construct a T in the arena (on the heap if it is full)
+  template <typename T, typename... Args>
+  T* create(Args&&... args) {
+    static_assert(alignof(T) <= kAlignment, "over-aligned type");
+    void* memory = allocate(sizeof(T));
+    if (memory == nullptr) {
+      overflow_count_++;
+      return new T(std::forward<Args>(args)...);
+    }
+    return new (memory) T(std::forward<Args>(args)...);
+  }
+
+  // count value-initialised Ts in the arena (on the heap if it is full)
+  template <typename T>
+  T* create_array(size_t count) {
+    static_assert(alignof(T) <= kAlignment, "over-aligned type");
+    void* memory = allocate(count * sizeof(T));
+    if (memory == nullptr) {
+      overflow_count_++;
+      return new T[count]();
+    }
+    T* items = static_cast<T*>(memory);
+    for (size_t i = 0; i < count; i++) {
+      new (items + i) T();
+    }
+    return items;
+  }
+
+  size_t size() const { return size_; }
+  size_t used() const { return used_; }
+  // Objects that did not fit and went to the heap
+  uint32_t get_overflow_count() const { return overflow_count_; }
+
+ private:
+  uint8_t* storage_ = nullptr;
+  size_t size_ = 0;
+  size_t used_ = 0;
+  uint32_t overflow_count_ = 0;
+};
+
+// Arena of the node's pipeline; src/main.cpp gives it its storage first thing
+// in setup()
+inline PipelineArena* pipeline_arena() {
+  static PipelineArena arena;
+  return &arena;
+}
+
+}  // namespace sensesp
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+
+namespace sensesp {
+
+// Time constants of the three load averages (seconds, minutes, hours)
+#ifndef RUNTIME_SHORT_TAU_S
+#define RUNTIME_SHORT_TAU_S 10.0f
+#endif
+
+#ifndef RUNTIME_MEDIUM_TAU_S
+#define RUNTIME_MEDIUM_TAU_S 300.0f
+#endif
+
+#ifndef RUNTIME_LONG_TAU_S
+#define RUNTIME_LONG_TAU_S 3600.0f
+#endif
+
+// A load change restarts the averages when the short average leaves the long
+// one by more than RUNTIME_CHANGE_SIGMAS standard deviations of the load plus
+// RUNTIME_CHANGE_MIN_A
+#ifndef RUNTIME_CHANGE_SIGMAS
+#define RUNTIME_CHANGE_SIGMAS 3.0f
+#endif
+
+#ifndef RUNTIME_CHANGE_MIN_A
+#define RUNTIME_CHANGE_MIN_A 0.2f
+#endif
+
+// Below this load (A) the battery counts as idle: no time to empty or full
+#ifndef RUNTIME_IDLE_CURRENT_A
+#define RUNTIME_IDLE_CURRENT_A 0.1f
+#endif
+
+// Time to empty and time to full from exponentially weighted load averages.
+//
+// add_sample() updates three averages of the current with time constants of
+// seconds, minutes and hours, plus the variance of the current around the
+// hours average: a few multiply-adds and one square root per sample, no
+// buffers. The estimate uses the longest average that has run for its time
+// constant, so a steady or cycling load (fridge compressor) gets the
+// smoothest figure.
+//
+// When the short average moves away from the long one by more than the load
+// normally varies (an inverter switched on), all averages restart from the
+// new load: the estimate then follows the short average and moves on to the
+// longer ones as they fill up again. The size of the jump is kept in the
+// variance, so a load that keeps switching between the same levels is soon
+// treated as one cycling load instead of restarting every time. Until an
+// average has run for its time constant it is the plain mean of the samples
+// since the restart.
+//
+// The efficiencies are applied like the Ah accumulator does: the Ah drops by
+// discharge current times the discharge efficiency and rises by charge
+// current times the charge efficiency.
+// Host-portable: no Arduino dependencies. Timestamps are micros() and may wrap.
+class RuntimeEstimator {
+ public:
+  static constexpr int kHorizons = 3;
+
+  RuntimeEstimator(float short_tau_s = RUNTIME_SHORT_TAU_S, float medium_tau_s = RUNTIME_MEDIUM_TAU_S,
+                   float long_tau_s = RUNTIME_LONG_TAU_S)
+      : tau_s_{short_tau_s, medium_tau_s, long_tau_s} {}
+
+  void add_sample(uint32_t timestamp_us, float current_a) {
+    if (std::isnan(current_a)) {
+      return;
+    }
+    if (!segment_open_) {
+      segment_open_ = true;
+      last_us_ = timestamp_us;
+      if (!has_sample_) {
+        has_sample_ = true;
+        for (int i = 0; i < kHorizons; i++) {
+          average_a_[i] = current_a;
+        }
+      }
+      return;
+    }
+    float dt_s = (timestamp_us - last_us_) * 1e-6f;
+    if (dt_s <= 0.0f) {
+      return;
+    }
+    last_us_ = timestamp_us;
+    if (age_s_ < tau_s_[kHorizons - 1]) {
+      age_s_ += dt_s;
+    }
+    for (int i = 0; i < kHorizons; i++) {
+      // Younger than tau: mean of the samples since the restart. Then
+      // dt / (tau + dt), the exponential weight without an exp() per sample
+      // (same limit for dt << tau, stays stable for a late sample).
+      float weight = age_s_ < tau_s_[i] ? dt_s / age_s_ : dt_s / (tau_s_[i] + dt_s);
+      average_a_[i] += (current_a - average_a_[i]) * weight;
+    }
+    float deviation = current_a - average_a_[kHorizons - 1];
+    variance_ += (deviation * deviation - variance_) * (dt_s / (tau_s_[kHorizons - 1] + dt_s));
+
+    float change = fabsf(average_a_[0] - average_a_[kHorizons - 1]);
+    if (change > RUNTIME_CHANGE_SIGMAS * sqrtf(variance_) + RUNTIME_CHANGE_MIN_A) {
+      // New load: the next sample starts every average again
+      age_s_ = 0.0f;
+      if (change * change > variance_) {
+        variance_ = change * change;
+      }
+      restart_count_++;
+    }
+  }
+
+  // The next sample only restarts the clock: the averages keep their values
+  // and the time since the last sample is not weighted (no measurement)
+  void restart_segment() { segment_open_ = false; }
+
+  // Load average (A) the estimates use, NaN before the first sample
+  float load_a() const {
+    if (!has_sample_) {
+      return NAN;
+    }
+    for (int i = kHorizons - 1; i > 0; i--) {
+      if (age_s_ >= tau_s_[i]) {
+        return average_a_[i];
+      }
+    }
+    return average_a_[0];
+  }
+
+  // Average of one horizon (0 short, 1 medium, 2 long)
+  float average_a(int horizon) const { return has_sample_ ? average_a_[horizon] : NAN; }
+
+  // Load changes that restarted the averages
+  uint32_t get_restart_count() const { return restart_count_; }
+
+  // Seconds until ah reaches 0 at the current load, NaN unless discharging
+  float time_to_empty_s(float ah, float discharge_efficiency_pct) const {
+    float load = load_a();
+    if (!(load < -RUNTIME_IDLE_CURRENT_A) || discharge_efficiency_pct <= 0.0f) {
+      return NAN;
+    }
+    float ah_per_s = -load * (discharge_efficiency_pct / 100.0f) / 3600.0f;
+    return (ah > 0.0f ? ah : 0.0f) / ah_per_s;
+  }
+
+  // Seconds until ah reaches capacity_ah at the current load, NaN unless
+  // charging
+  float time_to_full_s(float ah, float capacity_ah, float charge_efficiency_pct) const {
+    float load = load_a();
+    if (!(load > RUNTIME_IDLE_CURRENT_A) || charge_efficiency_pct <= 0.0f || capacity_ah <= 0.0f) {
+      return NAN;
+    }
+    float ah_per_s = load * (charge_efficiency_pct / 100.0f) / 3600.0f;
+    float missing = capacity_ah - ah;
+    return (missing > 0.0f ? missing : 0.0f) / ah_per_s;
+  }
+
+ private:
+  float tau_s_[kHorizons];
+  float average_a_[kHorizons] = {};
+  float variance_ = 0.0f;   // Of the current around the long average (A^2)
+  float age_s_ = 0.0f;      // Since the last restart, up to the longest time constant
+  uint32_t last_us_ = 0;
+  uint32_t restart_count_ = 0;
+  bool has_sample_ = false;
+  bool segment_open_ = false;  // last_us_ is the start of the next step
+};
+
+}  // namespace sensesp
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "sensesp/signalk/signalk_output.h"
+
+namespace sensesp {
+
+// Maximum number of paths one emitter can filter: 11 per battery monitor and
+// 6 plus one per member for each virtual bank, i.e. 16 * 11 + 4 * (6 + 16)
+// for BATTERY_BANK_MAX_MONITORS monitors and BATTERY_VIRTUAL_BANK_MAX banks
+// (checked in battery_bank.cpp)
+#ifndef SK_EMITTER_MAX_CHANNELS
+#define SK_EMITTER_MAX_CHANNELS 264
+#endif
+
+// When a path is sent: on a change larger than deadband, otherwise once per
+// heartbeat_ms so late subscribers and the server's cache stay fresh.
+struct SKEmitPolicy {
+  float deadband;             // Absolute change that triggers a send (0 = any change)
+  unsigned long heartbeat_ms; // Resend an unchanged value after this long
+};
+
+// Emission stage in front of a set of SKOutputFloats.
+//
+// Values are staged with update() during a tick and released by flush(). Only
+// values that pass their channel's deadband/heartbeat filter are passed on to
+// their outputs, all within the same callback, so the Signal K delta queue
+// sends them as one multi-value delta instead of one delta per path.
+//
+// The emitter counts the deltas it produced and an estimate of their size
+// (JSON "values" entries plus a fixed envelope), for tuning the policies.
+class SKDeltaEmitter {
+ public:
+  // Register an output; returns the channel index for update(), or -1 if the
+  // table is full
+  int add(SKOutputFloat* output, const SKEmitPolicy& policy);
+
+  // Stage a value for the next flush()
+  void update(int channel, float value);
+
+  // Send staged values that pass their filter. Returns the number sent.
+  size_t flush(unsigned long now_ms);
+
+  // Number of deltas (flushes that sent at least one value)
+  uint32_t get_message_count() const { return message_count_; }
+  // Number of path values sent
+  uint32_t get_value_count() const { return value_count_; }
+  // Number of staged values suppressed by the deadband
+  uint32_t get_suppressed_count() const { return suppressed_count_; }
+  // Estimated JSON bytes sent
+  uint32_t get_byte_count() const { return byte_count_; }
+  // Number of outputs add() refused because the table was full
+  uint32_t get_unregistered_count() const { return unregistered_count_; }
+
+ private:
+  struct Channel {
+    SKOutputFloat* output;
+    SKEmitPolicy policy;
+    uint16_t path_length;
+    float staged_value;
+    float sent_value;
+    unsigned long sent_ms;
+    bool staged;
+    bool ever_sent;
+  };
+
+  bool should_send(const Channel& channel, unsigned long now_ms) const;
+
+  Channel channels_[SK_EMITTER_MAX_CHANNELS];
+  size_t channel_count_ = 0;
+  uint32_t message_count_ = 0;
+  uint32_t value_count_ = 0;
+  uint32_t suppressed_count_ = 0;
+  uint32_t byte_count_ = 0;
+  uint32_t unregistered_count_ = 0;
+};
+
+}  // namespace sensesp
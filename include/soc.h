@@ -0,0 +1,15 @@
+#pragma once
+
+namespace sensesp {
+
+// State of charge in percent (0-100) from accumulated Ah and current capacity.
+// Returns 0 when the capacity is unknown (<= 0).
+inline float soc_percent(float ah, float capacity_ah) {
+  if (capacity_ah <= 0.0f) {
+    return 0.0f;
+  }
+  float soc = (ah / capacity_ah) * 100.0f;
+  return (soc < 0.0f) ? 0.0f : ((soc > 100.0f) ? 100.0f : soc);
+}
+
+}  // namespace sensesp
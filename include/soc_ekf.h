@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cstdint>
+
+// Kalman filter SOC (select at compile time with -D BATTERY_SOC_EKF)
+// Default: stateOfCharge is Ah / current capacity.
+// BATTERY_SOC_EKF: stateOfCharge comes from SocEkf, which also uses the
+// measured voltage and the battery temperature.
+
+// Initial SOC uncertainty (1 sigma, fraction) when the filter is reset from
+// the integrator's Ah
+#ifndef SOC_EKF_INITIAL_SIGMA
+#define SOC_EKF_INITIAL_SIGMA 0.10f
+#endif
+
+// Current measurement error (1 sigma, A) that the SOC process noise covers
+#ifndef SOC_EKF_CURRENT_SIGMA_A
+#define SOC_EKF_CURRENT_SIGMA_A 0.2f
+#endif
+
+// Voltages whose innovation exceeds this many sigmas are not used (crank
+// transients, loose terminals)
+#ifndef SOC_EKF_GATE_SIGMAS
+#define SOC_EKF_GATE_SIGMAS 5.0f
+#endif
+
+namespace sensesp {
+
+enum class BatteryChemistry : uint8_t {
+  kLeadAcid = 0,  // Flooded/AGM, 2 V cells
+  kLiFePO4 = 1,   // 3.2 V cells
+};
+
+// State of charge from current, voltage and temperature: an extended Kalman
+// filter over a 1-RC equivalent circuit
+//   V = OCV(SOC, T) + V1 + R0(T) * I,   dV1/dt = (R1(T) * I - V1) / tau
+// with state [SOC, V1]. Current moves SOC like the Ah integrator does
+// (efficiencies by direction); the voltage pulls it towards the SOC whose
+// open-circuit voltage matches, weighted by the slope of the OCV curve, so
+// the flat middle of a LiFePO4 curve mostly coasts on current while its
+// knees and the whole lead-acid curve correct drift.
+//
+// The OCV curves (per cell, 1 % SOC steps, with their slopes) and the
+// resistance-versus-temperature factors are generated at compile time from a
+// handful of datasheet points per chemistry (src/soc_ekf.cpp). One update()
+// is two table lookups, about 40 single-precision multiply-adds and two
+// divisions; no exp(), sqrt() or double math, so it runs on every sample
+// (a few microseconds on the ESP32, see the socFilter diagnostics
+// histogram and tools/soc_bench).
+//
+// Host-portable: no Arduino dependencies. Timestamps are micros() and may wrap.
+class SocEkf {
+ public:
+  // Chemistry parameters and tables (src/soc_ekf.cpp)
+  struct Model;
+
+  // cells: cells in series (6 lead-acid or 4 LiFePO4 for a 12 V battery)
+  SocEkf(BatteryChemistry chemistry, uint8_t cells, float capacity_ah);
+
+  // Restart from a known SOC (0-1), e.g. the integrator's Ah after a PUT
+  void reset(float soc, float soc_sigma = SOC_EKF_INITIAL_SIGMA);
+
+  void set_capacity_ah(float capacity_ah);
+  // Same meaning as the AmpHourIntegrator efficiencies (0-100 %)
+  void set_efficiencies(float charge_pct, float discharge_pct);
+  // Battery temperature; NaN uses 25 °C
+  void set_temperature_c(float celsius);
+
+  // One sample (current positive = charging). Returns false if the voltage
+  // was NaN or outside the innovation gate and only the current was used.
+  bool update(uint32_t timestamp_us, float current_a, float voltage_v);
+
+  // The next update() predicts no time step: nothing was measured since the
+  // last sample (the INA226 was offline)
+  void restart_segment() { has_sample_ = false; }
+
+  float soc() const { return soc_; }
+  // Standard deviation of soc() as the filter sees it
+  float soc_sigma() const;
+  // Voltage across the RC element (V)
+  float polarization_v() const { return v1_; }
+
+  // Battery open-circuit voltage at soc (0-1) and the set temperature
+  float open_circuit_voltage(float soc) const;
+  // Ohmic resistance R0 at the set temperature (Ohm)
+  float resistance_ohm() const { return r0_ohm_; }
+
+  // Voltages rejected by the innovation gate
+  uint32_t get_rejected_count() const { return rejected_count_; }
+
+ private:
+  // OCV (V) and dOCV/dSOC (V per unit SOC) of the whole battery
+  void lookup_ocv(float soc, float* ocv, float* slope) const;
+  // Circuit values and SOC rates for the capacity, efficiencies and
+  // temperature
+  void update_circuit();
+
+  const Model& model_;
+  float cells_;
+  float capacity_ah_;
+  float charge_factor_ = 1.0f;
+  float discharge_factor_ = 1.0f;
+  // SOC change per ampere-second, efficiency included
+  float charge_soc_per_as_ = 0.0f;
+  float discharge_soc_per_as_ = 0.0f;
+  float temperature_c_ = 25.0f;
+  // Temperature-dependent circuit values of the whole battery
+  float r0_ohm_ = 0.0f;
+  float r1_ohm_ = 0.0f;
+  float tau_s_ = 1.0f;
+  float ocv_offset_v_ = 0.0f;
+
+  float soc_ = 1.0f;
+  float v1_ = 0.0f;
+  float p00_ = 0.0f;  // Covariance of [SOC, V1]
+  float p01_ = 0.0f;
+  float p11_ = 0.0f;
+  bool has_sample_ = false;
+  uint32_t last_us_ = 0;
+  uint32_t rejected_count_ = 0;
+};
+
+}  // namespace sensesp
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace sensesp {
+
+// Lock-free single-producer/single-consumer ring buffer.
+//
+// Exactly one thread (or task) calls push() and exactly one calls pop(). Head
+// and tail are free-running counters; the producer publishes an element with a
+// release store of head_ and the consumer frees a slot with a release store of
+// tail_, so neither side ever waits on the other. When the ring is full push()
+// drops the new element and counts it as an overflow.
+//
+// Capacity must be a power of two. Only <atomic> is used, so the ring builds
+// and runs on a host (e.g. with std::thread producers).
+template <typename T, size_t Capacity>
+class SpscRing {
+  static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+ public:
+  // Producer side. Returns false (and counts an overflow) if the ring is full.
+  bool push(const T& item) {
+    const uint32_t head = head_.load(std::memory_order_relaxed);
+    const uint32_t tail = tail_.load(std::memory_order_acquire);
+    if (head - tail >= Capacity) {
+      overflow_count_.store(overflow_count_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      return false;
+    }
+    items_[head & kMask] = item;
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side. Returns false if the ring is empty.
+  bool pop(T* item) {
+    const uint32_t tail = tail_.load(std::memory_order_relaxed);
+    const uint32_t head = head_.load(std::memory_order_acquire);
+    if (head == tail) {
+      return false;
+    }
+    *item = items_[tail & kMask];
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Number of queued elements (exact on either side, approximate elsewhere)
+  size_t size() const {
+    return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire);
+  }
+
+  static constexpr size_t capacity() { return Capacity; }
+
+  // Number of elements dropped because the ring was full (written by the
+  // producer only)
+  uint32_t get_overflow_count() const { return overflow_count_.load(std::memory_order_relaxed); }
+
+ private:
+  static constexpr uint32_t kMask = Capacity - 1;
+
+  T items_[Capacity];
+  std::atomic<uint32_t> head_{0};
+  std::atomic<uint32_t> tail_{0};
+  std::atomic<uint32_t> overflow_count_{0};
+};
+
+}  // namespace sensesp
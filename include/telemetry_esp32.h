@@ -0,0 +1,60 @@
+#pragma once
+
+#include <mqtt_client.h>
+
+#include "telemetry_stream.h"
+
+// UDP destination: IPv4 address (the subnet broadcast by default, so any
+// host on the boat network can listen) and port
+#ifndef BATTERY_TELEMETRY_UDP_HOST
+#define BATTERY_TELEMETRY_UDP_HOST "255.255.255.255"
+#endif
+
+#ifndef BATTERY_TELEMETRY_UDP_PORT
+#define BATTERY_TELEMETRY_UDP_PORT 4950
+#endif
+
+// With -D BATTERY_TELEMETRY_MQTT_URI='"mqtt://host"' the datagrams are
+// published (QoS 0) to this topic instead of sent over UDP
+#ifndef BATTERY_TELEMETRY_MQTT_TOPIC
+#define BATTERY_TELEMETRY_MQTT_TOPIC "battery-sensors/telemetry"
+#endif
+
+// Network timeout of the MQTT client; also the longest a publish can block
+// the event loop when the TCP send buffer is full
+#ifndef BATTERY_TELEMETRY_MQTT_TIMEOUT_MS
+#define BATTERY_TELEMETRY_MQTT_TIMEOUT_MS 500
+#endif
+
+namespace sensesp {
+
+// Datagrams over a non-blocking UDP socket, opened on the first send (after
+// WiFi is up). Sends fail, and are counted as lost, while there is no network.
+class UdpTelemetryTransport : public TelemetryTransport {
+ public:
+  UdpTelemetryTransport(const char* host, uint16_t port);
+
+  bool send(const uint8_t* data, size_t length) override;
+
+ private:
+  const char* host_;
+  uint16_t port_;
+  int socket_ = -1;
+};
+
+// One MQTT publish per datagram through the ESP-IDF MQTT client, started on
+// the first send. The client reconnects by itself; publishes fail while it is
+// disconnected. QoS 0 goes straight to the socket, nothing is queued.
+class MqttTelemetryTransport : public TelemetryTransport {
+ public:
+  MqttTelemetryTransport(const char* uri, const char* topic);
+
+  bool send(const uint8_t* data, size_t length) override;
+
+ private:
+  const char* uri_;
+  const char* topic_;
+  esp_mqtt_client_handle_t client_ = nullptr;
+};
+
+}  // namespace sensesp
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "battery_sample.h"
+
+// Binary telemetry stream (select at compile time with -D BATTERY_TELEMETRY)
+// Default: only the Signal K deltas (output_interval_ms) leave the node.
+// BATTERY_TELEMETRY: every sample of every battery also goes out in binary
+// datagrams over UDP or MQTT (src/telemetry_esp32.cpp); the Signal K outputs
+// are unchanged.
+
+// Largest datagram (header plus records); below the Ethernet MTU, so a UDP
+// datagram is never fragmented
+#ifndef BATTERY_TELEMETRY_MAX_DATAGRAM_BYTES
+#define BATTERY_TELEMETRY_MAX_DATAGRAM_BYTES 1400
+#endif
+
+// A datagram goes out when full or when its first sample is this old
+#ifndef BATTERY_TELEMETRY_MAX_LATENCY_MS
+#define BATTERY_TELEMETRY_MAX_LATENCY_MS 200
+#endif
+
+namespace sensesp {
+
+// Wire format, all fields little-endian, floats IEEE 754 single precision.
+//
+// Datagram header (16 bytes):
+//   0  char[2]  magic "BT"
+//   2  uint8    version (1)
+//   3  uint8    record size (16)
+//   4  uint32   sequence, +1 per datagram (also for datagrams that failed to
+//               send, so the receiver counts them as lost)
+//   8  uint16   record count
+//  10  uint16   reserved (0)
+//  12  uint32   session: random per boot, the sequence restarts with it
+// Records (16 bytes each):
+//   0  uint32   timestamp (us, micros() of the sample, wraps)
+//   4  uint8    battery (index in the bank, BatteryBank::monitor())
+//   5  uint8    reserved (0)
+//   6  uint16   voltage (mV)
+//   8  float    current (A, positive = charging)
+//  12  float    Ah of the integrator after the sample
+constexpr uint8_t kTelemetryVersion = 1;
+constexpr size_t kTelemetryHeaderBytes = 16;
+constexpr size_t kTelemetryRecordBytes = 16;
+constexpr size_t kTelemetryMaxRecords =
+    (BATTERY_TELEMETRY_MAX_DATAGRAM_BYTES - kTelemetryHeaderBytes) / kTelemetryRecordBytes;
+static_assert(kTelemetryMaxRecords > 0, "BATTERY_TELEMETRY_MAX_DATAGRAM_BYTES holds no record");
+
+// Where datagrams go (UDP socket or MQTT client on the device, see
+// src/telemetry_esp32.cpp; a receiving fake in test/test_telemetry_stream).
+// send() must not block for long: it runs in the event loop.
+class TelemetryTransport {
+ public:
+  virtual ~TelemetryTransport() {}
+  // False if the datagram was not sent (no network, buffers full)
+  virtual bool send(const uint8_t* data, size_t length) = 0;
+};
+
+// Packs samples into fixed-layout records and batches them into datagrams in
+// one static buffer: no allocation after construction, one send per
+// datagram. A datagram that fails to send is dropped, not retried; its
+// sequence number is skipped. Not thread-safe: add() and poll() from one task
+// (the event loop). Host-portable.
+class TelemetryStream {
+ public:
+  TelemetryStream(TelemetryTransport* transport, uint32_t session,
+                  uint32_t max_latency_us = BATTERY_TELEMETRY_MAX_LATENCY_MS * 1000UL);
+
+  // Append one sample; sends the datagram when it is full or too old
+  void add(uint8_t battery, const BatterySample& sample, float ah);
+
+  // Send a partial datagram whose first sample is older than the latency
+  // (samples stopped, e.g. a slow poll interval)
+  void poll(uint32_t now_us);
+
+  // Send whatever is buffered
+  void flush();
+
+  uint32_t get_sent_count() const { return sent_count_; }
+  uint32_t get_failed_count() const { return failed_count_; }
+  uint32_t get_record_count() const { return record_count_; }
+
+ private:
+  TelemetryTransport* transport_;
+  uint32_t session_;
+  uint32_t max_latency_us_;
+  uint32_t sequence_ = 0;
+  uint32_t first_us_ = 0;  // Timestamp of the first buffered record
+  size_t count_ = 0;
+  uint32_t sent_count_ = 0;
+  uint32_t failed_count_ = 0;
+  uint32_t record_count_ = 0;
+  uint8_t buffer_[kTelemetryHeaderBytes + kTelemetryMaxRecords * kTelemetryRecordBytes];
+};
+
+// Receiver side (tools/telemetry_sink)
+struct TelemetryHeader {
+  uint32_t sequence;
+  uint32_t session;
+  uint16_t count;
+};
+
+struct TelemetryRecord {
+  uint32_t timestamp_us;
+  uint8_t battery;
+  float voltage_v;
+  float current_a;
+  float ah;
+};
+
+// False unless data is a complete datagram of this version
+bool decode_telemetry_header(const uint8_t* data, size_t length, TelemetryHeader* header);
+
+// Record index of a datagram that passed decode_telemetry_header()
+TelemetryRecord decode_telemetry_record(const uint8_t* data, size_t index);
+
+}  // namespace sensesp
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstddef>
+
+#include "bank_aggregate.h"
+#include "pipeline_arena.h"
+#include "sk_delta_emitter.h"
+#include "sensesp/signalk/signalk_output.h"
+#include "sensesp/signalk/signalk_put_request_listener.h"
+#include "sensesp/system/lambda_consumer.h"
+
+namespace sensesp {
+
+class BatteryBank;
+
+// Static description of one virtual bank. Meant to live in a constexpr table
+// (see src/main.cpp).
+struct VirtualBankConfig {
+  const char* name;            // Signal K battery instance: electrical.batteries.<name>.*
+  const char* key;             // Short persistence key (max 8 chars), distinct from the batteries' keys
+  const char* const* members;  // BatteryConfig::name of each member monitor
+  size_t member_count;
+  uint32_t initial_members;    // Members joined at first boot (no persisted state), bit i for members[i]
+};
+
+// A battery that combines member monitors of the bank (banks paralleled by a
+// combiner relay, several lithium modules), published as its own Signal K
+// battery instance: voltage, current, power, ah, stateOfCharge and
+// ah/capacity (see BankAggregate for how they are combined).
+//
+// The members' samples update the combined values in the same call that
+// integrates them (BatteryMonitor::handle_sample()); the bank's output timer
+// publishes them with the monitors' outputs, through the same emitter. No
+// extra I2C reads or timers.
+//
+// Members start as persisted, or as initial_members on the first boot (none
+// joined unless the config says so: a member is usually behind a relay that
+// is open until switched). members.<member> (1 joined, 0 not) is published
+// and takes PUTs, so the relay state can switch membership at runtime; every
+// change is staged in the state store (ah_state_store()) under the bank's
+// key and survives a reboot.
+class VirtualBank {
+ public:
+  // Combined outputs registered with the emitter (attach()), each with metadata
+  static constexpr size_t kOutputCount = 6;
+
+  // Created by BatteryBank::add_virtual_bank()
+  VirtualBank(const VirtualBankConfig& config, BatteryBank* bank);
+
+  const VirtualBankConfig& config() const { return config_; }
+  const BankAggregate& aggregate() const { return aggregate_; }
+
+  // Join (true) or leave member number index of the config
+  void set_member(size_t index, bool joined);
+
+  // Register the Signal K outputs with the bank's emitter
+  void attach(SKDeltaEmitter& emitter);
+
+  // Stage the combined values in the emitter
+  void emit_outputs(SKDeltaEmitter& emitter);
+
+ private:
+  const VirtualBankConfig& config_;
+  BatteryBank* bank_;
+  BankAggregate aggregate_;
+  uint32_t members_ = 0;  // Joined members, bit per config member (persisted)
+  // Bank monitor index of each member, -1 if there is no such monitor
+  int slots_[BankAggregate::kMaxMembers];
+  int first_channel_ = -1;  // Emitter channel of voltage_output_; the others follow in order
+
+  SKOutputFloat voltage_output_;
+  SKOutputFloat current_output_;
+  SKOutputFloat power_output_;
+  SKOutputFloat ah_output_;
+  SKOutputFloat soc_output_;
+  SKOutputFloat capacity_output_;
+  // Per member, created in the pipeline arena by the constructor
+  SKOutputFloat** member_outputs_;
+};
+
+// Pipeline arena bytes of the virtual banks created from configs: each bank,
+// the metadata of its outputs and per member an output with metadata, a PUT
+// listener and its consumer (sizes kPipelineArenaBytes in src/main.cpp)
+constexpr size_t virtual_bank_arena_bytes(const VirtualBankConfig* configs, size_t count) {
+  return count == 0
+             ? 0
+             : PipelineArena::arena_bytes<VirtualBank>() +
+                   PipelineArena::arena_bytes<SKMetadata>(VirtualBank::kOutputCount) +
+                   PipelineArena::arena_array_bytes<SKOutputFloat*>(configs[0].member_count) +
+                   configs[0].member_count *
+                       (PipelineArena::arena_bytes<SKOutputFloat>() + PipelineArena::arena_bytes<SKMetadata>() +
+                        PipelineArena::arena_bytes<SKPutRequestListener<float>>() +
+                        PipelineArena::arena_bytes<LambdaConsumer<float>>()) +
+                   virtual_bank_arena_bytes(configs + 1, count - 1);
+}
+
+}  // namespace sensesp
@@ -1,173 +1,197 @@
 #include "ah_integrator.h"
 #include <Arduino.h>
-#include <Preferences.h>
+#include "ah_journal.h"
 #include <cmath>
 
 namespace sensesp {
 
-AmpHourIntegrator::AmpHourIntegrator(const String& config_path, float initial_ah, float battery_capacity_ah)
-    : FloatTransform(config_path), marked_capacity_ah_(battery_capacity_ah),
-      battery_capacity_ah_(battery_capacity_ah), config_path_(config_path) {
-  ah_output_ = initial_ah;
-  this->output_ = initial_ah;  // Keep FloatTransform output in sync
+AmpHourIntegrator::AmpHourIntegrator(const String& config_path, float initial_ah, float battery_capacity_ah,
+                                     bool sample_synchronous)
+    : FloatTransform(config_path), sample_synchronous_(sample_synchronous), marked_capacity_ah_(battery_capacity_ah),
+      battery_capacity_ah_(battery_capacity_ah) {
+  float start_ah = initial_ah;
+  // Short key for the state store, built once: only its first kKeyLength
+  // characters are significant
+  const char* path = config_path.c_str();
+  size_t key_length = 0;
+  for (; key_length < AhStateStore::kKeyLength && path[key_length] != '\0'; key_length++) {
+    persist_key_[key_length] = path[key_length] == '/' ? '_' : path[key_length];
+  }
+  persist_key_[key_length] = '\0';
   last_update_ms_ = millis();
 
-  (void)config_path_; (void)initial_ah; (void)battery_capacity_ah;
-
-  // Load persisted capacities and efficiencies if available
-  if (config_path_.length() > 0) {
-    String key = config_path_;
-    key.replace('/', '_');
-    Preferences prefs;
-    if (prefs.begin("battcfg", false)) {  // open read-write to be safe
-      if (prefs.isKey((key + "_marked").c_str())) {
-        float v = prefs.getFloat((key + "_marked").c_str(), marked_capacity_ah_);
-        marked_capacity_ah_ = v;
-      }
-      if (prefs.isKey((key + "_current").c_str())) {
-        float v = prefs.getFloat((key + "_current").c_str(), battery_capacity_ah_);
-        battery_capacity_ah_ = v;
-      }
-      if (prefs.isKey((key + "_charge").c_str())) {
-        float v = prefs.getFloat((key + "_charge").c_str(), charge_efficiency_);
-        charge_efficiency_ = v;
-      }
-      if (prefs.isKey((key + "_discharge").c_str())) {
-        float v = prefs.getFloat((key + "_discharge").c_str(), discharge_efficiency_);
-        discharge_efficiency_ = v;
-      }
-      // Load persisted Ah value if present
-      if (prefs.isKey((key + "_ah").c_str())) {
-        float v = prefs.getFloat((key + "_ah").c_str(), (float)ah_output_);
-        ah_output_ = v;
-        this->output_ = v;  // Keep FloatTransform output in sync
-      }
-      prefs.end();
-    } else {
-      (void)key;
+  // Load persisted Ah, capacities and efficiencies if available
+  if (persist_key_[0] != '\0') {
+    AhPersistedState state = snapshot();
+    state.ah = start_ah;
+#if AH_RTC_SNAPSHOT
+    // After a warm reset the RTC snapshot is newer than the store, and
+    // reading it does not touch flash
+    rtc_handle_ = ah_rtc_snapshot()->attach(persist_key_);
+    bool restored = ah_rtc_snapshot()->restore(rtc_handle_, &state) ||
+                    ah_state_store()->restore(persist_key_, &state);
+#else
+    bool restored = ah_state_store()->restore(persist_key_, &state);
+#endif
+    if (restored) {
+      start_ah = state.ah;
+      marked_capacity_ah_ = state.marked_capacity_ah;
+      battery_capacity_ah_ = state.current_capacity_ah;
+      charge_efficiency_ = state.charge_efficiency;
+      discharge_efficiency_ = state.discharge_efficiency;
     }
   }
 
+  ah_acc_.set_efficiencies(charge_efficiency_, discharge_efficiency_);
+  ah_acc_.set_capacity(battery_capacity_ah_);
+  ah_acc_.set_ah(start_ah);
+  this->output_ = ah_acc_.get_ah_float();  // Keep FloatTransform output in sync
+  mirror_state(last_update_ms_);
+  // The start value is what the store holds (or what it starts from): the
+  // first samples must not stage it again
+  persist_policy_.mark(this->output_, last_update_ms_);
+
   // Start a timer for internal integration. Interval defined by AH_INTEGRATION_INTERVAL_MS.
-  event_loop()->onRepeat(AH_INTEGRATION_INTERVAL_MS, [this]() { this->integrate(); });
   // Start a timer to check whether we should persist the Ah value. Interval defined
   // by AH_PERSIST_CHECK_INTERVAL_MS (default 0.2 Hz -> every 5 seconds).
-  event_loop()->onRepeat(AH_PERSIST_CHECK_INTERVAL_MS, [this]() { this->maybe_persist_ah(); });
+  // In sample-synchronous mode the owner schedules both instead.
+  if (!sample_synchronous_) {
+    event_loop()->onRepeat(AH_INTEGRATION_INTERVAL_MS, [this]() { this->integrate(); });
+    event_loop()->onRepeat(AH_PERSIST_CHECK_INTERVAL_MS, [this]() { this->maybe_persist_ah(); });
+  }
 }
 
 void AmpHourIntegrator::set(const float& new_value) {
+  if (sample_synchronous_) {
+    add_sample(micros(), new_value);
+    return;
+  }
   // Store the current reading; integration happens in the timer
   current_a_ = new_value;
 }
 
-void AmpHourIntegrator::set_ah(double ah) {
-  // Clamp Ah between 0 and battery capacity
-  if (battery_capacity_ah_ > 0) {
-    ah_output_ = constrain(ah, 0.0, (double)battery_capacity_ah_);
-  } else {
-    ah_output_ = ah;
+void AmpHourIntegrator::add_sample(uint32_t timestamp_us, float current_a) {
+  current_a_ = current_a;
+  if (!has_sample_) {
+    // First sample only defines the start of the first segment
+    has_sample_ = true;
+    last_sample_us_ = timestamp_us;
+    last_sample_a_ = current_a;
+    return;
   }
-  this->output_ = ah_output_;  // Keep FloatTransform output in sync
+
+  // Unsigned subtraction handles micros() wrap-around
+  uint32_t dt_us = timestamp_us - last_sample_us_;
+  ah_acc_.add_trapezoid(last_sample_a_, current_a, dt_us);
+  last_sample_us_ = timestamp_us;
+  last_sample_a_ = current_a;
+
+  after_accumulate(millis());
+}
+
+void AmpHourIntegrator::after_accumulate(unsigned long now) {
+  float ah = ah_acc_.get_ah_float();
+  this->output_ = ah;  // Keep FloatTransform output in sync for SK sampling
+  mirror_state(now);
+
+  // Persist Ah if it changed more than the threshold since last persisted
+  if (persist_policy_.delta_reached(ah) && persist_key_[0] != '\0') {
+    stage_state();
+    persist_policy_.mark(ah, now);
+    ah_dirty_ = false;
+  }
+}
+
+void AmpHourIntegrator::set_ah(double ah) {
+  // Clamp Ah between 0 and battery capacity (done by the accumulator)
+  ah_acc_.set_ah(ah);
+  this->output_ = ah_acc_.get_ah_float();  // Keep FloatTransform output in sync
   // Mark Ah dirty for periodic persistence (avoid frequent NVS writes)
   ah_dirty_ = true;
 
-  // Also persist immediately because this value was explicitly set via SK PUT
-  if (config_path_.length() > 0) {
-    String key = config_path_;
-    key.replace('/', '_');
-    Preferences prefs;
-    if (prefs.begin("battcfg", false)) {
-      prefs.putFloat((key + "_ah").c_str(), (float)ah_output_);
-      last_persisted_ah_ = ah_output_;
-      last_ah_persist_ms_ = millis();
-      ah_dirty_ = false; // already persisted
-      prefs.end();
-    }
+  // Also persist right away (next store flush) because this value was explicitly set via SK PUT
+  if (persist_key_[0] != '\0') {
+    stage_state();
+    persist_policy_.mark(this->output_, millis());
+    ah_dirty_ = false; // already staged
   }
 }
 
 void AmpHourIntegrator::maybe_persist_ah() {
-  if (!ah_dirty_ || config_path_.length() == 0) {
+  if (!ah_dirty_ || persist_key_[0] == '\0') {
     return;
   }
   unsigned long now = millis();
-  if (now - last_ah_persist_ms_ < ah_persist_interval_ms_) {
+  if (!persist_policy_.interval_elapsed(now)) {
     // Not yet time to persist
     return;
   }
   // Persist only if delta since last persisted exceeds threshold
-  if (fabs(ah_output_ - last_persisted_ah_) < ah_persist_delta_) {
+  float ah = ah_acc_.get_ah_float();
+  if (!persist_policy_.delta_reached(ah)) {
     // Not enough change
     ah_dirty_ = false; // clear dirty to avoid repeated checks until next change
     return;
   }
 
-  String key = config_path_;
-  key.replace('/', '_');
-  Preferences prefs;
-    if (prefs.begin("battcfg", false)) {
-      prefs.putFloat((key + "_ah").c_str(), (float)ah_output_);
-      last_persisted_ah_ = ah_output_;
-      last_ah_persist_ms_ = now;
-      ah_dirty_ = false;
-      prefs.end();
-    } else {
-      (void)key;
-    }
+  stage_state();
+  persist_policy_.mark(ah, now);
+  ah_dirty_ = false;
+}
+
+AhPersistedState AmpHourIntegrator::snapshot() const {
+  AhPersistedState state;
+  state.ah = ah_acc_.get_ah_float();
+  state.marked_capacity_ah = marked_capacity_ah_;
+  state.current_capacity_ah = battery_capacity_ah_;
+  state.charge_efficiency = charge_efficiency_;
+  state.discharge_efficiency = discharge_efficiency_;
+  return state;
+}
+
+void AmpHourIntegrator::stage_state() {
+  if (persist_key_[0] != '\0') {
+    // Staged in RAM only; the state store commits all batteries in one batch
+    ah_state_store()->update(persist_key_, snapshot());
+    mirror_state(millis());
+  }
+}
+
+void AmpHourIntegrator::mirror_state(unsigned long now) {
+#if AH_RTC_SNAPSHOT
+  if (rtc_handle_ >= 0) {
+    ah_rtc_snapshot()->update(rtc_handle_, snapshot(), now);
+  }
+#else
+  (void)now;
+#endif
 }
 
 void AmpHourIntegrator::set_marked_capacity_ah(float capacity_ah) {
   marked_capacity_ah_ = constrain(capacity_ah, 0.1f, 10000.0f);
   // Persist
-  if (config_path_.length() > 0) {
-    String key = config_path_;
-    key.replace('/', '_');
-    Preferences prefs;
-    if (prefs.begin("battcfg", false)) {
-      prefs.putFloat((key + "_marked").c_str(), marked_capacity_ah_);
-      prefs.end();
-    }
-  }
+  stage_state();
 }
 
 void AmpHourIntegrator::set_current_capacity_ah(float capacity_ah) {
   battery_capacity_ah_ = constrain(capacity_ah, 0.1f, 10000.0f);
+  ah_acc_.set_capacity(battery_capacity_ah_);
   // Persist
-  if (config_path_.length() > 0) {
-    String key = config_path_;
-    key.replace('/', '_');
-    Preferences prefs;
-    if (prefs.begin("battcfg", false)) {
-      prefs.putFloat((key + "_current").c_str(), battery_capacity_ah_);
-      prefs.end();
-    }
-  }
+  stage_state();
 }
 
 void AmpHourIntegrator::set_charge_efficiency(float pct) {
   charge_efficiency_ = constrain(pct, 0.0f, 100.0f);
-  if (config_path_.length() > 0) {
-    String key = config_path_;
-    key.replace('/', '_');
-    Preferences prefs;
-    if (prefs.begin("battcfg", false)) {
-      prefs.putFloat((key + "_charge").c_str(), charge_efficiency_);
-      prefs.end();
-    }
-  }
+  ah_acc_.set_efficiencies(charge_efficiency_, discharge_efficiency_);
+  // Persist
+  stage_state();
 }
 
 void AmpHourIntegrator::set_discharge_efficiency(float pct) {
   discharge_efficiency_ = constrain(pct, 0.0f, 100.0f);
-  if (config_path_.length() > 0) {
-    String key = config_path_;
-    key.replace('/', '_');
-    Preferences prefs;
-    if (prefs.begin("battcfg", false)) {
-      prefs.putFloat((key + "_discharge").c_str(), discharge_efficiency_);
-      prefs.end();
-    }
-  }
+  ah_acc_.set_efficiencies(charge_efficiency_, discharge_efficiency_);
+  // Persist
+  stage_state();
 }
 
 void AmpHourIntegrator::integrate() {
@@ -175,42 +199,15 @@ void AmpHourIntegrator::integrate() {
   unsigned long dt_ms = now - last_update_ms_;
   last_update_ms_ = now;
 
-  // Convert milliseconds to hours: ms / 3_600_000 - use double for precision
-  double dt_hours = static_cast<double>(dt_ms) / 3600000.0;
-
-  // current_a_ is in amperes. delta Ah = A * hours - use double for small deltas
-  double delta_ah = current_a_ * dt_hours;
-  
-  // Apply efficiency factor based on current direction
-  // Positive current = charging, Negative current = discharging
-  double efficiency_factor = (current_a_ > 0) ? (charge_efficiency_ / 100.0) : (discharge_efficiency_ / 100.0);
-  delta_ah *= efficiency_factor;
-  
-  ah_output_ += delta_ah;
-  
-  // Clamp Ah between 0 and battery capacity
-  if (battery_capacity_ah_ > 0) {
-    ah_output_ = constrain(ah_output_, 0.0, (double)battery_capacity_ah_);
-  }
-
-  this->output_ = ah_output_;  // Keep FloatTransform output in sync for SK sampling
+  // current_a_ is in amperes, held for the whole interval. The accumulator
+  // applies the efficiency factor based on current direction
+  // (positive current = charging, negative current = discharging).
+  ah_acc_.add_hold(current_a_, dt_ms * 1000UL);
 
-  // Persist Ah if it changed more than the threshold since last persisted
-  if (fabs(ah_output_ - last_persisted_ah_) >= ah_persist_delta_ && config_path_.length() > 0) {
-    String key = config_path_;
-    key.replace('/', '_');
-    Preferences prefs;
-    if (prefs.begin("battcfg", false)) {
-      prefs.putFloat((key + "_ah").c_str(), (float)ah_output_);
-      last_persisted_ah_ = ah_output_;
-      last_ah_persist_ms_ = now;
-      ah_dirty_ = false;
-      prefs.end();
-    }
-  }
+  after_accumulate(now);
 
   // Lightweight debug output (can be disabled in production)
-  (void)current_a_; (void)charge_efficiency_; (void)discharge_efficiency_; (void)dt_ms; (void)delta_ah; (void)this->output_;
+  (void)current_a_; (void)charge_efficiency_; (void)discharge_efficiency_; (void)dt_ms; (void)this->output_;
 
   // Do NOT emit here; let Signal K output sample Ah at its own rate
   // This decouples integration timer from Signal K update rate
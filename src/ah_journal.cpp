@@ -0,0 +1,233 @@
+#include "ah_journal.h"
+#include <cstddef>
+#include <cstring>
+
+namespace sensesp {
+
+uint32_t journal_crc32(const void* data, size_t length) {
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  uint32_t crc = 0xFFFFFFFF;
+  for (size_t i = 0; i < length; i++) {
+    crc ^= bytes[i];
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+    }
+  }
+  return ~crc;
+}
+
+// -------------------- AhStateStore --------------------
+
+AhStateStore::Entry* AhStateStore::find(const char* key) {
+  for (size_t i = 0; i < entry_count_; i++) {
+    if (strncmp(entries_[i].key, key, kKeyLength) == 0) {
+      return &entries_[i];
+    }
+  }
+  return nullptr;
+}
+
+AhStateStore::Entry* AhStateStore::add(const char* key) {
+  if (entry_count_ >= AH_STORE_MAX_ENTRIES) {
+    return nullptr;
+  }
+  Entry* entry = &entries_[entry_count_++];
+  memset(entry->key, 0, kKeyLength);
+  strncpy(entry->key, key, kKeyLength);
+  entry->state = AhPersistedState();
+  entry->dirty = false;
+  return entry;
+}
+
+bool AhStateStore::restore(const char* key, AhPersistedState* state) {
+  Entry* entry = find(key);
+  if (entry != nullptr) {
+    *state = entry->state;
+    return true;
+  }
+  if (!load(key, state)) {
+    return false;
+  }
+  // Cache and stage so the next commit writes it to this store (migration)
+  entry = add(key);
+  if (entry != nullptr) {
+    entry->state = *state;
+    entry->dirty = true;
+  }
+  return true;
+}
+
+void AhStateStore::update(const char* key, const AhPersistedState& state) {
+  Entry* entry = find(key);
+  if (entry == nullptr) {
+    entry = add(key);
+    if (entry == nullptr) {
+      return;  // Table full; AH_STORE_MAX_ENTRIES too small
+    }
+  }
+  entry->state = state;
+  entry->dirty = true;
+}
+
+void AhStateStore::flush() {
+  Entry* dirty[AH_STORE_MAX_ENTRIES];
+  size_t count = 0;
+  for (size_t i = 0; i < entry_count_; i++) {
+    if (entries_[i].dirty) {
+      dirty[count++] = &entries_[i];
+    }
+  }
+  if (count == 0) {
+    return;
+  }
+  if (commit(dirty, count)) {
+    for (size_t i = 0; i < count; i++) {
+      dirty[i]->dirty = false;
+    }
+    commit_count_++;
+  }
+}
+
+// -------------------- AhJournal --------------------
+
+AhJournal::AhJournal(JournalFlash* flash, AhStateStore* fallback)
+    : flash_(flash), fallback_(fallback) {
+  scan();
+}
+
+size_t AhJournal::records_per_sector() const {
+  return flash_->sector_size() / sizeof(Record);
+}
+
+size_t AhJournal::sector_count() const {
+  return flash_->size() / flash_->sector_size();
+}
+
+bool AhJournal::is_erased(const Record& record) const {
+  const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&record);
+  for (size_t i = 0; i < sizeof(Record); i++) {
+    if (bytes[i] != 0xFF) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void AhJournal::scan() {
+  const size_t sector_size = flash_->sector_size();
+  const size_t per_sector = records_per_sector();
+  uint32_t entry_sequence[AH_STORE_MAX_ENTRIES] = {};
+  bool entry_seen[AH_STORE_MAX_ENTRIES] = {};
+  bool found = false;
+  uint32_t newest = 0;
+
+  for (size_t sector = 0; sector < sector_count(); sector++) {
+    for (size_t slot = 0; slot < per_sector; slot++) {
+      Record record;
+      if (!flash_->read(sector * sector_size + slot * sizeof(Record), &record, sizeof(record)) ||
+          is_erased(record)) {
+        continue;
+      }
+      if (journal_crc32(&record, offsetof(Record, crc)) != record.crc) {
+        continue;  // Torn or corrupted write
+      }
+      char key[kKeyLength + 1] = {};
+      memcpy(key, record.key, kKeyLength);
+      Entry* entry = find(key);
+      if (entry == nullptr) {
+        entry = add(key);
+        if (entry == nullptr) {
+          continue;
+        }
+      }
+      size_t index = entry - entries_;
+      if (!entry_seen[index] || record.sequence > entry_sequence[index]) {
+        entry_seen[index] = true;
+        entry_sequence[index] = record.sequence;
+        entry->state = record.state;
+      }
+      if (!found || record.sequence > newest) {
+        found = true;
+        newest = record.sequence;
+        active_sector_ = sector;
+        next_slot_ = slot + 1;
+      }
+    }
+  }
+
+  if (!found) {
+    // Empty (or foreign) region: start from a freshly erased first sector
+    active_sector_ = 0;
+    next_slot_ = 0;
+    needs_erase_ = true;
+    return;
+  }
+
+  next_sequence_ = newest + 1;
+  // Skip slots that are not blank (e.g. a torn record after the newest one).
+  // If none are left, the next commit moves on to the next sector.
+  while (next_slot_ < per_sector) {
+    Record record;
+    if (flash_->read(active_sector_ * sector_size + next_slot_ * sizeof(Record), &record, sizeof(record)) &&
+        is_erased(record)) {
+      break;
+    }
+    next_slot_++;
+  }
+}
+
+bool AhJournal::start_next_sector() {
+  size_t sector = needs_erase_ ? active_sector_ : (active_sector_ + 1) % sector_count();
+  if (!flash_->erase_sector(sector * flash_->sector_size())) {
+    return false;
+  }
+  erase_count_++;
+  active_sector_ = sector;
+  next_slot_ = 0;
+  needs_erase_ = false;
+  return true;
+}
+
+bool AhJournal::write_records(Entry* const* entries, size_t count) {
+  Record records[AH_STORE_MAX_ENTRIES];
+  for (size_t i = 0; i < count; i++) {
+    Record& record = records[i];
+    record.sequence = next_sequence_ + i;
+    memcpy(record.key, entries[i]->key, kKeyLength);
+    record.state = entries[i]->state;
+    record.crc = journal_crc32(&record, offsetof(Record, crc));
+  }
+  size_t offset = active_sector_ * flash_->sector_size() + next_slot_ * sizeof(Record);
+  if (!flash_->write(offset, records, count * sizeof(Record))) {
+    // Slots may be partially programmed; never reuse them
+    next_slot_ += count;
+    return false;
+  }
+  next_slot_ += count;
+  next_sequence_ += count;
+  record_count_ += count;
+  return true;
+}
+
+bool AhJournal::commit(Entry* const* entries, size_t count) {
+  if (!needs_erase_ && next_slot_ + count <= records_per_sector()) {
+    return write_records(entries, count);
+  }
+
+  // Move to a fresh sector and write the state of every key, so the sector
+  // erased next time around never holds the newest record of any key.
+  if (!start_next_sector()) {
+    return false;
+  }
+  Entry* all[AH_STORE_MAX_ENTRIES];
+  for (size_t i = 0; i < entry_count_; i++) {
+    all[i] = &entries_[i];
+  }
+  return write_records(all, entry_count_);
+}
+
+bool AhJournal::load(const char* key, AhPersistedState* state) {
+  return fallback_ != nullptr && fallback_->restore(key, state);
+}
+
+}  // namespace sensesp
@@ -0,0 +1,135 @@
+#include "ah_journal.h"
+#include <Arduino.h>
+#include <Preferences.h>
+#include <esp_partition.h>
+#include <cstring>
+#include "diagnostics.h"
+#include "sensesp_base_app.h"
+
+namespace sensesp {
+
+namespace {
+
+// Data partition holding the journal (see partitions.csv)
+constexpr const char* kJournalPartitionLabel = "ahjournal";
+constexpr esp_partition_subtype_t kJournalPartitionSubtype = static_cast<esp_partition_subtype_t>(0x40);
+
+// Journal flash backed by an ESP32 data partition
+class PartitionJournalFlash : public JournalFlash {
+ public:
+  explicit PartitionJournalFlash(const esp_partition_t* partition) : partition_(partition) {}
+  size_t size() const override { return partition_->size; }
+  size_t sector_size() const override { return SPI_FLASH_SEC_SIZE; }
+  bool read(size_t offset, void* data, size_t length) override {
+    return esp_partition_read(partition_, offset, data, length) == ESP_OK;
+  }
+  bool write(size_t offset, const void* data, size_t length) override {
+    return esp_partition_write(partition_, offset, data, length) == ESP_OK;
+  }
+  bool erase_sector(size_t offset) override {
+    return esp_partition_erase_range(partition_, offset, SPI_FLASH_SEC_SIZE) == ESP_OK;
+  }
+
+ private:
+  const esp_partition_t* partition_;
+};
+
+// Per-field float keys in the "battcfg" Preferences namespace, as written by
+// earlier firmware. Used when the journal partition is missing (e.g. after an
+// OTA update that kept the old partition table) and to migrate old state.
+// Unlike the old per-setter writes, a commit opens the namespace once for all
+// staged batteries.
+class PreferencesAhStateStore : public AhStateStore {
+ protected:
+  bool commit(Entry* const* entries, size_t count) override {
+    Preferences prefs;
+    if (!prefs.begin("battcfg", false)) {
+      return false;
+    }
+    for (size_t i = 0; i < count; i++) {
+      String key = entry_key(entries[i]);
+      const AhPersistedState& state = entries[i]->state;
+      prefs.putFloat((key + "_ah").c_str(), state.ah);
+      prefs.putFloat((key + "_marked").c_str(), state.marked_capacity_ah);
+      prefs.putFloat((key + "_current").c_str(), state.current_capacity_ah);
+      prefs.putFloat((key + "_charge").c_str(), state.charge_efficiency);
+      prefs.putFloat((key + "_discharge").c_str(), state.discharge_efficiency);
+      prefs.putUInt((key + "_members").c_str(), state.members);
+    }
+    prefs.end();
+    return true;
+  }
+
+  bool load(const char* key_name, AhPersistedState* state) override {
+    Preferences prefs;
+    if (!prefs.begin("battcfg", true)) {
+      return false;
+    }
+    String key = key_name;
+    bool found = false;
+    found |= load_float(prefs, key + "_ah", &state->ah);
+    found |= load_float(prefs, key + "_marked", &state->marked_capacity_ah);
+    found |= load_float(prefs, key + "_current", &state->current_capacity_ah);
+    found |= load_float(prefs, key + "_charge", &state->charge_efficiency);
+    found |= load_float(prefs, key + "_discharge", &state->discharge_efficiency);
+    if (prefs.isKey((key + "_members").c_str())) {
+      state->members = prefs.getUInt((key + "_members").c_str(), state->members);
+      found = true;
+    }
+    prefs.end();
+    return found;
+  }
+
+ private:
+  static String entry_key(const Entry* entry) {
+    char key[kKeyLength + 1] = {};
+    memcpy(key, entry->key, kKeyLength);
+    return String(key);
+  }
+
+  static bool load_float(Preferences& prefs, const String& key, float* value) {
+    if (!prefs.isKey(key.c_str())) {
+      return false;
+    }
+    *value = prefs.getFloat(key.c_str(), *value);
+    return true;
+  }
+};
+
+// Duration of flushes that committed (Preferences or journal partition writes)
+DIAG_HISTOGRAM(commit_time, "journal.commit");
+
+}  // namespace
+
+AhStateStore* ah_state_store() {
+  static AhStateStore* store = nullptr;
+  if (store != nullptr) {
+    return store;
+  }
+
+  auto* legacy = new PreferencesAhStateStore();
+  const esp_partition_t* partition =
+      esp_partition_find_first(ESP_PARTITION_TYPE_DATA, kJournalPartitionSubtype, kJournalPartitionLabel);
+  if (partition != nullptr) {
+    store = new AhJournal(new PartitionJournalFlash(partition), legacy);
+  } else {
+    store = legacy;
+  }
+
+  // Deferred, batched flush: integrators only stage changes in RAM
+  event_loop()->onRepeat(AH_JOURNAL_FLUSH_INTERVAL_MS, []() {
+#if BATTERY_DIAGNOSTICS
+    uint32_t commits = store->get_commit_count();
+    uint32_t start_us = micros();
+    store->flush();
+    if (store->get_commit_count() != commits) {
+      DIAG_RECORD(commit_time, micros() - start_us);
+    }
+#else
+    store->flush();
+#endif
+  });
+  return store;
+}
+
+}  // namespace sensesp
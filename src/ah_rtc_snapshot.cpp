@@ -0,0 +1,111 @@
+#include "ah_rtc_snapshot.h"
+#include <cstring>
+
+namespace sensesp {
+
+namespace {
+
+// "AhRt" plus the layout size, so a firmware with a different slot layout
+// does not accept the old contents
+constexpr uint32_t kMagic = 0x41685274 ^ static_cast<uint32_t>(sizeof(AhRtcSnapshot::Slot));
+
+}  // namespace
+
+AhRtcSnapshot::AhRtcSnapshot(Region* region, bool warm) : region_(region), warm_(warm) {
+  if (!warm_) {
+    for (auto& pair : region_->slots) {
+      pair[0].magic = 0;
+      pair[1].magic = 0;
+    }
+  }
+}
+
+uint32_t AhRtcSnapshot::slot_crc(const Slot& slot) {
+  return journal_crc32(&slot, offsetof(Slot, crc));
+}
+
+bool AhRtcSnapshot::is_valid(const Slot& slot) const {
+  return slot.magic == kMagic && slot_crc(slot) == slot.crc;
+}
+
+int AhRtcSnapshot::newest(int handle) const {
+  const Slot* pair = region_->slots[handle];
+  bool valid[2] = {is_valid(pair[0]), is_valid(pair[1])};
+  if (valid[0] && valid[1]) {
+    // Wrap-safe comparison
+    return static_cast<int32_t>(pair[1].sequence - pair[0].sequence) > 0 ? 1 : 0;
+  }
+  return valid[0] ? 0 : (valid[1] ? 1 : -1);
+}
+
+int AhRtcSnapshot::attach(const char* key) {
+  int handle = -1;
+  // Pair written for this key before the reset
+  for (int i = 0; i < AH_STORE_MAX_ENTRIES && handle < 0; i++) {
+    int slot = newest(i);
+    if (!attached_[i] && slot >= 0 && strncmp(region_->slots[i][slot].key, key, AhStateStore::kKeyLength) == 0) {
+      handle = i;
+      sequence_[i] = region_->slots[i][slot].sequence + 1;
+      next_slot_[i] = slot == 0 ? 1 : 0;
+    }
+  }
+  bool reused = handle >= 0;
+  // Else a free pair, else one left by a battery that did not attach (yet)
+  for (int i = 0; i < AH_STORE_MAX_ENTRIES && handle < 0; i++) {
+    if (!attached_[i] && newest(i) < 0) {
+      handle = i;
+    }
+  }
+  for (int i = 0; i < AH_STORE_MAX_ENTRIES && handle < 0; i++) {
+    if (!attached_[i]) {
+      handle = i;
+    }
+  }
+  if (handle < 0) {
+    return -1;
+  }
+  if (!reused) {
+    // New pair: drop what it held
+    region_->slots[handle][0].magic = 0;
+    region_->slots[handle][1].magic = 0;
+    sequence_[handle] = 1;
+    next_slot_[handle] = 0;
+  }
+  attached_[handle] = true;
+  strncpy(keys_[handle], key, AhStateStore::kKeyLength);
+  return handle;
+}
+
+bool AhRtcSnapshot::restore(int handle, AhPersistedState* state, uint32_t* integrated_ms) const {
+  if (handle < 0 || !warm_) {
+    return false;
+  }
+  int slot = newest(handle);
+  if (slot < 0) {
+    return false;
+  }
+  *state = region_->slots[handle][slot].state;
+  if (integrated_ms != nullptr) {
+    *integrated_ms = region_->slots[handle][slot].integrated_ms;
+  }
+  restore_count_++;
+  return true;
+}
+
+void AhRtcSnapshot::update(int handle, const AhPersistedState& state, uint32_t integrated_ms) {
+  if (handle < 0) {
+    return;
+  }
+  // Overwrite the older slot; the newer one stays intact until this one is
+  // complete
+  Slot& slot = region_->slots[handle][next_slot_[handle]];
+  next_slot_[handle] ^= 1;
+  slot.magic = kMagic;
+  slot.sequence = sequence_[handle]++;
+  memcpy(slot.key, keys_[handle], sizeof(slot.key));
+  slot.state = state;
+  slot.integrated_ms = integrated_ms;
+  slot.crc = slot_crc(slot);
+}
+
+}  // namespace sensesp
@@ -0,0 +1,32 @@
+#include "ah_rtc_snapshot.h"
+
+#if AH_RTC_SNAPSHOT
+
+#include <Arduino.h>
+#include <esp_system.h>
+
+namespace sensesp {
+
+namespace {
+
+// Raw words rather than a Region object: a global with a constructor would
+// be initialised at boot, which is exactly what RTC_NOINIT must avoid
+static_assert(sizeof(AhRtcSnapshot::Region) % sizeof(uint32_t) == 0, "Region is word-sized");
+RTC_NOINIT_ATTR uint32_t rtc_region[sizeof(AhRtcSnapshot::Region) / sizeof(uint32_t)];
+
+}  // namespace
+
+AhRtcSnapshot* ah_rtc_snapshot() {
+  static AhRtcSnapshot* snapshot = nullptr;
+  if (snapshot == nullptr) {
+    // RTC memory is undefined after power-on; every other reset (panic,
+    // watchdog, brown-out, software) keeps it. The CRC rejects anything else.
+    bool warm = esp_reset_reason() != ESP_RST_POWERON;
+    snapshot = new AhRtcSnapshot(reinterpret_cast<AhRtcSnapshot::Region*>(rtc_region), warm);
+  }
+  return snapshot;
+}
+
+}  // namespace sensesp
+
+#endif  // AH_RTC_SNAPSHOT
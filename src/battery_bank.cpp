@@ -0,0 +1,689 @@
+#include "battery_bank.h"
+#include <Arduino.h>
+#include <esp_timer.h>
+#include <cstring>
+#include <ctime>
+#include "soc.h"
+#include "virtual_bank.h"
+#include "sensesp_base_app.h"
+
+namespace sensesp {
+
+static_assert(SK_EMITTER_MAX_CHANNELS >=
+                  BATTERY_BANK_MAX_MONITORS * BatteryMonitor::kOutputCount +
+                      BATTERY_VIRTUAL_BANK_MAX * (VirtualBank::kOutputCount + BATTERY_BANK_MAX_MONITORS),
+              "the emitter holds every output of a full bank and its virtual banks");
+
+namespace {
+
+// electrical.batteries.<name>.<leaf>
+String battery_path(const BatteryConfig& config, const char* leaf) {
+  return String("electrical.batteries.") + config.name + "." + leaf;
+}
+
+// Metadata and outputs created at setup come from the pipeline arena
+SKMetadata* metadata(const char* units, const char* description) {
+  return pipeline_arena()->create<SKMetadata>(units, description);
+}
+
+SKOutputFloat* arena_output(const String& path, const char* units, const char* description) {
+  return pipeline_arena()->create<SKOutputFloat>(path, "", metadata(units, description));
+}
+
+// Emission policy per output, in BatteryMonitor member order. Deadbands are
+// about the resolution a chartplotter shows.
+constexpr SKEmitPolicy kOutputPolicies[] = {
+    {0.01f, BATTERY_SK_HEARTBEAT_MS},        // voltage (V)
+    {0.05f, BATTERY_SK_HEARTBEAT_MS},        // current (A)
+    {0.5f, BATTERY_SK_HEARTBEAT_MS},         // power (W)
+    {0.05f, BATTERY_SK_HEARTBEAT_MS},        // ah (Ah)
+    {0.1f, BATTERY_SK_HEARTBEAT_MS},         // stateOfCharge (%)
+    {60.0f, BATTERY_SK_HEARTBEAT_MS},        // capacity.timeRemaining (s)
+    {60.0f, BATTERY_SK_HEARTBEAT_MS},        // capacity.timeToFull (s)
+    {0.0f, BATTERY_SK_CONFIG_HEARTBEAT_MS},  // ah/chargeEfficiency
+    {0.0f, BATTERY_SK_CONFIG_HEARTBEAT_MS},  // ah/dischargeEfficiency
+    {0.0f, BATTERY_SK_CONFIG_HEARTBEAT_MS},  // ah/capacity
+    {0.0f, BATTERY_SK_CONFIG_HEARTBEAT_MS},  // ah/markedCapacity
+};
+static_assert(sizeof(kOutputPolicies) / sizeof(kOutputPolicies[0]) == BatteryMonitor::kOutputCount,
+              "one emission policy per output");
+
+// Crank summary outputs, in BatteryMonitor::CrankOutput order
+struct CrankOutputInfo {
+  const char* leaf;
+  const char* units;
+  const char* description;
+};
+constexpr CrankOutputInfo kCrankOutputs[] = {
+    {"crank.minimumVoltage", "V", "Lowest voltage of the last crank"},
+    {"crank.peakCurrent", "A", "Peak current of the last crank"},
+    {"crank.sagDuration", "s", "Voltage sag duration of the last crank"},
+    {"crank.internalResistance", "ohm", "Internal resistance from the last crank"},
+};
+static_assert(sizeof(kCrankOutputs) / sizeof(kCrankOutputs[0]) == BatteryMonitor::kCrankOutputCount,
+              "one description per crank output");
+
+DIAG_HISTOGRAM(poll_time, "callbacks.poll");
+#ifdef BATTERY_ACQUISITION_TASK
+DIAG_HISTOGRAM(drain_time, "callbacks.drain");
+#endif
+DIAG_HISTOGRAM(output_time, "callbacks.output");
+// Deviation of the output timer's period from output_interval_ms
+DIAG_HISTOGRAM(output_lateness, "timers.outputLateness");
+#ifdef BATTERY_SOC_EKF
+DIAG_HISTOGRAM(soc_filter_time, "socFilter");
+#endif
+
+}  // namespace
+
+BatteryMonitor::BatteryMonitor(const BatteryConfig& config, I2CBus* bus, size_t log_max_bytes)
+    : config_(config),
+      ina_(bus, config.i2c_address),
+      // Externally scheduled by BatteryBank (poll interval 0)
+      sampler_(ina_, config.alert_pin, 0),
+      // Integrate per sample (trapezoidal, sample timestamps); Ah is clamped
+      // between 0 and capacity. The short key keeps NVS/journal keys small.
+      integrator_(String(config.key), config.initial_ah, config.capacity_ah, true),
+#ifdef BATTERY_SOC_EKF
+      soc_filter_(config.chemistry, config.cells, config.capacity_ah),
+#endif
+#if BATTERY_DIAGNOSTICS
+      i2c_read_time_(String(config.name) + ".i2cRead"),
+#endif
+#if BATTERY_LOG
+      log_(battery_log_fs(), config.key, log_max_bytes),
+#endif
+      voltage_output_(battery_path(config, "voltage"), "", metadata("V", "Voltage")),
+      current_output_(battery_path(config, "current"), "", metadata("A", "Amps")),
+      power_output_(battery_path(config, "power"), "", metadata("W", "Power")),
+      ah_output_(battery_path(config, "ah"), "", metadata("Ah", "Ampere hours")),
+      soc_output_(battery_path(config, "stateOfCharge"), "", metadata("ratio", "State of Charge")),
+      time_remaining_output_(battery_path(config, "capacity.timeRemaining"), "",
+                             metadata("s", "Time to empty at the current load")),
+      time_to_full_output_(battery_path(config, "capacity.timeToFull"), "",
+                           metadata("s", "Time to full at the current charge current")),
+      charge_efficiency_output_(battery_path(config, "ah/chargeEfficiency"), "",
+                                metadata("%", "Charge Efficiency")),
+      discharge_efficiency_output_(battery_path(config, "ah/dischargeEfficiency"), "",
+                                   metadata("%", "Discharge Efficiency")),
+      capacity_output_(battery_path(config, "ah/capacity"), "", metadata("Ah", "Current Capacity")),
+      marked_capacity_output_(battery_path(config, "ah/markedCapacity"), "",
+                              metadata("Ah", "Marked Capacity")),
+      ah_input_(battery_path(config, "ah")),
+      charge_efficiency_input_(battery_path(config, "ah/chargeEfficiency")),
+      discharge_efficiency_input_(battery_path(config, "ah/dischargeEfficiency")),
+      capacity_input_(battery_path(config, "ah/capacity")),
+      marked_capacity_input_(battery_path(config, "ah/markedCapacity")),
+      ah_consumer_([this](float value) { set_ah(value); }),
+      charge_efficiency_consumer_([this](float value) { integrator_.set_charge_efficiency(value); }),
+      discharge_efficiency_consumer_([this](float value) { integrator_.set_discharge_efficiency(value); }),
+      capacity_consumer_([this](float value) { integrator_.set_current_capacity_ah(value); }),
+      marked_capacity_consumer_([this](float value) { integrator_.set_marked_capacity_ah(value); }) {
+  sampler_.connect_to(this);
+  if (config.crank_capture) {
+    crank_ = pipeline_arena()->create<CrankCapture>(
+        BATTERY_CRANK_TRIGGER_V, BATTERY_CRANK_TRIGGER_A, BATTERY_CRANK_CAPTURE_MS, BATTERY_CRANK_MAX_POINTS,
+        pipeline_arena()->create_array<CrankCapture::Point>(BATTERY_CRANK_MAX_POINTS));
+    sampler_.set_crank_capture(crank_);
+    for (size_t i = 0; i < kCrankOutputCount; i++) {
+      crank_outputs_[i] =
+          arena_output(battery_path(config, kCrankOutputs[i].leaf), kCrankOutputs[i].units, kCrankOutputs[i].description);
+    }
+  }
+#if BATTERY_DIAGNOSTICS
+  sampler_.set_read_histogram(&i2c_read_time_);
+#endif
+#if !BATTERY_LOG
+  (void)log_max_bytes;
+#endif
+#ifdef BATTERY_SOC_EKF
+  // Filter starts from the restored (or initial) Ah; nothing to persist
+  reset_soc_filter();
+#endif
+
+  // PUTs go to the setters only (set_ah() clamps and persists); the
+  // integrator's own set() takes current samples.
+  ah_input_.connect_to(&ah_consumer_);
+  charge_efficiency_input_.connect_to(&charge_efficiency_consumer_);
+  discharge_efficiency_input_.connect_to(&discharge_efficiency_consumer_);
+  capacity_input_.connect_to(&capacity_consumer_);
+  marked_capacity_input_.connect_to(&marked_capacity_consumer_);
+}
+
+void BatteryMonitor::begin() {
+  // An absent chip is retried by the bank
+  bring_up();
+  sampler_.begin();
+#if BATTERY_LOG
+  log_.begin();
+#endif
+}
+
+bool BatteryMonitor::bring_up() {
+  // Averaging and conversion times are set by the sampler
+  bool online = ina_.begin(config_.shunt_resistance, config_.current_lsb_ma / 1000.0f) && sampler_.configure();
+  ina_.bus()->set_online(ina_.device(), online);
+  return online;
+}
+
+BatterySettings BatteryMonitor::settings() const {
+  BatterySettings settings;
+  settings.ah = static_cast<float>(integrator_.get_ah());
+  settings.charge_efficiency = integrator_.get_charge_efficiency();
+  settings.discharge_efficiency = integrator_.get_discharge_efficiency();
+  settings.capacity_ah = integrator_.get_current_capacity_ah();
+  settings.marked_capacity_ah = integrator_.get_marked_capacity_ah();
+  return settings;
+}
+
+bool BatteryMonitor::apply_settings(const BatterySettings& settings) {
+  bool changed = false;
+  if (!std::isnan(settings.capacity_ah)) {
+    integrator_.set_current_capacity_ah(settings.capacity_ah);
+    changed = true;
+  }
+  if (!std::isnan(settings.marked_capacity_ah)) {
+    integrator_.set_marked_capacity_ah(settings.marked_capacity_ah);
+    changed = true;
+  }
+  if (!std::isnan(settings.charge_efficiency)) {
+    integrator_.set_charge_efficiency(settings.charge_efficiency);
+    changed = true;
+  }
+  if (!std::isnan(settings.discharge_efficiency)) {
+    integrator_.set_discharge_efficiency(settings.discharge_efficiency);
+    changed = true;
+  }
+  if (!std::isnan(settings.ah)) {
+    set_ah(settings.ah);
+    changed = true;
+  }
+  return changed;
+}
+
+void BatteryMonitor::set_ah(float ah) {
+  integrator_.set_ah(ah);
+#ifdef BATTERY_SOC_EKF
+  // A set Ah is a calibration: restart the filter from it
+  reset_soc_filter();
+#endif
+}
+
+#ifdef BATTERY_SOC_EKF
+void BatteryMonitor::reset_soc_filter() {
+  soc_filter_.set_capacity_ah(integrator_.get_current_capacity_ah());
+  soc_filter_.set_efficiencies(integrator_.get_charge_efficiency(), integrator_.get_discharge_efficiency());
+  soc_filter_.reset(soc_percent(integrator_.get_ah(), integrator_.get_current_capacity_ah()) / 100.0f);
+}
+#endif
+
+float BatteryMonitor::soc_pct() const {
+#ifdef BATTERY_SOC_EKF
+  return soc_filter_.soc() * 100.0f;
+#else
+  // SOC% = (Ah / Current Capacity) * 100, clamped to 0-100%
+  return soc_percent(integrator_.get_ah(), integrator_.get_current_capacity_ah());
+#endif
+}
+
+BankMemberState BatteryMonitor::member_state() const {
+  BankMemberState state;
+  state.voltage_v = last_sample_.voltage_v;
+  state.current_a = last_sample_.current_a;
+  state.power_w = last_sample_.power_w;
+  state.ah = integrator_.get_ah();
+  state.capacity_ah = integrator_.get_current_capacity_ah();
+  state.measured = has_sample_ && ina_.is_online();
+  return state;
+}
+
+void BatteryMonitor::add_aggregate(BankAggregate* aggregate, uint8_t slot) {
+  if (aggregate_count_ < BATTERY_VIRTUAL_BANK_MAX) {
+    aggregates_[aggregate_count_] = aggregate;
+    aggregate_slots_[aggregate_count_] = slot;
+    aggregate_count_++;
+  }
+}
+
+void BatteryMonitor::set(const BatterySample& sample) {
+#ifdef BATTERY_ACQUISITION_TASK
+  // Acquisition task: integration stays single-threaded in the event loop.
+  // Samples carry their own timestamps, so a late drain does not change the
+  // integrated Ah.
+  ring_.push(sample);
+#else
+  handle_sample(sample);
+#endif
+}
+
+#ifdef BATTERY_ACQUISITION_TASK
+void BatteryMonitor::drain() {
+  BatterySample sample;
+  while (ring_.pop(&sample)) {
+    handle_sample(sample);
+  }
+}
+#endif
+
+void BatteryMonitor::handle_sample(const BatterySample& sample) {
+  if (sample.segment_start) {
+    // The chip was (re)configured: do not bridge the time it was down
+    integrator_.restart_segment();
+    runtime_.restart_segment();
+#ifdef BATTERY_SOC_EKF
+    soc_filter_.restart_segment();
+#endif
+  }
+  last_sample_ = sample;
+  has_sample_ = true;
+  integrator_.add_sample(sample.timestamp_us, sample.current_a);
+  runtime_.add_sample(sample.timestamp_us, sample.current_a);
+  if (aggregate_count_ > 0) {
+    // Virtual banks follow in the same call (constant time per bank)
+    BankMemberState state = member_state();
+    for (size_t i = 0; i < aggregate_count_; i++) {
+      aggregates_[i]->update(aggregate_slots_[i], state);
+    }
+  }
+#ifdef BATTERY_SOC_EKF
+  {
+    DIAG_SCOPE(soc_filter_time);
+    soc_filter_.update(sample.timestamp_us, sample.current_a, sample.voltage_v);
+  }
+#endif
+#ifdef BATTERY_TELEMETRY
+  if (telemetry_ != nullptr) {
+    telemetry_->add(telemetry_index_, sample, integrator_.get_ah());
+  }
+#endif
+#if BATTERY_HISTORY
+  // Uptime from the 64-bit timer: millis() wraps after 49 days
+  history_.append(static_cast<uint32_t>(esp_timer_get_time() / 1000000), sample, integrator_.get_ah());
+#endif
+#if BATTERY_LOG
+  log_voltage_sum_ += sample.voltage_v;
+  log_current_sum_ += sample.current_a;
+  log_sample_count_++;
+#endif
+}
+
+void BatteryMonitor::set_temperature(float kelvin) {
+#ifdef BATTERY_SOC_EKF
+  soc_filter_.set_temperature_c(kelvin - 273.15f);
+#endif
+#if BATTERY_LOG
+  temperature_k_ = kelvin;
+  temperature_uptime_s_ = static_cast<uint32_t>(esp_timer_get_time() / 1000000);
+#else
+  (void)kelvin;
+#endif
+}
+
+#if BATTERY_LOG
+
+void BatteryMonitor::close_log_interval(uint32_t uptime_s, uint32_t epoch_s) {
+  if (log_sample_count_ == 0) {
+    return;  // No samples (INA226 not answering): leave a gap
+  }
+  float ah = integrator_.get_ah();
+  log_values_.voltage_v = log_voltage_sum_ / log_sample_count_;
+  log_values_.current_a = log_current_sum_ / log_sample_count_;
+  log_values_.ah = ah;
+  log_values_.soc_pct = soc_pct();
+  bool fresh = uptime_s - temperature_uptime_s_ <= BATTERY_LOG_INTERVAL_S;
+  log_values_.temperature_c = fresh ? temperature_k_ - 273.15f : NAN;
+  log_uptime_s_ = uptime_s;
+  log_epoch_s_ = epoch_s;
+  log_pending_ = true;
+  log_voltage_sum_ = 0;
+  log_current_sum_ = 0;
+  log_sample_count_ = 0;
+}
+
+void BatteryMonitor::write_log() {
+  if (log_pending_) {
+    log_.append(log_values_, log_uptime_s_, log_epoch_s_);
+    log_pending_ = false;
+  }
+}
+#endif
+
+void BatteryMonitor::publish_crank_summary() {
+  CrankCapture::Summary summary;
+  if (crank_ == nullptr || !crank_->take_completed(&summary)) {
+    return;
+  }
+  crank_uptime_s_ = static_cast<uint32_t>(esp_timer_get_time() / 1000000);
+  // Once per crank: sent right away, not through the delta emitter
+  crank_outputs_[kCrankMinVoltage]->set(summary.min_voltage_v);
+  crank_outputs_[kCrankPeakCurrent]->set(summary.peak_current_a);
+  crank_outputs_[kCrankSagDuration]->set(summary.sag_duration_s);
+  if (!std::isnan(summary.internal_resistance_ohm)) {
+    crank_outputs_[kCrankResistance]->set(summary.internal_resistance_ohm);
+  }
+}
+
+void BatteryMonitor::attach(SKDeltaEmitter& emitter) {
+  SKOutputFloat* outputs[] = {
+      &voltage_output_,           &current_output_,        &power_output_,
+      &ah_output_,                &soc_output_,            &time_remaining_output_,
+      &time_to_full_output_,      &charge_efficiency_output_, &discharge_efficiency_output_,
+      &capacity_output_,          &marked_capacity_output_,
+  };
+  static_assert(sizeof(outputs) / sizeof(outputs[0]) == kOutputCount, "kOutputCount matches the outputs");
+  for (size_t i = 0; i < kOutputCount; i++) {
+    int channel = emitter.add(outputs[i], kOutputPolicies[i]);
+    if (i == 0) {
+      first_channel_ = channel;
+    }
+  }
+}
+
+void BatteryMonitor::emit_outputs(SKDeltaEmitter& emitter) {
+  if (first_channel_ < 0) {
+    return;
+  }
+  int channel = first_channel_;
+  if (!ina_.is_online()) {
+    // No measurement: clear the values rather than repeat the last one
+    emitter.update(channel + 0, NAN);
+    emitter.update(channel + 1, NAN);
+    emitter.update(channel + 2, NAN);
+  } else if (has_sample_) {
+    emitter.update(channel + 0, last_sample_.voltage_v);
+    emitter.update(channel + 1, last_sample_.current_a);
+    emitter.update(channel + 2, last_sample_.power_w);
+  }
+
+  // Sample Ah from the integrator at the output rate (decoupled from the sample rate)
+  float ah = integrator_.get_ah();
+  emitter.update(channel + 3, ah);
+#ifdef BATTERY_SOC_EKF
+  // Capacity and efficiencies may have been PUT since the last output
+  soc_filter_.set_capacity_ah(integrator_.get_current_capacity_ah());
+  soc_filter_.set_efficiencies(integrator_.get_charge_efficiency(), integrator_.get_discharge_efficiency());
+#endif
+  emitter.update(channel + 4, soc_pct());
+  // Runtime from the averaged load, null while idle or in the other direction
+  emitter.update(channel + 5, runtime_.time_to_empty_s(ah, integrator_.get_discharge_efficiency()));
+  emitter.update(channel + 6, runtime_.time_to_full_s(ah, integrator_.get_current_capacity_ah(),
+                                                      integrator_.get_charge_efficiency()));
+
+  // Expose efficiencies and capacities so the server publishes metadata and
+  // allows PUT requests to those paths. Unchanged values only go out on the
+  // configuration heartbeat.
+  emitter.update(channel + 7, integrator_.get_charge_efficiency());
+  emitter.update(channel + 8, integrator_.get_discharge_efficiency());
+  emitter.update(channel + 9, integrator_.get_current_capacity_ah());
+  emitter.update(channel + 10, integrator_.get_marked_capacity_ah());
+}
+
+BatteryBank::BatteryBank(const BatteryConfig* configs, size_t count, I2CBus* bus, unsigned int output_interval_ms)
+    : bus_(bus),
+#if BATTERY_ADAPTIVE_ACQUISITION
+      // The poll timer runs at the fast rate; each sampler decides when it is due
+      read_interval_ms_(BATTERY_FAST_READ_INTERVAL_MS),
+#else
+      read_interval_ms_(BATTERY_FIXED_READ_INTERVAL_MS),
+#endif
+      output_interval_ms_(output_interval_ms) {
+  bool any_interrupt = false;
+  // The flash log budget is split evenly between the batteries
+  size_t log_max_bytes = BATTERY_LOG_MAX_BYTES / (count < BATTERY_BANK_MAX_MONITORS ? count : BATTERY_BANK_MAX_MONITORS);
+  for (size_t i = 0; i < count && i < BATTERY_BANK_MAX_MONITORS; i++) {
+    monitors_[count_] = pipeline_arena()->create<BatteryMonitor>(configs[i], bus, log_max_bytes);
+    monitors_[count_]->begin();
+    monitors_[count_]->attach(emitter_);
+    any_interrupt |= monitors_[count_]->sampler().is_interrupt_driven();
+    any_polled_ |= !monitors_[count_]->sampler().is_interrupt_driven();
+    any_polled_crank_ |= configs[i].crank_capture && !monitors_[count_]->sampler().is_interrupt_driven();
+    count_++;
+  }
+
+#ifdef BATTERY_ACQUISITION_TASK
+  (void)any_interrupt;
+  xTaskCreatePinnedToCore(&BatteryBank::acquisition_task, "battery_acq", BATTERY_ACQ_TASK_STACK_SIZE, this,
+                          BATTERY_ACQ_TASK_PRIORITY, &task_, BATTERY_ACQ_TASK_CORE);
+  for (size_t i = 0; i < count_; i++) {
+    monitors_[i]->sampler().set_alert_task(task_);
+  }
+  event_loop()->onRepeat(BATTERY_RING_DRAIN_INTERVAL_MS, [this]() { this->drain(); });
+#else
+  if (any_polled_) {
+    event_loop()->onRepeat(read_interval_ms_, [this]() { this->poll(); });
+  }
+  if (any_interrupt) {
+    event_loop()->onTick([this]() { this->service_alerts(); });
+  }
+  if (any_polled_crank_) {
+    event_loop()->onTick([this]() { this->service_bursts(); });
+  }
+#endif
+  event_loop()->onRepeat(output_interval_ms, [this]() { this->emit_outputs(); });
+}
+
+BatteryMonitor* BatteryBank::find(const char* name) {
+  for (size_t i = 0; i < count_; i++) {
+    if (strcmp(monitors_[i]->config().name, name) == 0) {
+      return monitors_[i];
+    }
+  }
+  return nullptr;
+}
+
+VirtualBank* BatteryBank::add_virtual_bank(const VirtualBankConfig& config) {
+  if (virtual_bank_count_ >= BATTERY_VIRTUAL_BANK_MAX) {
+    return nullptr;
+  }
+  VirtualBank* bank = pipeline_arena()->create<VirtualBank>(config, this);
+  bank->attach(emitter_);
+  virtual_banks_[virtual_bank_count_++] = bank;
+  return bank;
+}
+
+bool BatteryBank::apply_settings(const BatterySettings* settings) {
+  bool changed = false;
+  for (size_t i = 0; i < count_; i++) {
+    changed |= monitors_[i]->apply_settings(settings[i]);
+  }
+  if (!changed) {
+    return true;
+  }
+  // One commit for every battery (the setters only stage)
+  AhStateStore* store = ah_state_store();
+  uint32_t commits = store->get_commit_count();
+  store->flush();
+  return store->get_commit_count() != commits;
+}
+
+#ifdef BATTERY_TELEMETRY
+void BatteryBank::set_telemetry(TelemetryStream* stream) {
+  telemetry_ = stream;
+  for (size_t i = 0; i < count_; i++) {
+    monitors_[i]->set_telemetry(stream, static_cast<uint8_t>(i));
+  }
+}
+#endif
+
+void BatteryBank::poll() {
+  DIAG_SCOPE(poll_time);
+#if BATTERY_ADAPTIVE_ACQUISITION
+  unsigned long now = millis();
+#endif
+  for (size_t i = 0; i < count_; i++) {
+    INA226Sampler& sampler = monitors_[i]->sampler();
+    if (sampler.is_interrupt_driven() || sampler.is_bursting()) {
+      continue;
+    }
+#if BATTERY_ADAPTIVE_ACQUISITION
+    if (!sampler.is_due(now)) {
+      continue;
+    }
+#endif
+    sampler.poll();
+  }
+}
+
+void BatteryBank::retry_offline() {
+  for (size_t i = 0; i < count_; i++) {
+    INA226Device& device = monitors_[i]->device();
+    if (bus_->retry_due(device.device())) {
+      monitors_[i]->bring_up();
+    }
+  }
+}
+
+void BatteryBank::service_alerts() {
+  for (size_t i = 0; i < count_; i++) {
+    if (monitors_[i]->sampler().is_interrupt_driven()) {
+      monitors_[i]->sampler().service_alert();
+    }
+  }
+}
+
+void BatteryBank::service_bursts() {
+  uint32_t now_us = micros();
+  for (size_t i = 0; i < count_; i++) {
+    INA226Sampler& sampler = monitors_[i]->sampler();
+    if (!sampler.is_interrupt_driven() && sampler.is_burst_due(now_us)) {
+      sampler.poll();
+    }
+  }
+}
+
+#ifdef BATTERY_ACQUISITION_TASK
+void BatteryBank::acquisition_task(void* arg) {
+  static_cast<BatteryBank*>(arg)->acquire();
+}
+
+void BatteryBank::acquire() {
+  // Owns the INA226s from here on: the event loop only drains the rings
+  unsigned long last_poll_ms = millis() - read_interval_ms_;
+  for (;;) {
+    unsigned long now = millis();
+    if (any_polled_ && now - last_poll_ms >= read_interval_ms_) {
+      // Keep the poll grid unless we fell a whole interval behind
+      last_poll_ms = now - last_poll_ms >= 2 * read_interval_ms_ ? now : last_poll_ms + read_interval_ms_;
+      poll();
+    }
+    service_alerts();
+    service_bursts();
+    retry_offline();
+
+    // Sleep until the next poll is due or a conversion-ready interrupt
+    // notifies the task. Without polled monitors, wake at least once per
+    // read interval anyway.
+    unsigned long elapsed = millis() - last_poll_ms;
+    unsigned long wait_ms = read_interval_ms_;
+    if (any_polled_) {
+      wait_ms = elapsed >= read_interval_ms_ ? 0 : read_interval_ms_ - elapsed;
+    }
+    TickType_t wait_ticks = pdMS_TO_TICKS(wait_ms);
+    if (any_polled_crank_) {
+      for (size_t i = 0; i < count_; i++) {
+        if (monitors_[i]->sampler().is_bursting()) {
+          wait_ticks = 1;  // Next burst read on the next RTOS tick
+        }
+      }
+    }
+    ulTaskNotifyTake(pdTRUE, wait_ticks);
+  }
+}
+
+void BatteryBank::drain() {
+  DIAG_SCOPE(drain_time);
+  for (size_t i = 0; i < count_; i++) {
+    monitors_[i]->drain();
+  }
+}
+#endif
+
+void BatteryBank::emit_outputs() {
+#if BATTERY_DIAGNOSTICS
+  uint32_t now_us = micros();
+  if (last_output_us_ != 0) {
+    int32_t lateness_us = static_cast<int32_t>(now_us - last_output_us_ - output_interval_ms_ * 1000UL);
+    DIAG_RECORD(output_lateness, lateness_us < 0 ? -lateness_us : lateness_us);
+  }
+  last_output_us_ = now_us;
+#endif
+  DIAG_SCOPE(output_time);
+#ifdef BATTERY_ACQUISITION_TASK
+  drain();
+#endif
+  unsigned long now = millis();
+#if BATTERY_ADAPTIVE_ACQUISITION
+  // While every battery is steady, send at most every
+  // BATTERY_STEADY_OUTPUT_INTERVAL_MS; any battery in fast mode restores the
+  // full output rate
+  bool all_steady = true;
+  for (size_t i = 0; i < count_; i++) {
+    all_steady &= monitors_[i]->sampler().get_mode() == AcquisitionMode::kSteady;
+  }
+  bool emit = !all_steady || now - last_emit_ms_ >= BATTERY_STEADY_OUTPUT_INTERVAL_MS;
+#else
+  bool emit = true;
+#endif
+  if (emit) {
+    last_emit_ms_ = now;
+    for (size_t i = 0; i < count_; i++) {
+      monitors_[i]->emit_outputs(emitter_);
+    }
+    for (size_t i = 0; i < virtual_bank_count_; i++) {
+      virtual_banks_[i]->emit_outputs(emitter_);
+    }
+    // Release everything that passed its filter in this callback (one delta)
+    emitter_.flush(now);
+  }
+
+  // Persist checks ride on the output timer (AH_PERSIST_CHECK_INTERVAL_MS)
+  if (now - last_persist_check_ms_ >= AH_PERSIST_CHECK_INTERVAL_MS) {
+    last_persist_check_ms_ = now;
+    for (size_t i = 0; i < count_; i++) {
+      monitors_[i]->integrator().maybe_persist_ah();
+    }
+  }
+  for (size_t i = 0; i < count_; i++) {
+    monitors_[i]->publish_crank_summary();
+  }
+#ifdef BATTERY_TELEMETRY
+  if (telemetry_ != nullptr) {
+    telemetry_->poll(micros());
+  }
+#endif
+#ifndef BATTERY_ACQUISITION_TASK
+  retry_offline();
+#endif
+#if BATTERY_LOG
+  update_logs();
+#endif
+}
+
+#if BATTERY_LOG
+void BatteryBank::update_logs() {
+  uint32_t uptime_s = static_cast<uint32_t>(esp_timer_get_time() / 1000000);
+  if (static_cast<int32_t>(uptime_s - next_log_uptime_s_) >= 0) {
+    time_t now = time(nullptr);
+    uint32_t epoch_s = now > 1600000000 ? static_cast<uint32_t>(now) : 0;  // Clock set (NTP)?
+    for (size_t i = 0; i < count_; i++) {
+      monitors_[i]->close_log_interval(next_log_uptime_s_, epoch_s);
+    }
+    // Stay on the interval grid unless a whole interval was missed
+    next_log_uptime_s_ = uptime_s - next_log_uptime_s_ >= BATTERY_LOG_INTERVAL_S ? uptime_s + BATTERY_LOG_INTERVAL_S
+                                                                                 : next_log_uptime_s_ + BATTERY_LOG_INTERVAL_S;
+    log_pending_ = true;
+  }
+
+  // Never wait for the lock: while an HTTP export holds it, retry on the
+  // next output tick
+  if (log_pending_ && xSemaphoreTake(battery_log_mutex(), 0) == pdTRUE) {
+    for (size_t i = 0; i < count_; i++) {
+      monitors_[i]->write_log();
+    }
+    xSemaphoreGive(battery_log_mutex());
+    log_pending_ = false;
+  }
+}
+#endif
+
+}  // namespace sensesp
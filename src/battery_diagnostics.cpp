@@ -0,0 +1,181 @@
+#include "battery_diagnostics.h"
+
+#if BATTERY_DIAGNOSTICS
+
+#include <Arduino.h>
+#include <esp_heap_caps.h>
+#include "ah_journal.h"
+#include "pipeline_arena.h"
+#include "sensesp_base_app.h"
+
+namespace sensesp {
+
+DiagHistogram* DiagHistogram::head_ = nullptr;
+
+namespace {
+
+DIAG_HISTOGRAM(tick_interval, "eventLoop.tickInterval");
+
+// diagnostics.batterySensors.<name>
+String diag_path(const String& name) {
+  return String("diagnostics.batterySensors.") + name;
+}
+
+SKOutputFloat* seconds_output(const String& name, const char* description) {
+  return new SKOutputFloat(diag_path(name), "", new SKMetadata("s", description));
+}
+
+SKOutputFloat* bytes_output(const String& name, const char* description) {
+  return new SKOutputFloat(diag_path(name), "", new SKMetadata("B", description));
+}
+
+SKOutputInt* count_output(const String& name) {
+  return new SKOutputInt(diag_path(name));
+}
+
+}  // namespace
+
+BatteryDiagnostics::BatteryDiagnostics(BatteryBank* bank, unsigned int interval_ms) : bank_(bank) {
+  for (DiagHistogram* h = DiagHistogram::first(); h != nullptr; h = h->next()) {
+    histogram_count_++;
+  }
+  histograms_ = new HistogramOutputs[histogram_count_];
+  size_t index = 0;
+  for (DiagHistogram* h = DiagHistogram::first(); h != nullptr; h = h->next()) {
+    HistogramOutputs& outputs = histograms_[index++];
+    outputs.histogram = h;
+    outputs.mean = seconds_output(h->name() + ".mean", "Mean duration");
+    outputs.p99 = seconds_output(h->name() + ".p99", "99th percentile duration (bucket upper bound)");
+    outputs.max = seconds_output(h->name() + ".max", "Maximum duration");
+    outputs.count = count_output(h->name() + ".count");
+  }
+
+  monitors_ = new MonitorOutputs[bank_->size()];
+  for (size_t i = 0; i < bank_->size(); i++) {
+    String name = bank_->monitor(i).config().name;
+    monitors_[i].samples = count_output(name + ".samples");
+    monitors_[i].missed_alerts = count_output(name + ".missedAlerts");
+    monitors_[i].i2c_errors = count_output(name + ".i2cErrors");
+    monitors_[i].i2c_timeouts = count_output(name + ".i2cTimeouts");
+    monitors_[i].i2c_offline = count_output(name + ".i2cOffline");
+    monitors_[i].online = count_output(name + ".online");
+#ifdef BATTERY_ACQUISITION_TASK
+    monitors_[i].ring_overflows = count_output(name + ".ringOverflows");
+#endif
+#if BATTERY_ADAPTIVE_ACQUISITION
+    monitors_[i].mode = count_output(name + ".acquisitionMode");
+    monitors_[i].mode_switches = count_output(name + ".modeSwitches");
+    monitors_[i].sample_rate = new SKOutputFloat(diag_path(name + ".sampleRate"), "",
+                                                 new SKMetadata("Hz", "Effective sample rate"));
+    monitors_[i].last_sample_count = 0;
+#endif
+  }
+
+  heap_free_ = bytes_output("heap.free", "Free heap");
+  heap_min_free_ = bytes_output("heap.minFree", "Lowest free heap since boot");
+  heap_largest_block_ = bytes_output("heap.largestBlock", "Largest free heap block");
+  delta_messages_ = count_output("delta.messages");
+  delta_values_ = count_output("delta.values");
+  delta_suppressed_ = count_output("delta.suppressed");
+  delta_bytes_ = count_output("delta.bytes");
+  delta_unregistered_ = count_output("delta.unregistered");
+  journal_commits_ = count_output("journal.commits");
+  i2c_recoveries_ = count_output("i2c.recoveries");
+  arena_used_ = bytes_output("arena.used", "Pipeline arena bytes in use");
+  arena_overflows_ = count_output("arena.overflows");
+#ifdef BATTERY_TELEMETRY
+  if (bank_->telemetry() != nullptr) {
+    telemetry_records_ = count_output("telemetry.records");
+    telemetry_datagrams_ = count_output("telemetry.datagrams");
+    telemetry_failures_ = count_output("telemetry.sendFailures");
+  }
+#endif
+
+  event_loop()->onTick([this]() {
+    uint32_t now_us = micros();
+    if (last_tick_us_ != 0) {
+      tick_interval.record(now_us - last_tick_us_);
+    }
+    last_tick_us_ = now_us;
+  });
+  event_loop()->onRepeat(interval_ms, [this]() { this->publish(); });
+}
+
+void BatteryDiagnostics::add_onewire_bus(OneWireBus* bus) {
+  onewire_bus_ = bus;
+  onewire_crc_errors_ = count_output("onewire.crcErrors");
+  onewire_missed_reads_ = count_output("onewire.missedReads");
+}
+
+void BatteryDiagnostics::publish() {
+  for (size_t i = 0; i < histogram_count_; i++) {
+    HistogramOutputs& outputs = histograms_[i];
+    LatencyHistogram::Window window = outputs.histogram->take_window();
+    outputs.mean->set(window.mean_us / 1e6f);
+    outputs.p99->set(window.p99_us / 1e6f);
+    outputs.max->set(window.max_us / 1e6f);
+    outputs.count->set(window.count);
+  }
+
+#if BATTERY_ADAPTIVE_ACQUISITION
+  uint32_t now_us = micros();
+  float window_s = (now_us - last_publish_us_) / 1e6f;
+#endif
+  for (size_t i = 0; i < bank_->size(); i++) {
+    INA226Sampler& sampler = bank_->monitor(i).sampler();
+    monitors_[i].samples->set(sampler.get_sample_count());
+    monitors_[i].missed_alerts->set(sampler.get_missed_count());
+    INA226Device& device = bank_->monitor(i).device();
+    const I2CDeviceStats& i2c = bank_->bus()->stats(device.device());
+    monitors_[i].i2c_errors->set(i2c.nacks + i2c.bus_errors);
+    monitors_[i].i2c_timeouts->set(i2c.timeouts);
+    monitors_[i].i2c_offline->set(i2c.offline_count);
+    monitors_[i].online->set(device.is_online() ? 1 : 0);
+#ifdef BATTERY_ACQUISITION_TASK
+    monitors_[i].ring_overflows->set(bank_->monitor(i).get_ring_overflow_count());
+#endif
+#if BATTERY_ADAPTIVE_ACQUISITION
+    uint32_t sample_count = sampler.get_sample_count();
+    monitors_[i].mode->set(static_cast<int>(sampler.get_mode()));
+    monitors_[i].mode_switches->set(sampler.get_mode_switch_count());
+    if (last_publish_us_ != 0 && window_s > 0) {
+      monitors_[i].sample_rate->set((sample_count - monitors_[i].last_sample_count) / window_s);
+    }
+    monitors_[i].last_sample_count = sample_count;
+#endif
+  }
+#if BATTERY_ADAPTIVE_ACQUISITION
+  last_publish_us_ = now_us;
+#endif
+
+  heap_free_->set(esp_get_free_heap_size());
+  heap_min_free_->set(esp_get_minimum_free_heap_size());
+  heap_largest_block_->set(heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
+
+  const SKDeltaEmitter& emitter = bank_->emitter();
+  delta_messages_->set(emitter.get_message_count());
+  delta_values_->set(emitter.get_value_count());
+  delta_suppressed_->set(emitter.get_suppressed_count());
+  delta_bytes_->set(emitter.get_byte_count());
+  delta_unregistered_->set(emitter.get_unregistered_count());
+  journal_commits_->set(ah_state_store()->get_commit_count());
+  i2c_recoveries_->set(bank_->bus()->get_recovery_count());
+  arena_used_->set(pipeline_arena()->used());
+  arena_overflows_->set(pipeline_arena()->get_overflow_count());
+  if (onewire_bus_ != nullptr) {
+    onewire_crc_errors_->set(onewire_bus_->get_crc_error_count());
+    onewire_missed_reads_->set(onewire_bus_->get_missed_count());
+  }
+#ifdef BATTERY_TELEMETRY
+  TelemetryStream* telemetry = bank_->telemetry();
+  if (telemetry_records_ != nullptr) {
+    telemetry_records_->set(telemetry->get_record_count());
+    telemetry_datagrams_->set(telemetry->get_sent_count());
+    telemetry_failures_->set(telemetry->get_failed_count());
+  }
+#endif
+}
+
+}  // namespace sensesp
+
+#endif
@@ -0,0 +1,54 @@
+#include "battery_history.h"
+
+#if BATTERY_HISTORY
+
+namespace sensesp {
+
+BatteryHistory::BatteryHistory() : mutex_(xSemaphoreCreateMutex()) {}
+
+void BatteryHistory::append(uint32_t time_s, const BatterySample& sample, float ah) {
+  xSemaphoreTake(mutex_, portMAX_DELAY);
+  tiers_.append(time_s, sample.voltage_v, sample.current_a, ah);
+  xSemaphoreGive(mutex_);
+}
+
+uint32_t BatteryHistory::first_sequence(Tier tier) {
+  xSemaphoreTake(mutex_, portMAX_DELAY);
+  uint32_t sequence = tier == kRaw    ? tiers_.raw().first_sequence()
+                      : tier == kHour ? tiers_.hour().first_sequence()
+                                      : tiers_.minute().first_sequence();
+  xSemaphoreGive(mutex_);
+  return sequence;
+}
+
+template <typename Ring>
+bool BatteryHistory::copy_block(const Ring& ring, uint32_t* sequence, typename Ring::Block* block) {
+  uint32_t first = ring.first_sequence();
+  if (static_cast<int32_t>(*sequence - first) < 0) {
+    *sequence = first;  // Evicted while the reader was behind
+  }
+  if (*sequence - first >= ring.block_count()) {
+    return false;
+  }
+  *block = ring.block(*sequence - first);
+  return true;
+}
+
+bool BatteryHistory::copy_raw_block(uint32_t* sequence, HistoryTiers::RawRing::Block* block) {
+  xSemaphoreTake(mutex_, portMAX_DELAY);
+  bool copied = copy_block(tiers_.raw(), sequence, block);
+  xSemaphoreGive(mutex_);
+  return copied;
+}
+
+bool BatteryHistory::copy_aggregate_block(Tier tier, uint32_t* sequence,
+                                          HistoryTiers::AggregateRing::Block* block) {
+  xSemaphoreTake(mutex_, portMAX_DELAY);
+  bool copied = copy_block(tier == kHour ? tiers_.hour() : tiers_.minute(), sequence, block);
+  xSemaphoreGive(mutex_);
+  return copied;
+}
+
+}  // namespace sensesp
+
+#endif
@@ -0,0 +1,222 @@
+#include "battery_log.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace sensesp {
+
+namespace {
+
+int32_t saturate(int32_t value, int32_t low, int32_t high) {
+  return value < low ? low : (value > high ? high : value);
+}
+
+int32_t quantize_value(float value, float scale) {
+  return std::isnan(value) ? 0 : static_cast<int32_t>(lroundf(value * scale));
+}
+
+}  // namespace
+
+BatteryLog::BatteryLog(LogFileSystem* fs, const char* key, size_t max_bytes, uint32_t interval_s)
+    : fs_(fs), max_bytes_(max_bytes), interval_s_(interval_s) {
+  memset(key_, 0, sizeof(key_));
+  strncpy(key_, key, sizeof(key_) - 1);
+}
+
+void BatteryLog::segment_path(uint32_t sequence, char* path, size_t length) const {
+  snprintf(path, length, "%s/%s.%lu", BATTERY_LOG_DIR, key_, static_cast<unsigned long>(sequence));
+}
+
+void BatteryLog::begin() {
+  fs_->make_dir(BATTERY_LOG_DIR);
+  const size_t key_length = strlen(key_);
+  bool found = false;
+  uint32_t newest = 0;
+  stored_bytes_ = 0;
+  fs_->list(BATTERY_LOG_DIR, [&](const char* name, size_t size) {
+    if (strncmp(name, key_, key_length) != 0 || name[key_length] != '.') {
+      return;
+    }
+    uint32_t sequence = strtoul(name + key_length + 1, nullptr, 10);
+    if (!found || sequence < first_sequence_) {
+      first_sequence_ = sequence;
+    }
+    if (!found || sequence > newest) {
+      newest = sequence;
+    }
+    found = true;
+    stored_bytes_ += size;
+  });
+  next_sequence_ = found ? newest + 1 : 0;
+  if (!found) {
+    first_sequence_ = 0;
+  }
+  has_segment_ = false;
+}
+
+BatteryLog::Quantized BatteryLog::quantize(const LogValues& values) {
+  Quantized q;
+  q.voltage = quantize_value(values.voltage_v, 1000.0f);
+  q.current = quantize_value(values.current_a, 100.0f);
+  q.ah = quantize_value(values.ah, 100.0f);
+  q.soc = saturate(quantize_value(values.soc_pct, 10.0f), INT16_MIN, INT16_MAX);
+  q.temperature = std::isnan(values.temperature_c)
+                      ? kNoTemperature
+                      : saturate(quantize_value(values.temperature_c, 10.0f), INT16_MIN + 1, INT16_MAX);
+  return q;
+}
+
+bool BatteryLog::encode(const Quantized& values, LogRecord* record) {
+  if (values.temperature != kNoTemperature && last_.temperature == kNoTemperature) {
+    return false;  // A first temperature reading needs an absolute value
+  }
+  int32_t voltage = saturate(values.voltage - last_.voltage, INT16_MIN, INT16_MAX);
+  int32_t current = saturate(values.current - last_.current, INT16_MIN, INT16_MAX);
+  int32_t ah = saturate(values.ah - last_.ah, INT16_MIN, INT16_MAX);
+  int32_t soc = saturate(values.soc - last_.soc, INT8_MIN, INT8_MAX);
+  record->voltage = voltage;
+  record->current = current;
+  record->ah = ah;
+  record->soc = soc;
+  // Track what the decoder will see, so saturation errors are corrected by
+  // the next record instead of accumulating
+  last_.voltage += voltage;
+  last_.current += current;
+  last_.ah += ah;
+  last_.soc += soc;
+  if (values.temperature == kNoTemperature) {
+    record->temperature = kNoTemperatureDelta;
+  } else {
+    int32_t temperature = saturate(values.temperature - last_.temperature, INT8_MIN + 1, INT8_MAX);
+    record->temperature = temperature;
+    last_.temperature += temperature;
+  }
+  return true;
+}
+
+void BatteryLog::append(const LogValues& values, uint32_t uptime_s, uint32_t epoch_s) {
+  Quantized q = quantize(values);
+
+  // Continue the open segment only if the record lands on its time grid
+  // (half an interval of slack) and fits
+  int32_t offset = static_cast<int32_t>(uptime_s - next_uptime_s_);
+  bool on_grid = has_segment_ && offset <= static_cast<int32_t>(interval_s_ / 2) &&
+                 offset >= -static_cast<int32_t>(interval_s_ / 2);
+  if (buffer_used_ == 0) {
+    buffer_since_s_ = uptime_s;
+  }
+  LogRecord record;
+  if (on_grid && segment_bytes_ + sizeof(LogRecord) <= BATTERY_LOG_SEGMENT_BYTES && encode(q, &record)) {
+    put(&record, sizeof(record));
+    segment_bytes_ += sizeof(record);
+    next_uptime_s_ += interval_s_;
+  } else {
+    start_segment(q, uptime_s, epoch_s);
+  }
+
+  if (buffer_used_ > 0 && uptime_s - buffer_since_s_ >= BATTERY_LOG_MAX_BUFFER_AGE_S) {
+    write_buffer();
+  }
+}
+
+void BatteryLog::start_segment(const Quantized& values, uint32_t uptime_s, uint32_t epoch_s) {
+  flush();
+  buffer_since_s_ = uptime_s;
+
+  LogSegmentHeader header = {};
+  memcpy(header.magic, "BLG1", 4);
+  header.interval_s = interval_s_;
+  header.epoch_s = epoch_s;
+  header.uptime_s = uptime_s;
+  header.voltage = values.voltage;
+  header.current = values.current;
+  header.ah = values.ah;
+  header.soc = values.soc;
+  header.temperature = values.temperature;
+
+  next_sequence_++;
+  has_segment_ = true;
+  segment_bytes_ = sizeof(header);
+  next_uptime_s_ = uptime_s + interval_s_;
+  last_ = values;
+  enforce_budget();
+  put(&header, sizeof(header));
+}
+
+void BatteryLog::put(const void* data, size_t length) {
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  while (length > 0) {
+    size_t n = length < sizeof(buffer_) - buffer_used_ ? length : sizeof(buffer_) - buffer_used_;
+    memcpy(buffer_ + buffer_used_, bytes, n);
+    buffer_used_ += n;
+    bytes += n;
+    length -= n;
+    if (buffer_used_ == sizeof(buffer_)) {
+      write_buffer();  // Full page
+    }
+  }
+}
+
+void BatteryLog::write_buffer() {
+  if (buffer_used_ == 0 || !has_segment_) {
+    return;
+  }
+  char path[48];
+  segment_path(next_sequence_ - 1, path, sizeof(path));
+  if (fs_->append(path, buffer_, buffer_used_)) {
+    stored_bytes_ += buffer_used_;
+    write_count_++;
+  }
+  // On failure the page is dropped rather than retried forever
+  buffer_used_ = 0;
+}
+
+void BatteryLog::flush() {
+  write_buffer();
+}
+
+void BatteryLog::enforce_budget() {
+  // Make room for the whole new segment by dropping the oldest ones
+  while (stored_bytes_ + BATTERY_LOG_SEGMENT_BYTES > max_bytes_ && first_sequence_ + 1 < next_sequence_) {
+    char path[48];
+    segment_path(first_sequence_, path, sizeof(path));
+    size_t size = fs_->size(path);
+    fs_->remove(path);
+    stored_bytes_ = stored_bytes_ > size ? stored_bytes_ - size : 0;
+    first_sequence_++;
+  }
+}
+
+bool BatteryLog::export_to(uint8_t* chunk, size_t chunk_size,
+                           const std::function<bool(const void*, size_t)>& sink) const {
+  char path[48];
+  for (uint32_t sequence = first_sequence_; sequence != next_sequence_; sequence++) {
+    segment_path(sequence, path, sizeof(path));
+    bool open_segment = has_segment_ && sequence + 1 == next_sequence_;
+    size_t on_flash = fs_->size(path);
+    uint32_t length = on_flash + (open_segment ? buffer_used_ : 0);
+    if (length == 0) {
+      continue;
+    }
+    if (!sink(&length, sizeof(length))) {
+      return false;
+    }
+    for (size_t offset = 0; offset < on_flash;) {
+      size_t n = fs_->read(path, offset, chunk, on_flash - offset < chunk_size ? on_flash - offset : chunk_size);
+      if (n == 0) {
+        return false;  // Shorter than its size; the frame cannot be completed
+      }
+      if (!sink(chunk, n)) {
+        return false;
+      }
+      offset += n;
+    }
+    if (open_segment && buffer_used_ > 0 && !sink(buffer_, buffer_used_)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace sensesp
@@ -0,0 +1,69 @@
+#include "battery_log_esp32.h"
+
+#if BATTERY_LOG
+
+#include <Arduino.h>
+#include <LittleFS.h>
+
+namespace sensesp {
+
+namespace {
+
+// LittleFS as mounted by SensESP (the "spiffs" partition)
+class LittleFSLogFileSystem : public LogFileSystem {
+ public:
+  bool make_dir(const char* path) override { return LittleFS.exists(path) || LittleFS.mkdir(path); }
+
+  void list(const char* dir, const std::function<void(const char* name, size_t size)>& fn) override {
+    File root = LittleFS.open(dir);
+    if (!root || !root.isDirectory()) {
+      return;
+    }
+    for (File file = root.openNextFile(); file; file = root.openNextFile()) {
+      if (!file.isDirectory()) {
+        fn(file.name(), file.size());
+      }
+    }
+  }
+
+  size_t size(const char* path) override {
+    File file = LittleFS.open(path, FILE_READ);
+    return file ? file.size() : 0;
+  }
+
+  bool append(const char* path, const void* data, size_t length) override {
+    File file = LittleFS.open(path, FILE_APPEND);
+    if (!file) {
+      return false;
+    }
+    bool written = file.write(static_cast<const uint8_t*>(data), length) == length;
+    file.close();
+    return written;
+  }
+
+  size_t read(const char* path, size_t offset, void* data, size_t length) override {
+    File file = LittleFS.open(path, FILE_READ);
+    if (!file || !file.seek(offset)) {
+      return 0;
+    }
+    return file.read(static_cast<uint8_t*>(data), length);
+  }
+
+  bool remove(const char* path) override { return LittleFS.remove(path); }
+};
+
+}  // namespace
+
+LogFileSystem* battery_log_fs() {
+  static LittleFSLogFileSystem fs;
+  return &fs;
+}
+
+SemaphoreHandle_t battery_log_mutex() {
+  static SemaphoreHandle_t mutex = xSemaphoreCreateMutex();
+  return mutex;
+}
+
+}  // namespace sensesp
+
+#endif  // BATTERY_LOG
@@ -0,0 +1,213 @@
+#include "config_http.h"
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <esp_http_server.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include "http_chunk_writer.h"
+#include "sensesp/net/http_server.h"
+#include "sensesp_app.h"
+#include "sensesp_base_app.h"
+
+namespace sensesp {
+
+namespace {
+
+struct Field {
+  const char* name;
+  float BatterySettings::*member;
+  float min;
+  float max;
+};
+
+// Same ranges as the AmpHourIntegrator setters clamp to
+constexpr Field kFields[] = {
+    {"ah", &BatterySettings::ah, 0.0f, 10000.0f},
+    {"chargeEfficiency", &BatterySettings::charge_efficiency, 0.0f, 100.0f},
+    {"dischargeEfficiency", &BatterySettings::discharge_efficiency, 0.0f, 100.0f},
+    {"capacity", &BatterySettings::capacity_ah, 0.1f, 10000.0f},
+    {"markedCapacity", &BatterySettings::marked_capacity_ah, 0.1f, 10000.0f},
+};
+
+// Hand-off from the HTTP server task to the event loop: the handler fills
+// settings and sets kPending, the event loop applies them and gives done
+enum : uint8_t { kIdle, kPending, kApplying, kDone };
+
+struct PendingConfig {
+  BatteryBank* bank;
+  BatterySettings settings[BATTERY_BANK_MAX_MONITORS];
+  std::atomic<uint8_t> state{kIdle};
+  bool persisted = false;
+  SemaphoreHandle_t done;
+};
+
+// The HTTP server handles one request at a time
+char body[CONFIG_HTTP_MAX_BODY_BYTES];
+
+int monitor_index(BatteryBank* bank, const char* name) {
+  for (size_t i = 0; i < bank->size(); i++) {
+    if (strcmp(bank->monitor(i).config().name, name) == 0) {
+      return static_cast<int>(i);
+    }
+  }
+  return -1;
+}
+
+// Fill settings from the "batteries" object; false with a message in error
+// if anything in it is not acceptable
+bool parse_settings(BatteryBank* bank, JsonObject batteries, BatterySettings* settings, char* error,
+                    size_t error_size) {
+  for (JsonPair battery : batteries) {
+    const char* name = battery.key().c_str();
+    int index = monitor_index(bank, name);
+    if (index < 0) {
+      snprintf(error, error_size, "unknown battery %s", name);
+      return false;
+    }
+    JsonObject values = battery.value().as<JsonObject>();
+    if (values.isNull()) {
+      snprintf(error, error_size, "%s: object expected", name);
+      return false;
+    }
+    for (JsonPair value : values) {
+      const char* key = value.key().c_str();
+      const Field* field = nullptr;
+      for (const Field& candidate : kFields) {
+        if (strcmp(candidate.name, key) == 0) {
+          field = &candidate;
+        }
+      }
+      if (field == nullptr) {
+        snprintf(error, error_size, "%s: unknown setting %s", name, key);
+        return false;
+      }
+      if (!value.value().is<float>()) {
+        snprintf(error, error_size, "%s.%s: number expected", name, key);
+        return false;
+      }
+      float number = value.value().as<float>();
+      if (!(number >= field->min && number <= field->max)) {
+        snprintf(error, error_size, "%s.%s: outside %g-%g", name, key, field->min, field->max);
+        return false;
+      }
+      settings[index].*(field->member) = number;
+    }
+    // Against the capacity it will have
+    const BatterySettings& battery_settings = settings[index];
+    float capacity_ah = std::isnan(battery_settings.capacity_ah)
+                            ? bank->monitor(index).integrator().get_current_capacity_ah()
+                            : battery_settings.capacity_ah;
+    if (battery_settings.ah > capacity_ah) {
+      snprintf(error, error_size, "%s.ah: above the capacity of %g Ah", name, capacity_ah);
+      return false;
+    }
+  }
+  return true;
+}
+
+esp_err_t send_settings(BatteryBank* bank, httpd_req_t* req, const char* persisted) {
+  httpd_resp_set_type(req, "application/json");
+  ChunkWriter out(req);
+  out.printf("{%s\"batteries\":{", persisted);
+  for (size_t i = 0; i < bank->size(); i++) {
+    BatteryMonitor& monitor = bank->monitor(i);
+    BatterySettings settings = monitor.settings();
+    out.printf("%s\"%s\":{\"ah\":%.3f,\"chargeEfficiency\":%.1f,\"dischargeEfficiency\":%.1f,"
+               "\"capacity\":%.1f,\"markedCapacity\":%.1f}",
+               i == 0 ? "" : ",", monitor.config().name, settings.ah, settings.charge_efficiency,
+               settings.discharge_efficiency, settings.capacity_ah, settings.marked_capacity_ah);
+  }
+  out.printf("}}\n");
+  return out.finish();
+}
+
+esp_err_t handle_put(PendingConfig* pending, httpd_req_t* req) {
+  if (req->content_len == 0) {
+    httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "JSON document required");
+    return ESP_FAIL;
+  }
+  if (req->content_len > sizeof(body)) {
+    httpd_resp_set_status(req, "413 Payload Too Large");
+    httpd_resp_sendstr(req, "document too large\n");
+    return ESP_OK;
+  }
+  size_t received = 0;
+  while (received < req->content_len) {
+    int n = httpd_req_recv(req, body + received, req->content_len - received);
+    if (n <= 0) {
+      if (n == HTTPD_SOCK_ERR_TIMEOUT) {
+        httpd_resp_send_err(req, HTTPD_408_REQ_TIMEOUT, "body not received");
+      }
+      return ESP_FAIL;
+    }
+    received += n;
+  }
+
+  JsonDocument doc;
+  if (deserializeJson(doc, body, received)) {
+    httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "invalid JSON");
+    return ESP_FAIL;
+  }
+  JsonObject batteries = doc["batteries"].as<JsonObject>();
+  if (batteries.isNull()) {
+    httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "\"batteries\" object required");
+    return ESP_FAIL;
+  }
+  BatterySettings settings[BATTERY_BANK_MAX_MONITORS];
+  char error[96];
+  if (!parse_settings(pending->bank, batteries, settings, error, sizeof(error))) {
+    httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, error);
+    return ESP_FAIL;
+  }
+
+  memcpy(pending->settings, settings, sizeof(settings));
+  pending->state.store(kPending, std::memory_order_release);
+  if (xSemaphoreTake(pending->done, pdMS_TO_TICKS(CONFIG_HTTP_APPLY_TIMEOUT_MS)) != pdTRUE) {
+    uint8_t expected = kPending;
+    if (pending->state.compare_exchange_strong(expected, kIdle)) {
+      httpd_resp_set_status(req, "503 Service Unavailable");
+      httpd_resp_sendstr(req, "event loop busy, nothing applied\n");
+      return ESP_OK;
+    }
+    // Already being applied: it finishes in one event loop step
+    xSemaphoreTake(pending->done, portMAX_DELAY);
+  }
+  bool persisted = pending->persisted;
+  pending->state.store(kIdle, std::memory_order_release);
+  return send_settings(pending->bank, req, persisted ? "\"persisted\":true," : "\"persisted\":false,");
+}
+
+void apply_pending(PendingConfig* pending) {
+  uint8_t expected = kPending;
+  if (pending->state.load(std::memory_order_acquire) != kPending ||
+      !pending->state.compare_exchange_strong(expected, kApplying)) {
+    return;
+  }
+  pending->persisted = pending->bank->apply_settings(pending->settings);
+  pending->state.store(kDone, std::memory_order_release);
+  xSemaphoreGive(pending->done);
+}
+
+}  // namespace
+
+void add_config_http_handler(BatteryBank* bank) {
+  auto* pending = new PendingConfig();
+  pending->bank = bank;
+  pending->done = xSemaphoreCreateBinary();
+  event_loop()->onTick([pending]() { apply_pending(pending); });
+
+  auto* handler = new HTTPRequestHandler((1 << HTTP_GET) | (1 << HTTP_PUT), "/api/batteries/config",
+                                         [pending](httpd_req_t* req) {
+                                           if (req->method == HTTP_PUT) {
+                                             return handle_put(pending, req);
+                                           }
+                                           return send_settings(pending->bank, req, "");
+                                         });
+  sensesp_app->get_http_server()->add_handler(handler);
+}
+
+}  // namespace sensesp
@@ -0,0 +1,209 @@
+#include "crank_capture.h"
+#include <cmath>
+
+namespace sensesp {
+
+CrankCapture::CrankCapture(float trigger_voltage_v, float trigger_current_a, uint32_t capture_ms, size_t max_points,
+                           Point* points)
+    : trigger_voltage_v_(trigger_voltage_v),
+      trigger_current_a_(trigger_current_a),
+      capture_us_(capture_ms * 1000UL),
+      max_points_(max_points > BATTERY_CRANK_PRE_TRIGGER_POINTS ? max_points : BATTERY_CRANK_PRE_TRIGGER_POINTS + 1),
+      // A supplied buffer too small for the pre-trigger samples is not used
+      owns_points_(points == nullptr || max_points != max_points_),
+      points_(owns_points_ ? new Point[max_points_] : points) {}
+
+bool CrankCapture::triggers(float voltage_v, float current_a) const {
+  return voltage_v < trigger_voltage_v_ || fabsf(current_a) > trigger_current_a_;
+}
+
+CrankCapture::Point CrankCapture::make_point(int32_t time_us, float voltage_v, float current_a) {
+  Point point;
+  point.time_us = time_us;
+  float mv = voltage_v * 1000.0f;
+  point.voltage_mv = mv <= 0.0f ? 0 : (mv >= 65535.0f ? 65535 : static_cast<uint16_t>(lroundf(mv)));
+  float da = current_a * 10.0f;
+  point.current_da = da <= -32768.0f ? INT16_MIN : (da >= 32767.0f ? INT16_MAX : static_cast<int16_t>(lroundf(da)));
+  return point;
+}
+
+void CrankCapture::push_pre_trigger(uint32_t timestamp_us, float voltage_v, float current_a) {
+  pre_[pre_head_] = make_point(0, voltage_v, current_a);
+  pre_time_us_[pre_head_] = timestamp_us;
+  pre_head_ = (pre_head_ + 1) % BATTERY_CRANK_PRE_TRIGGER_POINTS;
+  if (pre_count_ < BATTERY_CRANK_PRE_TRIGGER_POINTS) {
+    pre_count_++;
+  }
+}
+
+bool CrankCapture::add(uint32_t timestamp_us, float voltage_v, float current_a) {
+  if (std::isnan(voltage_v) || std::isnan(current_a)) {
+    return is_capturing();
+  }
+  uint8_t state = state_.load(std::memory_order_acquire);
+  switch (state) {
+    case kReading:
+      return false;
+
+    case kWaiting:
+      if (!triggers(voltage_v, current_a)) {
+        // Fails if a reader took the buffer meanwhile; retried next sample
+        state_.compare_exchange_strong(state, kArmed, std::memory_order_acq_rel);
+      }
+      push_pre_trigger(timestamp_us, voltage_v, current_a);
+      return false;
+
+    case kArmed:
+      if (!triggers(voltage_v, current_a)) {
+        push_pre_trigger(timestamp_us, voltage_v, current_a);
+        return false;
+      }
+      if (!state_.compare_exchange_strong(state, kCapturing, std::memory_order_acq_rel)) {
+        return false;  // A reader holds the buffer: this crank is missed
+      }
+      start(timestamp_us);
+      break;
+
+    default:
+      break;
+  }
+
+  // Capturing
+  int32_t time_us = static_cast<int32_t>(timestamp_us - trigger_us_);
+  points_[count_++] = make_point(time_us, voltage_v, current_a);
+  if (static_cast<uint32_t>(time_us) >= capture_us_ || count_ == max_points_) {
+    finish();
+    return false;
+  }
+  return true;
+}
+
+void CrankCapture::start(uint32_t timestamp_us) {
+  trigger_us_ = timestamp_us;
+  has_capture_ = false;
+  count_ = 0;
+  // Oldest pre-trigger sample first
+  size_t first = (pre_head_ + BATTERY_CRANK_PRE_TRIGGER_POINTS - pre_count_) % BATTERY_CRANK_PRE_TRIGGER_POINTS;
+  for (size_t i = 0; i < pre_count_; i++) {
+    size_t index = (first + i) % BATTERY_CRANK_PRE_TRIGGER_POINTS;
+    points_[count_] = pre_[index];
+    points_[count_].time_us = static_cast<int32_t>(pre_time_us_[index] - timestamp_us);
+    count_++;
+  }
+  pre_count_ = 0;
+}
+
+void CrankCapture::finish() {
+  Summary summary = {};
+  summary.trigger_us = trigger_us_;
+  summary.point_count = count_;
+
+  // Rest values from the pre-trigger samples; without any, the first point
+  size_t pre = 0;
+  double rest_v = 0;
+  double rest_a = 0;
+  while (pre < count_ && points_[pre].time_us < 0) {
+    rest_v += points_[pre].voltage_mv;
+    rest_a += points_[pre].current_da;
+    pre++;
+  }
+  if (pre == 0) {
+    rest_v = points_[0].voltage_mv;
+    rest_a = points_[0].current_da;
+    pre = 1;
+  }
+  summary.rest_voltage_v = static_cast<float>(rest_v / pre / 1000.0);
+  summary.rest_current_a = static_cast<float>(rest_a / pre / 10.0);
+
+  // Extremes, sag and a least-squares fit V = E - R * I over the capture
+  uint16_t min_mv = UINT16_MAX;
+  int32_t peak_da = 0;
+  uint32_t sag_mv = static_cast<uint32_t>(lroundf((summary.rest_voltage_v - BATTERY_CRANK_SAG_MARGIN_V) * 1000.0f));
+  bool in_sag = false;
+  int32_t sag_start_us = 0;
+  int64_t sag_us = 0;
+  double n = 0, sum_i = 0, sum_v = 0, sum_ii = 0, sum_iv = 0;
+  const double fit_limit_da = rest_a / pre - BATTERY_CRANK_FIT_MIN_DISCHARGE_A * 10.0;
+  for (size_t k = 0; k < count_; k++) {
+    const Point& point = points_[k];
+    if (point.voltage_mv < min_mv) {
+      min_mv = point.voltage_mv;
+    }
+    int32_t magnitude = point.current_da < 0 ? -point.current_da : point.current_da;
+    if (magnitude > peak_da) {
+      peak_da = magnitude;
+    }
+    bool below = point.voltage_mv < sag_mv;
+    if (below && !in_sag) {
+      sag_start_us = point.time_us;
+    } else if (!below && in_sag) {
+      sag_us += point.time_us - sag_start_us;
+    }
+    in_sag = below;
+
+    // Fit the rest samples and the discharge, not the alternator charge
+    // after the engine started (its voltage is regulated)
+    if (point.time_us >= 0 && point.current_da > fit_limit_da) {
+      continue;
+    }
+    double i = point.current_da / 10.0;
+    double v = point.voltage_mv / 1000.0;
+    n += 1;
+    sum_i += i;
+    sum_v += v;
+    sum_ii += i * i;
+    sum_iv += i * v;
+  }
+  if (in_sag && count_ > 0) {
+    sag_us += points_[count_ - 1].time_us - sag_start_us;  // Still sagging at the end of the capture
+  }
+  summary.min_voltage_v = min_mv / 1000.0f;
+  summary.peak_current_a = peak_da / 10.0f;
+  summary.sag_duration_s = sag_us / 1e6f;
+
+  double variance = sum_ii - sum_i * sum_i / n;
+  // Needs a current swing of at least a few amps for a meaningful slope
+  if (n >= 3 && variance / n >= 1.0) {
+    double slope = (sum_iv - sum_i * sum_v / n) / variance;  // dV/dI, positive = charging
+    summary.internal_resistance_ohm = static_cast<float>(fabs(slope));
+  } else {
+    summary.internal_resistance_ohm = NAN;
+  }
+
+  summary_ = summary;
+  has_capture_ = true;
+  capture_count_.fetch_add(1, std::memory_order_relaxed);
+  completed_.store(true, std::memory_order_release);
+  state_.store(kWaiting, std::memory_order_release);
+}
+
+bool CrankCapture::take_completed(Summary* summary) {
+  if (!completed_.exchange(false, std::memory_order_acquire)) {
+    return false;
+  }
+  *summary = summary_;
+  return true;
+}
+
+bool CrankCapture::begin_read() {
+  for (;;) {
+    uint8_t state = state_.load(std::memory_order_acquire);
+    if (state == kCapturing || state == kReading) {
+      return false;
+    }
+    if (state_.compare_exchange_weak(state, kReading, std::memory_order_acq_rel)) {
+      break;
+    }
+  }
+  if (!has_capture_) {
+    end_read();
+    return false;
+  }
+  return true;
+}
+
+void CrankCapture::end_read() {
+  state_.store(kWaiting, std::memory_order_release);
+}
+
+}  // namespace sensesp
@@ -0,0 +1,60 @@
+#include "crank_http.h"
+#include <Arduino.h>
+#include <esp_http_server.h>
+#include "http_chunk_writer.h"
+#include "sensesp/net/http_server.h"
+#include "sensesp_app.h"
+
+namespace sensesp {
+
+namespace {
+
+esp_err_t handle_crank(BatteryBank* bank, httpd_req_t* req) {
+  char query[64] = {};
+  char battery[24] = {};
+  if (httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK ||
+      httpd_query_key_value(query, "battery", battery, sizeof(battery)) != ESP_OK) {
+    httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "battery=<name> required");
+    return ESP_FAIL;
+  }
+  BatteryMonitor* monitor = bank->find(battery);
+  if (monitor == nullptr || monitor->crank_capture() == nullptr) {
+    httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "no crank capture for this battery");
+    return ESP_FAIL;
+  }
+  CrankCapture* crank = monitor->crank_capture();
+  if (!crank->begin_read()) {
+    httpd_resp_set_status(req, "409 Conflict");
+    httpd_resp_sendstr(req, "no complete crank capture\n");
+    return ESP_OK;
+  }
+
+  httpd_resp_set_type(req, "text/csv");
+  ChunkWriter out(req);
+  CrankCapture::Summary summary = crank->summary();
+  out.printf("# battery=%s uptime_s=%lu rest_voltage_v=%.3f rest_current_a=%.1f min_voltage_v=%.3f "
+             "peak_current_a=%.1f sag_duration_s=%.3f internal_resistance_ohm=%.5f\n",
+             battery, static_cast<unsigned long>(monitor->get_crank_uptime_s()), summary.rest_voltage_v,
+             summary.rest_current_a, summary.min_voltage_v, summary.peak_current_a, summary.sag_duration_s,
+             summary.internal_resistance_ohm);
+  out.printf("time_ms,voltage_v,current_a\n");
+  const CrankCapture::Point* points = crank->points();
+  for (size_t i = 0; i < crank->size(); i++) {
+    if (!out.printf("%.3f,%.3f,%.1f\n", points[i].time_us / 1000.0f, points[i].voltage_mv / 1000.0f,
+                    points[i].current_da / 10.0f)) {
+      break;  // Client went away
+    }
+  }
+  crank->end_read();
+  return out.finish();
+}
+
+}  // namespace
+
+void add_crank_http_handler(BatteryBank* bank) {
+  auto* handler = new HTTPRequestHandler(1 << HTTP_GET, "/api/batteries/crank",
+                                         [bank](httpd_req_t* req) { return handle_crank(bank, req); });
+  sensesp_app->get_http_server()->add_handler(handler);
+}
+
+}  // namespace sensesp
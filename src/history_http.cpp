@@ -0,0 +1,150 @@
+#include "history_http.h"
+
+#if BATTERY_HISTORY
+
+#include <Arduino.h>
+#include <esp_http_server.h>
+#include <esp_timer.h>
+#include <cstring>
+#include <ctime>
+#include "http_chunk_writer.h"
+#include "sensesp/net/http_server.h"
+#include "sensesp_app.h"
+
+namespace sensesp {
+
+namespace {
+
+uint32_t uptime_s() {
+  return static_cast<uint32_t>(esp_timer_get_time() / 1000000);
+}
+
+uint32_t epoch_now() {
+  time_t now = time(nullptr);
+  return now > 1600000000 ? static_cast<uint32_t>(now) : 0;  // Clock set (NTP)?
+}
+
+void write_raw_row(ChunkWriter& out, uint32_t time_s, const int32_t* values) {
+  out.printf("%lu,%.3f,%.2f,%.3f\n", static_cast<unsigned long>(time_s),
+             values[HistoryTiers::kRawVoltage] / HistoryTiers::kVoltageScale,
+             values[HistoryTiers::kRawCurrent] / HistoryTiers::kCurrentScale,
+             values[HistoryTiers::kRawAh] / HistoryTiers::kAhScale);
+}
+
+void write_aggregate_row(ChunkWriter& out, uint32_t time_s, const int32_t* values) {
+  float voltage = values[HistoryTiers::kVoltageMean] / HistoryTiers::kVoltageScale;
+  float current = values[HistoryTiers::kCurrentMean] / HistoryTiers::kCurrentScale;
+  out.printf("%lu,%.3f,%.3f,%.3f,%.2f,%.2f,%.2f,%.3f\n", static_cast<unsigned long>(time_s), voltage,
+             voltage - values[HistoryTiers::kVoltageBelowMean] / HistoryTiers::kVoltageScale,
+             voltage + values[HistoryTiers::kVoltageAboveMean] / HistoryTiers::kVoltageScale, current,
+             current - values[HistoryTiers::kCurrentBelowMean] / HistoryTiers::kCurrentScale,
+             current + values[HistoryTiers::kCurrentAboveMean] / HistoryTiers::kCurrentScale,
+             values[HistoryTiers::kAggregateAh] / HistoryTiers::kAhScale);
+}
+
+// Walk the tier block by block from sequence on; copy(sequence, block) takes
+// one block under the history lock
+template <typename Ring, typename CopyFn, typename RowFn>
+void stream_tier(ChunkWriter& out, bool binary, uint32_t step_s, uint32_t sequence, CopyFn copy, RowFn row) {
+  if (binary) {
+    HistoryStreamHeader header = {};
+    memcpy(header.magic, "BHS1", 4);
+    header.channels = Ring::kChannels;
+    header.block_header_bytes = offsetof(typename Ring::Block, data);
+    header.step_s = step_s;
+    header.uptime_s = uptime_s();
+    header.epoch_s = epoch_now();
+    out.write(&header, sizeof(header));
+  }
+
+  // Static: the HTTP server runs one handler at a time, and its task stack
+  // is small
+  static typename Ring::Block block;
+  while (copy(&sequence, &block)) {
+    sequence++;
+    if (binary) {
+      if (!out.write(&block, offsetof(typename Ring::Block, data) + block.used)) {
+        break;
+      }
+    } else {
+      Ring::decode(block, [&](uint32_t time_s, const int32_t* values) { row(out, time_s, values); }, step_s);
+    }
+  }
+}
+
+esp_err_t handle_history(BatteryBank* bank, httpd_req_t* req) {
+  char query[96] = {};
+  char battery[24] = {};
+  char tier[8] = "raw";
+  char format[8] = "csv";
+  if (httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK ||
+      httpd_query_key_value(query, "battery", battery, sizeof(battery)) != ESP_OK) {
+    httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "battery=<name> required");
+    return ESP_FAIL;
+  }
+  httpd_query_key_value(query, "tier", tier, sizeof(tier));
+  httpd_query_key_value(query, "format", format, sizeof(format));
+
+  BatteryMonitor* monitor = bank->find(battery);
+  if (monitor == nullptr) {
+    httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "unknown battery");
+    return ESP_FAIL;
+  }
+
+  BatteryHistory::Tier selected;
+  uint32_t step_s;
+  if (strcmp(tier, "raw") == 0) {
+    selected = BatteryHistory::kRaw;
+    step_s = 1;
+  } else if (strcmp(tier, "minute") == 0) {
+    selected = BatteryHistory::kMinute;
+    step_s = 60;
+  } else if (strcmp(tier, "hour") == 0) {
+    selected = BatteryHistory::kHour;
+    step_s = 3600;
+  } else {
+    httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "tier must be raw, minute or hour");
+    return ESP_FAIL;
+  }
+  bool binary = strcmp(format, "bin") == 0;
+
+  httpd_resp_set_type(req, binary ? "application/octet-stream" : "text/csv");
+  ChunkWriter out(req);
+  if (!binary) {
+    out.printf("# battery=%s tier=%s uptime_s=%lu epoch_s=%lu\n", battery, tier,
+               static_cast<unsigned long>(uptime_s()), static_cast<unsigned long>(epoch_now()));
+    out.printf(selected == BatteryHistory::kRaw
+                   ? "uptime_s,voltage_v,current_a,ah\n"
+                   : "uptime_s,voltage_mean,voltage_min,voltage_max,current_mean,current_min,current_max,ah\n");
+  }
+
+  BatteryHistory& history = monitor->history();
+  if (selected == BatteryHistory::kRaw) {
+    stream_tier<HistoryTiers::RawRing>(
+        out, binary, step_s, history.first_sequence(selected),
+        [&](uint32_t* sequence, HistoryTiers::RawRing::Block* block) {
+          return history.copy_raw_block(sequence, block);
+        },
+        write_raw_row);
+  } else {
+    stream_tier<HistoryTiers::AggregateRing>(
+        out, binary, step_s, history.first_sequence(selected),
+        [&](uint32_t* sequence, HistoryTiers::AggregateRing::Block* block) {
+          return history.copy_aggregate_block(selected, sequence, block);
+        },
+        write_aggregate_row);
+  }
+  return out.finish();
+}
+
+}  // namespace
+
+void add_history_http_handler(BatteryBank* bank) {
+  auto* handler = new HTTPRequestHandler(1 << HTTP_GET, "/api/batteries/history",
+                                         [bank](httpd_req_t* req) { return handle_history(bank, req); });
+  sensesp_app->get_http_server()->add_handler(handler);
+}
+
+}  // namespace sensesp
+
+#endif
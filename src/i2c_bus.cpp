@@ -0,0 +1,107 @@
+#include "i2c_bus.h"
+
+namespace sensesp {
+
+int I2CBus::add_device(uint8_t address) {
+  if (device_count_ >= I2C_MAX_DEVICES) {
+    return -1;
+  }
+  Device& device = devices_[device_count_];
+  device.address = address;
+  device.state = kBringUp;
+  device.consecutive_failures = 0;
+  device.retry_ms = I2C_RETRY_MIN_MS;
+  device.next_retry_ms = 0;
+  device.stats = {};
+  return static_cast<int>(device_count_++);
+}
+
+I2CResult I2CBus::read_register16(int device, uint8_t reg, uint16_t* value) {
+  uint8_t data[2];
+  I2CResult result = transfer(device, &reg, 1, data, 2);
+  if (result == I2CResult::kOk) {
+    *value = static_cast<uint16_t>((data[0] << 8) | data[1]);
+  }
+  return result;
+}
+
+I2CResult I2CBus::write_register16(int device, uint8_t reg, uint16_t value) {
+  uint8_t data[3] = {reg, static_cast<uint8_t>(value >> 8), static_cast<uint8_t>(value & 0xFF)};
+  return transfer(device, data, sizeof(data), nullptr, 0);
+}
+
+I2CResult I2CBus::transfer(int handle, const uint8_t* tx, size_t tx_length, uint8_t* rx, size_t rx_length) {
+  Device& device = devices_[handle];
+  if (device.state == kOffline) {
+    return I2CResult::kOffline;
+  }
+
+  I2CResult result = transport_->transfer(device.address, tx, tx_length, rx, rx_length);
+  if (result == I2CResult::kTimeout || result == I2CResult::kBusError) {
+    // A slave may hold SDA low after a reset or glitch mid-transfer: clock it
+    // free and try once more
+    count_failure(device, result);
+    transport_->recover();
+    recovery_count_++;
+    result = transport_->transfer(device.address, tx, tx_length, rx, rx_length);
+  }
+  device.stats.transactions++;
+
+  if (result == I2CResult::kOk) {
+    device.consecutive_failures = 0;
+    return result;
+  }
+  count_failure(device, result);
+  if (device.state == kOnline && device.consecutive_failures >= I2C_DEVICE_MAX_FAILURES) {
+    device.state = kOffline;
+    device.stats.offline_count++;
+    device.retry_ms = I2C_RETRY_MIN_MS;
+    device.next_retry_ms = transport_->now_ms() + device.retry_ms;
+  }
+  return result;
+}
+
+void I2CBus::count_failure(Device& device, I2CResult result) {
+  switch (result) {
+    case I2CResult::kNack:
+      device.stats.nacks++;
+      break;
+    case I2CResult::kTimeout:
+      device.stats.timeouts++;
+      break;
+    default:
+      device.stats.bus_errors++;
+      break;
+  }
+  if (device.consecutive_failures < UINT8_MAX) {
+    device.consecutive_failures++;
+  }
+}
+
+bool I2CBus::retry_due(int handle) {
+  Device& device = devices_[handle];
+  if (device.state != kOffline || static_cast<int32_t>(transport_->now_ms() - device.next_retry_ms) < 0) {
+    return false;
+  }
+  device.state = kBringUp;
+  return true;
+}
+
+void I2CBus::set_online(int handle, bool online) {
+  Device& device = devices_[handle];
+  device.consecutive_failures = 0;
+  if (online) {
+    device.state = kOnline;
+    device.retry_ms = I2C_RETRY_MIN_MS;
+    return;
+  }
+  if (device.state == kBringUp && device.next_retry_ms != 0) {
+    // Failed retry: back off further
+    device.retry_ms = device.retry_ms * 2 < I2C_RETRY_MAX_MS ? device.retry_ms * 2 : I2C_RETRY_MAX_MS;
+  }
+  device.stats.bring_up_failures++;
+  device.state = kOffline;
+  device.next_retry_ms = transport_->now_ms() + device.retry_ms;
+}
+
+}  // namespace sensesp
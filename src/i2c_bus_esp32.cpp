@@ -0,0 +1,97 @@
+#include "i2c_bus_esp32.h"
+#include <Arduino.h>
+
+namespace sensesp {
+
+namespace {
+
+// TwoWire::endTransmission() results
+constexpr uint8_t kWireOk = 0;
+constexpr uint8_t kWireAddressNack = 2;
+constexpr uint8_t kWireDataNack = 3;
+constexpr uint8_t kWireTimeout = 5;
+
+// Half an SCL period of the recovery clock (about 100 kHz)
+constexpr uint32_t kRecoveryHalfPeriodUs = 5;
+
+}  // namespace
+
+WireTransport::WireTransport(TwoWire& wire, int sda_pin, int scl_pin, uint32_t frequency_hz, uint16_t timeout_ms)
+    : wire_(wire),
+      sda_pin_(sda_pin),
+      scl_pin_(scl_pin),
+      frequency_hz_(frequency_hz),
+      timeout_ms_(timeout_ms),
+      mutex_(xSemaphoreCreateMutex()) {}
+
+void WireTransport::begin() {
+  // A slave reset mid-transfer (brown-out during a crank) can still hold SDA
+  recover();
+}
+
+I2CResult WireTransport::transfer(uint8_t address, const uint8_t* tx, size_t tx_length, uint8_t* rx,
+                                  size_t rx_length) {
+  // Every holder is bounded by the Wire timeout (and recovery), so waiting
+  // for the lock is bounded too
+  xSemaphoreTake(mutex_, portMAX_DELAY);
+  wire_.beginTransmission(address);
+  wire_.write(tx, tx_length);
+  // Repeated start before the read
+  uint8_t status = wire_.endTransmission(rx_length == 0);
+  I2CResult result = I2CResult::kOk;
+  if (status == kWireAddressNack || status == kWireDataNack) {
+    result = I2CResult::kNack;
+  } else if (status == kWireTimeout) {
+    result = I2CResult::kTimeout;
+  } else if (status != kWireOk) {
+    result = I2CResult::kBusError;
+  } else if (rx_length > 0) {
+    size_t received = wire_.requestFrom(address, static_cast<uint8_t>(rx_length));
+    if (received != rx_length) {
+      // Short read: the slave stopped answering or the read timed out
+      result = I2CResult::kTimeout;
+    }
+    for (size_t i = 0; i < rx_length && wire_.available(); i++) {
+      rx[i] = static_cast<uint8_t>(wire_.read());
+    }
+  }
+  xSemaphoreGive(mutex_);
+  return result;
+}
+
+bool WireTransport::recover() {
+  xSemaphoreTake(mutex_, portMAX_DELAY);
+  wire_.end();
+  // Clock SCL (open drain, up to 9 pulses) until the slave releases SDA,
+  // then generate a STOP: SDA low to high while SCL is high
+  pinMode(sda_pin_, INPUT_PULLUP);
+  pinMode(scl_pin_, OUTPUT_OPEN_DRAIN);
+  digitalWrite(scl_pin_, HIGH);
+  for (int i = 0; i < 9 && digitalRead(sda_pin_) == LOW; i++) {
+    digitalWrite(scl_pin_, LOW);
+    delayMicroseconds(kRecoveryHalfPeriodUs);
+    digitalWrite(scl_pin_, HIGH);
+    delayMicroseconds(kRecoveryHalfPeriodUs);
+  }
+  pinMode(sda_pin_, OUTPUT_OPEN_DRAIN);
+  digitalWrite(scl_pin_, LOW);
+  digitalWrite(sda_pin_, LOW);
+  delayMicroseconds(kRecoveryHalfPeriodUs);
+  digitalWrite(scl_pin_, HIGH);
+  delayMicroseconds(kRecoveryHalfPeriodUs);
+  digitalWrite(sda_pin_, HIGH);
+  delayMicroseconds(kRecoveryHalfPeriodUs);
+  pinMode(sda_pin_, INPUT_PULLUP);
+  bool idle = digitalRead(sda_pin_) == HIGH;
+
+  wire_.begin(sda_pin_, scl_pin_, frequency_hz_);
+  wire_.setTimeOut(timeout_ms_);
+  xSemaphoreGive(mutex_);
+  return idle;
+}
+
+uint32_t WireTransport::now_ms() {
+  return millis();
+}
+
+}  // namespace sensesp
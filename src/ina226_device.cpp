@@ -0,0 +1,68 @@
+#include "ina226_device.h"
+
+namespace sensesp {
+
+namespace {
+
+// Registers
+constexpr uint8_t kConfiguration = 0x00;
+constexpr uint8_t kBusVoltage = 0x02;
+constexpr uint8_t kCurrent = 0x04;
+constexpr uint8_t kCalibration = 0x05;
+constexpr uint8_t kMaskEnable = 0x06;
+constexpr uint8_t kManufacturerId = 0xFE;
+
+constexpr uint16_t kTexasInstruments = 0x5449;  // "TI"
+constexpr uint16_t kReset = 0x8000;
+constexpr uint16_t kConfigurationFixed = 0x4000;  // Bit 14 reads as 1
+constexpr uint16_t kShuntAndBusContinuous = 0x0007;
+constexpr uint16_t kConversionReadyAlert = 0x0400;
+constexpr float kBusVoltageLsb = 0.00125f;  // V
+
+}  // namespace
+
+bool INA226Device::begin(float shunt_resistance_ohm, float current_lsb_a) {
+  uint16_t id;
+  if (bus_->read_register16(device_, kManufacturerId, &id) != I2CResult::kOk || id != kTexasInstruments) {
+    return false;
+  }
+  if (bus_->write_register16(device_, kConfiguration, kReset) != I2CResult::kOk) {
+    return false;
+  }
+  // Datasheet: CAL = 0.00512 / (Current_LSB * R_shunt), 15 bits
+  float calibration = 0.00512f / (current_lsb_a * shunt_resistance_ohm);
+  if (calibration > 0x7FFF) {
+    calibration = 0x7FFF;
+  }
+  current_lsb_a_ = current_lsb_a;
+  return bus_->write_register16(device_, kCalibration, static_cast<uint16_t>(calibration)) == I2CResult::kOk;
+}
+
+bool INA226Device::set_timing(Average average, ConversionTime bus_conversion, ConversionTime shunt_conversion) {
+  uint16_t value = kConfigurationFixed | (average << 9) | (bus_conversion << 6) | (shunt_conversion << 3) |
+                   kShuntAndBusContinuous;
+  return bus_->write_register16(device_, kConfiguration, value) == I2CResult::kOk;
+}
+
+bool INA226Device::enable_conversion_ready_alert() {
+  return bus_->write_register16(device_, kMaskEnable, kConversionReadyAlert) == I2CResult::kOk;
+}
+
+bool INA226Device::clear_alert() {
+  uint16_t value;
+  return bus_->read_register16(device_, kMaskEnable, &value) == I2CResult::kOk;
+}
+
+bool INA226Device::read(float* voltage_v, float* current_a) {
+  uint16_t bus;
+  uint16_t current;
+  if (bus_->read_register16(device_, kBusVoltage, &bus) != I2CResult::kOk ||
+      bus_->read_register16(device_, kCurrent, &current) != I2CResult::kOk) {
+    return false;
+  }
+  *voltage_v = bus * kBusVoltageLsb;
+  *current_a = static_cast<int16_t>(current) * current_lsb_a_;
+  return true;
+}
+
+}  // namespace sensesp
@@ -0,0 +1,178 @@
+#include "ina226_sampler.h"
+#include <Arduino.h>
+#include "sensesp_base_app.h"
+
+namespace sensesp {
+
+namespace {
+
+struct ModeSettings {
+  INA226Device::Average average;
+  INA226Device::ConversionTime bus_conversion;
+  INA226Device::ConversionTime shunt_conversion;
+  unsigned int read_interval_ms;  // Polled mode (0: scheduled elsewhere)
+};
+
+enum SettingsIndex { kSteadySettings, kFastSettings, kBurstSettings, kFixedSettings };
+
+// Indexed by SettingsIndex; the first two match AcquisitionMode
+constexpr ModeSettings kModeSettings[] = {
+    {INA226Device::kAverage1024, INA226Device::k332us, INA226Device::k1100us, BATTERY_STEADY_READ_INTERVAL_MS},  // steady
+    {INA226Device::kAverage64, INA226Device::k332us, INA226Device::k588us, BATTERY_FAST_READ_INTERVAL_MS},       // fast
+    {INA226Device::kAverage4, INA226Device::k140us, INA226Device::k140us, 0},                                    // crank burst
+    {INA226Device::kAverage256, INA226Device::k1100us, INA226Device::k1100us, 0},  // fixed (no adaptive acquisition)
+};
+
+}  // namespace
+
+INA226Sampler::INA226Sampler(INA226Device& ina, int alert_pin, unsigned int poll_interval_ms)
+    : ina_(ina), alert_pin_(alert_pin), poll_interval_ms_(poll_interval_ms) {}
+
+bool INA226Sampler::configure() {
+  // The chip may have been reset (power loss): write everything again
+  applied_settings_ = -1;
+  // Nothing was measured while the chip was down (or before boot)
+  segment_start_ = true;
+  // Writing the configuration clears a conversion-ready flag still pending
+  portENTER_CRITICAL(&alert_mux_);
+  alert_pending_ = false;
+  portEXIT_CRITICAL(&alert_mux_);
+  apply_mode();
+  if (applied_settings_ < 0) {
+    return false;
+  }
+  // ALERT is open-drain, active low. Route the conversion-ready flag to it;
+  // reading the Mask/Enable register in service_alert() releases the line.
+  return alert_pin_ < 0 || ina_.enable_conversion_ready_alert();
+}
+
+void INA226Sampler::begin() {
+  if (alert_pin_ >= 0) {
+    pinMode(alert_pin_, INPUT_PULLUP);
+    attachInterruptArg(digitalPinToInterrupt(alert_pin_), &INA226Sampler::on_alert, this, FALLING);
+  }
+  if (poll_interval_ms_ == 0) {
+    return;  // Externally scheduled
+  }
+  if (alert_pin_ >= 0) {
+    // Cheap flag check every tick; all I2C traffic stays in the event loop
+    event_loop()->onTick([this]() { this->service_alert(); });
+  } else {
+    event_loop()->onRepeat(poll_interval_ms_, [this]() { this->poll(); });
+  }
+}
+
+void INA226Sampler::poll() {
+  read_sample(micros());
+}
+
+int INA226Sampler::settings_index() const {
+  if (crank_ != nullptr && crank_->is_capturing()) {
+    return kBurstSettings;
+  }
+#if BATTERY_ADAPTIVE_ACQUISITION
+  if (crank_ != nullptr) {
+    return kFastSettings;  // Watch for a crank at the fast rate
+  }
+  return static_cast<int>(mode_controller_.mode());
+#else
+  return kFixedSettings;
+#endif
+}
+
+void INA226Sampler::apply_mode() {
+  int index = settings_index();
+  if (index == applied_settings_) {
+    return;
+  }
+  const ModeSettings& settings = kModeSettings[index];
+  if (ina_.set_timing(settings.average, settings.bus_conversion, settings.shunt_conversion)) {
+    applied_settings_ = index;
+  }
+}
+
+#if BATTERY_ADAPTIVE_ACQUISITION
+bool INA226Sampler::is_due(unsigned long now_ms) const {
+  // Half a fast interval early rather than one scheduler tick late
+  unsigned int interval_ms = kModeSettings[settings_index()].read_interval_ms;
+  return now_ms - last_read_ms_ + BATTERY_FAST_READ_INTERVAL_MS / 2 >= interval_ms;
+}
+#endif
+
+bool INA226Sampler::is_burst_due(uint32_t now_us) const {
+  return is_bursting() && now_us - last_read_us_ >= BATTERY_CRANK_READ_INTERVAL_US;
+}
+
+void IRAM_ATTR INA226Sampler::on_alert(void* arg) {
+  auto* self = static_cast<INA226Sampler*>(arg);
+  portENTER_CRITICAL_ISR(&self->alert_mux_);
+  if (self->alert_pending_) {
+    self->missed_count_ = self->missed_count_ + 1;
+  }
+  self->alert_us_ = micros();
+  self->alert_pending_ = true;
+  portEXIT_CRITICAL_ISR(&self->alert_mux_);
+
+  if (self->alert_task_ != nullptr) {
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(self->alert_task_, &woken);
+    portYIELD_FROM_ISR(woken);
+  }
+}
+
+void INA226Sampler::service_alert() {
+  if (!alert_pending_) {
+    return;
+  }
+  portENTER_CRITICAL(&alert_mux_);
+  uint32_t timestamp_us = alert_us_;
+  alert_pending_ = false;
+  portEXIT_CRITICAL(&alert_mux_);
+
+  // Reading the Mask/Enable register clears the conversion-ready flag. If
+  // that fails ALERT stays low and no new edge comes: retry on the next tick.
+  if (!ina_.clear_alert()) {
+    portENTER_CRITICAL(&alert_mux_);
+    alert_pending_ = true;
+    portEXIT_CRITICAL(&alert_mux_);
+    return;
+  }
+  read_sample(timestamp_us);
+}
+
+void INA226Sampler::read_sample(uint32_t timestamp_us) {
+  BatterySample sample;
+  sample.timestamp_us = timestamp_us;
+  last_read_us_ = timestamp_us;
+#if BATTERY_ADAPTIVE_ACQUISITION
+  last_read_ms_ = millis();
+#endif
+#if BATTERY_DIAGNOSTICS
+  uint32_t read_start_us = micros();
+#endif
+  bool read = ina_.read(&sample.voltage_v, &sample.current_a);
+#if BATTERY_DIAGNOSTICS
+  if (read_histogram_ != nullptr) {
+    read_histogram_->record(micros() - read_start_us);
+  }
+#endif
+  if (!read) {
+    return;  // Counted by the bus; the chip may be going offline
+  }
+  sample.power_w = sample.voltage_v * sample.current_a;
+  sample.segment_start = segment_start_;
+  segment_start_ = false;
+  sample_count_++;
+  this->emit(sample);
+
+#if BATTERY_ADAPTIVE_ACQUISITION
+  mode_controller_.update(timestamp_us, sample.current_a);
+#endif
+  if (crank_ != nullptr) {
+    crank_->add(timestamp_us, sample.voltage_v, sample.current_a);
+  }
+  // Reconfigure right after the sample that changed the mode (no-op otherwise)
+  apply_mode();
+}
+
+}  // namespace sensesp
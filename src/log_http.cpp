@@ -0,0 +1,52 @@
+#include "log_http.h"
+
+#if BATTERY_LOG
+
+#include <Arduino.h>
+#include <esp_http_server.h>
+#include "http_chunk_writer.h"
+#include "sensesp/net/http_server.h"
+#include "sensesp_app.h"
+
+namespace sensesp {
+
+namespace {
+
+esp_err_t handle_log(BatteryBank* bank, httpd_req_t* req) {
+  char query[64] = {};
+  char battery[24] = {};
+  if (httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK ||
+      httpd_query_key_value(query, "battery", battery, sizeof(battery)) != ESP_OK) {
+    httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "battery=<name> required");
+    return ESP_FAIL;
+  }
+  BatteryMonitor* monitor = bank->find(battery);
+  if (monitor == nullptr) {
+    httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "unknown battery");
+    return ESP_FAIL;
+  }
+
+  httpd_resp_set_type(req, "application/octet-stream");
+  ChunkWriter out(req);
+  // Static: the HTTP server runs one handler at a time, and its task stack
+  // is small
+  static uint8_t chunk[1024];
+  // Appends from the event loop are held back (not blocked) meanwhile
+  xSemaphoreTake(battery_log_mutex(), portMAX_DELAY);
+  monitor->log().export_to(chunk, sizeof(chunk),
+                           [&](const void* data, size_t length) { return out.write(data, length); });
+  xSemaphoreGive(battery_log_mutex());
+  return out.finish();
+}
+
+}  // namespace
+
+void add_log_http_handler(BatteryBank* bank) {
+  auto* handler = new HTTPRequestHandler(1 << HTTP_GET, "/api/batteries/log",
+                                         [bank](httpd_req_t* req) { return handle_log(bank, req); });
+  sensesp_app->get_http_server()->add_handler(handler);
+}
+
+}  // namespace sensesp
+
+#endif
@@ -1,5 +1,16 @@
 #include <memory>
+#include "battery_bank.h"
+#include "battery_diagnostics.h"
+#include "config_http.h"
+#include "crank_http.h"
+#include "history_http.h"
+#include "i2c_bus_esp32.h"
+#include "log_http.h"
+#include "onewire_bus.h"
 #include "onewire_helper.h"
+#include "pipeline_arena.h"
+#include "telemetry_esp32.h"
+#include "virtual_bank.h"
 // Boilerplate #includes:
 #include "sensesp_app_builder.h"
 #include "sensesp/signalk/signalk_output.h"
@@ -7,7 +18,6 @@
 #include "sensesp/ui/config_item.h"
 
 // Sensor-specific #includes:
-#include "INA226.h"
 #include "sensesp_onewire/onewire_temperature.h"
 
 using namespace sensesp;
@@ -16,24 +26,93 @@ using namespace sensesp;
 // - Use GPIO numbers (ESP32): refer to pins as `ONEWIRE_PIN`, `RPM_PIN`.
 // - Use named constants to avoid magic numbers scattered through the code.
 static constexpr uint8_t ONEWIRE_PIN = 25;
+static constexpr int I2C_SDA_PIN = SDA;
+static constexpr int I2C_SCL_PIN = SCL;
 static constexpr unsigned int TEMPERATURE_READ_DELAY_MS = 2000;
-static constexpr unsigned int BATTERY_READ_INTERVAL_MS = 1000;
+
+// INA226 ALERT pins (conversion-ready interrupt). Set to the GPIO wired to the
+// chip's ALERT output to sample at the conversion rate; -1 polls at the
+// acquisition mode's read interval instead (BATTERY_STEADY_READ_INTERVAL_MS,
+// BATTERY_FAST_READ_INTERVAL_MS; BATTERY_FIXED_READ_INTERVAL_MS without
+// adaptive acquisition).
+static constexpr int HOUSE_BATTERY_ALERT_PIN = -1;
+static constexpr int STARTER_BATTERY_ALERT_PIN = -1;
 
 // Battery capacity constants (in Ah)
 static constexpr float HOUSE_BATTERY_CAPACITY_AH = 200.0f;  // House battery 200 Ah
 static constexpr float STARTER_BATTERY_CAPACITY_AH = 110.0f; // Starter battery 110 Ah
 
-// Globals
-static INA226 HouseBatteryINA(0x40);
-static INA226 StarterBatteryINA(0x41);
-
-// Helper moved to separate files
-#include "battery_helper.h"
+// Battery monitors: one row per INA226
+static constexpr BatteryConfig kBatteries[] = {
+    // name, key, I2C address, shunt (Ohm), current LSB (mA), capacity (Ah), initial Ah, ALERT pin,
+    // crank capture, chemistry, cells
+    {"house", "house", 0x40, 0.0075F, 0.250F, HOUSE_BATTERY_CAPACITY_AH, HOUSE_BATTERY_CAPACITY_AH,
+     HOUSE_BATTERY_ALERT_PIN, false, BatteryChemistry::kLeadAcid, 6},
+    {"starter", "start", 0x41, 0.0075F, 0.250F, STARTER_BATTERY_CAPACITY_AH, STARTER_BATTERY_CAPACITY_AH,
+     STARTER_BATTERY_ALERT_PIN, true, BatteryChemistry::kLeadAcid, 6},
+};
+
+// Virtual banks: combined values of member monitors as their own battery
+// instance. Members join and leave at runtime with a PUT of 1/0 to
+// electrical.batteries.<name>.members.<member> (e.g. the combiner relay);
+// the membership is persisted. None by default. Example, with both members
+// out until the relay reports closed:
+//   static constexpr const char* kCombinedMembers[] = {"house", "starter"};
+//   {"combined", "combined", kCombinedMembers, 2, 0b00},
+static constexpr VirtualBankConfig kVirtualBanks[] = {
+    // name, key, members, member count, members joined at first boot (bit per member)
+    {nullptr, nullptr, nullptr, 0, 0},  // End of table (an array cannot be empty); keep last
+};
+static constexpr size_t kVirtualBankCount = sizeof(kVirtualBanks) / sizeof(kVirtualBanks[0]) - 1;
+
+// Battery temperature probes on the OneWire bus, each fed to its battery
+// (flash log, SOC filter). To find valid Signal K paths that fit your need
+// look at this link:
+// https://signalk.org/specification/1.4.0/doc/vesselsBranch.html
+struct TemperatureProbe {
+    const char* base_name;  // Configuration paths /<base_name>/*
+    const char* sk_path;
+    const char* label;
+    int sensor_sort;
+    int linear_sort;
+    int sk_sort;
+    const char* battery;    // BatteryConfig::name
+};
+static constexpr TemperatureProbe kTemperatureProbes[] = {
+    {"houseBatteryTemperature", "electrical.batteries.house.temperature", "House Battery Temperature",
+     110, 120, 130, "house"},
+    {"starterBatteryTemperature", "electrical.batteries.starter.temperature", "Starter Battery Temperature",
+     210, 220, 230, "starter"},
+};
+static constexpr size_t kTemperatureProbeCount = sizeof(kTemperatureProbes) / sizeof(kTemperatureProbes[0]);
+
+// Everything setup() creates for the pipeline comes from one static arena
+// sized from the tables above: no heap blocks for it, and the RAM it takes
+// shows up in the link map. A size that comes out too small only costs heap
+// (diagnostics.batterySensors.arena.overflows counts the objects).
+static constexpr size_t kPipelineArenaBytes =
+    PipelineArena::arena_bytes<WireTransport>() + PipelineArena::arena_bytes<I2CBus>() +
+    battery_bank_arena_bytes(kBatteries, sizeof(kBatteries) / sizeof(kBatteries[0])) +
+    virtual_bank_arena_bytes(kVirtualBanks, kVirtualBankCount) + PipelineArena::arena_bytes<BatteryDiagnostics>() +
+    PipelineArena::arena_bytes<onewire::DallasTemperatureSensors>() + PipelineArena::arena_bytes<OneWireBus>() +
+    onewire_temp_arena_bytes(kTemperatureProbeCount) +
+    PipelineArena::arena_bytes<LambdaConsumer<float>>(kTemperatureProbeCount)
+#ifdef BATTERY_TELEMETRY
+#ifdef BATTERY_TELEMETRY_MQTT_URI
+    + PipelineArena::arena_bytes<MqttTelemetryTransport>()
+#else
+    + PipelineArena::arena_bytes<UdpTelemetryTransport>()
+#endif
+    + PipelineArena::arena_bytes<TelemetryStream>()
+#endif
+    ;
+alignas(PipelineArena::kAlignment) static uint8_t pipeline_arena_storage[kPipelineArenaBytes];
 
 void setup()
 {
     // put your setup code here, to run once:
     SetupLogging();
+    pipeline_arena()->set_storage(pipeline_arena_storage, sizeof(pipeline_arena_storage));
 
     // Create the global SensESPApp() object
     SensESPAppBuilder builder;
@@ -41,41 +120,74 @@ void setup()
                       .set_hostname("battery-sensors")
                       ->get_app();
 
-    Wire.begin();
-
-    // Read the sensor every BATTERY_READ_INTERVAL_MS
-    const unsigned int read_interval = BATTERY_READ_INTERVAL_MS;
-
-    // -------------- House Battery Voltage and current -----------------------
-    setupBatteryINA(HouseBatteryINA, read_interval, 0.0075F, 0.250F, "electrical.batteries.house.voltage",
-                    "electrical.batteries.house.current", "electrical.batteries.house.power", "electrical.batteries.house.ah", 
-                    "electrical.batteries.house.stateOfCharge", HOUSE_BATTERY_CAPACITY_AH, HOUSE_BATTERY_CAPACITY_AH, "house");
-
-    // -------------- Starter Battery Voltage and current -----------------------
-    setupBatteryINA(StarterBatteryINA, read_interval, 0.0075F, 0.250F, "electrical.batteries.starter.voltage",
-                    "electrical.batteries.starter.current", "electrical.batteries.starter.power", "electrical.batteries.starter.ah", 
-                    "electrical.batteries.starter.stateOfCharge", STARTER_BATTERY_CAPACITY_AH, STARTER_BATTERY_CAPACITY_AH, "start");
+    // All I2C traffic goes through the bus manager: per-transaction timeouts,
+    // bus recovery, and INA226s that fail are retried instead of blocking
+    auto* wire = pipeline_arena()->create<WireTransport>(Wire, I2C_SDA_PIN, I2C_SCL_PIN);
+    wire->begin();
+    auto* i2c_bus = pipeline_arena()->create<I2CBus>(wire);
+
+    // -------------- Battery voltage, current, Ah and SOC -----------------------
+    // All monitors share one polling timer and one output timer
+    auto* battery_bank = pipeline_arena()->create<BatteryBank>(kBatteries, sizeof(kBatteries) / sizeof(kBatteries[0]),
+                                                               i2c_bus);
+    for (size_t i = 0; i < kVirtualBankCount; i++) {
+        battery_bank->add_virtual_bank(kVirtualBanks[i]);
+    }
+
+#ifdef BATTERY_TELEMETRY
+    // Every sample in binary datagrams next to the Signal K deltas; decode
+    // them with tools/telemetry_sink. The rate is the sampling rate: 10 Hz
+    // in the fast acquisition mode, the conversion rate with ALERT pins.
+#ifdef BATTERY_TELEMETRY_MQTT_URI
+    auto* telemetry_transport = pipeline_arena()->create<MqttTelemetryTransport>(BATTERY_TELEMETRY_MQTT_URI,
+                                                                                 BATTERY_TELEMETRY_MQTT_TOPIC);
+#else
+    auto* telemetry_transport = pipeline_arena()->create<UdpTelemetryTransport>(BATTERY_TELEMETRY_UDP_HOST,
+                                                                                BATTERY_TELEMETRY_UDP_PORT);
+#endif
+    battery_bank->set_telemetry(pipeline_arena()->create<TelemetryStream>(telemetry_transport, esp_random()));
+#endif
+
+    // Timing, heap and traffic counters on diagnostics.batterySensors.*
+    // (compiled out with -D BATTERY_DIAGNOSTICS=0)
+    auto* diagnostics = pipeline_arena()->create<BatteryDiagnostics>(battery_bank);
+
+    // RAM history per battery on /api/batteries/history
+    // (compiled out with -D BATTERY_HISTORY=0)
+    add_history_http_handler(battery_bank);
+
+    // Size-capped 5 minute log per battery in flash on /api/batteries/log
+    // (compiled out with -D BATTERY_LOG=0)
+    add_log_http_handler(battery_bank);
+
+    // Last engine crank waveform of the starter on /api/batteries/crank;
+    // its summary goes to electrical.batteries.starter.crank.*
+    add_crank_http_handler(battery_bank);
+
+    // Every battery's Ah, efficiencies and capacities as one JSON document on
+    // /api/batteries/config; a PUT applies all of it with one flash commit
+    add_config_http_handler(battery_bank);
 
     // ############ Battery temperature sensors ##########
     constexpr uint8_t pin = ONEWIRE_PIN;
-    sensesp::onewire::DallasTemperatureSensors *dts = new sensesp::onewire::DallasTemperatureSensors(pin);
-
-    // Read the sensor every TEMPERATURE_READ_DELAY_MS
-    const unsigned int temperature_read_delay = TEMPERATURE_READ_DELAY_MS;
-
-    // Below are temperatures sampled and sent to Signal K server
-    // To find valid Signal K Paths that fits your need you look at this link:
-    // https://signalk.org/specification/1.4.0/doc/vesselsBranch.html
-
-    // Measure house battery temperature
-    add_onewire_temp(dts, temperature_read_delay, "houseBatteryTemperature",
-                     "electrical.batteries.house.temperature",
-                     "House Battery Temperature", 110, 120, 130);
-
-    // Measure starter battery temperature
-    add_onewire_temp(dts, temperature_read_delay, "starterBatteryTemperature",
-                     "electrical.batteries.starter.temperature",
-                     "Starter Battery Temperature", 210, 220, 230);
+    auto* dts = pipeline_arena()->create<sensesp::onewire::DallasTemperatureSensors>(pin);
+
+    // All probes share one bus cycle every TEMPERATURE_READ_DELAY_MS: one
+    // broadcast conversion, then the scratchpads back to back
+    auto* onewire_bus = pipeline_arena()->create<OneWireBus>(dts, TEMPERATURE_READ_DELAY_MS);
+    diagnostics->add_onewire_bus(onewire_bus);
+
+    // Temperatures sampled and sent to Signal K server, logged with the
+    // battery records and fed to the SOC filter (BATTERY_SOC_EKF)
+    for (const TemperatureProbe& probe : kTemperatureProbes) {
+        auto* temperature = add_onewire_temp(onewire_bus, probe.base_name, probe.sk_path, probe.label,
+                                             probe.sensor_sort, probe.linear_sort, probe.sk_sort);
+        BatteryMonitor* monitor = battery_bank->find(probe.battery);
+        if (monitor != nullptr) {
+            temperature->connect_to(pipeline_arena()->create<LambdaConsumer<float>>(
+                [monitor](float kelvin) { monitor->set_temperature(kelvin); }));
+        }
+    }
 }
 
 void loop()
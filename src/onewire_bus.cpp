@@ -0,0 +1,195 @@
+#include "onewire_bus.h"
+#include <Arduino.h>
+#include <cstdio>
+#include <cstring>
+#include "diagnostics.h"
+#include "pipeline_arena.h"
+#include "sensesp_base_app.h"
+
+namespace sensesp {
+
+namespace {
+
+// DS18B20 function commands
+constexpr uint8_t kConvertT = 0x44;
+constexpr uint8_t kReadScratchpad = 0xBE;
+constexpr uint8_t kWriteScratchpad = 0x4E;
+
+// Scratchpad content after power-on (85 degC), never a real reading here
+constexpr int16_t kPowerOnRaw = 0x0550;
+
+DIAG_HISTOGRAM(bus_time, "onewire.busTime");
+
+uint8_t configuration_byte(uint8_t resolution_bits) {
+  return static_cast<uint8_t>(((resolution_bits - 9) << 5) | 0x1F);
+}
+
+unsigned int conversion_time_ms(uint8_t resolution_bits) {
+  return 750 >> (12 - resolution_bits);  // 94, 188, 375, 750 ms
+}
+
+}  // namespace
+
+OneWireProbe::OneWireProbe(uint8_t resolution_bits, const String& config_path)
+    : FloatSensor(config_path),
+      resolution_bits_(resolution_bits < 9 ? 9 : (resolution_bits > 12 ? 12 : resolution_bits)) {
+  this->load();
+}
+
+bool OneWireProbe::to_json(JsonObject& root) {
+  char address[24];
+  snprintf(address, sizeof(address), "%02x:%02x:%02x:%02x:%02x:%02x:%02x:%02x", address_[0], address_[1],
+           address_[2], address_[3], address_[4], address_[5], address_[6], address_[7]);
+  root["address"] = address;
+  return true;
+}
+
+bool OneWireProbe::from_json(const JsonObject& config) {
+  if (!config["address"].is<String>()) {
+    return false;
+  }
+  String text = config["address"].as<String>();
+  unsigned int bytes[8];
+  if (sscanf(text.c_str(), "%x:%x:%x:%x:%x:%x:%x:%x", &bytes[0], &bytes[1], &bytes[2], &bytes[3], &bytes[4],
+             &bytes[5], &bytes[6], &bytes[7]) != 8) {
+    return false;
+  }
+  for (size_t i = 0; i < 8; i++) {
+    address_[i] = static_cast<uint8_t>(bytes[i]);
+  }
+  // All zeros: not assigned yet
+  has_address_ = address_[0] != 0;
+  return true;
+}
+
+OneWireBus::OneWireBus(onewire::DallasTemperatureSensors* dts, unsigned int read_interval_ms)
+    : onewire_(dts->onewire_) {
+  event_loop()->onRepeat(read_interval_ms, [this]() { this->start_cycle(); });
+}
+
+OneWireProbe* OneWireBus::add_probe(const String& config_path, uint8_t resolution_bits) {
+  if (count_ >= ONEWIRE_MAX_PROBES) {
+    return nullptr;
+  }
+  probes_[count_] = pipeline_arena()->create<OneWireProbe>(resolution_bits, config_path);
+  return probes_[count_++];
+}
+
+void OneWireBus::assign_addresses() {
+  // Probes without a configured address take unclaimed ones, in search order
+  onewire::OWDevAddr found;
+  onewire_->reset_search();
+  while (onewire_->search(found.data())) {
+    if (OneWire::crc8(found.data(), 7) != found[7]) {
+      continue;
+    }
+    bool claimed = false;
+    for (size_t i = 0; i < count_; i++) {
+      claimed |= probes_[i]->has_address_ && probes_[i]->address_ == found;
+    }
+    for (size_t i = 0; i < count_ && !claimed; i++) {
+      if (!probes_[i]->has_address_) {
+        probes_[i]->address_ = found;
+        probes_[i]->has_address_ = true;
+        probes_[i]->save();
+        claimed = true;
+      }
+    }
+  }
+  addresses_assigned_ = true;
+}
+
+void OneWireBus::start_cycle() {
+  if (busy_ || count_ == 0) {
+    return;
+  }
+  if (!addresses_assigned_) {
+    assign_addresses();
+  }
+
+  uint32_t start_us = micros();
+  if (!onewire_->reset()) {
+    // No presence pulse: nothing on the bus (or shorted)
+    missed_count_ += count_;
+    return;
+  }
+  onewire_->skip();
+  onewire_->write(kConvertT);
+  bus_time_us_ = micros() - start_us;
+
+  // Wait for the slowest probe without blocking the event loop
+  unsigned int wait_ms = 0;
+  for (size_t i = 0; i < count_; i++) {
+    unsigned int ms = conversion_time_ms(probes_[i]->resolution_bits_);
+    wait_ms = ms > wait_ms ? ms : wait_ms;
+  }
+  busy_ = true;
+  event_loop()->onDelay(wait_ms, [this]() { this->read_probes(); });
+}
+
+bool OneWireBus::read_scratchpad(const onewire::OWDevAddr& address, uint8_t* data) {
+  if (!onewire_->reset()) {
+    return false;
+  }
+  onewire_->select(address.data());
+  onewire_->write(kReadScratchpad);
+  onewire_->read_bytes(data, 9);
+  // The configuration byte has fixed bits; an absent probe reads all ones,
+  // a shorted line all zeros (which passes the CRC)
+  return OneWire::crc8(data, 8) == data[8] && (data[4] & 0x9F) == 0x1F;
+}
+
+void OneWireBus::write_configuration(const onewire::OWDevAddr& address, const uint8_t* data, uint8_t configuration) {
+  if (!onewire_->reset()) {
+    return;
+  }
+  onewire_->select(address.data());
+  onewire_->write(kWriteScratchpad);
+  onewire_->write(data[2]);  // TH and TL alarm registers unchanged
+  onewire_->write(data[3]);
+  onewire_->write(configuration);
+}
+
+void OneWireBus::read_probes() {
+  busy_ = false;
+  uint32_t start_us = micros();
+  for (size_t i = 0; i < count_; i++) {
+    OneWireProbe* probe = probes_[i];
+    if (!probe->has_address_) {
+      continue;
+    }
+    uint8_t data[9];
+    bool valid = false;
+    for (int attempt = 0; attempt < ONEWIRE_READ_ATTEMPTS && !valid; attempt++) {
+      valid = read_scratchpad(probe->address_, data);
+      if (!valid) {
+        crc_error_count_++;
+      }
+    }
+    if (!valid) {
+      probe->missed_count_++;
+      missed_count_++;
+      continue;
+    }
+
+    uint8_t configuration = configuration_byte(probe->resolution_bits_);
+    if (data[4] != configuration) {
+      // Takes effect with the next conversion
+      write_configuration(probe->address_, data, configuration);
+    }
+    int16_t raw = static_cast<int16_t>((data[1] << 8) | data[0]);
+    if (raw == kPowerOnRaw) {
+      probe->missed_count_++;  // Missed the conversion (power-on value)
+      continue;
+    }
+    // Bits below the probe's current resolution are undefined
+    uint8_t bits = 9 + ((data[4] >> 5) & 0x03);
+    raw &= static_cast<int16_t>(~((1 << (12 - bits)) - 1));
+    probe->emit(raw / 16.0f + 273.15f);
+  }
+  bus_time_us_ += micros() - start_us;
+  last_bus_time_us_ = bus_time_us_;
+  DIAG_RECORD(bus_time, bus_time_us_);
+}
+
+}  // namespace sensesp
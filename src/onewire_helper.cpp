@@ -1,41 +1,51 @@
-#include <string>
+#include <cstdio>
 
 #include "onewire_helper.h"
 
-#include "sensesp/signalk/signalk_output.h"
-#include "sensesp/transforms/linear.h"
+#include "pipeline_arena.h"
 #include "sensesp/ui/config_item.h"
-#include "sensesp_onewire/onewire_temperature.h"
 
 using namespace sensesp;
-using namespace sensesp::onewire;
 
-void add_onewire_temp(DallasTemperatureSensors* dts, unsigned int read_delay,
-                      const char* base_name, const char* signal_k_path,
-                      const char* human_label, int sensor_sort,
-                      int linear_sort, int sk_sort) {
-  const std::string onewire_cfg = std::string("/") + base_name + "/oneWire";
-  const std::string linear_cfg = std::string("/") + base_name + "/linear";
-  const std::string sk_cfg = std::string("/") + base_name + "/skPath";
-
-  auto* sensor = new OneWireTemperature(dts, read_delay, onewire_cfg.c_str());
+Linear* add_onewire_temp(OneWireBus* bus, const char* base_name,
+                         const char* signal_k_path, const char* human_label,
+                         int sensor_sort, int linear_sort, int sk_sort,
+                         uint8_t resolution_bits) {
+  // Config paths and titles are built in place: no string temporaries
+  char onewire_cfg[64];
+  char linear_cfg[64];
+  char sk_cfg[64];
+  snprintf(onewire_cfg, sizeof(onewire_cfg), "/%s/oneWire", base_name);
+  snprintf(linear_cfg, sizeof(linear_cfg), "/%s/linear", base_name);
+  snprintf(sk_cfg, sizeof(sk_cfg), "/%s/skPath", base_name);
+  char title[96];
+  char description[96];
+
+  // Same config path as the former per-probe OneWireTemperature, so the
+  // configured address is kept
+  auto* sensor = bus->add_probe(onewire_cfg, resolution_bits);
 
   ConfigItem(sensor)
       ->set_title(human_label)
       ->set_description(human_label)
       ->set_sort_order(sensor_sort);
 
-  auto* calibration = new Linear(1.0, 0.0, linear_cfg.c_str());
+  auto* calibration = pipeline_arena()->create<Linear>(1.0, 0.0, linear_cfg);
+  snprintf(title, sizeof(title), "%s Calibration", human_label);
+  snprintf(description, sizeof(description), "Calibration for the %s", human_label);
   ConfigItem(calibration)
-      ->set_title((std::string(human_label) + " Calibration").c_str())
-      ->set_description((std::string("Calibration for the ") + human_label).c_str())
+      ->set_title(title)
+      ->set_description(description)
       ->set_sort_order(linear_sort);
 
-  auto* sk_output = new SKOutputFloat(signal_k_path, sk_cfg.c_str());
+  auto* sk_output = pipeline_arena()->create<SKOutputFloat>(signal_k_path, sk_cfg);
+  snprintf(title, sizeof(title), "%s Signal K Path", human_label);
+  snprintf(description, sizeof(description), "Signal K path for the %s", human_label);
   ConfigItem(sk_output)
-      ->set_title((std::string(human_label) + " Signal K Path").c_str())
-      ->set_description((std::string("Signal K path for the ") + human_label).c_str())
+      ->set_title(title)
+      ->set_description(description)
       ->set_sort_order(sk_sort);
 
   sensor->connect_to(calibration)->connect_to(sk_output);
+  return calibration;
 }
@@ -0,0 +1,86 @@
+#include "sk_delta_emitter.h"
+#include <cmath>
+#include <cstdio>
+
+namespace sensesp {
+
+namespace {
+
+// {"updates":[{"source":{...},"timestamp":"...","values":[ ... ]}]}
+constexpr uint32_t kEnvelopeBytes = 120;
+// {"path":"","value":} plus separator
+constexpr uint32_t kValueOverheadBytes = 21;
+
+}  // namespace
+
+int SKDeltaEmitter::add(SKOutputFloat* output, const SKEmitPolicy& policy) {
+  if (channel_count_ >= SK_EMITTER_MAX_CHANNELS) {
+    unregistered_count_++;  // SK_EMITTER_MAX_CHANNELS too small
+    return -1;
+  }
+  Channel& channel = channels_[channel_count_];
+  channel.output = output;
+  channel.policy = policy;
+  channel.path_length = output->get_sk_path().length();
+  channel.staged_value = 0.0f;
+  channel.sent_value = 0.0f;
+  channel.sent_ms = 0;
+  channel.staged = false;
+  channel.ever_sent = false;
+  return channel_count_++;
+}
+
+void SKDeltaEmitter::update(int channel, float value) {
+  if (channel < 0 || static_cast<size_t>(channel) >= channel_count_) {
+    return;
+  }
+  channels_[channel].staged_value = value;
+  channels_[channel].staged = true;
+}
+
+bool SKDeltaEmitter::should_send(const Channel& channel, unsigned long now_ms) const {
+  if (!channel.ever_sent) {
+    return true;
+  }
+  if (now_ms - channel.sent_ms >= channel.policy.heartbeat_ms) {
+    return true;
+  }
+  // NaN compares unequal to everything; send once when it appears or clears
+  if (std::isnan(channel.staged_value) != std::isnan(channel.sent_value)) {
+    return true;
+  }
+  float change = std::fabs(channel.staged_value - channel.sent_value);
+  return channel.policy.deadband > 0.0f ? change >= channel.policy.deadband : change > 0.0f;
+}
+
+size_t SKDeltaEmitter::flush(unsigned long now_ms) {
+  size_t sent = 0;
+  for (size_t i = 0; i < channel_count_; i++) {
+    Channel& channel = channels_[i];
+    if (!channel.staged) {
+      continue;
+    }
+    channel.staged = false;
+    if (!should_send(channel, now_ms)) {
+      suppressed_count_++;
+      continue;
+    }
+    channel.output->set(channel.staged_value);
+    channel.sent_value = channel.staged_value;
+    channel.sent_ms = now_ms;
+    channel.ever_sent = true;
+
+    char value[24];
+    int value_length = snprintf(value, sizeof(value), "%.7g", channel.staged_value);
+    byte_count_ += kValueOverheadBytes + channel.path_length + (value_length > 0 ? value_length : 0);
+    sent++;
+  }
+  if (sent > 0) {
+    message_count_++;
+    value_count_ += sent;
+    byte_count_ += kEnvelopeBytes;
+  }
+  return sent;
+}
+
+}  // namespace sensesp
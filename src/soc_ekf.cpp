@@ -0,0 +1,248 @@
+#include "soc_ekf.h"
+#include <cmath>
+
+namespace sensesp {
+
+namespace {
+
+// ---------------- Compile-time tables ----------------
+// Written as single-return constexpr functions so they also build as C++11.
+
+struct Point {
+  float x;
+  float y;
+};
+
+// Linear interpolation between points sorted by x, clamped at both ends
+constexpr float interpolate(const Point* points, int count, float x) {
+  return count < 2 || x <= points[0].x ? points[0].y
+         : x >= points[1].x            ? interpolate(points + 1, count - 1, x)
+                                       : points[0].y + (points[1].y - points[0].y) * (x - points[0].x) /
+                                                           (points[1].x - points[0].x);
+}
+
+template <int... I>
+struct Indices {};
+template <int N, int... I>
+struct MakeIndices : MakeIndices<N - 1, N - 1, I...> {};
+template <int... I>
+struct MakeIndices<0, I...> {
+  typedef Indices<I...> type;
+};
+
+// Cell OCV at 0, 1, ... 100 % SOC and its slope (V per unit SOC, central
+// difference over +-0.5 %)
+constexpr int kOcvSteps = 100;
+struct OcvTable {
+  float volts[kOcvSteps + 1];
+  float slope[kOcvSteps + 1];
+};
+
+template <int N, int... I>
+constexpr OcvTable make_ocv_table(const Point (&points)[N], Indices<I...>) {
+  return OcvTable{{interpolate(points, N, static_cast<float>(I))...},
+                  {(interpolate(points, N, I + 0.5f) - interpolate(points, N, I - 0.5f)) * kOcvSteps...}};
+}
+
+// Resistance factor relative to 25 °C at -20, -15, ... 40 °C
+constexpr float kTableMinC = -20.0f;
+constexpr float kTableStepC = 5.0f;
+constexpr int kTemperatureSteps = 12;
+struct TemperatureTable {
+  float resistance_factor[kTemperatureSteps + 1];
+};
+
+template <int N, int... I>
+constexpr TemperatureTable make_temperature_table(const Point (&points)[N], Indices<I...>) {
+  return TemperatureTable{{interpolate(points, N, kTableMinC + I * kTableStepC)...}};
+}
+
+// Rested cell OCV (V) at SOC (%), 25 °C
+constexpr Point kLeadAcidOcv[] = {
+    {0, 1.885f},  {10, 1.918f}, {20, 1.943f}, {30, 1.968f}, {40, 1.993f}, {50, 2.017f},
+    {60, 2.040f}, {70, 2.062f}, {80, 2.083f}, {90, 2.103f}, {100, 2.122f},
+};
+constexpr Point kLiFePO4Ocv[] = {
+    {0, 2.50f},  {5, 2.90f},  {10, 3.05f}, {20, 3.20f}, {30, 3.23f}, {40, 3.25f}, {50, 3.26f},
+    {60, 3.27f}, {70, 3.29f}, {80, 3.31f}, {90, 3.33f}, {95, 3.34f}, {100, 3.40f},
+};
+
+// Internal resistance relative to 25 °C over temperature (°C)
+constexpr Point kLeadAcidResistance[] = {
+    {-20, 2.5f}, {-10, 1.9f}, {0, 1.5f}, {10, 1.2f}, {25, 1.0f}, {40, 0.9f},
+};
+constexpr Point kLiFePO4Resistance[] = {
+    {-20, 4.0f}, {-10, 2.6f}, {0, 1.8f}, {10, 1.3f}, {25, 1.0f}, {40, 0.85f},
+};
+
+constexpr OcvTable kLeadAcidOcvTable = make_ocv_table(kLeadAcidOcv, MakeIndices<kOcvSteps + 1>::type());
+constexpr OcvTable kLiFePO4OcvTable = make_ocv_table(kLiFePO4Ocv, MakeIndices<kOcvSteps + 1>::type());
+constexpr TemperatureTable kLeadAcidTemperatureTable =
+    make_temperature_table(kLeadAcidResistance, MakeIndices<kTemperatureSteps + 1>::type());
+constexpr TemperatureTable kLiFePO4TemperatureTable =
+    make_temperature_table(kLiFePO4Resistance, MakeIndices<kTemperatureSteps + 1>::type());
+
+static_assert(kLeadAcidOcvTable.volts[50] > 2.01f && kLeadAcidOcvTable.volts[50] < 2.02f, "lead-acid OCV table");
+static_assert(kLiFePO4OcvTable.slope[50] > 0.0f, "LiFePO4 OCV slope");
+static_assert(kLeadAcidTemperatureTable.resistance_factor[9] == 1.0f, "25 °C is the reference");
+
+}  // namespace
+
+// Per cell and per 100 Ah of capacity at 25 °C
+struct SocEkf::Model {
+  const float* ocv_volts;    // kOcvSteps + 1 entries
+  const float* ocv_slope;
+  const float* resistance_factor;  // kTemperatureSteps + 1 entries
+  float ocv_tempco_v_per_c;  // Change of the cell OCV per °C
+  float r0_ohm;
+  float r1_ohm;
+  float tau_s;               // R1 * C1
+  float voltage_sigma_v;     // Model and measurement error of the cell voltage
+};
+
+namespace {
+
+constexpr float kOffsetTimeS = 3600.0f;
+
+const SocEkf::Model kModels[] = {
+    // Lead-acid: slow diffusion, OCV rises slightly with temperature
+    // OCV, slope, resistance factor, tempco, R0, R1, tau, voltage sigma
+    {kLeadAcidOcvTable.volts, kLeadAcidOcvTable.slope, kLeadAcidTemperatureTable.resistance_factor, 0.0002f,
+     0.0008f, 0.0010f, 600.0f, 0.005f},
+    // LiFePO4: low resistance, fast relaxation, flat OCV
+    {kLiFePO4OcvTable.volts, kLiFePO4OcvTable.slope, kLiFePO4TemperatureTable.resistance_factor, 0.0f,
+     0.0005f, 0.0004f, 120.0f, 0.004f},
+};
+
+}  // namespace
+
+SocEkf::SocEkf(BatteryChemistry chemistry, uint8_t cells, float capacity_ah)
+    : model_(kModels[static_cast<int>(chemistry)]), cells_(cells), capacity_ah_(capacity_ah) {
+  update_circuit();
+  reset(1.0f);
+}
+
+void SocEkf::reset(float soc, float soc_sigma) {
+  soc_ = soc < 0.0f ? 0.0f : (soc > 1.0f ? 1.0f : soc);
+  v1_ = 0.0f;
+  p00_ = soc_sigma * soc_sigma;
+  p01_ = 0.0f;
+  float v1_sigma = model_.voltage_sigma_v * cells_;
+  p11_ = v1_sigma * v1_sigma;
+}
+
+void SocEkf::set_capacity_ah(float capacity_ah) {
+  if (capacity_ah != capacity_ah_) {
+    capacity_ah_ = capacity_ah;
+    update_circuit();
+  }
+}
+
+void SocEkf::set_efficiencies(float charge_pct, float discharge_pct) {
+  charge_factor_ = charge_pct / 100.0f;
+  discharge_factor_ = discharge_pct / 100.0f;
+  update_circuit();
+}
+
+void SocEkf::set_temperature_c(float celsius) {
+  temperature_c_ = std::isnan(celsius) ? 25.0f : celsius;
+  update_circuit();
+}
+
+void SocEkf::update_circuit() {
+  float position = (temperature_c_ - kTableMinC) / kTableStepC;
+  position = position < 0.0f ? 0.0f : (position > kTemperatureSteps ? kTemperatureSteps : position);
+  int index = static_cast<int>(position);
+  index = index < kTemperatureSteps ? index : kTemperatureSteps - 1;
+  const float* factors = model_.resistance_factor;
+  float factor = factors[index] + (factors[index + 1] - factors[index]) * (position - index);
+  // Resistance scales with cells in series and inversely with capacity
+  float scale = cells_ * factor * (capacity_ah_ > 0.0f ? 100.0f / capacity_ah_ : 1.0f);
+  r0_ohm_ = model_.r0_ohm * scale;
+  r1_ohm_ = model_.r1_ohm * scale;
+  tau_s_ = model_.tau_s;
+  ocv_offset_v_ = model_.ocv_tempco_v_per_c * (temperature_c_ - 25.0f) * cells_;
+  float soc_per_as = capacity_ah_ > 0.0f ? 1.0f / (3600.0f * capacity_ah_) : 0.0f;
+  charge_soc_per_as_ = charge_factor_ * soc_per_as;
+  discharge_soc_per_as_ = discharge_factor_ * soc_per_as;
+}
+
+void SocEkf::lookup_ocv(float soc, float* ocv, float* slope) const {
+  float position = soc * kOcvSteps;
+  position = position < 0.0f ? 0.0f : (position > kOcvSteps ? kOcvSteps : position);
+  int index = static_cast<int>(position);
+  index = index < kOcvSteps ? index : kOcvSteps - 1;
+  const float* volts = model_.ocv_volts;
+  const float* slopes = model_.ocv_slope;
+  float fraction = position - index;
+  *ocv = (volts[index] + (volts[index + 1] - volts[index]) * fraction) * cells_ + ocv_offset_v_;
+  *slope = (slopes[index] + (slopes[index + 1] - slopes[index]) * fraction) * cells_;
+}
+
+float SocEkf::open_circuit_voltage(float soc) const {
+  float ocv;
+  float slope;
+  lookup_ocv(soc, &ocv, &slope);
+  return ocv;
+}
+
+float SocEkf::soc_sigma() const {
+  return sqrtf(p00_);
+}
+
+bool SocEkf::update(uint32_t timestamp_us, float current_a, float voltage_v) {
+  if (std::isnan(current_a)) {
+    return false;
+  }
+  float dt_s = has_sample_ ? (timestamp_us - last_us_) * 1e-6f : 0.0f;
+  has_sample_ = true;
+  last_us_ = timestamp_us;
+
+  // Predict: coulomb counting and RC relaxation. tau / (tau + dt) stands in
+  // for exp(-dt / tau), as in RuntimeEstimator.
+  if (dt_s > 0.0f) {
+    float soc_per_as = current_a > 0.0f ? charge_soc_per_as_ : discharge_soc_per_as_;
+    soc_ += current_a * dt_s * soc_per_as;
+    soc_ = soc_ < 0.0f ? 0.0f : (soc_ > 1.0f ? 1.0f : soc_);
+    float decay = tau_s_ / (tau_s_ + dt_s);
+    v1_ = decay * v1_ + (1.0f - decay) * r1_ohm_ * current_a;
+    // A current error is mostly offset: its SOC error grows like a random
+    // walk correlated over kOffsetTimeS rather than averaging out per sample
+    float soc_noise = SOC_EKF_CURRENT_SIGMA_A * soc_per_as;
+    float v1_noise = model_.voltage_sigma_v * cells_ * 0.01f;
+    p00_ += soc_noise * soc_noise * dt_s * kOffsetTimeS;
+    p01_ *= decay;
+    p11_ = decay * decay * p11_ + v1_noise * v1_noise * dt_s;
+  }
+
+  if (std::isnan(voltage_v)) {
+    return false;
+  }
+
+  // Correct with the measured voltage: H = [dOCV/dSOC, 1]
+  float ocv;
+  float slope;
+  lookup_ocv(soc_, &ocv, &slope);
+  float innovation = voltage_v - (ocv + v1_ + r0_ohm_ * current_a);
+  float voltage_sigma = model_.voltage_sigma_v * cells_;
+  float ph0 = slope * p00_ + p01_;  // P * H^T
+  float ph1 = slope * p01_ + p11_;
+  float s = slope * ph0 + ph1 + voltage_sigma * voltage_sigma;
+  if (innovation * innovation > SOC_EKF_GATE_SIGMAS * SOC_EKF_GATE_SIGMAS * s) {
+    rejected_count_++;
+    return false;
+  }
+  float inverse_s = 1.0f / s;
+  float k0 = ph0 * inverse_s;
+  float k1 = ph1 * inverse_s;
+  soc_ += k0 * innovation;
+  soc_ = soc_ < 0.0f ? 0.0f : (soc_ > 1.0f ? 1.0f : soc_);
+  v1_ += k1 * innovation;
+  // P = (I - K H) P
+  p00_ -= k0 * ph0;
+  p01_ -= k0 * ph1;
+  p11_ -= k1 * ph1;
+  return true;
+}
+
+}  // namespace sensesp
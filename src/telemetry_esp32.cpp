@@ -0,0 +1,54 @@
+#ifdef BATTERY_TELEMETRY
+
+#include "telemetry_esp32.h"
+#include <lwip/sockets.h>
+#include <cstring>
+
+namespace sensesp {
+
+UdpTelemetryTransport::UdpTelemetryTransport(const char* host, uint16_t port) : host_(host), port_(port) {}
+
+bool UdpTelemetryTransport::send(const uint8_t* data, size_t length) {
+  if (socket_ < 0) {
+    socket_ = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (socket_ < 0) {
+      return false;
+    }
+    int broadcast = 1;
+    setsockopt(socket_, SOL_SOCKET, SO_BROADCAST, &broadcast, sizeof(broadcast));
+  }
+  struct sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port_);
+  if (inet_aton(host_, &address.sin_addr) == 0) {
+    return false;
+  }
+  // Never wait for buffer space: a full stack drops the datagram
+  return sendto(socket_, data, length, MSG_DONTWAIT, reinterpret_cast<struct sockaddr*>(&address),
+                sizeof(address)) == static_cast<int>(length);
+}
+
+MqttTelemetryTransport::MqttTelemetryTransport(const char* uri, const char* topic) : uri_(uri), topic_(topic) {}
+
+bool MqttTelemetryTransport::send(const uint8_t* data, size_t length) {
+  if (client_ == nullptr) {
+    esp_mqtt_client_config_t config;
+    memset(&config, 0, sizeof(config));
+    config.uri = uri_;
+    // A whole datagram fits the client's buffer: one write per publish
+    config.buffer_size = BATTERY_TELEMETRY_MAX_DATAGRAM_BYTES + 64;
+    config.network_timeout_ms = BATTERY_TELEMETRY_MQTT_TIMEOUT_MS;
+    client_ = esp_mqtt_client_init(&config);
+    if (client_ == nullptr) {
+      return false;
+    }
+    esp_mqtt_client_start(client_);
+  }
+  return esp_mqtt_client_publish(client_, topic_, reinterpret_cast<const char*>(data), static_cast<int>(length), 0,
+                                 0) >= 0;
+}
+
+}  // namespace sensesp
+
+#endif  // BATTERY_TELEMETRY
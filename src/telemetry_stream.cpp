@@ -0,0 +1,118 @@
+#include "telemetry_stream.h"
+#include <cstring>
+
+namespace sensesp {
+
+namespace {
+
+void put_u16(uint8_t* out, uint16_t value) {
+  out[0] = static_cast<uint8_t>(value);
+  out[1] = static_cast<uint8_t>(value >> 8);
+}
+
+void put_u32(uint8_t* out, uint32_t value) {
+  for (int i = 0; i < 4; i++) {
+    out[i] = static_cast<uint8_t>(value >> (8 * i));
+  }
+}
+
+void put_float(uint8_t* out, float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  put_u32(out, bits);
+}
+
+uint16_t get_u16(const uint8_t* in) {
+  return static_cast<uint16_t>(in[0] | (in[1] << 8));
+}
+
+uint32_t get_u32(const uint8_t* in) {
+  uint32_t value = 0;
+  for (int i = 0; i < 4; i++) {
+    value |= static_cast<uint32_t>(in[i]) << (8 * i);
+  }
+  return value;
+}
+
+float get_float(const uint8_t* in) {
+  uint32_t bits = get_u32(in);
+  float value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+}  // namespace
+
+TelemetryStream::TelemetryStream(TelemetryTransport* transport, uint32_t session, uint32_t max_latency_us)
+    : transport_(transport), session_(session), max_latency_us_(max_latency_us) {
+  memset(buffer_, 0, sizeof(buffer_));
+  buffer_[0] = 'B';
+  buffer_[1] = 'T';
+  buffer_[2] = kTelemetryVersion;
+  buffer_[3] = kTelemetryRecordBytes;
+  put_u32(buffer_ + 12, session_);
+}
+
+void TelemetryStream::add(uint8_t battery, const BatterySample& sample, float ah) {
+  if (count_ == 0) {
+    first_us_ = sample.timestamp_us;
+  }
+  uint8_t* record = buffer_ + kTelemetryHeaderBytes + count_ * kTelemetryRecordBytes;
+  put_u32(record, sample.timestamp_us);
+  record[4] = battery;
+  record[5] = 0;
+  float millivolts = sample.voltage_v * 1000.0f + 0.5f;
+  put_u16(record + 6, !(millivolts > 0.0f) ? 0 : (millivolts >= 65535.0f ? 65535 : static_cast<uint16_t>(millivolts)));
+  put_float(record + 8, sample.current_a);
+  put_float(record + 12, ah);
+  count_++;
+  record_count_++;
+
+  if (count_ == kTelemetryMaxRecords || sample.timestamp_us - first_us_ >= max_latency_us_) {
+    flush();
+  }
+}
+
+void TelemetryStream::poll(uint32_t now_us) {
+  if (count_ > 0 && now_us - first_us_ >= max_latency_us_) {
+    flush();
+  }
+}
+
+void TelemetryStream::flush() {
+  if (count_ == 0) {
+    return;
+  }
+  put_u32(buffer_ + 4, sequence_++);
+  put_u16(buffer_ + 8, static_cast<uint16_t>(count_));
+  if (transport_->send(buffer_, kTelemetryHeaderBytes + count_ * kTelemetryRecordBytes)) {
+    sent_count_++;
+  } else {
+    failed_count_++;
+  }
+  count_ = 0;
+}
+
+bool decode_telemetry_header(const uint8_t* data, size_t length, TelemetryHeader* header) {
+  if (length < kTelemetryHeaderBytes || data[0] != 'B' || data[1] != 'T' || data[2] != kTelemetryVersion ||
+      data[3] != kTelemetryRecordBytes) {
+    return false;
+  }
+  header->sequence = get_u32(data + 4);
+  header->count = get_u16(data + 8);
+  header->session = get_u32(data + 12);
+  return length == kTelemetryHeaderBytes + header->count * kTelemetryRecordBytes;
+}
+
+TelemetryRecord decode_telemetry_record(const uint8_t* data, size_t index) {
+  const uint8_t* record = data + kTelemetryHeaderBytes + index * kTelemetryRecordBytes;
+  TelemetryRecord result;
+  result.timestamp_us = get_u32(record);
+  result.battery = record[4];
+  result.voltage_v = get_u16(record + 6) / 1000.0f;
+  result.current_a = get_float(record + 8);
+  result.ah = get_float(record + 12);
+  return result;
+}
+
+}  // namespace sensesp
@@ -0,0 +1,135 @@
+#include "virtual_bank.h"
+#include <cstring>
+#include "ah_journal.h"
+#include "battery_bank.h"
+
+namespace sensesp {
+
+namespace {
+
+static_assert(BATTERY_BANK_MAX_MONITORS <= BankAggregate::kMaxMembers, "one aggregate slot per monitor");
+static_assert(BankAggregate::kMaxMembers <= 32, "one bit of AhPersistedState::members per member");
+
+// electrical.batteries.<name>.<leaf>
+String virtual_bank_path(const VirtualBankConfig& config, const String& leaf) {
+  return String("electrical.batteries.") + config.name + "." + leaf;
+}
+
+// Metadata and member objects come from the pipeline arena
+SKMetadata* metadata(const char* units, const char* description) {
+  return pipeline_arena()->create<SKMetadata>(units, description);
+}
+
+// Emission policy per output, in VirtualBank member order (as for the
+// monitors' outputs)
+constexpr SKEmitPolicy kOutputPolicies[] = {
+    {0.01f, BATTERY_SK_HEARTBEAT_MS},        // voltage (V)
+    {0.05f, BATTERY_SK_HEARTBEAT_MS},        // current (A)
+    {0.5f, BATTERY_SK_HEARTBEAT_MS},         // power (W)
+    {0.05f, BATTERY_SK_HEARTBEAT_MS},        // ah (Ah)
+    {0.1f, BATTERY_SK_HEARTBEAT_MS},         // stateOfCharge (%)
+    {0.0f, BATTERY_SK_CONFIG_HEARTBEAT_MS},  // ah/capacity (changes with membership)
+};
+static_assert(sizeof(kOutputPolicies) / sizeof(kOutputPolicies[0]) == VirtualBank::kOutputCount,
+              "one emission policy per output");
+constexpr SKEmitPolicy kMemberPolicy = {0.0f, BATTERY_SK_CONFIG_HEARTBEAT_MS};
+
+}  // namespace
+
+VirtualBank::VirtualBank(const VirtualBankConfig& config, BatteryBank* bank)
+    : config_(config),
+      bank_(bank),
+      voltage_output_(virtual_bank_path(config, "voltage"), "", metadata("V", "Voltage")),
+      current_output_(virtual_bank_path(config, "current"), "", metadata("A", "Amps")),
+      power_output_(virtual_bank_path(config, "power"), "", metadata("W", "Power")),
+      ah_output_(virtual_bank_path(config, "ah"), "", metadata("Ah", "Ampere hours")),
+      soc_output_(virtual_bank_path(config, "stateOfCharge"), "", metadata("ratio", "State of Charge")),
+      capacity_output_(virtual_bank_path(config, "ah/capacity"), "",
+                       metadata("Ah", "Combined capacity of the members")),
+      member_outputs_(pipeline_arena()->create_array<SKOutputFloat*>(config.member_count)) {
+  AhPersistedState state;
+  members_ = ah_state_store()->restore(config.key, &state) ? state.members : config.initial_members;
+  for (size_t i = 0; i < config.member_count && i < BankAggregate::kMaxMembers; i++) {
+    slots_[i] = -1;
+    for (size_t m = 0; m < bank->size(); m++) {
+      if (strcmp(bank->monitor(m).config().name, config.members[i]) == 0) {
+        slots_[i] = static_cast<int>(m);
+      }
+    }
+    String path = virtual_bank_path(config, String("members.") + config.members[i]);
+    member_outputs_[i] =
+        pipeline_arena()->create<SKOutputFloat>(path, "", metadata("", "1 if the battery is part of this bank"));
+    auto* input = pipeline_arena()->create<SKPutRequestListener<float>>(path);
+    input->connect_to(pipeline_arena()->create<LambdaConsumer<float>>(
+        [this, i](float value) { set_member(i, value >= 0.5f); }));
+    if (slots_[i] >= 0) {
+      BatteryMonitor& monitor = bank->monitor(slots_[i]);
+      monitor.add_aggregate(&aggregate_, static_cast<uint8_t>(slots_[i]));
+      if (members_ & (1UL << i)) {
+        aggregate_.join(slots_[i], monitor.member_state());
+      }
+    }
+  }
+}
+
+void VirtualBank::set_member(size_t index, bool joined) {
+  if (index >= config_.member_count || index >= BankAggregate::kMaxMembers || slots_[index] < 0) {
+    return;
+  }
+  int slot = slots_[index];
+  if (joined) {
+    aggregate_.join(slot, bank_->monitor(slot).member_state());
+  } else {
+    aggregate_.leave(slot);
+  }
+  uint32_t members = joined ? members_ | (1UL << index) : members_ & ~(1UL << index);
+  if (members != members_) {
+    // Staged only; committed with the batteries' state on the next flush
+    members_ = members;
+    AhPersistedState state;
+    state.members = members_;
+    ah_state_store()->update(config_.key, state);
+  }
+}
+
+void VirtualBank::attach(SKDeltaEmitter& emitter) {
+  SKOutputFloat* outputs[] = {
+      &voltage_output_, &current_output_, &power_output_, &ah_output_, &soc_output_, &capacity_output_,
+  };
+  static_assert(sizeof(outputs) / sizeof(outputs[0]) == kOutputCount, "kOutputCount matches the outputs");
+  for (size_t i = 0; i < kOutputCount; i++) {
+    int channel = emitter.add(outputs[i], kOutputPolicies[i]);
+    if (i == 0) {
+      first_channel_ = channel;
+    }
+  }
+  for (size_t i = 0; i < config_.member_count && i < BankAggregate::kMaxMembers; i++) {
+    emitter.add(member_outputs_[i], kMemberPolicy);
+  }
+}
+
+void VirtualBank::emit_outputs(SKDeltaEmitter& emitter) {
+  if (first_channel_ < 0) {
+    return;
+  }
+  // Members without samples (offline) do not update the aggregate
+  // themselves; take their state (and any Ah PUT since) here
+  for (size_t i = 0; i < config_.member_count && i < BankAggregate::kMaxMembers; i++) {
+    if (slots_[i] >= 0 && !bank_->monitor(slots_[i]).device().is_online()) {
+      aggregate_.update(slots_[i], bank_->monitor(slots_[i]).member_state());
+    }
+  }
+
+  int channel = first_channel_;
+  emitter.update(channel + 0, aggregate_.voltage_v());
+  emitter.update(channel + 1, aggregate_.current_a());
+  emitter.update(channel + 2, aggregate_.power_w());
+  emitter.update(channel + 3, aggregate_.ah());
+  emitter.update(channel + 4, aggregate_.soc_pct());
+  emitter.update(channel + 5, aggregate_.capacity_ah());
+  for (size_t i = 0; i < config_.member_count && i < BankAggregate::kMaxMembers; i++) {
+    emitter.update(channel + 6 + static_cast<int>(i), aggregate_.is_member(slots_[i]) ? 1.0f : 0.0f);
+  }
+}
+
+}  // namespace sensesp
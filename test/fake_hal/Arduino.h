@@ -0,0 +1,100 @@
+#pragma once
+
+// Host stand-in for the Arduino-ESP32 core (native test environment): the
+// clock runs on fake_hal's virtual time, pins and interrupts are recorded so
+// tests can raise them. See fake_hal.h for the test side.
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "freertos/FreeRTOS.h"
+
+#define IRAM_ATTR
+#define RTC_NOINIT_ATTR
+
+#define LOW 0x0
+#define HIGH 0x1
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+#define OUTPUT_OPEN_DRAIN 0x12
+#define RISING 0x01
+#define FALLING 0x02
+#define CHANGE 0x03
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+unsigned long millis();
+unsigned long micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+inline int digitalPinToInterrupt(uint8_t pin) { return pin; }
+void attachInterruptArg(uint8_t pin, void (*handler)(void*), void* arg, int mode);
+void detachInterrupt(uint8_t pin);
+
+// Subset of the Arduino String used by the firmware
+class String {
+ public:
+  String() {}
+  String(const char* text) : value_(text != nullptr ? text : "") {}
+  String(const std::string& text) : value_(text) {}
+  explicit String(char c) : value_(1, c) {}
+  explicit String(int value) : value_(std::to_string(value)) {}
+  explicit String(unsigned int value) : value_(std::to_string(value)) {}
+  explicit String(long value) : value_(std::to_string(value)) {}
+  explicit String(unsigned long value) : value_(std::to_string(value)) {}
+
+  const char* c_str() const { return value_.c_str(); }
+  unsigned int length() const { return static_cast<unsigned int>(value_.size()); }
+  bool isEmpty() const { return value_.empty(); }
+  bool reserve(unsigned int size) {
+    value_.reserve(size);
+    return true;
+  }
+  char operator[](unsigned int index) const { return index < value_.size() ? value_[index] : '\0'; }
+
+  String& operator+=(const String& other) {
+    value_ += other.value_;
+    return *this;
+  }
+  String& operator+=(const char* other) {
+    value_ += other;
+    return *this;
+  }
+  String& operator+=(char c) {
+    value_ += c;
+    return *this;
+  }
+  bool concat(const char* other) {
+    value_ += other;
+    return true;
+  }
+
+  bool operator==(const String& other) const { return value_ == other.value_; }
+  bool operator==(const char* other) const { return value_ == other; }
+  bool operator!=(const String& other) const { return value_ != other.value_; }
+  bool startsWith(const String& prefix) const { return value_.compare(0, prefix.value_.size(), prefix.value_) == 0; }
+  int indexOf(char c) const {
+    size_t index = value_.find(c);
+    return index == std::string::npos ? -1 : static_cast<int>(index);
+  }
+  String substring(unsigned int from) const { return String(value_.substr(from)); }
+  String substring(unsigned int from, unsigned int to) const { return String(value_.substr(from, to - from)); }
+  void replace(char find, char replacement) { std::replace(value_.begin(), value_.end(), find, replacement); }
+
+  friend String operator+(const String& a, const String& b) { return String(a.value_ + b.value_); }
+  friend String operator+(const String& a, const char* b) { return String(a.value_ + b); }
+  friend String operator+(const char* a, const String& b) { return String(a + b.value_); }
+
+ private:
+  std::string value_;
+};
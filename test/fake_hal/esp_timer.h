@@ -0,0 +1,6 @@
+#pragma once
+
+#include <cstdint>
+
+// Microseconds since boot on the virtual clock (64 bit, no wrap)
+int64_t esp_timer_get_time();
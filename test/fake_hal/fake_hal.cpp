@@ -0,0 +1,288 @@
+#include "fake_hal.h"
+
+#include <Arduino.h>
+#include <esp_timer.h>
+#include <freertos/semphr.h>
+
+#include <chrono>
+
+#include "battery_log_esp32.h"
+#include "diagnostics.h"
+#include "sensesp/signalk/signalk_output.h"
+#include "sensesp/signalk/signalk_put_request_listener.h"
+
+namespace fake_hal {
+
+namespace {
+
+constexpr int kMaxPins = 64;
+constexpr size_t kMaxClockListeners = 8;
+
+struct Interrupt {
+  void (*handler)(void*);
+  void* arg;
+};
+
+uint64_t clock_us = 0;
+Interrupt interrupts[kMaxPins] = {};
+uint8_t pin_levels[kMaxPins] = {};
+ClockListener* clock_listeners[kMaxClockListeners] = {};
+
+MemoryFlash flash;
+MemoryFileSystem file_system;
+
+// RTC_NOINIT memory: survives reboot(true)
+sensesp::AhRtcSnapshot::Region rtc_region;
+bool rtc_warm = false;
+
+sensesp::AhStateStore* state_store = nullptr;
+sensesp::AhRtcSnapshot* rtc_snapshot = nullptr;
+
+std::shared_ptr<reactesp::EventLoop> event_loop_instance = std::make_shared<reactesp::EventLoop>();
+
+ClockListener* next_listener(uint64_t limit_us) {
+  ClockListener* next = nullptr;
+  uint64_t next_us = limit_us;
+  for (ClockListener* listener : clock_listeners) {
+    if (listener != nullptr && listener->next_event_us() <= next_us) {
+      next = listener;
+      next_us = listener->next_event_us();
+    }
+  }
+  return next;
+}
+
+void restart() {
+  clock_us = 0;
+  for (Interrupt& interrupt : interrupts) {
+    interrupt = {};
+  }
+  event_loop_instance->clear();
+  sensesp::SKOutputFloat::clear_registry();
+  sensesp::SKPutRequestListener<float>::clear_registry();
+  delete state_store;
+  state_store = nullptr;
+  delete rtc_snapshot;
+  rtc_snapshot = nullptr;
+}
+
+}  // namespace
+
+uint64_t now_us() { return clock_us; }
+
+void advance_us(uint64_t us) {
+  uint64_t target_us = clock_us + us;
+  for (ClockListener* listener = next_listener(target_us); listener != nullptr; listener = next_listener(target_us)) {
+    uint64_t event_us = listener->next_event_us();
+    if (event_us > clock_us) {
+      clock_us = event_us;
+    }
+    listener->on_time(clock_us);
+  }
+  clock_us = target_us;
+}
+
+void run_for_ms(uint64_t ms, uint32_t step_us) {
+  uint64_t end_us = clock_us + ms * 1000;
+  while (clock_us < end_us) {
+    advance_us(end_us - clock_us < step_us ? end_us - clock_us : step_us);
+    event_loop_instance->tick();
+  }
+}
+
+void add_clock_listener(ClockListener* listener) {
+  for (ClockListener*& slot : clock_listeners) {
+    if (slot == nullptr) {
+      slot = listener;
+      return;
+    }
+  }
+}
+
+void remove_clock_listener(ClockListener* listener) {
+  for (ClockListener*& slot : clock_listeners) {
+    if (slot == listener) {
+      slot = nullptr;
+    }
+  }
+}
+
+bool raise_interrupt(int pin) {
+  if (pin < 0 || pin >= kMaxPins || interrupts[pin].handler == nullptr) {
+    return false;
+  }
+  interrupts[pin].handler(interrupts[pin].arg);
+  return true;
+}
+
+reactesp::EventLoop& loop() { return *event_loop_instance; }
+MemoryFlash& journal_flash() { return flash; }
+MemoryFileSystem& log_file_system() { return file_system; }
+
+void reset() {
+  restart();
+  flash.erase_all();
+  flash.write_count = 0;
+  flash.erase_count = 0;
+  file_system.clear();
+  file_system.append_count = 0;
+  file_system.remove_count = 0;
+  rtc_warm = false;
+}
+
+void reboot(bool warm) {
+  restart();
+  rtc_warm = warm;
+}
+
+}  // namespace fake_hal
+
+// Arduino core
+
+unsigned long millis() { return static_cast<uint32_t>(fake_hal::clock_us / 1000); }
+unsigned long micros() { return static_cast<uint32_t>(fake_hal::clock_us); }
+void delay(uint32_t ms) { fake_hal::advance_ms(ms); }
+void delayMicroseconds(uint32_t us) { fake_hal::advance_us(us); }
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  if (pin < fake_hal::kMaxPins) {
+    fake_hal::pin_levels[pin] = mode == INPUT_PULLUP ? HIGH : LOW;
+  }
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+  if (pin < fake_hal::kMaxPins) {
+    fake_hal::pin_levels[pin] = value;
+  }
+}
+
+int digitalRead(uint8_t pin) { return pin < fake_hal::kMaxPins ? fake_hal::pin_levels[pin] : LOW; }
+
+void attachInterruptArg(uint8_t pin, void (*handler)(void*), void* arg, int /*mode*/) {
+  if (pin < fake_hal::kMaxPins) {
+    fake_hal::interrupts[pin] = {handler, arg};
+  }
+}
+
+void detachInterrupt(uint8_t pin) {
+  if (pin < fake_hal::kMaxPins) {
+    fake_hal::interrupts[pin] = {};
+  }
+}
+
+int64_t esp_timer_get_time() { return static_cast<int64_t>(fake_hal::clock_us); }
+
+// Event loop
+
+namespace reactesp {
+
+Event* EventLoop::add(Event::Kind kind, uint64_t interval_us, std::function<void()> callback) {
+  for (Event& event : events_) {
+    if (event.kind_ == Event::kUnused) {
+      event.kind_ = kind;
+      event.interval_us_ = interval_us;
+      event.due_us_ = fake_hal::now_us() + interval_us;
+      event.callback_ = callback;
+      event.call_count_ = 0;
+      return &event;
+    }
+  }
+  return nullptr;  // FAKE_EVENT_LOOP_MAX_EVENTS too small
+}
+
+RepeatEvent* EventLoop::onRepeat(uint32_t interval_ms, std::function<void()> callback) {
+  return add(Event::kRepeat, interval_ms * 1000ULL, callback);
+}
+
+DelayEvent* EventLoop::onDelay(uint32_t delay_ms, std::function<void()> callback) {
+  return add(Event::kDelay, delay_ms * 1000ULL, callback);
+}
+
+TickEvent* EventLoop::onTick(std::function<void()> callback) { return add(Event::kTick, 0, callback); }
+
+void EventLoop::remove(Event* event) {
+  event->kind_ = Event::kUnused;
+  event->callback_ = nullptr;
+}
+
+void EventLoop::tick() {
+  for (Event& event : events_) {
+    if (event.kind_ == Event::kUnused || (event.kind_ != Event::kTick && fake_hal::now_us() < event.due_us_)) {
+      continue;
+    }
+    if (event.kind_ == Event::kRepeat) {
+      // Keep the grid unless a whole interval was missed
+      event.due_us_ += event.interval_us_;
+      if (event.due_us_ <= fake_hal::now_us()) {
+        event.due_us_ = fake_hal::now_us() + event.interval_us_;
+      }
+    }
+    auto start = std::chrono::steady_clock::now();
+    event.call_count_++;
+    if (event.kind_ == Event::kDelay) {
+      // The callback may add events; this slot is free from here on
+      std::function<void()> callback = event.callback_;
+      remove(&event);
+      callback();
+    } else {
+      event.callback_();
+    }
+    call_ns_ += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    call_count_++;
+  }
+}
+
+size_t EventLoop::event_count() const {
+  size_t count = 0;
+  for (const Event& event : events_) {
+    count += event.kind_ != Event::kUnused ? 1 : 0;
+  }
+  return count;
+}
+
+void EventLoop::clear() {
+  for (Event& event : events_) {
+    remove(&event);
+  }
+  call_count_ = 0;
+  call_ns_ = 0;
+}
+
+}  // namespace reactesp
+
+// Storage seams of the ESP32-only sources (src/*_esp32.cpp) and the globals of
+// sources the native build leaves out
+
+namespace sensesp {
+
+std::shared_ptr<reactesp::EventLoop> event_loop() { return fake_hal::event_loop_instance; }
+
+AhStateStore* ah_state_store() {
+  if (fake_hal::state_store == nullptr) {
+    fake_hal::state_store = new AhJournal(&fake_hal::flash);
+    // Deferred, batched flush as on the device
+    event_loop()->onRepeat(AH_JOURNAL_FLUSH_INTERVAL_MS, []() { fake_hal::state_store->flush(); });
+  }
+  return fake_hal::state_store;
+}
+
+#if AH_RTC_SNAPSHOT
+AhRtcSnapshot* ah_rtc_snapshot() {
+  if (fake_hal::rtc_snapshot == nullptr) {
+    fake_hal::rtc_snapshot = new AhRtcSnapshot(&fake_hal::rtc_region, fake_hal::rtc_warm);
+  }
+  return fake_hal::rtc_snapshot;
+}
+#endif
+
+#if BATTERY_LOG
+LogFileSystem* battery_log_fs() { return &fake_hal::file_system; }
+
+SemaphoreHandle_t battery_log_mutex() { return xSemaphoreCreateMutex(); }
+#endif
+
+#if BATTERY_DIAGNOSTICS
+DiagHistogram* DiagHistogram::head_ = nullptr;
+#endif
+
+}  // namespace sensesp
@@ -0,0 +1,67 @@
+#pragma once
+
+// Test side of the fake HAL (native environment). The firmware's Arduino,
+// FreeRTOS, ESP-IDF and SensESP calls land on the headers next to this one;
+// tests drive them from here:
+// - a virtual clock behind millis(), micros() and esp_timer_get_time(),
+//   advanced explicitly. Devices on it (fake INA226 conversions) act at
+//   their exact times,
+// - the event loop, ticked by run_for_ms(),
+// - interrupts attached with attachInterruptArg(), raised by the devices or
+//   the test,
+// - the storage seams of the ESP32-only sources: ah_state_store() is an
+//   AhJournal on a MemoryFlash, ah_rtc_snapshot() a plain memory region,
+//   battery_log_fs() a MemoryFileSystem.
+// reset() starts a freshly flashed board; reboot() keeps flash, files and
+// (warm) the RTC memory, like a reset of the real one.
+
+#include <cstdint>
+
+#include "ah_journal.h"
+#include "ah_rtc_snapshot.h"
+#include "memory_storage.h"
+#include "sensesp_base_app.h"
+
+namespace fake_hal {
+
+// Something on the virtual clock that acts at given times
+class ClockListener {
+ public:
+  virtual ~ClockListener() {}
+  // Virtual time of the next action, UINT64_MAX if none
+  virtual uint64_t next_event_us() const = 0;
+  // Called with the clock at next_event_us() (or later)
+  virtual void on_time(uint64_t now_us) = 0;
+};
+
+uint64_t now_us();
+
+// Move the clock forward, stopping at every listener event on the way
+void advance_us(uint64_t us);
+inline void advance_ms(uint64_t ms) { advance_us(ms * 1000); }
+
+// Run the event loop for ms: one tick every step_us of virtual time
+void run_for_ms(uint64_t ms, uint32_t step_us = 1000);
+
+void add_clock_listener(ClockListener* listener);
+void remove_clock_listener(ClockListener* listener);
+
+// Call the handler attached to pin (a falling edge on an ALERT line).
+// False if none is attached.
+bool raise_interrupt(int pin);
+
+reactesp::EventLoop& loop();
+MemoryFlash& journal_flash();
+MemoryFileSystem& log_file_system();
+
+// Freshly flashed board: clock at 0, no events, interrupts or outputs,
+// erased journal flash, empty log file system, RTC memory not yet written
+void reset();
+
+// Reset of the board: clock at 0, no events, interrupts or outputs; flash
+// and files kept; the RTC memory survives a warm reboot (software reset,
+// panic) but not a cold one (power-on). The state store and RTC snapshot are
+// set up again on first use, objects created before must not be used.
+void reboot(bool warm);
+
+}  // namespace fake_hal
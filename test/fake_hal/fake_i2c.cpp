@@ -0,0 +1,195 @@
+#include "fake_i2c.h"
+
+#include <cmath>
+
+namespace fake_hal {
+
+namespace {
+
+// Registers
+constexpr uint8_t kConfiguration = 0x00;
+constexpr uint8_t kShuntVoltage = 0x01;
+constexpr uint8_t kBusVoltage = 0x02;
+constexpr uint8_t kPower = 0x03;
+constexpr uint8_t kCurrent = 0x04;
+constexpr uint8_t kCalibration = 0x05;
+constexpr uint8_t kMaskEnable = 0x06;
+constexpr uint8_t kManufacturerId = 0xFE;
+
+constexpr uint16_t kConversionReadyAlert = 0x0400;  // CNVR
+constexpr uint16_t kConversionReadyFlag = 0x0008;   // CVRF
+constexpr float kShuntLsbV = 2.5e-6f;
+constexpr float kBusLsbV = 0.00125f;
+
+constexpr uint32_t kAverages[] = {1, 4, 16, 64, 128, 256, 512, 1024};
+constexpr uint32_t kConversionTimesUs[] = {140, 204, 332, 588, 1100, 2116, 4156, 8244};
+
+int16_t saturate16(float value) {
+  value = std::round(value);
+  return static_cast<int16_t>(value > 32767.0f ? 32767.0f : (value < -32768.0f ? -32768.0f : value));
+}
+
+}  // namespace
+
+uint32_t FakeINA226::conversion_us() const {
+  return kAverages[(config >> 9) & 0x7] * (kConversionTimesUs[(config >> 6) & 0x7] + kConversionTimesUs[(config >> 3) & 0x7]);
+}
+
+uint16_t* FakeINA226::reg(uint8_t index) {
+  switch (index) {
+    case kConfiguration: return &config;
+    case kShuntVoltage: return &shunt_voltage;
+    case kBusVoltage: return &bus_voltage;
+    case kCurrent: return &current;
+    case kCalibration: return &calibration;
+    case kMaskEnable: return &mask_enable;
+    default: return nullptr;
+  }
+}
+
+void FakeINA226::write(uint8_t index, uint16_t value, uint64_t now_us) {
+  if (index == kConfiguration && (value & 0x8000) != 0) {
+    // Reset: power-on defaults, calibration and alert cleared
+    config = kPowerOnConfig;
+    calibration = 0;
+    mask_enable = 0;
+    conversion_ready_ = false;
+    alert_asserted_ = false;
+  } else if (index == kConfiguration) {
+    config = value;
+  } else if (index == kCalibration || index == kMaskEnable) {
+    *reg(index) = value;
+  }
+  if (index == kConfiguration) {
+    // Writing the configuration aborts the running conversion
+    next_conversion_us_ = now_us + conversion_us();
+  }
+}
+
+uint16_t FakeINA226::read(uint8_t index) {
+  if (index == kManufacturerId) {
+    return 0x5449;  // "TI"
+  }
+  if (index == kPower) {
+    return static_cast<uint16_t>(static_cast<uint32_t>(bus_voltage) * std::abs(static_cast<int16_t>(current)) / 20000);
+  }
+  if (index == kMaskEnable) {
+    // Reading Mask/Enable clears the flag and releases ALERT
+    uint16_t value = mask_enable | (conversion_ready_ ? kConversionReadyFlag : 0);
+    conversion_ready_ = false;
+    alert_asserted_ = false;
+    return value;
+  }
+  uint16_t* value = reg(index);
+  return value != nullptr ? *value : 0;
+}
+
+void FakeINA226::convert(uint64_t now_us) {
+  float voltage_v = voltage_v_;
+  float current_a = current_a_;
+  if (waveform) {
+    waveform(now_us, &voltage_v, &current_a);
+  }
+  // The chip measures the shunt voltage; current = shunt * CAL / 2048
+  int16_t shunt = saturate16(current_a * shunt_ohm_ / kShuntLsbV);
+  shunt_voltage = static_cast<uint16_t>(shunt);
+  bus_voltage = static_cast<uint16_t>(voltage_v <= 0.0f ? 0 : std::lround(voltage_v / kBusLsbV));
+  current = static_cast<uint16_t>(saturate16(static_cast<float>(shunt) * calibration / 2048.0f));
+  conversion_count_++;
+  conversion_ready_ = true;
+  if ((mask_enable & kConversionReadyAlert) != 0 && !alert_asserted_) {
+    alert_asserted_ = true;
+    raise_interrupt(alert_pin_);
+  }
+  next_conversion_us_ = now_us + conversion_us();
+}
+
+FakeI2CTransport::FakeI2CTransport() { add_clock_listener(this); }
+
+FakeI2CTransport::~FakeI2CTransport() { remove_clock_listener(this); }
+
+void FakeI2CTransport::add(FakeINA226* chip) {
+  if (chip_count_ < kMaxChips) {
+    chips_[chip_count_++] = chip;
+    // Converting since power-on
+    chip->next_conversion_us_ = now_us() + chip->conversion_us();
+  }
+}
+
+FakeINA226* FakeI2CTransport::find(uint8_t address) {
+  for (size_t i = 0; i < chip_count_; i++) {
+    if (chips_[i]->address_ == address) {
+      return chips_[i];
+    }
+  }
+  return nullptr;
+}
+
+sensesp::I2CResult FakeI2CTransport::transfer(uint8_t address, const uint8_t* tx, size_t tx_length, uint8_t* rx,
+                                              size_t rx_length) {
+  transfer_count++;
+  if (sda_stuck) {
+    advance_us(transfer_us);
+    return sensesp::I2CResult::kBusError;
+  }
+  FakeINA226* chip = find(address);
+  if (chip != nullptr && chip->timeout_count > 0) {
+    chip->timeout_count--;
+    advance_us(I2C_TIMEOUT_MS * 1000ULL);
+    return sensesp::I2CResult::kTimeout;
+  }
+  sensesp::I2CResult result = sensesp::I2CResult::kOk;
+  if (chip == nullptr || !chip->present) {
+    result = sensesp::I2CResult::kNack;
+  } else if (chip->nack_count > 0) {
+    chip->nack_count--;
+    result = sensesp::I2CResult::kNack;
+  } else {
+    if (tx_length >= 1) {
+      chip->pointer_ = tx[0];
+    }
+    if (tx_length == 3) {
+      chip->write(chip->pointer_, static_cast<uint16_t>((tx[1] << 8) | tx[2]), now_us());
+    }
+    if (rx_length == 2) {
+      uint16_t value = chip->read(chip->pointer_);
+      rx[0] = static_cast<uint8_t>(value >> 8);
+      rx[1] = static_cast<uint8_t>(value & 0xFF);
+    }
+  }
+  advance_us(transfer_us);
+  return result;
+}
+
+bool FakeI2CTransport::recover() {
+  recover_count++;
+  advance_us(recovery_us);
+  sda_stuck = false;
+  return true;
+}
+
+uint32_t FakeI2CTransport::now_ms() { return static_cast<uint32_t>(now_us() / 1000); }
+
+uint64_t FakeI2CTransport::next_event_us() const {
+  uint64_t next_us = UINT64_MAX;
+  for (size_t i = 0; i < chip_count_; i++) {
+    const FakeINA226* chip = chips_[i];
+    if (chip->present && (chip->config & 0x7) == 0x7 && chip->next_conversion_us_ < next_us) {
+      next_us = chip->next_conversion_us_;
+    }
+  }
+  return next_us;
+}
+
+void FakeI2CTransport::on_time(uint64_t now_us) {
+  for (size_t i = 0; i < chip_count_; i++) {
+    FakeINA226* chip = chips_[i];
+    if (chip->present && (chip->config & 0x7) == 0x7 && chip->next_conversion_us_ <= now_us) {
+      // A chip that was absent restarts its conversions now
+      bool late = now_us - chip->next_conversion_us_ >= chip->conversion_us();
+      chip->convert(late ? now_us : chip->next_conversion_us_);
+    }
+  }
+}
+
+}  // namespace fake_hal
@@ -0,0 +1,111 @@
+#pragma once
+
+// Fake I2C bus with INA226s emulated at register level, on the virtual
+// clock:
+// - a chip converts continuously at the rate its configuration register sets
+//   (averages x (bus + shunt conversion time)) and latches its analog inputs
+//   (set_input() or a waveform) into the result registers at the end of
+//   each conversion,
+// - with the conversion-ready alert enabled it pulls ALERT low at the end of
+//   a conversion (raise_interrupt() on its pin) until the Mask/Enable
+//   register is read,
+// - faults per chip (absent, NACK bursts, timeouts) and on the bus (a slave
+//   holding SDA low until recovery clocks it free),
+// - every transfer takes transfer_us of virtual time (I2C_TIMEOUT_MS on a
+//   timeout), so a test sees what the bus traffic costs.
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+#include "fake_hal.h"
+#include "i2c_bus.h"
+
+namespace fake_hal {
+
+class FakeINA226 {
+ public:
+  static constexpr uint16_t kPowerOnConfig = 0x4127;
+
+  FakeINA226(uint8_t address, float shunt_ohm, int alert_pin = -1)
+      : address_(address), shunt_ohm_(shunt_ohm), alert_pin_(alert_pin) {}
+
+  uint8_t address() const { return address_; }
+
+  // Inputs latched by the following conversions
+  void set_input(float voltage_v, float current_a) {
+    voltage_v_ = voltage_v;
+    current_a_ = current_a;
+  }
+  // Inputs as a function of virtual time (overrides set_input())
+  std::function<void(uint64_t now_us, float* voltage_v, float* current_a)> waveform;
+
+  // Faults
+  bool present = true;
+  uint32_t nack_count = 0;     // Next transfers to NACK
+  uint32_t timeout_count = 0;  // Next transfers to time out
+
+  // Registers
+  uint16_t config = kPowerOnConfig;
+  uint16_t calibration = 0;
+  uint16_t mask_enable = 0;
+  uint16_t shunt_voltage = 0;
+  uint16_t bus_voltage = 0;
+  uint16_t current = 0;
+
+  // Time of one conversion at the current configuration
+  uint32_t conversion_us() const;
+  uint32_t get_conversion_count() const { return conversion_count_; }
+  bool alert_asserted() const { return alert_asserted_; }
+
+ private:
+  friend class FakeI2CTransport;
+
+  uint16_t* reg(uint8_t index);
+  void write(uint8_t index, uint16_t value, uint64_t now_us);
+  uint16_t read(uint8_t index);
+  void convert(uint64_t now_us);
+
+  uint8_t address_;
+  float shunt_ohm_;
+  int alert_pin_;
+  float voltage_v_ = 12.8f;
+  float current_a_ = 0.0f;
+  uint8_t pointer_ = 0;
+  uint64_t next_conversion_us_ = 0;  // 0: not started since power-on
+  uint32_t conversion_count_ = 0;
+  bool conversion_ready_ = false;
+  bool alert_asserted_ = false;
+};
+
+class FakeI2CTransport : public sensesp::I2CTransport, public ClockListener {
+ public:
+  static constexpr size_t kMaxChips = 16;
+
+  FakeI2CTransport();
+  ~FakeI2CTransport() override;
+
+  void add(FakeINA226* chip);
+
+  sensesp::I2CResult transfer(uint8_t address, const uint8_t* tx, size_t tx_length, uint8_t* rx,
+                              size_t rx_length) override;
+  bool recover() override;
+  uint32_t now_ms() override;
+
+  uint64_t next_event_us() const override;
+  void on_time(uint64_t now_us) override;
+
+  uint32_t transfer_us = 200;  // One register access at 100 kHz
+  uint32_t recovery_us = 100;  // Nine SCL pulses and a STOP
+  bool sda_stuck = false;
+  uint32_t transfer_count = 0;
+  uint32_t recover_count = 0;
+
+ private:
+  FakeINA226* find(uint8_t address);
+
+  FakeINA226* chips_[kMaxChips] = {};
+  size_t chip_count_ = 0;
+};
+
+}  // namespace fake_hal
@@ -0,0 +1,149 @@
+#pragma once
+
+// Flash and file system in RAM behind the firmware's storage seams: the
+// "ahjournal" partition (JournalFlash) and the LittleFS log files
+// (LogFileSystem). Contents survive fake_hal::reboot().
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include "ah_journal.h"
+#include "battery_log.h"
+
+namespace fake_hal {
+
+// NOR flash: writes can only clear bits, erase sets a sector to 0xFF
+class MemoryFlash : public sensesp::JournalFlash {
+ public:
+  static constexpr size_t kSectorSize = 4096;
+  static constexpr size_t kSize = 4 * kSectorSize;  // Like the ahjournal partition
+
+  MemoryFlash() { erase_all(); }
+
+  size_t size() const override { return kSize; }
+  size_t sector_size() const override { return kSectorSize; }
+  bool read(size_t offset, void* data, size_t length) override {
+    memcpy(data, data_ + offset, length);
+    return true;
+  }
+  bool write(size_t offset, const void* data, size_t length) override {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < length; i++) {
+      data_[offset + i] &= bytes[i];
+    }
+    write_count++;
+    return true;
+  }
+  bool erase_sector(size_t offset) override {
+    memset(data_ + offset, 0xFF, kSectorSize);
+    erase_count++;
+    return true;
+  }
+
+  void erase_all() { memset(data_, 0xFF, sizeof(data_)); }
+  uint8_t* data() { return data_; }
+
+  uint32_t write_count = 0;
+  uint32_t erase_count = 0;
+
+ private:
+  uint8_t data_[kSize];
+};
+
+// Files in fixed slots of up to one log segment each
+class MemoryFileSystem : public sensesp::LogFileSystem {
+ public:
+  static constexpr size_t kMaxFiles = 64;
+
+  bool make_dir(const char*) override { return true; }
+  void list(const char* dir, const std::function<void(const char* name, size_t size)>& fn) override {
+    size_t dir_length = strlen(dir);
+    for (File& file : files_) {
+      if (file.used && strncmp(file.path, dir, dir_length) == 0 && file.path[dir_length] == '/') {
+        fn(file.path + dir_length + 1, file.size);
+      }
+    }
+  }
+  size_t size(const char* path) override {
+    File* file = find(path);
+    return file != nullptr ? file->size : 0;
+  }
+  bool append(const char* path, const void* data, size_t length) override {
+    File* file = find(path);
+    if (file == nullptr) {
+      for (File& free_file : files_) {
+        if (!free_file.used) {
+          file = &free_file;
+          file->used = true;
+          file->size = 0;
+          snprintf(file->path, sizeof(file->path), "%s", path);
+          break;
+        }
+      }
+    }
+    if (file == nullptr || file->size + length > sizeof(file->data)) {
+      return false;
+    }
+    memcpy(file->data + file->size, data, length);
+    file->size += length;
+    append_count++;
+    return true;
+  }
+  size_t read(const char* path, size_t offset, void* data, size_t length) override {
+    File* file = find(path);
+    if (file == nullptr || offset >= file->size) {
+      return 0;
+    }
+    size_t n = file->size - offset < length ? file->size - offset : length;
+    memcpy(data, file->data + offset, n);
+    return n;
+  }
+  bool remove(const char* path) override {
+    File* file = find(path);
+    if (file == nullptr) {
+      return false;
+    }
+    file->used = false;
+    remove_count++;
+    return true;
+  }
+
+  void clear() {
+    for (File& file : files_) {
+      file.used = false;
+    }
+  }
+  size_t file_count() const {
+    size_t count = 0;
+    for (const File& file : files_) {
+      count += file.used ? 1 : 0;
+    }
+    return count;
+  }
+
+  uint32_t append_count = 0;
+  uint32_t remove_count = 0;
+
+ private:
+  struct File {
+    bool used = false;
+    char path[48];
+    size_t size = 0;
+    uint8_t data[BATTERY_LOG_SEGMENT_BYTES];
+  };
+
+  File* find(const char* path) {
+    for (File& file : files_) {
+      if (file.used && strcmp(file.path, path) == 0) {
+        return &file;
+      }
+    }
+    return nullptr;
+  }
+
+  File files_[kMaxFiles];
+};
+
+}  // namespace fake_hal
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <Arduino.h>
+
+namespace sensesp {
+
+class SKMetadata {
+ public:
+  SKMetadata(const String& units = "", const String& display_name = "", const String& description = "",
+             const String& short_name = "", float timeout = -1.0f)
+      : units_(units), display_name_(display_name), description_(description), short_name_(short_name),
+        timeout_(timeout) {}
+
+  String units_;
+  String display_name_;
+  String description_;
+  String short_name_;
+  float timeout_;
+};
+
+}  // namespace sensesp
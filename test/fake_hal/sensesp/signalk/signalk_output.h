@@ -0,0 +1,56 @@
+#pragma once
+
+// Signal K output that records what would be sent instead of queueing a
+// delta. Every output registers itself, so tests can look them up by path.
+
+#include <cstring>
+
+#include "sensesp/signalk/signalk_metadata.h"
+#include "sensesp/transforms/transform.h"
+
+namespace sensesp {
+
+template <typename T>
+class SKOutput : public SymmetricTransform<T> {
+ public:
+  SKOutput(const String& sk_path, const String& config_path = "", SKMetadata* meta = nullptr)
+      : SymmetricTransform<T>(config_path), sk_path_(sk_path), meta_(meta), next_(head_) {
+    head_ = this;
+  }
+
+  void set(const T& new_value) override {
+    set_count_++;
+    this->emit(new_value);
+  }
+
+  const String& get_sk_path() const { return sk_path_; }
+  SKMetadata* get_metadata() const { return meta_; }
+  // Values sent since construction
+  uint32_t get_set_count() const { return set_count_; }
+
+  // Most recently constructed output with the path, nullptr if none
+  static SKOutput* find(const char* sk_path) {
+    for (SKOutput* output = head_; output != nullptr; output = output->next_) {
+      if (strcmp(output->sk_path_.c_str(), sk_path) == 0) {
+        return output;
+      }
+    }
+    return nullptr;
+  }
+  // Forget every output (reboot); the objects themselves are not touched
+  static void clear_registry() { head_ = nullptr; }
+
+ private:
+  String sk_path_;
+  SKMetadata* meta_;
+  uint32_t set_count_ = 0;
+  SKOutput* next_;
+  static inline SKOutput* head_ = nullptr;
+};
+
+using SKOutputFloat = SKOutput<float>;
+using SKOutputInt = SKOutput<int>;
+using SKOutputBool = SKOutput<bool>;
+using SKOutputString = SKOutput<String>;
+
+}  // namespace sensesp
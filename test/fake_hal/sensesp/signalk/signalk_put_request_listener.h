@@ -0,0 +1,35 @@
+#pragma once
+
+// PUT listener; a test delivers a PUT by calling emit() on it (find() looks
+// it up by path)
+
+#include <cstring>
+
+#include "sensesp/system/valueconsumer.h"
+
+namespace sensesp {
+
+template <typename T>
+class SKPutRequestListener : public ValueProducer<T> {
+ public:
+  SKPutRequestListener(const String& sk_path) : sk_path_(sk_path), next_(head_) { head_ = this; }
+
+  const String& get_sk_path() const { return sk_path_; }
+
+  static SKPutRequestListener* find(const char* sk_path) {
+    for (SKPutRequestListener* listener = head_; listener != nullptr; listener = listener->next_) {
+      if (strcmp(listener->sk_path_.c_str(), sk_path) == 0) {
+        return listener;
+      }
+    }
+    return nullptr;
+  }
+  static void clear_registry() { head_ = nullptr; }
+
+ private:
+  String sk_path_;
+  SKPutRequestListener* next_;
+  static inline SKPutRequestListener* head_ = nullptr;
+};
+
+}  // namespace sensesp
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <functional>
+
+#include "sensesp/system/valueconsumer.h"
+
+namespace sensesp {
+
+template <typename T>
+class LambdaConsumer : public ValueConsumer<T> {
+ public:
+  LambdaConsumer(std::function<void(const T&)> function) : function_(function) {}
+  void set(const T& new_value) override { function_(new_value); }
+
+ private:
+  std::function<void(const T&)> function_;
+};
+
+}  // namespace sensesp
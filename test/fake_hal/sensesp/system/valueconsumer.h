@@ -0,0 +1,55 @@
+#pragma once
+
+// ValueConsumer / ValueProducer as used by the firmware: producers call
+// set() on every connected consumer when they emit.
+
+#include <Arduino.h>
+
+#include <cstddef>
+
+#ifndef FAKE_PRODUCER_MAX_CONSUMERS
+#define FAKE_PRODUCER_MAX_CONSUMERS 8
+#endif
+
+namespace sensesp {
+
+template <typename T>
+class ValueConsumer {
+ public:
+  using input_type = T;
+  virtual ~ValueConsumer() {}
+  virtual void set(const T& /*new_value*/) {}
+};
+
+template <typename T>
+class ValueProducer {
+ public:
+  using output_type = T;
+  virtual ~ValueProducer() {}
+
+  const T& get() const { return output_; }
+
+  template <typename VConsumer>
+  VConsumer* connect_to(VConsumer* consumer) {
+    if (consumer_count_ < FAKE_PRODUCER_MAX_CONSUMERS) {
+      consumers_[consumer_count_++] = consumer;
+    }
+    return consumer;
+  }
+
+  void emit(const T& new_value) {
+    output_ = new_value;
+    for (size_t i = 0; i < consumer_count_; i++) {
+      consumers_[i]->set(new_value);
+    }
+  }
+
+ protected:
+  T output_ = T();
+
+ private:
+  ValueConsumer<T>* consumers_[FAKE_PRODUCER_MAX_CONSUMERS] = {};
+  size_t consumer_count_ = 0;
+};
+
+}  // namespace sensesp
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "sensesp/system/valueconsumer.h"
+
+namespace sensesp {
+
+class TransformBase {
+ public:
+  TransformBase(const String& config_path = "") : config_path_(config_path) {}
+  const String& get_config_path() const { return config_path_; }
+
+ private:
+  String config_path_;
+};
+
+template <typename IN, typename OUT>
+class Transform : public TransformBase, public ValueConsumer<IN>, public ValueProducer<OUT> {
+ public:
+  Transform(const String& config_path = "") : TransformBase(config_path) {}
+};
+
+template <typename T>
+using SymmetricTransform = Transform<T, T>;
+
+using FloatTransform = Transform<float, float>;
+
+}  // namespace sensesp
@@ -0,0 +1,74 @@
+#pragma once
+
+// Event loop on the virtual clock. Same calls as ReactESP; tick() runs every
+// tick callback and every timer that is due, and also counts the callbacks
+// and the host time they take (for the benchmarks).
+
+#include <Arduino.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+#ifndef FAKE_EVENT_LOOP_MAX_EVENTS
+#define FAKE_EVENT_LOOP_MAX_EVENTS 64
+#endif
+
+namespace reactesp {
+
+class EventLoop;
+
+class Event {
+ public:
+  uint32_t get_call_count() const { return call_count_; }
+
+ private:
+  friend class EventLoop;
+  enum Kind : uint8_t { kUnused, kTick, kRepeat, kDelay };
+
+  Kind kind_ = kUnused;
+  uint64_t interval_us_ = 0;
+  uint64_t due_us_ = 0;
+  std::function<void()> callback_;
+  uint32_t call_count_ = 0;
+};
+
+using RepeatEvent = Event;
+using DelayEvent = Event;
+using TickEvent = Event;
+
+class EventLoop {
+ public:
+  RepeatEvent* onRepeat(uint32_t interval_ms, std::function<void()> callback);
+  DelayEvent* onDelay(uint32_t delay_ms, std::function<void()> callback);
+  TickEvent* onTick(std::function<void()> callback);
+  void remove(Event* event);
+
+  void tick();
+
+  // Registered callbacks (tick, repeat and pending delay events)
+  size_t event_count() const;
+  // Callbacks run since the last clear()
+  uint64_t get_call_count() const { return call_count_; }
+  // Host nanoseconds spent in them
+  uint64_t get_call_ns() const { return call_ns_; }
+
+  // Drop every event (reboot)
+  void clear();
+
+ private:
+  Event* add(Event::Kind kind, uint64_t interval_us, std::function<void()> callback);
+
+  Event events_[FAKE_EVENT_LOOP_MAX_EVENTS];
+  uint64_t call_count_ = 0;
+  uint64_t call_ns_ = 0;
+};
+
+}  // namespace reactesp
+
+namespace sensesp {
+
+std::shared_ptr<reactesp::EventLoop> event_loop();
+
+}  // namespace sensesp
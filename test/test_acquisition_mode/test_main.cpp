@@ -0,0 +1,117 @@
+#include <unity.h>
+
+#include "acquisition_mode.h"
+
+using namespace sensesp;
+
+namespace {
+
+constexpr uint32_t kSteadyIntervalUs = 2000000;
+constexpr uint32_t kFastIntervalUs = 100000;
+
+}  // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_starts_steady() {
+  AcquisitionModeController controller;
+  TEST_ASSERT_FALSE(controller.update(0, 50.0f));
+  TEST_ASSERT_EQUAL(AcquisitionMode::kSteady, controller.mode());
+}
+
+void test_step_enters_fast() {
+  AcquisitionModeController controller(1.0f, 0.25f, 30000);
+  controller.update(0, 2.0f);
+  // 10 A step within one steady read interval: 5 A/s
+  TEST_ASSERT_TRUE(controller.update(kSteadyIntervalUs, 12.0f));
+  TEST_ASSERT_EQUAL(AcquisitionMode::kFast, controller.mode());
+  TEST_ASSERT_EQUAL_UINT32(1, controller.get_switch_count());
+}
+
+void test_slow_drift_stays_steady() {
+  AcquisitionModeController controller(1.0f, 0.25f, 30000);
+  uint32_t t = 0;
+  float current = 0.0f;
+  // 0.4 A per 2 s read: 0.2 A/s
+  for (int i = 0; i < 100; i++) {
+    TEST_ASSERT_FALSE(controller.update(t, current));
+    t += kSteadyIntervalUs;
+    current += 0.4f;
+  }
+  TEST_ASSERT_EQUAL(AcquisitionMode::kSteady, controller.mode());
+}
+
+void test_noise_within_band_does_not_trigger() {
+  AcquisitionModeController controller(1.0f, 0.25f, 30000);
+  uint32_t t = 0;
+  // 0.2 A of noise at fast read intervals is 2 A/s but inside the band
+  for (int i = 0; i < 100; i++) {
+    controller.update(t, (i % 2) ? 5.2f : 5.0f);
+    t += kFastIntervalUs;
+  }
+  TEST_ASSERT_EQUAL(AcquisitionMode::kSteady, controller.mode());
+  TEST_ASSERT_EQUAL_UINT32(0, controller.get_switch_count());
+}
+
+void test_returns_to_steady_after_hold() {
+  AcquisitionModeController controller(1.0f, 0.25f, 30000);
+  controller.update(0, 0.0f);
+  controller.update(kSteadyIntervalUs, 20.0f);
+  uint32_t t = kSteadyIntervalUs;
+  // Held within the band for just under the hold time
+  while (t + kFastIntervalUs < kSteadyIntervalUs + 30000000UL) {
+    t += kFastIntervalUs;
+    TEST_ASSERT_FALSE(controller.update(t, (t / kFastIntervalUs) % 2 ? 20.2f : 19.9f));
+  }
+  TEST_ASSERT_EQUAL(AcquisitionMode::kFast, controller.mode());
+  t += kFastIntervalUs;
+  TEST_ASSERT_TRUE(controller.update(t, 20.0f));
+  TEST_ASSERT_EQUAL(AcquisitionMode::kSteady, controller.mode());
+  TEST_ASSERT_EQUAL_UINT32(2, controller.get_switch_count());
+}
+
+void test_leaving_band_restarts_hold() {
+  AcquisitionModeController controller(1.0f, 0.25f, 30000);
+  controller.update(0, 0.0f);
+  controller.update(kSteadyIntervalUs, 20.0f);
+  uint32_t t = kSteadyIntervalUs;
+  for (int i = 0; i < 250; i++) {
+    t += kFastIntervalUs;
+    controller.update(t, 20.0f);
+  }
+  // 25 s in, the load changes again
+  t += kFastIntervalUs;
+  controller.update(t, 25.0f);
+  for (int i = 0; i < 250; i++) {
+    t += kFastIntervalUs;
+    controller.update(t, 25.0f);
+  }
+  TEST_ASSERT_EQUAL(AcquisitionMode::kFast, controller.mode());
+}
+
+void test_timestamp_wrap() {
+  AcquisitionModeController controller(1.0f, 0.25f, 30000);
+  uint32_t t = 0xFFFFFFFFUL - 1000000UL;
+  controller.update(t, 0.0f);
+  t += kSteadyIntervalUs;  // Wraps
+  TEST_ASSERT_TRUE(controller.update(t, 10.0f));
+  for (int i = 0; i < 300; i++) {
+    t += kFastIntervalUs;
+    controller.update(t, 10.0f);
+  }
+  TEST_ASSERT_EQUAL(AcquisitionMode::kSteady, controller.mode());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_starts_steady);
+  RUN_TEST(test_step_enters_fast);
+  RUN_TEST(test_slow_drift_stays_steady);
+  RUN_TEST(test_noise_within_band_does_not_trigger);
+  RUN_TEST(test_returns_to_steady_after_hold);
+  RUN_TEST(test_leaving_band_restarts_hold);
+  RUN_TEST(test_timestamp_wrap);
+  return UNITY_END();
+}
@@ -0,0 +1,159 @@
+#include <unity.h>
+
+#include <chrono>
+#include <cstdio>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "ah_accumulator.h"
+
+using namespace sensesp;
+
+namespace {
+
+constexpr double kUsPerHour = 3600000000.0;
+constexpr uint32_t kMaxDtUs = 0xFFFFFFFFUL;  // ~71.6 minutes
+constexpr float kMaxCurrentA = 200.0f;
+
+// Deterministic load: fridge cycling, engine charging bursts, noise; crosses
+// zero regularly
+struct LoadTrace {
+  uint32_t state = 12345;
+
+  float next(uint32_t second) {
+    state = state * 1664525UL + 1013904223UL;
+    float noise = static_cast<float>(state >> 8) / 16777216.0f - 0.5f;
+    float load = (second % 1800) < 600 ? -4.5f : -0.3f;
+    float charge = (second % 86400) > 30000 && (second % 86400) < 37200 ? 25.0f : 0.0f;
+    return load + charge + noise;
+  }
+};
+
+template <typename Accumulator>
+Accumulator crossing_at_max_current(float charge_pct, float discharge_pct) {
+  Accumulator acc;
+  acc.set_efficiencies(charge_pct, discharge_pct);
+  acc.set_ah(0.0);
+  acc.add_trapezoid(kMaxCurrentA, -kMaxCurrentA, kMaxDtUs);
+  acc.add_trapezoid(-kMaxCurrentA, kMaxCurrentA, kMaxDtUs);
+  return acc;
+}
+
+template <typename Accumulator>
+double bench_ns_per_step(uint64_t* cycles_per_step) {
+  const uint32_t kSteps = 2000000;
+  Accumulator acc;
+  acc.set_efficiencies(95.0f, 100.0f);
+  acc.set_ah(100.0);
+  static float currents[1024];
+  LoadTrace trace;
+  for (uint32_t i = 0; i < 1024; i++) {
+    currents[i] = trace.next(i * 37);
+  }
+#if defined(__x86_64__) || defined(__i386__)
+  uint64_t start_cycles = __rdtsc();
+#endif
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t i = 1; i < kSteps; i++) {
+    acc.add_trapezoid(currents[(i - 1) & 1023], currents[i & 1023], 1000000);
+  }
+  double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+#if defined(__x86_64__) || defined(__i386__)
+  *cycles_per_step = (__rdtsc() - start_cycles) / kSteps;
+#else
+  *cycles_per_step = 0;
+#endif
+  // Keep the loop from being optimised away
+  TEST_ASSERT_TRUE(acc.get_ah() >= 0.0);
+  return ns / kSteps;
+}
+
+}  // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_crossing_at_max_current_and_dt() {
+  // 200 A x 200 A x 4.3e9 us is ~1.7e20 mA^2 us: beyond int64 if formed
+  auto fixed = crossing_at_max_current<FixedAhAccumulator>(100.0f, 100.0f);
+  TEST_ASSERT_DOUBLE_WITHIN(1e-6, 0.0, fixed.get_ah());
+
+  auto fixed_eff = crossing_at_max_current<FixedAhAccumulator>(90.0f, 100.0f);
+  auto reference = crossing_at_max_current<DoubleAhAccumulator>(90.0f, 100.0f);
+  // Each half triangle: 200 A x dt / 4
+  double half_ah = kMaxCurrentA * kMaxDtUs / kUsPerHour / 4.0;
+  TEST_ASSERT_DOUBLE_WITHIN(1e-6, -0.1 * 2 * half_ah, reference.get_ah());
+  // Q24 efficiency factor: ~3e-8 relative
+  TEST_ASSERT_DOUBLE_WITHIN(1e-5, reference.get_ah(), fixed_eff.get_ah());
+}
+
+void test_asymmetric_crossing_at_long_dt() {
+  FixedAhAccumulator fixed;
+  DoubleAhAccumulator reference;
+  fixed.add_trapezoid(150.0f, -10.0f, kMaxDtUs);
+  reference.add_trapezoid(150.0f, -10.0f, kMaxDtUs);
+  fixed.add_trapezoid(-kMaxCurrentA, 0.5f, kMaxDtUs);
+  reference.add_trapezoid(-kMaxCurrentA, 0.5f, kMaxDtUs);
+  TEST_ASSERT_DOUBLE_WITHIN(1e-6, reference.get_ah(), fixed.get_ah());
+}
+
+void test_hold_and_trapezoid_at_max_current_and_dt() {
+  FixedAhAccumulator fixed;
+  fixed.add_hold(-kMaxCurrentA, kMaxDtUs);
+  double expected = -kMaxCurrentA * kMaxDtUs / kUsPerHour;
+  TEST_ASSERT_DOUBLE_WITHIN(1e-6, expected, fixed.get_ah());
+  fixed.add_trapezoid(kMaxCurrentA, kMaxCurrentA, kMaxDtUs);
+  TEST_ASSERT_DOUBLE_WITHIN(1e-6, 0.0, fixed.get_ah());
+}
+
+void test_fixed_matches_double_over_30_days() {
+  FixedAhAccumulator fixed;
+  DoubleAhAccumulator reference;
+  fixed.set_efficiencies(95.0f, 100.0f);
+  reference.set_efficiencies(95.0f, 100.0f);
+  fixed.set_ah(100.0);
+  reference.set_ah(100.0);
+
+  LoadTrace trace;
+  const uint32_t kSeconds = 30 * 86400;
+  float previous = trace.next(0);
+  double throughput_ah = 0.0;
+  for (uint32_t second = 1; second <= kSeconds; second++) {
+    float current = trace.next(second);
+    fixed.add_trapezoid(previous, current, 1000000);
+    reference.add_trapezoid(previous, current, 1000000);
+    throughput_ah += std::fabs(current) / 3600.0;
+    previous = current;
+  }
+  double drift_ah = fixed.get_ah() - reference.get_ah();
+  char message[96];
+  snprintf(message, sizeof(message), "30 days, %.0f Ah throughput: fixed - double = %.3g Ah", throughput_ah,
+           drift_ah);
+  TEST_MESSAGE(message);
+  TEST_ASSERT_DOUBLE_WITHIN(0.005, 0.0, drift_ah);
+}
+
+void test_cost_per_step() {
+  uint64_t double_cycles;
+  uint64_t fixed_cycles;
+  double double_ns = bench_ns_per_step<DoubleAhAccumulator>(&double_cycles);
+  double fixed_ns = bench_ns_per_step<FixedAhAccumulator>(&fixed_cycles);
+  // Host figures; on the ESP32 every double operation is emulated in software
+  char message[128];
+  snprintf(message, sizeof(message), "add_trapezoid per step: double %.1f ns (%llu cycles), fixed %.1f ns (%llu cycles)",
+           double_ns, static_cast<unsigned long long>(double_cycles), fixed_ns,
+           static_cast<unsigned long long>(fixed_cycles));
+  TEST_MESSAGE(message);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_crossing_at_max_current_and_dt);
+  RUN_TEST(test_asymmetric_crossing_at_long_dt);
+  RUN_TEST(test_hold_and_trapezoid_at_max_current_and_dt);
+  RUN_TEST(test_fixed_matches_double_over_30_days);
+  RUN_TEST(test_cost_per_step);
+  return UNITY_END();
+}
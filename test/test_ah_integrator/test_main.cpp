@@ -0,0 +1,145 @@
+#include <unity.h>
+
+#include "ah_integrator.h"
+#include "fake_hal.h"
+
+using namespace sensesp;
+
+namespace {
+
+constexpr uint32_t kHourUs = 3600000000UL;
+
+}  // namespace
+
+void setUp() { fake_hal::reset(); }
+
+void tearDown() {}
+
+void test_trapezoid_per_sample() {
+  AmpHourIntegrator integrator("house", 50.0f, 100.0f, true);
+  integrator.add_sample(0, -10.0f);
+  integrator.add_sample(kHourUs / 2, -10.0f);
+  TEST_ASSERT_DOUBLE_WITHIN(1e-4, 45.0, integrator.get_ah());
+  // Ramp from -10 A to +10 A: the halves cancel
+  integrator.add_sample(kHourUs, 10.0f);
+  TEST_ASSERT_DOUBLE_WITHIN(1e-4, 45.0, integrator.get_ah());
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, 45.0f, integrator.get());
+}
+
+void test_first_sample_only_starts_segment() {
+  AmpHourIntegrator integrator("house", 50.0f, 100.0f, true);
+  integrator.add_sample(123456, 100.0f);
+  TEST_ASSERT_DOUBLE_WITHIN(1e-9, 50.0, integrator.get_ah());
+}
+
+void test_restarted_segment_not_integrated() {
+  AmpHourIntegrator integrator("house", 50.0f, 100.0f, true);
+  integrator.add_sample(0, -10.0f);
+  integrator.add_sample(kHourUs / 2, -10.0f);
+  // No measurement for an hour, then the same load again
+  integrator.restart_segment();
+  integrator.add_sample(kHourUs / 2 + kHourUs, -10.0f);
+  TEST_ASSERT_DOUBLE_WITHIN(1e-4, 45.0, integrator.get_ah());
+  integrator.add_sample(2 * kHourUs, -10.0f);
+  TEST_ASSERT_DOUBLE_WITHIN(1e-4, 40.0, integrator.get_ah());
+}
+
+void test_timestamp_wrap() {
+  AmpHourIntegrator integrator("house", 50.0f, 100.0f, true);
+  // 36 s across the micros() wrap
+  integrator.add_sample(0xFFFFFFFFUL - 17999999UL, 100.0f);
+  integrator.add_sample(18000000UL, 100.0f);
+  TEST_ASSERT_DOUBLE_WITHIN(1e-4, 51.0, integrator.get_ah());
+}
+
+void test_efficiency_split_at_zero_crossing() {
+  AmpHourIntegrator integrator("house", 50.0f, 100.0f, true);
+  integrator.set_charge_efficiency(90.0f);
+  // +10 A to -10 A over an hour: +2.5 Ah charged at 90 %, -2.5 Ah discharged
+  integrator.add_sample(0, 10.0f);
+  integrator.add_sample(kHourUs, -10.0f);
+  TEST_ASSERT_DOUBLE_WITHIN(1e-4, 50.0 + 2.25 - 2.5, integrator.get_ah());
+}
+
+void test_clamped_to_capacity() {
+  AmpHourIntegrator integrator("house", 99.0f, 100.0f, true);
+  integrator.add_sample(0, 10.0f);
+  integrator.add_sample(kHourUs / 2, 10.0f);
+  TEST_ASSERT_DOUBLE_WITHIN(1e-9, 100.0, integrator.get_ah());
+  integrator.set_ah(-5.0);
+  TEST_ASSERT_DOUBLE_WITHIN(1e-9, 0.0, integrator.get_ah());
+  integrator.set_ah(150.0);
+  TEST_ASSERT_DOUBLE_WITHIN(1e-9, 100.0, integrator.get_ah());
+}
+
+void test_timer_mode_holds_current() {
+  AmpHourIntegrator integrator("house", 50.0f, 100.0f);
+  integrator.set(3.6f);
+  fake_hal::run_for_ms(10000);
+  // 3.6 A for 10 s = 0.01 Ah
+  TEST_ASSERT_DOUBLE_WITHIN(1e-5, 50.01, integrator.get_ah());
+}
+
+void test_settings_persist_across_cold_reboot() {
+  {
+    AmpHourIntegrator integrator("house", 50.0f, 100.0f, true);
+    integrator.set_ah(70.0);
+    integrator.set_current_capacity_ah(90.0f);
+    integrator.set_charge_efficiency(95.0f);
+    fake_hal::run_for_ms(AH_JOURNAL_FLUSH_INTERVAL_MS);
+  }
+  fake_hal::reboot(false);
+  AmpHourIntegrator integrator("house", 0.0f, 100.0f, true);
+  TEST_ASSERT_DOUBLE_WITHIN(1e-4, 70.0, integrator.get_ah());
+  TEST_ASSERT_EQUAL_FLOAT(90.0f, integrator.get_current_capacity_ah());
+  TEST_ASSERT_EQUAL_FLOAT(100.0f, integrator.get_marked_capacity_ah());
+  TEST_ASSERT_EQUAL_FLOAT(95.0f, integrator.get_charge_efficiency());
+}
+
+void test_unflushed_change_lost_on_cold_reboot() {
+  {
+    AmpHourIntegrator integrator("house", 50.0f, 100.0f, true);
+    integrator.set_ah(70.0);
+    fake_hal::run_for_ms(AH_JOURNAL_FLUSH_INTERVAL_MS);
+    integrator.set_ah(60.0);
+  }
+  fake_hal::reboot(false);
+  AmpHourIntegrator integrator("house", 0.0f, 100.0f, true);
+  TEST_ASSERT_DOUBLE_WITHIN(1e-4, 70.0, integrator.get_ah());
+}
+
+#if AH_RTC_SNAPSHOT
+void test_warm_reboot_restores_from_rtc_snapshot() {
+  uint32_t writes;
+  {
+    AmpHourIntegrator integrator("house", 50.0f, 100.0f, true);
+    integrator.set_ah(70.0);
+    fake_hal::run_for_ms(AH_JOURNAL_FLUSH_INTERVAL_MS);
+    // Below the persist delta: only in the RTC snapshot
+    integrator.add_sample(0, 36.0f);
+    integrator.add_sample(10000000UL, 36.0f);
+    writes = fake_hal::journal_flash().write_count;
+  }
+  fake_hal::reboot(true);
+  AmpHourIntegrator integrator("house", 0.0f, 100.0f, true);
+  TEST_ASSERT_DOUBLE_WITHIN(1e-3, 70.1, integrator.get_ah());
+  TEST_ASSERT_EQUAL_UINT32(writes, fake_hal::journal_flash().write_count);
+}
+#endif
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_trapezoid_per_sample);
+  RUN_TEST(test_first_sample_only_starts_segment);
+  RUN_TEST(test_restarted_segment_not_integrated);
+  RUN_TEST(test_timestamp_wrap);
+  RUN_TEST(test_efficiency_split_at_zero_crossing);
+  RUN_TEST(test_clamped_to_capacity);
+  RUN_TEST(test_timer_mode_holds_current);
+  RUN_TEST(test_settings_persist_across_cold_reboot);
+  RUN_TEST(test_unflushed_change_lost_on_cold_reboot);
+#if AH_RTC_SNAPSHOT
+  RUN_TEST(test_warm_reboot_restores_from_rtc_snapshot);
+#endif
+  return UNITY_END();
+}
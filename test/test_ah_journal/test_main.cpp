@@ -0,0 +1,156 @@
+#include <unity.h>
+
+#include <cstring>
+
+#include "ah_journal.h"
+#include "memory_storage.h"
+
+using namespace sensesp;
+
+namespace {
+
+// sequence + key + state + crc
+constexpr size_t kRecordSize = 4 + AhStateStore::kKeyLength + sizeof(AhPersistedState) + 4;
+
+fake_hal::MemoryFlash* flash;
+
+// Store that keeps everything in RAM (legacy store for the migration test)
+class RamStore : public AhStateStore {
+ protected:
+  bool commit(Entry* const*, size_t) override { return true; }
+};
+
+AhPersistedState state_with_ah(float ah) {
+  AhPersistedState state;
+  state.ah = ah;
+  state.marked_capacity_ah = 100.0f;
+  state.current_capacity_ah = 95.0f;
+  return state;
+}
+
+float restored_ah(AhStateStore* store, const char* key) {
+  AhPersistedState state;
+  return store->restore(key, &state) ? state.ah : -1.0f;
+}
+
+}  // namespace
+
+void setUp() { flash = new fake_hal::MemoryFlash(); }
+
+void tearDown() { delete flash; }
+
+void test_empty_flash_has_no_state() {
+  AhJournal journal(flash);
+  AhPersistedState state;
+  TEST_ASSERT_FALSE(journal.restore("house", &state));
+  TEST_ASSERT_EQUAL_UINT32(0, flash->erase_count);
+  TEST_ASSERT_EQUAL_UINT32(0, flash->write_count);
+}
+
+void test_flush_batches_all_keys_in_one_write() {
+  AhJournal journal(flash);
+  journal.update("house", state_with_ah(50.0f));
+  journal.update("starter", state_with_ah(60.0f));
+  journal.flush();
+  TEST_ASSERT_EQUAL_UINT32(1, flash->write_count);
+  TEST_ASSERT_EQUAL_UINT32(1, journal.get_commit_count());
+  TEST_ASSERT_EQUAL_UINT32(2, journal.get_record_count());
+
+  // Nothing staged: no flash access
+  journal.flush();
+  TEST_ASSERT_EQUAL_UINT32(1, flash->write_count);
+
+  AhJournal rescanned(flash);
+  TEST_ASSERT_EQUAL_FLOAT(50.0f, restored_ah(&rescanned, "house"));
+  TEST_ASSERT_EQUAL_FLOAT(60.0f, restored_ah(&rescanned, "starter"));
+}
+
+void test_newest_record_wins_across_sector_wrap() {
+  AhJournal journal(flash);
+  journal.update("starter", state_with_ah(60.0f));
+  const int kFlushes = 1000;  // Wraps the 4 sector ring twice
+  for (int i = 1; i <= kFlushes; i++) {
+    journal.update("house", state_with_ah(static_cast<float>(i)));
+    journal.flush();
+  }
+  size_t per_sector = fake_hal::MemoryFlash::kSectorSize / kRecordSize;
+  TEST_ASSERT_GREATER_THAN_UINT32(fake_hal::MemoryFlash::kSize / fake_hal::MemoryFlash::kSectorSize,
+                                  journal.get_erase_count());
+  // One erase per sector of records (plus the carried-over keys)
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(kFlushes / (per_sector - 2) + 1, journal.get_erase_count());
+
+  AhJournal rescanned(flash);
+  TEST_ASSERT_EQUAL_FLOAT(static_cast<float>(kFlushes), restored_ah(&rescanned, "house"));
+  // Never updated again, but carried into every new sector
+  TEST_ASSERT_EQUAL_FLOAT(60.0f, restored_ah(&rescanned, "starter"));
+}
+
+void test_torn_record_is_skipped() {
+  {
+    AhJournal journal(flash);
+    journal.update("house", state_with_ah(1.0f));
+    journal.flush();
+    journal.update("house", state_with_ah(2.0f));
+    journal.flush();
+  }
+  // Power lost while programming the second record
+  flash->data()[kRecordSize + 18] &= 0x0F;
+
+  AhJournal rescanned(flash);
+  TEST_ASSERT_EQUAL_FLOAT(1.0f, restored_ah(&rescanned, "house"));
+
+  // The torn slot is not reused
+  rescanned.update("house", state_with_ah(3.0f));
+  rescanned.flush();
+  uint32_t sequence;
+  memcpy(&sequence, flash->data() + 2 * kRecordSize, sizeof(sequence));
+  TEST_ASSERT_NOT_EQUAL(0xFFFFFFFFUL, sequence);
+  AhJournal again(flash);
+  TEST_ASSERT_EQUAL_FLOAT(3.0f, restored_ah(&again, "house"));
+}
+
+void test_foreign_data_is_erased_before_use() {
+  memset(flash->data(), 0x5A, fake_hal::MemoryFlash::kSize);
+  AhJournal journal(flash);
+  AhPersistedState state;
+  TEST_ASSERT_FALSE(journal.restore("house", &state));
+  journal.update("house", state_with_ah(7.0f));
+  journal.flush();
+  TEST_ASSERT_EQUAL_UINT32(1, journal.get_erase_count());
+  AhJournal rescanned(flash);
+  TEST_ASSERT_EQUAL_FLOAT(7.0f, restored_ah(&rescanned, "house"));
+}
+
+void test_keys_migrate_from_fallback_store() {
+  RamStore legacy;
+  legacy.update("house", state_with_ah(42.0f));
+  {
+    AhJournal journal(flash, &legacy);
+    TEST_ASSERT_EQUAL_FLOAT(42.0f, restored_ah(&journal, "house"));
+    // Staged by the lookup, written by the next flush
+    journal.flush();
+    TEST_ASSERT_EQUAL_UINT32(1, journal.get_record_count());
+  }
+  AhJournal rescanned(flash);
+  TEST_ASSERT_EQUAL_FLOAT(42.0f, restored_ah(&rescanned, "house"));
+}
+
+void test_long_keys_are_truncated() {
+  AhJournal journal(flash);
+  journal.update("house/battery", state_with_ah(5.0f));
+  journal.flush();
+  AhJournal rescanned(flash);
+  TEST_ASSERT_EQUAL_FLOAT(5.0f, restored_ah(&rescanned, "house/ba"));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_empty_flash_has_no_state);
+  RUN_TEST(test_flush_batches_all_keys_in_one_write);
+  RUN_TEST(test_newest_record_wins_across_sector_wrap);
+  RUN_TEST(test_torn_record_is_skipped);
+  RUN_TEST(test_foreign_data_is_erased_before_use);
+  RUN_TEST(test_keys_migrate_from_fallback_store);
+  RUN_TEST(test_long_keys_are_truncated);
+  return UNITY_END();
+}
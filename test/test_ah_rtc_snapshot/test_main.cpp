@@ -0,0 +1,214 @@
+#include <unity.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+
+#include "ah_persist_policy.h"
+#include "ah_rtc_snapshot.h"
+
+using namespace sensesp;
+
+namespace {
+
+// Plain memory standing in for RTC_NOINIT: a reset constructs a new
+// AhRtcSnapshot on the same region
+AhRtcSnapshot::Region* region;
+
+AhPersistedState make_state(float ah) {
+  AhPersistedState state;
+  state.ah = ah;
+  state.marked_capacity_ah = 200.0f;
+  state.current_capacity_ah = 190.0f;
+  state.charge_efficiency = 98.0f;
+  state.discharge_efficiency = 99.0f;
+  return state;
+}
+
+void assert_state(const AhPersistedState& expected, const AhPersistedState& actual) {
+  TEST_ASSERT_EQUAL_FLOAT(expected.ah, actual.ah);
+  TEST_ASSERT_EQUAL_FLOAT(expected.marked_capacity_ah, actual.marked_capacity_ah);
+  TEST_ASSERT_EQUAL_FLOAT(expected.current_capacity_ah, actual.current_capacity_ah);
+  TEST_ASSERT_EQUAL_FLOAT(expected.charge_efficiency, actual.charge_efficiency);
+  TEST_ASSERT_EQUAL_FLOAT(expected.discharge_efficiency, actual.discharge_efficiency);
+}
+
+// One boot that writes a single state for key
+void write_once(const char* key, float ah) {
+  AhRtcSnapshot boot(region, false);
+  boot.update(boot.attach(key), make_state(ah), 1);
+}
+
+}  // namespace
+
+void setUp() { region = new AhRtcSnapshot::Region; }
+
+void tearDown() { delete region; }
+
+void test_warm_reset_restores_newest_state() {
+  AhRtcSnapshot boot1(region, false);
+  int house = boot1.attach("house");
+  int start = boot1.attach("start");
+  for (int step = 0; step < 1000; step++) {
+    boot1.update(house, make_state(150.0f - step * 0.01f), step * 100);
+    boot1.update(start, make_state(100.0f - step * 0.001f), step * 100);
+  }
+
+  // Batteries attach in the other order after the reset
+  AhRtcSnapshot boot2(region, true);
+  int start2 = boot2.attach("start");
+  int house2 = boot2.attach("house");
+  AhPersistedState house_state;
+  AhPersistedState start_state;
+  uint32_t integrated_ms = 0;
+  TEST_ASSERT_TRUE(boot2.restore(house2, &house_state, &integrated_ms));
+  TEST_ASSERT_TRUE(boot2.restore(start2, &start_state));
+  assert_state(make_state(150.0f - 999 * 0.01f), house_state);
+  assert_state(make_state(100.0f - 999 * 0.001f), start_state);
+  TEST_ASSERT_EQUAL_UINT32(99900, integrated_ms);
+  TEST_ASSERT_EQUAL_UINT32(2, boot2.get_restore_count());
+
+  // Keeps working across several resets
+  boot2.update(house2, make_state(42.0f), 5);
+  AhRtcSnapshot boot3(region, true);
+  TEST_ASSERT_TRUE(boot3.restore(boot3.attach("house"), &house_state));
+  TEST_ASSERT_EQUAL_FLOAT(42.0f, house_state.ah);
+}
+
+void test_torn_write_restores_previous_step() {
+  AhRtcSnapshot boot1(region, false);
+  int house = boot1.attach("house");
+  boot1.update(house, make_state(120.0f), 1000);
+  boot1.update(house, make_state(119.5f), 1100);
+
+  // Reset while the next update was half written: the slot it overwrites
+  // gets a new sequence but keeps the old CRC
+  AhRtcSnapshot::Slot* slots = region->slots[house];
+  AhRtcSnapshot::Slot& older = slots[0].sequence < slots[1].sequence ? slots[0] : slots[1];
+  older.sequence += 2;
+  older.state.ah = 119.0f;
+
+  AhRtcSnapshot boot2(region, true);
+  AhPersistedState state;
+  TEST_ASSERT_TRUE(boot2.restore(boot2.attach("house"), &state));
+  TEST_ASSERT_EQUAL_FLOAT(119.5f, state.ah);
+}
+
+void test_power_on_restores_nothing() {
+  write_once("house", 80.0f);
+  AhRtcSnapshot power_on(region, false);
+  AhPersistedState state;
+  TEST_ASSERT_FALSE(power_on.restore(power_on.attach("house"), &state));
+}
+
+void test_random_memory_restores_nothing() {
+  // Whatever RAM held (different firmware, never written)
+  std::mt19937 rng(1);
+  uint8_t* bytes = reinterpret_cast<uint8_t*>(region);
+  for (size_t i = 0; i < sizeof(*region); i++) {
+    bytes[i] = static_cast<uint8_t>(rng());
+  }
+  AhRtcSnapshot random(region, true);
+  int house = random.attach("house");
+  int start = random.attach("start");
+  AhPersistedState state;
+  TEST_ASSERT_FALSE(random.restore(house, &state));
+  TEST_ASSERT_FALSE(random.restore(start, &state));
+}
+
+void test_other_layout_restores_nothing() {
+  // Valid CRC but another layout magic
+  write_once("house", 80.0f);
+  for (auto& pair : region->slots) {
+    for (auto& slot : pair) {
+      slot.magic ^= 0x04;
+      slot.crc = journal_crc32(&slot, offsetof(AhRtcSnapshot::Slot, crc));
+    }
+  }
+  AhRtcSnapshot other_layout(region, true);
+  AhPersistedState state;
+  TEST_ASSERT_FALSE(other_layout.restore(other_layout.attach("house"), &state));
+}
+
+void test_renamed_battery_gets_no_state() {
+  write_once("house", 80.0f);
+  AhRtcSnapshot boot2(region, true);
+  AhPersistedState state;
+  int aux = boot2.attach("aux");
+  TEST_ASSERT_FALSE(boot2.restore(aux, &state));
+  // The old battery's pair is kept
+  boot2.update(aux, make_state(10.0f), 1);
+  TEST_ASSERT_TRUE(boot2.restore(boot2.attach("house"), &state));
+  TEST_ASSERT_EQUAL_FLOAT(80.0f, state.ah);
+}
+
+void test_reset_loses_no_integrated_ah() {
+  // Resets at random moments while discharging, flash persistence rules alone
+  // versus the snapshot
+  const float current_a = -6.0f;
+  const float step_s = 2.0f;  // Steady mode read interval
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<float> reset_s(60.0f, 7200.0f);
+  double flash_loss = 0;
+  double snapshot_loss = 0;
+  const int resets = 200;
+  for (int n = 0; n < resets; n++) {
+    AhPersistPolicy policy;
+    policy.mark(150.0f, 0);
+    float ah = 150.0f;
+    float persisted = 150.0f;
+    AhRtcSnapshot before(region, false);
+    int house = before.attach("house");
+    float end_s = reset_s(rng);
+    for (float t = step_s; t <= end_s; t += step_s) {
+      ah += current_a * step_s / 3600.0f;
+      before.update(house, make_state(ah), static_cast<uint32_t>(t * 1000));
+      // AmpHourIntegrator stages on the delta
+      if (policy.delta_reached(ah)) {
+        policy.mark(ah, static_cast<unsigned long>(t * 1000));
+        persisted = ah;
+      }
+    }
+    AhRtcSnapshot after(region, true);
+    AhPersistedState restored;
+    if (!after.restore(after.attach("house"), &restored)) {
+      restored.ah = persisted;
+    }
+    flash_loss += std::fabs(ah - persisted);
+    snapshot_loss += std::fabs(ah - restored.ah);
+  }
+  char message[96];
+  snprintf(message, sizeof(message), "Ah lost per reset at %.0f A: flash only %.3f Ah (mean), with snapshot %.3f Ah",
+           -current_a, flash_loss / resets, snapshot_loss / resets);
+  TEST_MESSAGE(message);
+  TEST_ASSERT_TRUE(flash_loss > 0.0);
+  TEST_ASSERT_EQUAL_DOUBLE(0.0, snapshot_loss);
+}
+
+void test_update_cost() {
+  AhRtcSnapshot snapshot(region, false);
+  int house = snapshot.attach("house");
+  const int updates = 1000000;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < updates; i++) {
+    snapshot.update(house, make_state(static_cast<float>(i)), i);
+  }
+  double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / updates;
+  char message[64];
+  snprintf(message, sizeof(message), "update(): %.0f ns on this host", ns);
+  TEST_MESSAGE(message);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_warm_reset_restores_newest_state);
+  RUN_TEST(test_torn_write_restores_previous_step);
+  RUN_TEST(test_power_on_restores_nothing);
+  RUN_TEST(test_random_memory_restores_nothing);
+  RUN_TEST(test_other_layout_restores_nothing);
+  RUN_TEST(test_renamed_battery_gets_no_state);
+  RUN_TEST(test_reset_loses_no_integrated_ah);
+  RUN_TEST(test_update_cost);
+  return UNITY_END();
+}
@@ -0,0 +1,302 @@
+#include <unity.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+
+#include "ah_accumulator.h"
+#include "bank_aggregate.h"
+
+using namespace sensesp;
+
+namespace {
+
+// Tolerance of the float -> uAh conversion of one member's Ah
+constexpr float kAhTolerance = 1e-4f;
+constexpr uint64_t kUsPerS = 1000000;
+
+// One simulated monitor: its own sample grid and Ah accumulator
+struct Member {
+  const char* name;
+  float capacity_ah;
+  float initial_ah;
+  uint32_t period_us;
+  uint32_t phase_us;
+  float base_a;  // Mean current, a load cycle and noise ride on it
+  DoubleAhAccumulator accumulator;
+  uint64_t next_us = 0;
+  uint64_t last_us = 0;
+  float last_a = 0;
+  bool has_sample = false;
+  bool online = true;
+  BankMemberState state = {};
+};
+
+// What the 6 hour simulation observed
+struct Result {
+  long updates = 0;
+  float worst_sum_error = 0;
+  double worst_integral_error = 0;
+  bool join_leave_exact = true;
+  bool outage_seen = false;
+  bool offline_ok = true;
+  float soc_pct = NAN;
+  float ah = NAN;
+  float capacity_ah = NAN;
+  BankAggregate after_all_left;
+};
+
+float member_current(const Member& member, double t_s, std::mt19937& rng) {
+  std::normal_distribution<float> gauss(0.0f, 0.05f);
+  float cycle = std::fmod(t_s, 1800.0) < 600.0 ? -3.0f : 0.0f;  // Compressor
+  return member.base_a + cycle * (member.capacity_ah / 200.0f) + gauss(rng);
+}
+
+// Three members on unsynchronised sample grids (like INA226s on their own
+// conversion clocks). Two leave and join again mid-integration, then one goes
+// offline for 10 minutes.
+Result simulate() {
+  Result result;
+  std::mt19937 rng(1);
+  Member members[] = {
+      {"house", 200.0f, 150.0f, 1000000, 0, -4.0f, {}},
+      {"starter", 110.0f, 100.0f, 1000000, 370000, 0.8f, {}},
+      {"lithium", 280.0f, 200.0f, 100000, 55000, -6.0f, {}},
+  };
+  const int count = sizeof(members) / sizeof(members[0]);
+  BankAggregate aggregate;
+  for (int m = 0; m < count; m++) {
+    members[m].accumulator.set_capacity(0);  // No clamping: keep the sums comparable
+    members[m].accumulator.set_ah(members[m].initial_ah);
+    members[m].next_us = members[m].phase_us;
+    members[m].state = {NAN, NAN, NAN, members[m].initial_ah, members[m].capacity_ah, false};
+    aggregate.join(m, members[m].state);
+  }
+
+  const uint64_t end_us = 6 * 3600 * kUsPerS;
+  const uint64_t starter_leave_us = end_us / 6;
+  const uint64_t starter_join_us = end_us / 3;
+  const uint64_t lithium_leave_us = end_us / 2 + 123456;  // Between two lithium samples
+  const uint64_t lithium_join_us = end_us * 2 / 3;
+  const uint64_t house_offline_us = end_us * 5 / 6;
+  const uint64_t house_online_us = house_offline_us + 600 * kUsPerS;
+
+  // Combined Ah against the integral of the combined current, per stretch of
+  // constant membership
+  double integral_ah = 0;
+  double stretch_start_ah = aggregate.ah();
+  uint64_t last_aggregate_us = 0;
+  float last_aggregate_a = NAN;
+
+  auto end_stretch = [&]() {
+    double error = std::fabs((aggregate.ah() - stretch_start_ah) - integral_ah);
+    result.worst_integral_error = std::max(result.worst_integral_error, error);
+  };
+  auto start_stretch = [&](uint64_t t_us) {
+    stretch_start_ah = aggregate.ah();
+    integral_ah = 0;
+    last_aggregate_us = t_us;
+    last_aggregate_a = aggregate.current_a();
+  };
+  auto change_membership = [&](int m, bool join, uint64_t t_us) {
+    end_stretch();
+    float ah_before = aggregate.ah();
+    float capacity_before = aggregate.capacity_ah();
+    if (join) {
+      aggregate.join(m, members[m].state);
+    } else {
+      aggregate.leave(m);
+    }
+    float sign = join ? 1.0f : -1.0f;
+    result.join_leave_exact &= std::fabs(aggregate.ah() - ah_before - sign * members[m].state.ah) < kAhTolerance;
+    result.join_leave_exact &=
+        std::fabs(aggregate.capacity_ah() - capacity_before - sign * members[m].capacity_ah) < 1e-4f;
+    start_stretch(t_us);
+  };
+
+  bool starter_left = false, starter_joined = false, lithium_left = false, lithium_joined = false;
+  bool house_down = false, house_up = false;
+  for (uint64_t t_us = 0; t_us < end_us; t_us += 1000) {
+    if (!starter_left && t_us >= starter_leave_us) {
+      starter_left = true;
+      change_membership(1, false, t_us);
+    }
+    if (!starter_joined && t_us >= starter_join_us) {
+      starter_joined = true;
+      change_membership(1, true, t_us);
+    }
+    if (!lithium_left && t_us >= lithium_leave_us) {
+      lithium_left = true;
+      change_membership(2, false, t_us);
+    }
+    if (!lithium_joined && t_us >= lithium_join_us) {
+      lithium_joined = true;
+      change_membership(2, true, t_us);
+    }
+    if (!house_down && t_us >= house_offline_us) {
+      // What VirtualBank::emit_outputs() does for an offline monitor
+      house_down = true;
+      members[0].online = false;
+      members[0].state.measured = false;
+      aggregate.update(0, members[0].state);
+      end_stretch();
+    }
+    if (!house_up && t_us >= house_online_us) {
+      house_up = true;
+      members[0].online = true;
+      members[0].has_sample = false;  // Integration resumes with the next sample
+    }
+
+    for (int m = 0; m < count; m++) {
+      Member& member = members[m];
+      if (t_us < member.next_us) {
+        continue;
+      }
+      member.next_us += member.period_us;
+      if (!member.online) {
+        continue;
+      }
+      float current = member_current(member, t_us / 1e6, rng);
+      if (member.has_sample) {
+        member.accumulator.add_trapezoid(member.last_a, current, static_cast<uint32_t>(t_us - member.last_us));
+      }
+      bool resumed = !member.has_sample && house_up && m == 0;
+      member.has_sample = true;
+      member.last_us = t_us;
+      member.last_a = current;
+      member.state.voltage_v = 12.6f + current * 0.01f + m * 0.05f;
+      member.state.current_a = current;
+      member.state.power_w = member.state.voltage_v * current;
+      member.state.ah = member.accumulator.get_ah_float();
+      member.state.measured = true;
+      aggregate.update(m, member.state);
+      result.updates++;
+      if (resumed) {
+        start_stretch(t_us);
+      }
+
+      // Integrate the combined current between member samples (step-wise, as
+      // each member's current holds until its next sample)
+      float combined = aggregate.current_a();
+      if (!std::isnan(last_aggregate_a)) {
+        integral_ah += last_aggregate_a * ((t_us - last_aggregate_us) / 3.6e9);
+      }
+      last_aggregate_us = t_us;
+      last_aggregate_a = combined;
+
+      float expected_ah = 0;
+      for (int k = 0; k < count; k++) {
+        if (aggregate.is_member(k)) {
+          expected_ah += members[k].state.ah;
+        }
+      }
+      result.worst_sum_error = std::max(result.worst_sum_error, std::fabs(aggregate.ah() - expected_ah));
+
+      if (house_down && !house_up) {
+        result.outage_seen = true;
+        float expected_voltage = 0;
+        int measured = 0;
+        for (int k = 1; k < count; k++) {
+          if (aggregate.is_member(k)) {
+            expected_voltage += members[k].state.voltage_v;
+            measured++;
+          }
+        }
+        result.offline_ok &= std::isnan(aggregate.current_a()) && std::isnan(aggregate.power_w());
+        result.offline_ok &= std::fabs(aggregate.voltage_v() - expected_voltage / measured) < 1e-4f;
+      }
+    }
+  }
+  end_stretch();
+
+  result.soc_pct = aggregate.soc_pct();
+  result.ah = aggregate.ah();
+  result.capacity_ah = aggregate.capacity_ah();
+  for (int m = 0; m < count; m++) {
+    aggregate.leave(m);
+  }
+  result.after_all_left = aggregate;
+  return result;
+}
+
+// The simulation runs once for all tests
+const Result& simulation() {
+  static Result result = simulate();
+  return result;
+}
+
+}  // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_combined_ah_is_sum_over_members() {
+  char message[96];
+  snprintf(message, sizeof(message), "%ld member updates over 6 h; worst |combined Ah - sum| %.6f Ah",
+           simulation().updates, simulation().worst_sum_error);
+  TEST_MESSAGE(message);
+  TEST_ASSERT_FLOAT_WITHIN(3 * kAhTolerance, 0.0f, simulation().worst_sum_error);
+}
+
+void test_join_and_leave_move_exactly_the_member_share() { TEST_ASSERT_TRUE(simulation().join_leave_exact); }
+
+void test_combined_ah_follows_combined_current() {
+  // The members' currents are only sampled, so the step-wise integral of the
+  // combined current differs from the members' trapezoids a little
+  TEST_ASSERT_DOUBLE_WITHIN(0.02, 0.0, simulation().worst_integral_error);
+}
+
+void test_offline_member_blanks_current_and_power() {
+  // No current or power, voltage of the others, Ah kept
+  TEST_ASSERT_TRUE(simulation().outage_seen);
+  TEST_ASSERT_TRUE(simulation().offline_ok);
+}
+
+void test_soc_is_combined_ah_over_combined_capacity() {
+  TEST_ASSERT_FLOAT_WITHIN(1e-3f, 590.0f, simulation().capacity_ah);
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, soc_percent(simulation().ah, simulation().capacity_ah), simulation().soc_pct);
+}
+
+void test_sums_exactly_zero_once_every_member_left() {
+  const BankAggregate& aggregate = simulation().after_all_left;
+  TEST_ASSERT_EQUAL_INT(0, aggregate.member_count());
+  TEST_ASSERT_TRUE(aggregate.ah() == 0.0f);
+  TEST_ASSERT_TRUE(aggregate.capacity_ah() == 0.0f);
+  TEST_ASSERT_TRUE(std::isnan(aggregate.voltage_v()));
+  TEST_ASSERT_TRUE(std::isnan(aggregate.current_a()));
+}
+
+void test_update_cost() {
+  BankAggregate bench;
+  BankMemberState state = {12.7f, -5.0f, -63.5f, 150.0f, 200.0f, true};
+  for (int m = 0; m < 4; m++) {
+    bench.join(m, state);
+  }
+  const int samples = 10000000;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < samples; i++) {
+    state.current_a = -5.0f - (i & 7) * 0.1f;
+    state.ah = 150.0f - i * 1e-6f;
+    bench.update(i & 3, state);
+  }
+  double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / samples;
+  char message[96];
+  snprintf(message, sizeof(message), "update(): %.1f ns on this host, %zu bytes of state (current %.2f A)", ns,
+           sizeof(bench), bench.current_a());
+  TEST_MESSAGE(message);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_combined_ah_is_sum_over_members);
+  RUN_TEST(test_join_and_leave_move_exactly_the_member_share);
+  RUN_TEST(test_combined_ah_follows_combined_current);
+  RUN_TEST(test_offline_member_blanks_current_and_power);
+  RUN_TEST(test_soc_is_combined_ah_over_combined_capacity);
+  RUN_TEST(test_sums_exactly_zero_once_every_member_left);
+  RUN_TEST(test_update_cost);
+  return UNITY_END();
+}
@@ -0,0 +1,225 @@
+#include <unity.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#include "battery_bank.h"
+#include "fake_hal.h"
+#include "fake_i2c.h"
+#include "virtual_bank.h"
+
+using namespace sensesp;
+
+// Heap use of everything the bank creates (host figures: the fake Signal K
+// classes keep their paths in std::string like SensESP's String)
+static size_t heap_allocations = 0;
+static size_t heap_bytes = 0;
+
+void* operator new(size_t size) {
+  heap_allocations++;
+  heap_bytes += size;
+  void* memory = malloc(size == 0 ? 1 : size);
+  if (memory == nullptr) {
+    throw std::bad_alloc();
+  }
+  return memory;
+}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+void operator delete(void* memory) noexcept { free(memory); }
+void operator delete(void* memory, size_t) noexcept { free(memory); }
+#pragma GCC diagnostic pop
+
+namespace {
+
+constexpr size_t kSizes[] = {2, 4, 8, 16};
+constexpr size_t kSizeCount = sizeof(kSizes) / sizeof(kSizes[0]);
+constexpr uint32_t kRunMs = 60000;
+
+char names[BATTERY_BANK_MAX_MONITORS][8];
+BatteryConfig configs[BATTERY_BANK_MAX_MONITORS];
+
+alignas(PipelineArena::kAlignment) uint8_t arena_storage[BATTERY_BANK_MAX_MONITORS * 64 * 1024];
+
+struct BankCost {
+  size_t arena_bytes;
+  size_t heap_allocations;
+  size_t heap_bytes;
+  size_t events;
+  uint64_t callbacks;
+  uint64_t callback_ns;
+  uint32_t transfers;
+};
+
+void make_configs(int alert_pin_base) {
+  for (size_t i = 0; i < BATTERY_BANK_MAX_MONITORS; i++) {
+    snprintf(names[i], sizeof(names[i]), "bat%u", static_cast<unsigned>(i));
+    configs[i] = {names[i], names[i], static_cast<uint8_t>(0x40 + i), 0.0075f, 0.25f, 100.0f, 80.0f,
+                  alert_pin_base < 0 ? -1 : alert_pin_base + static_cast<int>(i), false,
+                  BatteryChemistry::kLeadAcid, 6};
+  }
+}
+
+BankCost run_bank(size_t count) {
+  fake_hal::reset();
+  pipeline_arena()->set_storage(arena_storage, sizeof(arena_storage));
+  fake_hal::FakeI2CTransport transport;
+  fake_hal::FakeINA226* chips[BATTERY_BANK_MAX_MONITORS];
+  for (size_t i = 0; i < count; i++) {
+    chips[i] = new fake_hal::FakeINA226(configs[i].i2c_address, configs[i].shunt_resistance, configs[i].alert_pin);
+    chips[i]->set_input(12.6f + 0.01f * i, -2.0f - 0.5f * i);
+    transport.add(chips[i]);
+  }
+  I2CBus bus(&transport);
+
+  BankCost cost;
+  size_t allocations = heap_allocations;
+  size_t bytes = heap_bytes;
+  pipeline_arena()->create<BatteryBank>(configs, count, &bus);
+  cost.arena_bytes = pipeline_arena()->used();
+  cost.heap_allocations = heap_allocations - allocations;
+  cost.heap_bytes = heap_bytes - bytes;
+
+  fake_hal::run_for_ms(1000);  // Boot and first samples
+  cost.events = fake_hal::loop().event_count();
+  uint64_t callbacks = fake_hal::loop().get_call_count();
+  uint64_t callback_ns = fake_hal::loop().get_call_ns();
+  uint32_t transfers = transport.transfer_count;
+  fake_hal::run_for_ms(kRunMs);
+  cost.callbacks = fake_hal::loop().get_call_count() - callbacks;
+  cost.callback_ns = fake_hal::loop().get_call_ns() - callback_ns;
+  cost.transfers = transport.transfer_count - transfers;
+
+  for (size_t i = 0; i < count; i++) {
+    delete chips[i];
+  }
+  return cost;
+}
+
+void check_scaling(const char* label) {
+  BankCost costs[kSizeCount];
+  for (size_t i = 0; i < kSizeCount; i++) {
+    costs[i] = run_bank(kSizes[i]);
+    char message[200];
+    snprintf(message, sizeof(message),
+             "%s, %2u batteries: arena %6u B, heap %3u allocs / %5u B, %u callbacks, %llu callbacks/s, "
+             "%.1f us callback time/s, %u I2C transfers/s",
+             label, static_cast<unsigned>(kSizes[i]), static_cast<unsigned>(costs[i].arena_bytes),
+             static_cast<unsigned>(costs[i].heap_allocations), static_cast<unsigned>(costs[i].heap_bytes),
+             static_cast<unsigned>(costs[i].events),
+             static_cast<unsigned long long>(costs[i].callbacks * 1000 / kRunMs),
+             costs[i].callback_ns / 1000.0 / (kRunMs / 1000), static_cast<unsigned>(costs[i].transfers * 1000 / kRunMs));
+    TEST_MESSAGE(message);
+  }
+
+  size_t arena_per_battery = (costs[1].arena_bytes - costs[0].arena_bytes) / (kSizes[1] - kSizes[0]);
+  size_t heap_per_battery = (costs[1].heap_allocations - costs[0].heap_allocations) / (kSizes[1] - kSizes[0]);
+  for (size_t i = 0; i < kSizeCount; i++) {
+    // One set of callbacks for the whole bank, however many batteries
+    TEST_ASSERT_EQUAL_size_t(costs[0].events, costs[i].events);
+    // ALERT mode ticks once per loop pass, and I2C time stretches the pass
+    TEST_ASSERT_UINT32_WITHIN(costs[0].callbacks / 20, costs[0].callbacks, costs[i].callbacks);
+    // Memory grows by the same amount per battery
+    TEST_ASSERT_EQUAL_size_t(costs[0].arena_bytes + (kSizes[i] - kSizes[0]) * arena_per_battery,
+                             costs[i].arena_bytes);
+    TEST_ASSERT_EQUAL_size_t(costs[0].heap_allocations + (kSizes[i] - kSizes[0]) * heap_per_battery,
+                             costs[i].heap_allocations);
+    // And matches the compile-time size
+    TEST_ASSERT_EQUAL_size_t(battery_bank_arena_bytes(configs, kSizes[i]), costs[i].arena_bytes);
+    TEST_ASSERT_EQUAL_UINT32(0, pipeline_arena()->get_overflow_count());
+  }
+}
+
+}  // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_polled_bank_scaling() {
+  make_configs(-1);
+  check_scaling("polled");
+}
+
+void test_alert_bank_scaling() {
+  make_configs(16);
+  check_scaling("ALERT");
+}
+
+void test_offline_gap_not_integrated() {
+  make_configs(-1);
+  fake_hal::reset();
+  pipeline_arena()->set_storage(arena_storage, sizeof(arena_storage));
+  fake_hal::FakeI2CTransport transport;
+  fake_hal::FakeINA226 chip(configs[0].i2c_address, configs[0].shunt_resistance);
+  chip.set_input(12.4f, -10.0f);
+  transport.add(&chip);
+  I2CBus bus(&transport);
+  BatteryBank* bank = pipeline_arena()->create<BatteryBank>(configs, 1, &bus);
+  BatteryMonitor& monitor = bank->monitor(0);
+
+  fake_hal::run_for_ms(60000);
+  // 30 minutes without the chip: 5 Ah at 10 A if the gap were bridged
+  chip.present = false;
+  fake_hal::run_for_ms(30 * 60000UL, 10000);
+  TEST_ASSERT_FALSE(monitor.device().is_online());
+  double offline_ah = monitor.integrator().get_ah();
+  chip.present = true;
+  fake_hal::run_for_ms(120000);
+  TEST_ASSERT_TRUE(monitor.device().is_online());
+  // At most the two minutes after the chip returned
+  double drop_ah = offline_ah - monitor.integrator().get_ah();
+  TEST_ASSERT_TRUE(drop_ah > 0.0);
+  TEST_ASSERT_TRUE(drop_ah <= 10.0 * 120 / 3600);
+}
+
+void test_boot_stages_nothing() {
+  make_configs(-1);
+  fake_hal::reset();
+  pipeline_arena()->set_storage(arena_storage, sizeof(arena_storage));
+  fake_hal::FakeI2CTransport transport;
+  fake_hal::FakeINA226 chip(configs[0].i2c_address, configs[0].shunt_resistance);
+  chip.set_input(12.6f, 0.0f);
+  transport.add(&chip);
+  I2CBus bus(&transport);
+  uint32_t commits = ah_state_store()->get_commit_count();
+  pipeline_arena()->create<BatteryBank>(configs, 1, &bus);
+  // Restoring (or starting from initial_ah) is not a change to persist, also
+  // once samples are integrated at 0 A
+  fake_hal::run_for_ms(10000);
+  ah_state_store()->flush();
+  TEST_ASSERT_EQUAL_UINT32(commits, ah_state_store()->get_commit_count());
+}
+
+void test_full_bank_registers_every_output() {
+  make_configs(-1);
+  fake_hal::reset();
+  pipeline_arena()->set_storage(arena_storage, sizeof(arena_storage));
+  fake_hal::FakeI2CTransport transport;
+  I2CBus bus(&transport);
+  BatteryBank* bank = pipeline_arena()->create<BatteryBank>(configs, BATTERY_BANK_MAX_MONITORS, &bus);
+  // The largest virtual banks: every monitor a member of each
+  const char* members[BATTERY_BANK_MAX_MONITORS];
+  for (size_t i = 0; i < BATTERY_BANK_MAX_MONITORS; i++) {
+    members[i] = configs[i].name;
+  }
+  char virtual_names[BATTERY_VIRTUAL_BANK_MAX][8];
+  for (size_t i = 0; i < BATTERY_VIRTUAL_BANK_MAX; i++) {
+    snprintf(virtual_names[i], sizeof(virtual_names[i]), "virt%u", static_cast<unsigned>(i));
+    VirtualBankConfig config = {virtual_names[i], virtual_names[i], members, BATTERY_BANK_MAX_MONITORS, 0};
+    TEST_ASSERT_NOT_NULL(bank->add_virtual_bank(config));
+  }
+  TEST_ASSERT_EQUAL_UINT32(0, bank->emitter().get_unregistered_count());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_polled_bank_scaling);
+  RUN_TEST(test_alert_bank_scaling);
+  RUN_TEST(test_offline_gap_not_integrated);
+  RUN_TEST(test_boot_stages_nothing);
+  RUN_TEST(test_full_bank_registers_every_output);
+  return UNITY_END();
+}
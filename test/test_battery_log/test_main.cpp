@@ -0,0 +1,327 @@
+#include <unity.h>
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include "battery_log.h"
+#include "fake_hal.h"
+
+using namespace sensesp;
+
+namespace {
+
+constexpr uint32_t kIntervalS = 300;
+// Header plus records of a full segment
+constexpr size_t kSegmentRecords = 1 + (BATTERY_LOG_SEGMENT_BYTES - sizeof(LogSegmentHeader)) / sizeof(LogRecord);
+
+struct Decoded {
+  uint32_t uptime_s;
+  float voltage_v;
+  float current_a;
+  float ah;
+  float soc_pct;
+  float temperature_c;  // NaN: no reading
+};
+
+struct Export {
+  std::vector<Decoded> records;
+  std::vector<uint32_t> segment_lengths;
+  std::vector<uint8_t> bytes;
+};
+
+// Decode one segment like tools/log_dump
+bool decode_segment(const uint8_t* data, size_t length, std::vector<Decoded>* records) {
+  LogSegmentHeader header;
+  if (length < sizeof(header) || (length - sizeof(header)) % sizeof(LogRecord) != 0) {
+    return false;
+  }
+  memcpy(&header, data, sizeof(header));
+  if (memcmp(header.magic, "BLG1", 4) != 0 || header.interval_s != kIntervalS) {
+    return false;
+  }
+  int32_t voltage = header.voltage;
+  int32_t current = header.current;
+  int32_t ah = header.ah;
+  int32_t soc = header.soc;
+  int32_t temperature = header.temperature;
+  bool has_temperature = temperature != BatteryLog::kNoTemperature;
+  uint32_t uptime_s = header.uptime_s;
+  for (size_t offset = sizeof(header);; offset += sizeof(LogRecord)) {
+    records->push_back({uptime_s, voltage / 1000.0f, current / 100.0f, ah / 100.0f, soc / 10.0f,
+                        has_temperature ? temperature / 10.0f : NAN});
+    if (offset == length) {
+      return true;
+    }
+    LogRecord record;
+    memcpy(&record, data + offset, sizeof(record));
+    voltage += record.voltage;
+    current += record.current;
+    ah += record.ah;
+    soc += record.soc;
+    has_temperature = record.temperature != BatteryLog::kNoTemperatureDelta;
+    if (has_temperature) {
+      temperature += record.temperature;
+    }
+    uptime_s += header.interval_s;
+  }
+}
+
+// The export through a small chunk, split into its [length][segment] frames
+Export export_log(const BatteryLog& log) {
+  Export result;
+  uint8_t chunk[100];
+  TEST_ASSERT_TRUE(log.export_to(chunk, sizeof(chunk), [&](const void* data, size_t length) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    result.bytes.insert(result.bytes.end(), bytes, bytes + length);
+    return true;
+  }));
+  size_t offset = 0;
+  while (offset < result.bytes.size()) {
+    uint32_t length;
+    TEST_ASSERT_TRUE(offset + sizeof(length) <= result.bytes.size());
+    memcpy(&length, result.bytes.data() + offset, sizeof(length));
+    offset += sizeof(length);
+    TEST_ASSERT_TRUE(offset + length <= result.bytes.size());
+    TEST_ASSERT_TRUE(decode_segment(result.bytes.data() + offset, length, &result.records));
+    result.segment_lengths.push_back(length);
+    offset += length;
+  }
+  return result;
+}
+
+LogValues values_at(uint32_t i) {
+  LogValues values;
+  values.voltage_v = 12.6f + 0.3f * sinf(i * 0.05f);
+  values.current_a = -4.0f + 6.0f * sinf(i * 0.02f);
+  values.ah = 150.0f - 0.01f * (i % 500);
+  values.soc_pct = 75.0f - 0.005f * (i % 500);
+  values.temperature_c = 18.0f + 0.1f * (i % 40);
+  return values;
+}
+
+void append_records(BatteryLog* log, uint32_t first, uint32_t count) {
+  for (uint32_t i = first; i < first + count; i++) {
+    log->append(values_at(i), i * kIntervalS, 0);
+  }
+}
+
+void assert_matches(const Decoded& decoded, const LogValues& values) {
+  TEST_ASSERT_FLOAT_WITHIN(0.0006f, values.voltage_v, decoded.voltage_v);
+  TEST_ASSERT_FLOAT_WITHIN(0.006f, values.current_a, decoded.current_a);
+  TEST_ASSERT_FLOAT_WITHIN(0.006f, values.ah, decoded.ah);
+  TEST_ASSERT_FLOAT_WITHIN(0.06f, values.soc_pct, decoded.soc_pct);
+  if (std::isnan(values.temperature_c)) {
+    TEST_ASSERT_TRUE(std::isnan(decoded.temperature_c));
+  } else {
+    TEST_ASSERT_FLOAT_WITHIN(0.06f, values.temperature_c, decoded.temperature_c);
+  }
+}
+
+fake_hal::MemoryFileSystem* fs;
+
+}  // namespace
+
+void setUp() {
+  fake_hal::reset();
+  fs = &fake_hal::log_file_system();
+}
+
+void tearDown() {}
+
+void test_records_round_trip() {
+  BatteryLog log(fs, "house", BATTERY_LOG_MAX_BYTES, kIntervalS);
+  log.begin();
+  append_records(&log, 0, 100);
+  Export result = export_log(log);
+  TEST_ASSERT_EQUAL_size_t(1, result.segment_lengths.size());
+  TEST_ASSERT_EQUAL_size_t(100, result.records.size());
+  for (uint32_t i = 0; i < 100; i++) {
+    TEST_ASSERT_EQUAL_UINT32(i * kIntervalS, result.records[i].uptime_s);
+    assert_matches(result.records[i], values_at(i));
+  }
+}
+
+void test_saturated_deltas_catch_up() {
+  BatteryLog log(fs, "house", BATTERY_LOG_MAX_BYTES, kIntervalS);
+  log.begin();
+  LogValues values = {12.0f, -2.0f, 100.0f, 50.0f, NAN};
+  log.append(values, 0, 0);
+  // 33 V (int16 mV delta) and 30 % (int8 0.1 % delta) in one interval
+  values.voltage_v = 45.0f;
+  values.soc_pct = 80.0f;
+  for (uint32_t i = 1; i <= 3; i++) {
+    log.append(values, i * kIntervalS, 0);
+  }
+  Export result = export_log(log);
+  TEST_ASSERT_EQUAL_size_t(1, result.segment_lengths.size());
+  TEST_ASSERT_EQUAL_size_t(4, result.records.size());
+  // Saturated, then the rest with the next record: no error remains
+  TEST_ASSERT_FLOAT_WITHIN(0.0006f, 12.0f + INT16_MAX / 1000.0f, result.records[1].voltage_v);
+  TEST_ASSERT_FLOAT_WITHIN(0.0006f, 45.0f, result.records[2].voltage_v);
+  TEST_ASSERT_FLOAT_WITHIN(0.06f, 50.0f + INT8_MAX / 10.0f, result.records[1].soc_pct);
+  TEST_ASSERT_FLOAT_WITHIN(0.06f, 50.0f + 2 * INT8_MAX / 10.0f, result.records[2].soc_pct);
+  TEST_ASSERT_FLOAT_WITHIN(0.06f, 80.0f, result.records[3].soc_pct);
+  assert_matches(result.records[3], values);
+}
+
+void test_first_temperature_starts_segment() {
+  BatteryLog log(fs, "house", BATTERY_LOG_MAX_BYTES, kIntervalS);
+  log.begin();
+  LogValues values = {12.6f, -3.0f, 120.0f, 60.0f, NAN};
+  log.append(values, 0, 0);
+  log.append(values, kIntervalS, 0);
+  // The probe appears: needs an absolute value
+  values.temperature_c = 21.5f;
+  log.append(values, 2 * kIntervalS, 0);
+  // Missed once, then back: deltas against the last reading
+  values.temperature_c = NAN;
+  log.append(values, 3 * kIntervalS, 0);
+  values.temperature_c = 22.0f;
+  log.append(values, 4 * kIntervalS, 0);
+
+  Export result = export_log(log);
+  TEST_ASSERT_EQUAL_size_t(2, result.segment_lengths.size());
+  TEST_ASSERT_EQUAL_size_t(5, result.records.size());
+  TEST_ASSERT_TRUE(std::isnan(result.records[1].temperature_c));
+  TEST_ASSERT_FLOAT_WITHIN(0.06f, 21.5f, result.records[2].temperature_c);
+  TEST_ASSERT_TRUE(std::isnan(result.records[3].temperature_c));
+  TEST_ASSERT_FLOAT_WITHIN(0.06f, 22.0f, result.records[4].temperature_c);
+  // The grid continues across the new segment
+  for (uint32_t i = 0; i < 5; i++) {
+    TEST_ASSERT_EQUAL_UINT32(i * kIntervalS, result.records[i].uptime_s);
+  }
+}
+
+void test_segments_roll_over() {
+  BatteryLog log(fs, "house", BATTERY_LOG_MAX_BYTES, kIntervalS);
+  log.begin();
+  const uint32_t count = 2 * kSegmentRecords + 100;
+  append_records(&log, 0, count);
+  log.flush();
+  Export result = export_log(log);
+  TEST_ASSERT_EQUAL_size_t(3, result.segment_lengths.size());
+  TEST_ASSERT_EQUAL_UINT32(BATTERY_LOG_SEGMENT_BYTES - (BATTERY_LOG_SEGMENT_BYTES - sizeof(LogSegmentHeader)) %
+                                                           sizeof(LogRecord),
+                           result.segment_lengths[0]);
+  TEST_ASSERT_EQUAL_size_t(3, fs->file_count());
+  TEST_ASSERT_EQUAL_size_t(fs->size(BATTERY_LOG_DIR "/house.0") + fs->size(BATTERY_LOG_DIR "/house.1") +
+                               fs->size(BATTERY_LOG_DIR "/house.2"),
+                           log.stored_bytes());
+  TEST_ASSERT_EQUAL_size_t(count, result.records.size());
+  for (uint32_t i = 0; i < count; i++) {
+    TEST_ASSERT_EQUAL_UINT32(i * kIntervalS, result.records[i].uptime_s);
+  }
+  assert_matches(result.records[count - 1], values_at(count - 1));
+}
+
+void test_gap_starts_segment() {
+  BatteryLog log(fs, "house", BATTERY_LOG_MAX_BYTES, kIntervalS);
+  log.begin();
+  append_records(&log, 0, 10);
+  // Two intervals missed
+  append_records(&log, 12, 10);
+  Export result = export_log(log);
+  TEST_ASSERT_EQUAL_size_t(2, result.segment_lengths.size());
+  TEST_ASSERT_EQUAL_size_t(20, result.records.size());
+  TEST_ASSERT_EQUAL_UINT32(12 * kIntervalS, result.records[10].uptime_s);
+}
+
+void test_budget_drops_oldest_segments() {
+  const size_t max_bytes = 3 * BATTERY_LOG_SEGMENT_BYTES;
+  BatteryLog log(fs, "house", max_bytes, kIntervalS);
+  log.begin();
+  const uint32_t count = 4000;  // Almost 8 segments
+  for (uint32_t i = 0; i < count; i += 50) {
+    append_records(&log, i, 50);
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(max_bytes, log.stored_bytes());
+  }
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(3, fs->file_count());
+  TEST_ASSERT_GREATER_THAN_UINT32(0, fs->remove_count);
+  // The newest records are kept, the oldest are gone
+  Export result = export_log(log);
+  TEST_ASSERT_EQUAL_UINT32((count - 1) * kIntervalS, result.records.back().uptime_s);
+  TEST_ASSERT_TRUE(result.records.front().uptime_s > 0);
+  TEST_ASSERT_TRUE(result.records.size() < count);
+}
+
+void test_begin_recovers_sequences() {
+  const size_t max_bytes = 3 * BATTERY_LOG_SEGMENT_BYTES;
+  {
+    BatteryLog log(fs, "house", max_bytes, kIntervalS);
+    log.begin();
+    append_records(&log, 0, 4 * kSegmentRecords);
+    log.flush();
+  }
+  // Another battery's files are not this log's
+  BatteryLog other(fs, "houseb", max_bytes, kIntervalS);
+  other.begin();
+  append_records(&other, 0, 10);
+  other.flush();
+  TEST_ASSERT_EQUAL_size_t(0, fs->size(BATTERY_LOG_DIR "/house.0"));
+  TEST_ASSERT_TRUE(fs->size(BATTERY_LOG_DIR "/house.1") > 0);
+  size_t stored = fs->size(BATTERY_LOG_DIR "/house.1") + fs->size(BATTERY_LOG_DIR "/house.2") +
+                  fs->size(BATTERY_LOG_DIR "/house.3");
+
+  // After a reboot: segments 1 to 3 are found and exported unchanged
+  BatteryLog log(fs, "house", max_bytes, kIntervalS);
+  log.begin();
+  TEST_ASSERT_EQUAL_size_t(stored, log.stored_bytes());
+  Export result = export_log(log);
+  TEST_ASSERT_EQUAL_size_t(3, result.segment_lengths.size());
+  TEST_ASSERT_EQUAL_UINT32(kSegmentRecords * kIntervalS, result.records.front().uptime_s);
+  TEST_ASSERT_EQUAL_UINT32((4 * kSegmentRecords - 1) * kIntervalS, result.records.back().uptime_s);
+
+  // Appends go to a new segment after the newest, the oldest makes room
+  log.append(values_at(0), 60, 0);
+  log.flush();
+  TEST_ASSERT_TRUE(fs->size(BATTERY_LOG_DIR "/house.4") > 0);
+  TEST_ASSERT_EQUAL_size_t(0, fs->size(BATTERY_LOG_DIR "/house.1"));
+  TEST_ASSERT_TRUE(fs->size(BATTERY_LOG_DIR "/houseb.0") > 0);
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(max_bytes, log.stored_bytes());
+}
+
+void test_export_includes_buffered_records() {
+  BatteryLog log(fs, "house", BATTERY_LOG_MAX_BYTES, kIntervalS);
+  log.begin();
+  append_records(&log, 0, 10);
+  // Less than a page: nothing written yet
+  TEST_ASSERT_EQUAL_UINT32(0, log.get_write_count());
+  TEST_ASSERT_EQUAL_size_t(0, fs->file_count());
+  Export buffered = export_log(log);
+  TEST_ASSERT_EQUAL_size_t(1, buffered.segment_lengths.size());
+  TEST_ASSERT_EQUAL_UINT32(sizeof(LogSegmentHeader) + 9 * sizeof(LogRecord), buffered.segment_lengths[0]);
+  TEST_ASSERT_EQUAL_size_t(10, buffered.records.size());
+
+  // The same bytes once written
+  log.flush();
+  TEST_ASSERT_EQUAL_UINT32(1, log.get_write_count());
+  Export written = export_log(log);
+  TEST_ASSERT_TRUE(buffered.bytes == written.bytes);
+
+  // Part on flash, part buffered, in one frame
+  append_records(&log, 10, 5);
+  Export mixed = export_log(log);
+  TEST_ASSERT_EQUAL_size_t(1, mixed.segment_lengths.size());
+  TEST_ASSERT_EQUAL_size_t(15, mixed.records.size());
+  assert_matches(mixed.records[14], values_at(14));
+
+  // A sink that gives up stops the export
+  uint8_t chunk[64];
+  size_t calls = 0;
+  TEST_ASSERT_FALSE(log.export_to(chunk, sizeof(chunk), [&](const void*, size_t) { return ++calls < 2; }));
+  TEST_ASSERT_EQUAL_size_t(2, calls);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_records_round_trip);
+  RUN_TEST(test_saturated_deltas_catch_up);
+  RUN_TEST(test_first_temperature_starts_segment);
+  RUN_TEST(test_segments_roll_over);
+  RUN_TEST(test_gap_starts_segment);
+  RUN_TEST(test_budget_drops_oldest_segments);
+  RUN_TEST(test_begin_recovers_sequences);
+  RUN_TEST(test_export_includes_buffered_records);
+  return UNITY_END();
+}
@@ -0,0 +1,159 @@
+#include <unity.h>
+
+#include <cmath>
+#include <random>
+
+#include "crank_capture.h"
+
+using namespace sensesp;
+
+namespace {
+
+// The firmware's watch interval (BATTERY_FAST_READ_INTERVAL_MS) and burst
+// interval (BATTERY_CRANK_READ_INTERVAL_US)
+constexpr double kWatchS = 0.1;
+constexpr double kBurstS = 0.002;
+constexpr float kNoiseV = 0.005f;
+
+struct Crank {
+  float emf_v;           // Open-circuit voltage
+  float resistance_ohm;  // Internal resistance incl. cabling
+  float rest_a;          // Quiescent current (negative = discharge)
+  float inrush_a;        // Peak starter current (magnitude)
+  float crank_a;         // Cranking current after the inrush (magnitude)
+  float ripple_a;        // Compression ripple amplitude
+  float crank_s;         // Cranking time until the engine runs
+  float charge_a;        // Alternator current after start
+};
+
+// emf, R, rest, inrush, cranking, ripple, crank time, charge
+constexpr Crank kHealthyDiesel = {12.70f, 0.006f, -0.05f, 450.0f, 180.0f, 40.0f, 1.5f, 25.0f};
+constexpr Crank kAgedDiesel = {12.45f, 0.014f, -0.05f, 380.0f, 160.0f, 35.0f, 2.5f, 25.0f};
+constexpr Crank kOutboard = {12.80f, 0.010f, -0.02f, 150.0f, 80.0f, 15.0f, 0.8f, 10.0f};
+
+// Current and voltage at t seconds after the starter engages (t < 0: rest)
+void waveform(const Crank& crank, double t, float* voltage_v, float* current_a) {
+  double current;
+  if (t < 0) {
+    current = crank.rest_a;
+  } else if (t < crank.crank_s) {
+    // Inrush decays within ~50 ms to the cranking current; 8 Hz compression ripple
+    double magnitude = crank.crank_a + (crank.inrush_a - crank.crank_a) * exp(-t / 0.025) +
+                       crank.ripple_a * sin(2 * M_PI * 8 * t);
+    current = -magnitude;
+  } else {
+    current = crank.charge_a;
+  }
+  double voltage = crank.emf_v + crank.resistance_ohm * current;
+  if (t >= crank.crank_s) {
+    voltage = 14.2;  // Alternator regulated
+  }
+  *voltage_v = static_cast<float>(voltage);
+  *current_a = static_cast<float>(current);
+}
+
+// Sample like the sampler: watch interval until the trigger, burst interval
+// while add() reports a capture in progress
+bool run(const Crank& crank, CrankCapture::Summary* summary) {
+  std::mt19937 rng(1);
+  std::normal_distribution<float> noise(0.0f, kNoiseV);
+  CrankCapture capture;
+  const double start_s = 5.0;  // Starter engages 5 s into the trace
+  bool captured = false;
+  for (double t = 0; t < start_s + crank.crank_s + 10.0;) {
+    float voltage, current;
+    waveform(crank, t - start_s, &voltage, &current);
+    uint32_t timestamp_us = static_cast<uint32_t>(t * 1e6) + 0xFFF00000u;  // Crosses the micros() wrap
+    bool capturing = capture.add(timestamp_us, voltage + noise(rng), current);
+    captured |= capture.take_completed(summary);
+    t += capturing ? kBurstS : kWatchS;
+  }
+  return captured;
+}
+
+// The summary against the waveform's true values
+void check_crank(const Crank& crank) {
+  CrankCapture::Summary summary;
+  TEST_ASSERT_TRUE(run(crank, &summary));
+  float rest_v = crank.emf_v + crank.resistance_ohm * crank.rest_a;
+  TEST_ASSERT_FLOAT_WITHIN(0.02f, rest_v, summary.rest_voltage_v);
+  // The watch interval may miss the first part of the inrush: the peak is
+  // checked against the current the capture could have seen
+  float peak_min = (crank.crank_a + crank.ripple_a) * 0.95f;
+  float peak_max = crank.inrush_a * 1.01f;
+  TEST_ASSERT_FLOAT_WITHIN((peak_max - peak_min) / 2, (peak_max + peak_min) / 2, summary.peak_current_a);
+  float min_v = crank.emf_v - crank.resistance_ohm * summary.peak_current_a;
+  TEST_ASSERT_FLOAT_WITHIN(0.05f, min_v, summary.min_voltage_v);
+  TEST_ASSERT_FLOAT_WITHIN(0.15f, crank.crank_s, summary.sag_duration_s);
+  TEST_ASSERT_FLOAT_WITHIN(crank.resistance_ohm * 0.2f, crank.resistance_ohm, summary.internal_resistance_ohm);
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(BATTERY_CRANK_MAX_POINTS, summary.point_count);
+}
+
+}  // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_healthy_diesel_starter() { check_crank(kHealthyDiesel); }
+
+void test_aged_diesel_starter() { check_crank(kAgedDiesel); }
+
+void test_small_outboard() { check_crank(kOutboard); }
+
+void test_house_loads_do_not_capture() {
+  std::mt19937 rng(1);
+  std::normal_distribution<float> noise(0.0f, kNoiseV);
+  CrankCapture capture;
+  for (uint32_t k = 0; k < 36000; k++) {  // One hour at the watch interval
+    float current = -2.0f - 20.0f * (k % 600 < 30);  // Fridge compressor cycles
+    capture.add(k * 100000, 12.6f + 0.01f * current + noise(rng), current);
+  }
+  TEST_ASSERT_EQUAL_UINT32(0, capture.get_capture_count());
+}
+
+void test_battery_resting_below_trigger_does_not_capture() {
+  CrankCapture capture;
+  for (uint32_t k = 0; k < 6000; k++) {
+    capture.add(k * 100000, BATTERY_CRANK_TRIGGER_V - 0.5f, -0.1f);
+  }
+  TEST_ASSERT_EQUAL_UINT32(0, capture.get_capture_count());
+}
+
+void test_reader_blocks_triggers() {
+  CrankCapture capture;
+  // One capture to read
+  double t = 0;
+  for (; t < 20; t += kWatchS) {
+    float voltage, current;
+    waveform(kHealthyDiesel, t - 5.0, &voltage, &current);
+    while (capture.add(static_cast<uint32_t>(t * 1e6), voltage, current)) {
+      t += kBurstS;
+      waveform(kHealthyDiesel, t - 5.0, &voltage, &current);
+    }
+  }
+  uint32_t captures = capture.get_capture_count();
+  TEST_ASSERT_EQUAL_UINT32(1, captures);
+  TEST_ASSERT_TRUE(capture.begin_read());
+  // Second crank while reading: not captured, waveform unchanged
+  size_t size = capture.size();
+  for (double t2 = 0; t2 < 20; t2 += kWatchS) {
+    float voltage, current;
+    waveform(kHealthyDiesel, t2 - 5.0, &voltage, &current);
+    capture.add(static_cast<uint32_t>((t + t2) * 1e6), voltage, current);
+  }
+  TEST_ASSERT_EQUAL_UINT32(captures, capture.get_capture_count());
+  TEST_ASSERT_EQUAL_size_t(size, capture.size());
+  capture.end_read();
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_healthy_diesel_starter);
+  RUN_TEST(test_aged_diesel_starter);
+  RUN_TEST(test_small_outboard);
+  RUN_TEST(test_house_loads_do_not_capture);
+  RUN_TEST(test_battery_resting_below_trigger_does_not_capture);
+  RUN_TEST(test_reader_blocks_triggers);
+  return UNITY_END();
+}
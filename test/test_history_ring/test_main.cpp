@@ -0,0 +1,113 @@
+#include <unity.h>
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "history_ring.h"
+
+using namespace sensesp;
+
+namespace {
+
+// A month of a house battery at 1 Hz: a daily cycle of discharge (fridge,
+// instruments) and solar charge, plus measurement noise of 2 mV and 30 mA
+struct HouseSignal {
+  std::mt19937 rng{42};
+  std::normal_distribution<double> noise{0.0, 1.0};
+
+  void sample(double t, float* voltage_v, float* current_a) {
+    double hour = fmod(t / 3600.0, 24.0);
+    // Fridge compressor cycling (20 min period) plus a base load
+    double load = -1.5 - (fmod(t, 1200.0) < 480.0 ? 4.0 : 0.0);
+    // Solar charge around midday
+    double solar = hour > 7.0 && hour < 19.0 ? 18.0 * sin((hour - 7.0) / 12.0 * M_PI) : 0.0;
+    double current = load + solar + noise(rng) * 0.030;
+    *voltage_v = static_cast<float>(12.7 + 0.02 * current + noise(rng) * 0.002);
+    *current_a = static_cast<float>(current);
+  }
+};
+
+constexpr uint32_t kDays = 31;
+
+HistoryTiers* tiers;
+// Raw records appended, quantized like the ring does
+std::vector<uint32_t> expected_time;
+std::vector<int32_t> expected;
+
+void fill() {
+  HouseSignal signal;
+  double ah = 100.0;
+  for (uint32_t time_s = 0; time_s < kDays * 86400; time_s++) {
+    float voltage_v;
+    float current_a;
+    signal.sample(time_s, &voltage_v, &current_a);
+    ah += current_a / 3600.0;
+    ah = ah < 0.0 ? 0.0 : (ah > 200.0 ? 200.0 : ah);
+    tiers->append(time_s, voltage_v, current_a, static_cast<float>(ah));
+    expected_time.push_back(time_s);
+    expected.push_back(static_cast<int32_t>(lroundf(voltage_v * HistoryTiers::kVoltageScale)));
+    expected.push_back(static_cast<int32_t>(lroundf(current_a * HistoryTiers::kCurrentScale)));
+    expected.push_back(static_cast<int32_t>(lroundf(static_cast<float>(ah) * HistoryTiers::kAhScale)));
+  }
+}
+
+template <typename Ring>
+double span_h(const Ring& ring) {
+  return ring.record_count() * ring.step_s() / 3600.0;
+}
+
+template <typename Ring>
+void report(const char* name, const Ring& ring) {
+  char message[128];
+  snprintf(message, sizeof(message), "%s: %u records, %.2f B/record, holds %.1f h", name, ring.record_count(),
+           ring.record_count() ? static_cast<double>(ring.stored_bytes()) / ring.record_count() : 0.0,
+           span_h(ring));
+  TEST_MESSAGE(message);
+}
+
+}  // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_raw_tier_is_lossless() {
+  // The ring wrapped and holds the newest record_count() records
+  const HistoryTiers::RawRing& raw = tiers->raw();
+  TEST_ASSERT_LESS_THAN_UINT32(expected_time.size(), raw.record_count());
+  size_t index = expected_time.size() - raw.record_count();
+  size_t mismatches = 0;
+  raw.for_each([&](uint32_t time_s, const int32_t* values) {
+    if (index >= expected_time.size() || time_s != expected_time[index] ||
+        memcmp(values, &expected[index * 3], 3 * sizeof(int32_t)) != 0) {
+      mismatches++;
+    }
+    index++;
+  });
+  TEST_ASSERT_EQUAL_size_t(expected_time.size(), index);
+  TEST_ASSERT_EQUAL_size_t(0, mismatches);
+}
+
+void test_default_tiers_cover_their_spans() {
+  report("raw", tiers->raw());
+  report("minute", tiers->minute());
+  report("hour", tiers->hour());
+  // What the HISTORY_*_BLOCKS defaults promise for a house battery
+  TEST_ASSERT_TRUE(span_h(tiers->raw()) >= 1.0);
+  TEST_ASSERT_TRUE(span_h(tiers->minute()) >= 24.0);
+  TEST_ASSERT_TRUE(span_h(tiers->hour()) >= 30 * 24.0);
+}
+
+int main() {
+  tiers = new HistoryTiers();
+  fill();
+  UNITY_BEGIN();
+  RUN_TEST(test_raw_tier_is_lossless);
+  RUN_TEST(test_default_tiers_cover_their_spans);
+  int failures = UNITY_END();
+  delete tiers;
+  return failures;
+}
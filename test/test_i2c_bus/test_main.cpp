@@ -0,0 +1,237 @@
+#include <unity.h>
+
+#include <cstdio>
+#include <vector>
+
+#include "fake_hal.h"
+#include "fake_i2c.h"
+#include "i2c_bus.h"
+#include "ina226_device.h"
+
+using namespace sensesp;
+
+namespace {
+
+constexpr uint32_t kReadIntervalMs = 100;
+
+constexpr float kShuntOhm = 0.0075f;
+constexpr float kCurrentLsbA = 0.00025f;
+constexpr uint16_t kExpectedCalibration = 2730;  // 0.00512 / (0.00025 * 0.0075)
+constexpr uint16_t kSteadyConfig = 0x4EA7;      // 1024 averages, 332 us bus, 1100 us shunt
+
+// What BatteryMonitor::bring_up() does, with the steady mode's timing
+bool bring_up(INA226Device& ina) {
+  bool online = ina.begin(kShuntOhm, kCurrentLsbA) &&
+                ina.set_timing(INA226Device::kAverage1024, INA226Device::k332us, INA226Device::k1100us);
+  ina.bus()->set_online(ina.device(), online);
+  return online;
+}
+
+// Two INA226s on the fake bus and a driver loop doing what BatteryBank does:
+// read every chip once per read interval, bring up chips whose retry is due
+struct Node {
+  fake_hal::FakeI2CTransport transport;
+  I2CBus bus{&transport};
+  fake_hal::FakeINA226 house_chip{0x40, kShuntOhm};
+  fake_hal::FakeINA226 starter_chip{0x41, kShuntOhm};
+  INA226Device house{&bus, 0x40};
+  INA226Device starter{&bus, 0x41};
+  uint32_t house_samples = 0;
+  uint32_t starter_samples = 0;
+  std::vector<uint32_t> starter_retry_ms;  // Times of starter bring-up attempts after boot
+  uint64_t max_iteration_us = 0;
+
+  Node() {
+    transport.add(&house_chip);
+    transport.add(&starter_chip);
+  }
+
+  void boot() {
+    bring_up(house);
+    bring_up(starter);
+  }
+
+  static void read(INA226Device& ina, uint32_t* samples) {
+    float voltage_v;
+    float current_a;
+    if (ina.read(&voltage_v, &current_a)) {
+      (*samples)++;
+    }
+  }
+
+  void iterate() {
+    uint64_t start_us = fake_hal::now_us();
+    read(house, &house_samples);
+    read(starter, &starter_samples);
+    if (bus.retry_due(house.device())) {
+      bring_up(house);
+    }
+    if (bus.retry_due(starter.device())) {
+      starter_retry_ms.push_back(transport.now_ms());
+      bring_up(starter);
+    }
+    uint64_t elapsed_us = fake_hal::now_us() - start_us;
+    max_iteration_us = elapsed_us > max_iteration_us ? elapsed_us : max_iteration_us;
+    // Sleep until the next read interval
+    uint64_t next_us = (start_us / (kReadIntervalMs * 1000) + 1) * kReadIntervalMs * 1000;
+    if (next_us > fake_hal::now_us()) {
+      fake_hal::advance_us(next_us - fake_hal::now_us());
+    }
+  }
+
+  void run_ms(uint32_t ms) {
+    uint64_t end_us = fake_hal::now_us() + ms * 1000ULL;
+    while (fake_hal::now_us() < end_us) {
+      iterate();
+    }
+  }
+};
+
+Node* node;
+
+}  // namespace
+
+void setUp() {
+  fake_hal::reset();
+  node = new Node();
+}
+
+void tearDown() { delete node; }
+
+void test_chip_absent_at_boot() {
+  node->starter_chip.present = false;
+  node->boot();
+  TEST_ASSERT_TRUE(node->bus.is_online(node->house.device()));
+  TEST_ASSERT_FALSE(node->bus.is_online(node->starter.device()));
+
+  node->run_ms(5000);
+  // The other chip keeps its read rate
+  TEST_ASSERT_GREATER_OR_EQUAL_UINT32(49, node->house_samples);
+  TEST_ASSERT_EQUAL_UINT32(0, node->starter_samples);
+  // Offline chips cost no bus time between retries: reads return kOffline
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(1 + node->starter_retry_ms.size(),
+                                   node->bus.stats(node->starter.device()).transactions);
+
+  uint32_t appeared_ms = node->transport.now_ms();
+  node->starter_chip.present = true;
+  node->run_ms(10000);
+  TEST_ASSERT_TRUE(node->bus.is_online(node->starter.device()));
+  TEST_ASSERT_GREATER_THAN_UINT32(0, node->starter_samples);
+  // Comes up configured, within one backoff period
+  TEST_ASSERT_EQUAL_HEX16(kExpectedCalibration, node->starter_chip.calibration);
+  TEST_ASSERT_EQUAL_HEX16(kSteadyConfig, node->starter_chip.config);
+  TEST_ASSERT_FALSE(node->starter_retry_ms.empty());
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(8000, node->starter_retry_ms.back() - appeared_ms);
+  const I2CDeviceStats& stats = node->bus.stats(node->starter.device());
+  TEST_ASSERT_EQUAL_UINT32(node->starter_retry_ms.size(), stats.bring_up_failures);
+  TEST_ASSERT_EQUAL_UINT32(0, stats.offline_count);
+}
+
+void test_nack_bursts() {
+  node->boot();
+  node->run_ms(1000);
+
+  // Two NACKs: two lost samples, still online
+  uint32_t before = node->house_samples;
+  node->house_chip.nack_count = 2;
+  node->run_ms(1000);
+  TEST_ASSERT_TRUE(node->bus.is_online(node->house.device()));
+  TEST_ASSERT_EQUAL_UINT32(before + 8, node->house_samples);
+
+  // Longer burst: offline after I2C_DEVICE_MAX_FAILURES reads; the first three
+  // retries (1, 3 and 7 s later) still fail
+  node->house_chip.nack_count = 6;
+  node->run_ms(300);
+  TEST_ASSERT_FALSE(node->bus.is_online(node->house.device()));
+  TEST_ASSERT_EQUAL_UINT32(1, node->bus.stats(node->house.device()).offline_count);
+  TEST_ASSERT_TRUE(node->bus.is_online(node->starter.device()));
+  node->run_ms(20000);
+  TEST_ASSERT_TRUE(node->bus.is_online(node->house.device()));
+  TEST_ASSERT_EQUAL_HEX16(kExpectedCalibration, node->house_chip.calibration);
+
+  const I2CDeviceStats& stats = node->bus.stats(node->house.device());
+  TEST_ASSERT_EQUAL_UINT32(8, stats.nacks);
+  TEST_ASSERT_EQUAL_UINT32(0, stats.timeouts);
+  TEST_ASSERT_EQUAL_UINT32(0, stats.bus_errors);
+  // NACKs do not trigger bus recovery
+  TEST_ASSERT_EQUAL_UINT32(0, node->bus.get_recovery_count());
+}
+
+void test_single_timeout_is_recovered() {
+  node->boot();
+  node->run_ms(1000);
+
+  // Bus recovery and a successful retry, no sample lost
+  uint32_t before = node->house_samples;
+  node->house_chip.timeout_count = 1;
+  node->run_ms(1000);
+  TEST_ASSERT_EQUAL_UINT32(before + 10, node->house_samples);
+  TEST_ASSERT_EQUAL_UINT32(1, node->bus.get_recovery_count());
+  TEST_ASSERT_EQUAL_UINT32(1, node->bus.stats(node->house.device()).timeouts);
+  TEST_ASSERT_TRUE(node->bus.is_online(node->house.device()));
+}
+
+void test_dead_chip_cost_is_bounded() {
+  node->boot();
+  node->run_ms(1000);
+
+  // A chip that times out on every transfer
+  node->house_chip.timeout_count = 1000000;
+  uint32_t transactions = node->bus.stats(node->house.device()).transactions;
+  node->run_ms(60000);
+  TEST_ASSERT_FALSE(node->bus.is_online(node->house.device()));
+  TEST_ASSERT_TRUE(node->bus.is_online(node->starter.device()));
+  // Worst iteration: a read (two attempts and a recovery each) plus a retry
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(
+      6 * (I2C_TIMEOUT_MS * 1000 + node->transport.recovery_us + node->transport.transfer_us),
+      node->max_iteration_us);
+  // Two reads to go offline, then one transaction per retry (1, 3, 7, 15, 31 s)
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(10, node->bus.stats(node->house.device()).transactions - transactions);
+
+  // Back once it answers
+  node->house_chip.timeout_count = 0;
+  node->run_ms(70000);
+  TEST_ASSERT_TRUE(node->bus.is_online(node->house.device()));
+}
+
+void test_stuck_sda_is_freed() {
+  node->boot();
+  node->run_ms(1000);
+
+  // Freed by recovery, no sample lost
+  uint32_t before = node->house_samples;
+  node->transport.sda_stuck = true;
+  node->run_ms(1000);
+  TEST_ASSERT_EQUAL_UINT32(before + 10, node->house_samples);
+  TEST_ASSERT_EQUAL_UINT32(1, node->transport.recover_count);
+  TEST_ASSERT_EQUAL_UINT32(1, node->bus.stats(node->house.device()).bus_errors);
+  TEST_ASSERT_TRUE(node->bus.is_online(node->house.device()));
+  TEST_ASSERT_TRUE(node->bus.is_online(node->starter.device()));
+}
+
+void test_retry_interval_doubles_up_to_max() {
+  node->starter_chip.present = false;
+  node->boot();
+  node->run_ms(400000);
+
+  // Attempts at 1, 3, 7, 15, 31, 63, 123, 183, ... s
+  TEST_ASSERT_GREATER_OR_EQUAL_UINT32(8, node->starter_retry_ms.size());
+  uint32_t expected = I2C_RETRY_MIN_MS * 2;
+  for (size_t i = 1; i < node->starter_retry_ms.size(); i++) {
+    uint32_t interval = node->starter_retry_ms[i] - node->starter_retry_ms[i - 1];
+    // Retries happen on the read grid: up to one interval late
+    TEST_ASSERT_UINT32_WITHIN(kReadIntervalMs / 2, expected + kReadIntervalMs / 2, interval);
+    expected = expected * 2 < I2C_RETRY_MAX_MS ? expected * 2 : I2C_RETRY_MAX_MS;
+  }
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_chip_absent_at_boot);
+  RUN_TEST(test_nack_bursts);
+  RUN_TEST(test_single_timeout_is_recovered);
+  RUN_TEST(test_dead_chip_cost_is_bounded);
+  RUN_TEST(test_stuck_sda_is_freed);
+  RUN_TEST(test_retry_interval_doubles_up_to_max);
+  return UNITY_END();
+}
@@ -0,0 +1,231 @@
+#include <unity.h>
+
+#include <cstdio>
+
+#include "fake_hal.h"
+#include "fake_i2c.h"
+#include "ina226_sampler.h"
+#include "sensesp/system/lambda_consumer.h"
+
+using namespace sensesp;
+
+namespace {
+
+constexpr uint8_t kAddress = 0x40;
+constexpr int kAlertPin = 4;
+constexpr float kShuntOhm = 0.00075f;
+constexpr float kCurrentLsbA = 0.0025f;
+
+// Samples as the consumers see them
+struct Recorder {
+  static constexpr size_t kMaxSamples = 1024;
+  uint32_t timestamp_us[kMaxSamples];
+  float current_a[kMaxSamples];
+  size_t count = 0;
+
+  void add(const BatterySample& sample) {
+    if (count < kMaxSamples) {
+      timestamp_us[count] = sample.timestamp_us;
+      current_a[count] = sample.current_a;
+      count++;
+    }
+  }
+};
+
+fake_hal::FakeI2CTransport* transport;
+fake_hal::FakeINA226* chip;
+I2CBus* bus;
+INA226Device* ina;
+INA226Sampler* sampler;
+LambdaConsumer<BatterySample>* consumer;
+Recorder* recorder;
+CrankCapture* crank;
+
+void start(int alert_pin, unsigned int poll_interval_ms, CrankCapture* crank_capture = nullptr) {
+  chip = new fake_hal::FakeINA226(kAddress, kShuntOhm, alert_pin);
+  transport->add(chip);
+  ina = new INA226Device(bus, kAddress);
+  sampler = new INA226Sampler(*ina, alert_pin, poll_interval_ms);
+  sampler->set_crank_capture(crank_capture);
+  consumer = new LambdaConsumer<BatterySample>([](const BatterySample& sample) { recorder->add(sample); });
+  sampler->connect_to(consumer);
+  sampler->begin();
+  bool online = ina->begin(kShuntOhm, kCurrentLsbA) && sampler->configure();
+  bus->set_online(ina->device(), online);
+  TEST_ASSERT_TRUE(online);
+}
+
+#if BATTERY_ADAPTIVE_ACQUISITION
+// An idle starter battery cranking for 1.5 s from crank_start_us, with no
+// load before it
+uint64_t crank_start_us;
+
+void crank_waveform(uint64_t now_us, float* voltage_v, float* current_a) {
+  bool cranking = now_us >= crank_start_us && now_us < crank_start_us + 1500000;
+  *current_a = cranking ? -60.0f : -0.05f;
+  *voltage_v = cranking ? 10.2f : 12.7f;
+}
+#endif
+
+}  // namespace
+
+void setUp() {
+  fake_hal::reset();
+  transport = new fake_hal::FakeI2CTransport();
+  bus = new I2CBus(transport);
+  recorder = new Recorder();
+  chip = nullptr;
+  ina = nullptr;
+  sampler = nullptr;
+  consumer = nullptr;
+  crank = nullptr;
+}
+
+void tearDown() {
+  delete consumer;
+  delete sampler;
+  delete ina;
+  delete chip;
+  delete bus;
+  delete transport;
+  delete recorder;
+  delete crank;
+}
+
+void test_one_sample_per_conversion_ready_alert() {
+  start(kAlertPin, 1);
+  chip->set_input(12.8f, -5.0f);
+  uint32_t conversions = chip->get_conversion_count();
+  uint32_t transfers = transport->transfer_count;
+  fake_hal::run_for_ms(30000);
+
+  uint32_t converted = chip->get_conversion_count() - conversions;
+  TEST_ASSERT_GREATER_THAN_UINT32(10, converted);
+  TEST_ASSERT_EQUAL_UINT32(converted, sampler->get_sample_count());
+  TEST_ASSERT_EQUAL_size_t(converted, recorder->count);
+  TEST_ASSERT_EQUAL_UINT32(0, sampler->get_missed_count());
+  // Mask/Enable, bus voltage and current; nothing else
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(3 * converted, transport->transfer_count - transfers);
+  TEST_ASSERT_FLOAT_WITHIN(kCurrentLsbA, -5.0f, recorder->current_a[recorder->count - 1]);
+}
+
+void test_timestamps_follow_conversion_time() {
+  start(kAlertPin, 1);
+#if BATTERY_ADAPTIVE_ACQUISITION
+  // Steady: 1024 x (332 + 1100) us
+  TEST_ASSERT_EQUAL_UINT32(1024 * (332 + 1100), chip->conversion_us());
+#endif
+  fake_hal::run_for_ms(30000);
+  TEST_ASSERT_GREATER_THAN_UINT32(2, recorder->count);
+  // Stamped in the ISR, so the event loop's tick (1 ms) adds no jitter
+  for (size_t i = 1; i < recorder->count; i++) {
+    TEST_ASSERT_EQUAL_UINT32(chip->conversion_us(), recorder->timestamp_us[i] - recorder->timestamp_us[i - 1]);
+  }
+}
+
+#if BATTERY_ADAPTIVE_ACQUISITION
+void test_load_step_switches_to_fast_conversions() {
+  start(kAlertPin, 1);
+  fake_hal::run_for_ms(5000);
+  chip->set_input(12.5f, -40.0f);
+  fake_hal::run_for_ms(5000);
+  TEST_ASSERT_EQUAL(AcquisitionMode::kFast, sampler->get_mode());
+  // Fast: 64 x (332 + 588) us
+  TEST_ASSERT_EQUAL_UINT32(64 * (332 + 588), chip->conversion_us());
+  size_t before = recorder->count;
+  fake_hal::run_for_ms(1000);
+  size_t fast_samples = recorder->count - before;
+  TEST_ASSERT_GREATER_OR_EQUAL_UINT32(1000000 / chip->conversion_us(), fast_samples);
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(1000000 / chip->conversion_us() + 1, fast_samples);
+  for (size_t i = before + 1; i < recorder->count; i++) {
+    TEST_ASSERT_EQUAL_UINT32(chip->conversion_us(), recorder->timestamp_us[i] - recorder->timestamp_us[i - 1]);
+  }
+  // Back to steady after the hold time at a constant load
+  fake_hal::run_for_ms(BATTERY_ADAPTIVE_HOLD_MS + 1000);
+  TEST_ASSERT_EQUAL(AcquisitionMode::kSteady, sampler->get_mode());
+  TEST_ASSERT_EQUAL_UINT32(2, sampler->get_mode_switch_count());
+}
+
+void test_idle_crank_battery_watched_at_fast_settings() {
+  crank = new CrankCapture();
+  start(kAlertPin, 1, crank);
+  chip->set_input(12.7f, -0.05f);
+  fake_hal::run_for_ms(60000);
+  // The current stays steady, the chip does not
+  TEST_ASSERT_EQUAL(AcquisitionMode::kSteady, sampler->get_mode());
+  TEST_ASSERT_EQUAL_UINT32(64 * (332 + 588), chip->conversion_us());
+  TEST_ASSERT_GREATER_OR_EQUAL_UINT32(59000000 / chip->conversion_us(), recorder->count);
+}
+
+void test_crank_from_idle_battery_captured_whole() {
+  crank = new CrankCapture();
+  start(kAlertPin, 1, crank);
+  crank_start_us = 15000000;
+  chip->waveform = crank_waveform;
+  fake_hal::run_for_ms(25000);
+  CrankCapture::Summary summary;
+  TEST_ASSERT_TRUE(crank->take_completed(&summary));
+  // From the rest voltage before it to the end of the sag
+  TEST_ASSERT_FLOAT_WITHIN(0.02f, 12.7f, summary.rest_voltage_v);
+  TEST_ASSERT_FLOAT_WITHIN(0.02f, 10.2f, summary.min_voltage_v);
+  TEST_ASSERT_FLOAT_WITHIN(0.1f, 1.5f, summary.sag_duration_s);
+}
+#endif
+
+void test_polled_mode_reads_on_timer() {
+  start(-1, 500);
+  fake_hal::run_for_ms(10000);
+  TEST_ASSERT_EQUAL_UINT32(20, sampler->get_sample_count());
+  // Timer mode: within one event loop tick
+  for (size_t i = 1; i < recorder->count; i++) {
+    TEST_ASSERT_UINT32_WITHIN(1000, 500000, recorder->timestamp_us[i] - recorder->timestamp_us[i - 1]);
+  }
+}
+
+void test_failed_alert_clear_is_retried() {
+  start(kAlertPin, 1);
+  fake_hal::run_for_ms(3000);
+  uint32_t samples = sampler->get_sample_count();
+  // The Mask/Enable read after the next conversion is NACKed: ALERT stays low
+  chip->nack_count = 1;
+  fake_hal::run_for_ms(chip->conversion_us() / 1000 + 2);
+  TEST_ASSERT_EQUAL_UINT32(samples + 1, sampler->get_sample_count());
+  TEST_ASSERT_FALSE(chip->alert_asserted());
+  // Still one sample per conversion afterwards
+  uint32_t conversions = chip->get_conversion_count();
+  samples = sampler->get_sample_count();
+  fake_hal::run_for_ms(10000);
+  TEST_ASSERT_EQUAL_UINT32(chip->get_conversion_count() - conversions, sampler->get_sample_count() - samples);
+}
+
+void test_offline_chip_resumes_after_bring_up() {
+  start(kAlertPin, 1);
+  fake_hal::run_for_ms(3000);
+  // Every Mask/Enable read fails until the chip goes offline, ALERT pending
+  chip->nack_count = I2C_DEVICE_MAX_FAILURES;
+  fake_hal::run_for_ms(5000);
+  TEST_ASSERT_FALSE(ina->is_online());
+  // What the bank does once retry_due(): configure the chip again
+  TEST_ASSERT_TRUE(bus->retry_due(ina->device()));
+  bus->set_online(ina->device(), ina->begin(kShuntOhm, kCurrentLsbA) && sampler->configure());
+  uint32_t samples = sampler->get_sample_count();
+  fake_hal::run_for_ms(10000);
+  TEST_ASSERT_GREATER_OR_EQUAL_UINT32(samples + 6, sampler->get_sample_count());
+  // No sample stamped before the bring-up
+  TEST_ASSERT_GREATER_OR_EQUAL_UINT32(8000000, recorder->timestamp_us[samples]);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_one_sample_per_conversion_ready_alert);
+  RUN_TEST(test_timestamps_follow_conversion_time);
+#if BATTERY_ADAPTIVE_ACQUISITION
+  RUN_TEST(test_load_step_switches_to_fast_conversions);
+  RUN_TEST(test_idle_crank_battery_watched_at_fast_settings);
+  RUN_TEST(test_crank_from_idle_battery_captured_whole);
+#endif
+  RUN_TEST(test_polled_mode_reads_on_timer);
+  RUN_TEST(test_failed_alert_clear_is_retried);
+  RUN_TEST(test_offline_chip_resumes_after_bring_up);
+  return UNITY_END();
+}
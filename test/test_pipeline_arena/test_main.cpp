@@ -0,0 +1,153 @@
+#include <unity.h>
+
+#include <cstdlib>
+#include <new>
+
+#include "battery_bank.h"
+#include "fake_hal.h"
+#include "fake_i2c.h"
+#include "virtual_bank.h"
+
+using namespace sensesp;
+
+// Allocations while counting is on (steady state)
+static bool counting = false;
+static size_t allocations = 0;
+
+void* operator new(size_t size) {
+  if (counting) {
+    allocations++;
+  }
+  void* memory = malloc(size == 0 ? 1 : size);
+  if (memory == nullptr) {
+    throw std::bad_alloc();
+  }
+  return memory;
+}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+void operator delete(void* memory) noexcept { free(memory); }
+void operator delete(void* memory, size_t) noexcept { free(memory); }
+#pragma GCC diagnostic pop
+
+namespace {
+
+constexpr int kHouseAlertPin = 4;
+
+// House on ALERT, starter polled with crank capture
+constexpr BatteryConfig kBatteries[] = {
+    {"house", "house", 0x40, 0.0075f, 0.25f, 200.0f, 150.0f, kHouseAlertPin, false, BatteryChemistry::kLeadAcid, 6},
+    {"starter", "start", 0x41, 0.00075f, 2.5f, 100.0f, 90.0f, -1, true, BatteryChemistry::kLeadAcid, 6},
+};
+constexpr size_t kBatteryCount = sizeof(kBatteries) / sizeof(kBatteries[0]);
+constexpr const char* kMembers[] = {"house", "starter"};
+constexpr VirtualBankConfig kVirtualBanks[] = {
+    {"combined", "combined", kMembers, 2, 0b11},
+};
+
+alignas(PipelineArena::kAlignment) uint8_t arena_storage[256 * 1024];
+
+fake_hal::FakeI2CTransport* transport;
+fake_hal::FakeINA226* chips[kBatteryCount];
+I2CBus* bus;
+
+void add_chips() {
+  transport = new fake_hal::FakeI2CTransport();
+  for (size_t i = 0; i < kBatteryCount; i++) {
+    chips[i] = new fake_hal::FakeINA226(kBatteries[i].i2c_address, kBatteries[i].shunt_resistance,
+                                        kBatteries[i].alert_pin);
+    transport->add(chips[i]);
+  }
+  bus = new I2CBus(transport);
+}
+
+}  // namespace
+
+void setUp() {
+  fake_hal::reset();
+  pipeline_arena()->set_storage(arena_storage, sizeof(arena_storage));
+  add_chips();
+}
+
+void tearDown() {
+  counting = false;
+  delete bus;
+  for (size_t i = 0; i < kBatteryCount; i++) {
+    delete chips[i];
+  }
+  delete transport;
+}
+
+void test_monitor_arena_bytes_match_use() {
+  // One bank per config: with and without crank capture
+  for (size_t i = 0; i < kBatteryCount; i++) {
+    size_t used = pipeline_arena()->used();
+    pipeline_arena()->create<BatteryBank>(&kBatteries[i], 1, bus);
+    TEST_ASSERT_EQUAL_size_t(battery_bank_arena_bytes(&kBatteries[i], 1), pipeline_arena()->used() - used);
+  }
+  TEST_ASSERT_EQUAL_UINT32(0, pipeline_arena()->get_overflow_count());
+}
+
+void test_virtual_bank_arena_bytes_match_use() {
+  BatteryBank* bank = pipeline_arena()->create<BatteryBank>(kBatteries, kBatteryCount, bus);
+  size_t used = pipeline_arena()->used();
+  TEST_ASSERT_NOT_NULL(bank->add_virtual_bank(kVirtualBanks[0]));
+  TEST_ASSERT_EQUAL_size_t(virtual_bank_arena_bytes(kVirtualBanks, 1), pipeline_arena()->used() - used);
+  TEST_ASSERT_EQUAL_size_t(battery_bank_arena_bytes(kBatteries, kBatteryCount) +
+                               virtual_bank_arena_bytes(kVirtualBanks, 1),
+                           pipeline_arena()->used());
+}
+
+void test_full_arena_falls_back_to_heap() {
+  // Room for the bank object only: the monitors go to the heap and still work
+  pipeline_arena()->set_storage(arena_storage, PipelineArena::arena_bytes<BatteryBank>());
+  BatteryBank* bank = pipeline_arena()->create<BatteryBank>(kBatteries, kBatteryCount, bus);
+  TEST_ASSERT_GREATER_THAN_UINT32(0, pipeline_arena()->get_overflow_count());
+  chips[0]->set_input(12.7f, -4.0f);
+  fake_hal::run_for_ms(5000);
+  TEST_ASSERT_GREATER_THAN_UINT32(0, bank->monitor(0).sampler().get_sample_count());
+}
+
+void test_steady_state_allocates_nothing() {
+  BatteryBank* bank = pipeline_arena()->create<BatteryBank>(kBatteries, kBatteryCount, bus);
+  bank->add_virtual_bank(kVirtualBanks[0]);
+  // House: a load that steps every minute (fast and steady acquisition).
+  // Starter: a crank every 10 minutes.
+  chips[0]->waveform = [](uint64_t now_us, float* voltage_v, float* current_a) {
+    uint64_t minute = now_us / 60000000ULL;
+    *current_a = minute % 2 ? -25.0f : 8.0f;
+    *voltage_v = 12.6f + *current_a * 0.01f;
+  };
+  chips[1]->waveform = [](uint64_t now_us, float* voltage_v, float* current_a) {
+    uint64_t ms = now_us / 1000 % 600000;
+    bool cranking = ms >= 300000 && ms < 301500;
+    *current_a = cranking ? -180.0f : -0.05f;
+    *voltage_v = cranking ? 9.6f : 12.7f;
+  };
+  // Warm-up: lazy first-use setup (state store flush timer, log files)
+  fake_hal::run_for_ms(60000);
+  uint32_t samples = bank->monitor(0).sampler().get_sample_count();
+  uint32_t cranks = bank->monitor(1).get_crank_uptime_s();
+
+  counting = true;
+  fake_hal::run_for_ms(30 * 60000UL);
+  counting = false;
+
+  // The run covered what it should
+  TEST_ASSERT_GREATER_THAN_UINT32(samples + 1000, bank->monitor(0).sampler().get_sample_count());
+  TEST_ASSERT_NOT_EQUAL(cranks, bank->monitor(1).get_crank_uptime_s());
+#if BATTERY_ADAPTIVE_ACQUISITION
+  TEST_ASSERT_GREATER_THAN_UINT32(2, bank->monitor(0).sampler().get_mode_switch_count());
+#endif
+  TEST_ASSERT_EQUAL_size_t(0, allocations);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_monitor_arena_bytes_match_use);
+  RUN_TEST(test_virtual_bank_arena_bytes_match_use);
+  RUN_TEST(test_full_arena_falls_back_to_heap);
+  RUN_TEST(test_steady_state_allocates_nothing);
+  return UNITY_END();
+}
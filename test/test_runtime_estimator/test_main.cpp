@@ -0,0 +1,153 @@
+#include <unity.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+
+#include "runtime_estimator.h"
+
+using namespace sensesp;
+
+namespace {
+
+// 1 Hz samples with INA226-like noise
+constexpr double kDtS = 1.0;
+constexpr float kNoiseA = 0.3f;
+
+// micros() at t_s: wraps after 71.6 minutes
+uint32_t micros_at(double t_s) { return static_cast<uint32_t>(static_cast<uint64_t>(t_s * 1e6)); }
+
+// House load: base current plus a compressor drawing compressor_a for 10 of
+// every 30 minutes, with Gaussian measurement noise
+float house_current(double t_s, float base_a, float compressor_a, std::mt19937& rng) {
+  std::normal_distribution<float> gauss(0.0f, kNoiseA);
+  bool compressor_on = std::fmod(t_s, 1800.0) < 600.0;
+  return base_a - (compressor_on ? compressor_a : 0.0f) + gauss(rng);
+}
+
+// Relative second-to-second change of a series of estimates
+struct Jitter {
+  double sum = 0;
+  long count = 0;
+  float last = NAN;
+
+  void add(float value) {
+    if (!std::isnan(last) && !std::isnan(value) && last > 0) {
+      sum += std::fabs(value - last) / last;
+      count++;
+    }
+    last = value;
+  }
+  double mean() const { return count > 0 ? sum / count : 0; }
+};
+
+}  // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_cycling_load() {
+  std::mt19937 rng(1);
+  RuntimeEstimator estimator;
+  const float ah = 150.0f;
+  const float discharge_eff = 98.0f;
+  const float base_a = -4.0f;
+  const float compressor_a = 4.5f;
+  // Mean load over the compressor cycle
+  const float mean_a = base_a - compressor_a / 3.0f;
+  const float truth_s = ah / (-mean_a * discharge_eff / 100.0f) * 3600.0f;
+
+  Jitter estimate_jitter;
+  Jitter raw_jitter;
+  float worst_error = 0;
+  for (double t = 0; t < 6 * 3600.0; t += kDtS) {
+    float current = house_current(t, base_a, compressor_a, rng);
+    estimator.add_sample(micros_at(t), current);
+    if (t < 2 * 3600.0) {
+      continue;  // Long average still settling
+    }
+    float estimate = estimator.time_to_empty_s(ah, discharge_eff);
+    estimate_jitter.add(estimate);
+    raw_jitter.add(ah / (-current * discharge_eff / 100.0f) * 3600.0f);
+    float error = std::fabs(estimate - truth_s) / truth_s;
+    worst_error = error > worst_error ? error : worst_error;
+  }
+  char message[128];
+  snprintf(message, sizeof(message), "cycling load: worst error %.1f %%, change per sample %.2f %% (raw current %.2f %%)",
+           worst_error * 100, estimate_jitter.mean() * 100, raw_jitter.mean() * 100);
+  TEST_MESSAGE(message);
+  // The compressor swings the short average by 4.5 A; only the long average,
+  // not restarted on every cycle, stays this close
+  TEST_ASSERT_FLOAT_WITHIN(0.10f, 0.0f, worst_error);
+  // At least 10x steadier than an estimate from the raw current
+  TEST_ASSERT_TRUE(estimate_jitter.mean() < raw_jitter.mean() / 10);
+}
+
+void test_load_step_followed() {
+  std::mt19937 rng(1);
+  std::normal_distribution<float> gauss(0.0f, kNoiseA);
+  RuntimeEstimator estimator;
+  double t = 0;
+  for (; t < 4 * 3600.0; t += kDtS) {
+    estimator.add_sample(micros_at(t), -5.0f + gauss(rng));
+  }
+  // Inverter switched on: 5 A -> 40 A
+  double step_s = t;
+  double settled_s = NAN;
+  for (; t < step_s + 600.0; t += kDtS) {
+    estimator.add_sample(micros_at(t), -40.0f + gauss(rng));
+    float estimate = estimator.time_to_empty_s(100.0f, 100.0f);
+    if (std::isnan(settled_s) && std::fabs(estimate - 9000.0f) < 900.0f) {
+      settled_s = t - step_s;
+    }
+  }
+  // Within 10 % in five short time constants
+  TEST_ASSERT_FALSE(std::isnan(settled_s));
+  TEST_ASSERT_TRUE(settled_s <= 5 * RUNTIME_SHORT_TAU_S);
+}
+
+void test_idle_and_charging() {
+  std::mt19937 rng(1);
+  std::normal_distribution<float> gauss(0.0f, 0.02f);
+  RuntimeEstimator estimator;
+  double t = 0;
+  for (; t < 3600.0; t += kDtS) {
+    estimator.add_sample(micros_at(t), gauss(rng));
+  }
+  // Idle: no time to empty or full
+  TEST_ASSERT_TRUE(std::isnan(estimator.time_to_empty_s(100.0f, 100.0f)));
+  TEST_ASSERT_TRUE(std::isnan(estimator.time_to_full_s(100.0f, 200.0f, 100.0f)));
+
+  // Charging at 20 A with 90 % charge efficiency, 100 Ah missing
+  for (; t < 2 * 3600.0; t += kDtS) {
+    estimator.add_sample(micros_at(t), 20.0f + gauss(rng));
+  }
+  TEST_ASSERT_FLOAT_WITHIN(200.0f, 100.0f / 18.0f * 3600.0f, estimator.time_to_full_s(100.0f, 200.0f, 90.0f));
+  TEST_ASSERT_TRUE(std::isnan(estimator.time_to_empty_s(100.0f, 100.0f)));
+  TEST_ASSERT_EQUAL_FLOAT(0.0f, estimator.time_to_full_s(200.0f, 200.0f, 90.0f));
+}
+
+void test_sample_cost() {
+  RuntimeEstimator estimator;
+  const int samples = 10000000;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < samples; i++) {
+    estimator.add_sample(static_cast<uint32_t>(i) * 1000u, -5.0f - (i & 7) * 0.1f);
+  }
+  double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / samples;
+  char message[96];
+  snprintf(message, sizeof(message), "add_sample(): %.1f ns on this host, %zu bytes of state (load %.2f A)", ns,
+           sizeof(estimator), estimator.load_a());
+  TEST_MESSAGE(message);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_cycling_load);
+  RUN_TEST(test_load_step_followed);
+  RUN_TEST(test_idle_and_charging);
+  RUN_TEST(test_sample_cost);
+  return UNITY_END();
+}
@@ -0,0 +1,132 @@
+#include <unity.h>
+
+#include <cmath>
+
+#include "sk_delta_emitter.h"
+
+using namespace sensesp;
+
+namespace {
+
+SKOutputFloat* voltage;
+SKOutputFloat* current;
+SKDeltaEmitter* emitter;
+int voltage_channel;
+int current_channel;
+
+}  // namespace
+
+void setUp() {
+  voltage = new SKOutputFloat("electrical.batteries.house.voltage");
+  current = new SKOutputFloat("electrical.batteries.house.current");
+  emitter = new SKDeltaEmitter();
+  voltage_channel = emitter->add(voltage, {0.01f, 10000});
+  current_channel = emitter->add(current, {0.0f, 10000});
+}
+
+void tearDown() {
+  delete emitter;
+  delete current;
+  delete voltage;
+  SKOutputFloat::clear_registry();
+}
+
+void test_first_value_always_sent() {
+  emitter->update(voltage_channel, 12.8f);
+  emitter->update(current_channel, 0.0f);
+  TEST_ASSERT_EQUAL_size_t(2, emitter->flush(0));
+  TEST_ASSERT_EQUAL_FLOAT(12.8f, voltage->get());
+  TEST_ASSERT_EQUAL_UINT32(1, voltage->get_set_count());
+  TEST_ASSERT_EQUAL_UINT32(1, current->get_set_count());
+  // Both paths in one delta
+  TEST_ASSERT_EQUAL_UINT32(1, emitter->get_message_count());
+  TEST_ASSERT_EQUAL_UINT32(2, emitter->get_value_count());
+}
+
+void test_deadband_suppresses_small_changes() {
+  emitter->update(voltage_channel, 12.80f);
+  emitter->flush(0);
+  emitter->update(voltage_channel, 12.805f);
+  TEST_ASSERT_EQUAL_size_t(0, emitter->flush(100));
+  TEST_ASSERT_EQUAL_UINT32(1, emitter->get_suppressed_count());
+  // Compared with the last value sent, not the last staged one
+  emitter->update(voltage_channel, 12.811f);
+  TEST_ASSERT_EQUAL_size_t(1, emitter->flush(200));
+  TEST_ASSERT_EQUAL_FLOAT(12.811f, voltage->get());
+  TEST_ASSERT_EQUAL_UINT32(2, emitter->get_message_count());
+}
+
+void test_zero_deadband_sends_any_change() {
+  emitter->update(current_channel, 1.0f);
+  emitter->flush(0);
+  emitter->update(current_channel, 1.0f);
+  TEST_ASSERT_EQUAL_size_t(0, emitter->flush(100));
+  emitter->update(current_channel, 1.0001f);
+  TEST_ASSERT_EQUAL_size_t(1, emitter->flush(200));
+}
+
+void test_heartbeat_resends_unchanged_value() {
+  emitter->update(voltage_channel, 12.8f);
+  emitter->flush(0);
+  emitter->update(voltage_channel, 12.8f);
+  TEST_ASSERT_EQUAL_size_t(0, emitter->flush(9999));
+  emitter->update(voltage_channel, 12.8f);
+  TEST_ASSERT_EQUAL_size_t(1, emitter->flush(10000));
+  TEST_ASSERT_EQUAL_UINT32(2, voltage->get_set_count());
+}
+
+void test_nan_sent_once_when_it_appears_and_clears() {
+  emitter->update(voltage_channel, 12.8f);
+  emitter->flush(0);
+  emitter->update(voltage_channel, NAN);
+  TEST_ASSERT_EQUAL_size_t(1, emitter->flush(100));
+  TEST_ASSERT_FLOAT_IS_NAN(voltage->get());
+  emitter->update(voltage_channel, NAN);
+  TEST_ASSERT_EQUAL_size_t(0, emitter->flush(200));
+  emitter->update(voltage_channel, 12.8f);
+  TEST_ASSERT_EQUAL_size_t(1, emitter->flush(300));
+}
+
+void test_unstaged_channels_not_sent() {
+  emitter->update(voltage_channel, 12.8f);
+  emitter->update(current_channel, 1.0f);
+  emitter->flush(0);
+  // Heartbeat due, but nothing staged
+  TEST_ASSERT_EQUAL_size_t(0, emitter->flush(20000));
+  TEST_ASSERT_EQUAL_UINT32(1, emitter->get_message_count());
+  // Out of range channels are ignored
+  emitter->update(-1, 1.0f);
+  emitter->update(7, 1.0f);
+  TEST_ASSERT_EQUAL_size_t(0, emitter->flush(30000));
+}
+
+void test_byte_estimate() {
+  emitter->update(voltage_channel, 12.5f);
+  emitter->flush(0);
+  // Envelope + value overhead + path + "12.5"
+  uint32_t path_length = voltage->get_sk_path().length();
+  TEST_ASSERT_EQUAL_UINT32(120 + 21 + path_length + 4, emitter->get_byte_count());
+}
+
+void test_table_full() {
+  SKDeltaEmitter full;
+  for (int i = 0; i < SK_EMITTER_MAX_CHANNELS; i++) {
+    TEST_ASSERT_EQUAL_INT(i, full.add(voltage, {0.0f, 1000}));
+  }
+  TEST_ASSERT_EQUAL_UINT32(0, full.get_unregistered_count());
+  TEST_ASSERT_EQUAL_INT(-1, full.add(voltage, {0.0f, 1000}));
+  TEST_ASSERT_EQUAL_UINT32(1, full.get_unregistered_count());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_first_value_always_sent);
+  RUN_TEST(test_deadband_suppresses_small_changes);
+  RUN_TEST(test_zero_deadband_sends_any_change);
+  RUN_TEST(test_heartbeat_resends_unchanged_value);
+  RUN_TEST(test_nan_sent_once_when_it_appears_and_clears);
+  RUN_TEST(test_unstaged_channels_not_sent);
+  RUN_TEST(test_byte_estimate);
+  RUN_TEST(test_table_full);
+  return UNITY_END();
+}
@@ -0,0 +1,189 @@
+#include <unity.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+
+#include "soc_ekf.h"
+
+using namespace sensesp;
+
+namespace {
+
+// The simulated battery: same circuit form as the filter, other values
+struct Plant {
+  SocEkf ocv_source;  // Only for its OCV curve
+  float capacity_ah;
+  float soc;
+  float v1 = 0;
+  float r0_ohm;
+  float r1_ohm;
+  float tau_s;
+  float ocv_error_v;  // Systematic OCV error, varies with SOC
+
+  Plant(BatteryChemistry chemistry, uint8_t cells, float capacity, float start_soc, float celsius)
+      : ocv_source(chemistry, cells, capacity), capacity_ah(capacity), soc(start_soc) {
+    // Resistance and OCV shift with temperature like the filter assumes,
+    // from a 20 % higher resistance
+    ocv_source.set_temperature_c(celsius);
+    r0_ohm = ocv_source.resistance_ohm() * 1.2f;
+    r1_ohm = r0_ohm * 1.5f;
+    tau_s = chemistry == BatteryChemistry::kLeadAcid ? 900.0f : 90.0f;
+    ocv_error_v = 0.003f * cells;
+  }
+
+  float step(float current_a, float dt_s) {
+    soc += current_a * dt_s / (3600.0f * capacity_ah);
+    soc = soc < 0 ? 0 : (soc > 1 ? 1 : soc);
+    float decay = std::exp(-dt_s / tau_s);
+    v1 = decay * v1 + (1 - decay) * r1_ohm * current_a;
+    return ocv_source.open_circuit_voltage(soc) + ocv_error_v * std::sin(soc * 9.0f) + v1 + r0_ohm * current_a;
+  }
+};
+
+struct Scenario {
+  const char* name;
+  BatteryChemistry chemistry;
+  uint8_t cells;
+  float capacity_ah;
+  float true_start_soc;
+  float guessed_start_soc;
+  float offset_a;         // Current sensor offset
+  float temperature_c;    // Battery temperature
+  bool tell_temperature;  // Filter gets the temperature (else assumes 25 °C)
+  float hours;
+};
+
+struct Result {
+  float ekf_final_error;
+  float ekf_worst_error_after_2h;
+  float coulomb_final_error;
+};
+
+// House load with a fridge compressor; charges at 25 A for the last 2 of
+// every 12 hours, about what the 10 hours before took out
+float house_current(double t_s) {
+  double cycle = std::fmod(t_s, 12 * 3600.0);
+  if (cycle >= 10 * 3600.0) {
+    return 25.0f;
+  }
+  bool compressor = std::fmod(t_s, 1800.0) < 600.0;
+  return -4.0f - (compressor ? 4.5f : 0.0f);
+}
+
+// The filter and coulomb counting from the same guess against the plant's SOC
+Result run(const Scenario& scenario) {
+  std::mt19937 rng(1);
+  Plant plant(scenario.chemistry, scenario.cells, scenario.capacity_ah, scenario.true_start_soc,
+              scenario.temperature_c);
+  SocEkf ekf(scenario.chemistry, scenario.cells, scenario.capacity_ah);
+  ekf.reset(scenario.guessed_start_soc);
+  if (scenario.tell_temperature) {
+    ekf.set_temperature_c(scenario.temperature_c);
+  }
+  float coulomb_soc = scenario.guessed_start_soc;
+  std::normal_distribution<float> voltage_noise(0.0f, 0.004f);
+  std::normal_distribution<float> current_noise(0.0f, 0.05f);
+
+  Result result = {};
+  const float dt_s = 1.0f;
+  for (double t = 0; t < scenario.hours * 3600.0; t += dt_s) {
+    float current = house_current(t);
+    float voltage = plant.step(current, dt_s) + voltage_noise(rng);
+    float measured_a = current + scenario.offset_a + current_noise(rng);
+    coulomb_soc += measured_a * dt_s / (3600.0f * scenario.capacity_ah);
+    coulomb_soc = coulomb_soc < 0 ? 0 : (coulomb_soc > 1 ? 1 : coulomb_soc);
+
+    // micros(): wraps after 71.6 minutes
+    ekf.update(static_cast<uint32_t>(static_cast<uint64_t>(t * 1e6)), measured_a, voltage);
+
+    float error = std::fabs(ekf.soc() - plant.soc);
+    if (t >= 2 * 3600.0 && error > result.ekf_worst_error_after_2h) {
+      result.ekf_worst_error_after_2h = error;
+    }
+  }
+  result.ekf_final_error = std::fabs(ekf.soc() - plant.soc);
+  result.coulomb_final_error = std::fabs(coulomb_soc - plant.soc);
+  char message[160];
+  snprintf(message, sizeof(message),
+           "%s: EKF %.1f %% (worst after 2 h %.1f %%), coulomb %.1f %%, %u voltages rejected", scenario.name,
+           result.ekf_final_error * 100, result.ekf_worst_error_after_2h * 100, result.coulomb_final_error * 100,
+           static_cast<unsigned>(ekf.get_rejected_count()));
+  TEST_MESSAGE(message);
+  return result;
+}
+
+}  // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_lead_acid_wrong_start_corrected() {
+  const Scenario scenario = {"lead-acid, start guessed 30 % low", BatteryChemistry::kLeadAcid, 6, 200.0f,
+                             0.85f, 0.55f, 0.0f, 25.0f, true, 24.0f};
+  Result result = run(scenario);
+  // Within 5 % after 2 h; coulomb counting keeps the wrong start
+  TEST_ASSERT_FLOAT_WITHIN(0.05f, 0.0f, result.ekf_worst_error_after_2h);
+  TEST_ASSERT_TRUE(result.coulomb_final_error > 0.25f);
+}
+
+void test_lead_acid_offset_does_not_drift() {
+  const Scenario scenario = {"lead-acid, +0.4 A sensor offset", BatteryChemistry::kLeadAcid, 6, 200.0f, 0.90f,
+                             0.90f, 0.4f, 25.0f, true, 72.0f};
+  Result result = run(scenario);
+  // Within 5 % after 3 days, coulomb counting drifts more
+  TEST_ASSERT_FLOAT_WITHIN(0.05f, 0.0f, result.ekf_final_error);
+  TEST_ASSERT_TRUE(result.coulomb_final_error > result.ekf_final_error * 2);
+}
+
+void test_lifepo4_wrong_start_corrected() {
+  const Scenario scenario = {"LiFePO4, start guessed 30 % low", BatteryChemistry::kLiFePO4, 4, 200.0f, 0.85f,
+                             0.55f, 0.0f, 25.0f, true, 24.0f};
+  // Within 8 % after a day: the flat OCV curve gives less to correct from
+  TEST_ASSERT_FLOAT_WITHIN(0.08f, 0.0f, run(scenario).ekf_final_error);
+}
+
+void test_lifepo4_offset_drifts_less_than_coulomb_counting() {
+  const Scenario scenario = {"LiFePO4, +0.4 A sensor offset", BatteryChemistry::kLiFePO4, 4, 200.0f, 0.90f,
+                             0.90f, 0.4f, 25.0f, true, 72.0f};
+  Result result = run(scenario);
+  TEST_ASSERT_TRUE(result.ekf_final_error < result.coulomb_final_error);
+}
+
+void test_temperature_input_helps_in_the_cold() {
+  const Scenario known = {"lead-acid at 0 C, temperature known", BatteryChemistry::kLeadAcid, 6, 200.0f, 0.85f,
+                          0.55f, 0.0f, 0.0f, true, 24.0f};
+  const Scenario blind = {"lead-acid at 0 C, assumed 25 C", BatteryChemistry::kLeadAcid, 6, 200.0f, 0.85f,
+                          0.55f, 0.0f, 0.0f, false, 24.0f};
+  Result known_result = run(known);
+  Result blind_result = run(blind);
+  TEST_ASSERT_TRUE(known_result.ekf_worst_error_after_2h < blind_result.ekf_worst_error_after_2h);
+  TEST_ASSERT_FLOAT_WITHIN(0.06f, 0.0f, known_result.ekf_worst_error_after_2h);
+}
+
+void test_update_cost() {
+  SocEkf ekf(BatteryChemistry::kLeadAcid, 6, 200.0f);
+  const int steps = 10000000;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < steps; i++) {
+    ekf.update(static_cast<uint32_t>(i) * 100000u, -5.0f - (i & 7) * 0.1f, 12.4f - (i & 3) * 0.001f);
+  }
+  double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / steps;
+  char message[96];
+  snprintf(message, sizeof(message), "update(): %.1f ns on this host, %zu bytes of state (soc %.3f)", ns,
+           sizeof(ekf), ekf.soc());
+  TEST_MESSAGE(message);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_lead_acid_wrong_start_corrected);
+  RUN_TEST(test_lead_acid_offset_does_not_drift);
+  RUN_TEST(test_lifepo4_wrong_start_corrected);
+  RUN_TEST(test_lifepo4_offset_drifts_less_than_coulomb_counting);
+  RUN_TEST(test_temperature_input_helps_in_the_cold);
+  RUN_TEST(test_update_cost);
+  return UNITY_END();
+}
@@ -0,0 +1,174 @@
+#include <unity.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "battery_bank.h"
+#include "battery_sample.h"
+#include "spsc_ring.h"
+
+using namespace sensesp;
+
+namespace {
+
+// The ring between the acquisition task and the event loop
+using SampleRing = SpscRing<BatterySample, BATTERY_SAMPLE_RING_SIZE>;
+
+BatterySample numbered(uint32_t i) {
+  BatterySample sample;
+  sample.timestamp_us = i;
+  sample.current_a = static_cast<float>(i % 1000);
+  return sample;
+}
+
+// Consumer's view: every sample must come after the previous one and carry
+// matching fields
+struct Checker {
+  std::vector<uint32_t> received;
+  size_t torn = 0;
+
+  void add(const BatterySample& sample) {
+    if (sample.current_a != static_cast<float>(sample.timestamp_us % 1000)) {
+      torn++;
+    }
+    received.push_back(sample.timestamp_us);
+  }
+
+  size_t out_of_order() const {
+    size_t count = 0;
+    for (size_t i = 1; i < received.size(); i++) {
+      count += received[i] <= received[i - 1];
+    }
+    return count;
+  }
+};
+
+SampleRing* ring;
+
+}  // namespace
+
+void setUp() { ring = new SampleRing(); }
+
+void tearDown() { delete ring; }
+
+void test_full_ring_drops_new_items() {
+  for (uint32_t i = 0; i < SampleRing::capacity(); i++) {
+    TEST_ASSERT_TRUE(ring->push(numbered(i)));
+  }
+  TEST_ASSERT_FALSE(ring->push(numbered(999)));
+  TEST_ASSERT_EQUAL_UINT32(1, ring->get_overflow_count());
+  TEST_ASSERT_EQUAL_size_t(SampleRing::capacity(), ring->size());
+  // The queued items are kept, oldest first
+  BatterySample sample;
+  for (uint32_t i = 0; i < SampleRing::capacity(); i++) {
+    TEST_ASSERT_TRUE(ring->pop(&sample));
+    TEST_ASSERT_EQUAL_UINT32(i, sample.timestamp_us);
+  }
+  TEST_ASSERT_FALSE(ring->pop(&sample));
+}
+
+void test_threads_hand_over_every_item_in_order() {
+  const uint32_t items = 2000000;
+  std::thread producer([] {
+    for (uint32_t i = 0; i < items; i++) {
+      // Wait for room instead of dropping: size() is exact on this side
+      while (ring->size() >= SampleRing::capacity()) {
+        std::this_thread::yield();
+      }
+      ring->push(numbered(i));
+    }
+  });
+  Checker checker;
+  checker.received.reserve(items);
+  BatterySample sample;
+  while (checker.received.size() < items) {
+    if (ring->pop(&sample)) {
+      checker.add(sample);
+    } else {
+      std::this_thread::yield();
+    }
+  }
+  producer.join();
+
+  TEST_ASSERT_FALSE(ring->pop(&sample));
+  TEST_ASSERT_EQUAL_UINT32(0, ring->get_overflow_count());
+  TEST_ASSERT_EQUAL_size_t(0, checker.torn);
+  // In order and consecutive: nothing lost, nothing twice
+  TEST_ASSERT_EQUAL_size_t(0, checker.out_of_order());
+  TEST_ASSERT_EQUAL_UINT32(0, checker.received.front());
+  TEST_ASSERT_EQUAL_UINT32(items - 1, checker.received.back());
+}
+
+void test_stalled_consumer_counts_overflows() {
+  const uint32_t items = SampleRing::capacity() + 1000;
+  std::atomic<bool> produced{false};
+  uint32_t rejected = 0;
+  std::thread producer([&] {
+    for (uint32_t i = 0; i < items; i++) {
+      rejected += !ring->push(numbered(i));
+    }
+    produced = true;
+  });
+  // The event loop is blocked until the task has pushed everything
+  while (!produced) {
+    std::this_thread::yield();
+  }
+  Checker checker;
+  BatterySample sample;
+  while (ring->pop(&sample)) {
+    checker.add(sample);
+  }
+  producer.join();
+
+  // The first capacity() items are kept, the rest dropped and counted
+  TEST_ASSERT_EQUAL_UINT32(1000, rejected);
+  TEST_ASSERT_EQUAL_UINT32(1000, ring->get_overflow_count());
+  TEST_ASSERT_EQUAL_size_t(SampleRing::capacity(), checker.received.size());
+  TEST_ASSERT_EQUAL_size_t(0, checker.out_of_order());
+  TEST_ASSERT_EQUAL_UINT32(SampleRing::capacity() - 1, checker.received.back());
+}
+
+void test_periodic_drain_loses_only_counted_items() {
+  // The task pushes at its own pace; the event loop drains in bursts, like
+  // every BATTERY_RING_DRAIN_INTERVAL_MS, and sometimes too late
+  const uint32_t items = 200000;
+  std::atomic<bool> produced{false};
+  std::thread producer([&] {
+    for (uint32_t i = 0; i < items; i++) {
+      ring->push(numbered(i));
+      if (i % 64 == 0) {
+        std::this_thread::sleep_for(std::chrono::microseconds(20));
+      }
+    }
+    produced = true;
+  });
+  Checker checker;
+  checker.received.reserve(items);
+  BatterySample sample;
+  for (;;) {
+    bool done = produced;
+    while (ring->pop(&sample)) {
+      checker.add(sample);
+    }
+    if (done) {
+      break;
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(500));
+  }
+  producer.join();
+
+  TEST_ASSERT_EQUAL_UINT32(items, checker.received.size() + ring->get_overflow_count());
+  TEST_ASSERT_EQUAL_size_t(0, checker.torn);
+  TEST_ASSERT_EQUAL_size_t(0, checker.out_of_order());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_full_ring_drops_new_items);
+  RUN_TEST(test_threads_hand_over_every_item_in_order);
+  RUN_TEST(test_stalled_consumer_counts_overflows);
+  RUN_TEST(test_periodic_drain_loses_only_counted_items);
+  return UNITY_END();
+}
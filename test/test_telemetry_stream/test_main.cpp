@@ -0,0 +1,225 @@
+#include <unity.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+#include "telemetry_stream.h"
+
+using namespace sensesp;
+
+// Allocations while counting is on (inside TelemetryStream::add())
+static bool counting = false;
+static size_t allocations = 0;
+
+void* operator new(size_t size) {
+  if (counting) {
+    allocations++;
+  }
+  void* memory = malloc(size == 0 ? 1 : size);
+  if (memory == nullptr) {
+    throw std::bad_alloc();
+  }
+  return memory;
+}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+void operator delete(void* memory) noexcept { free(memory); }
+void operator delete(void* memory, size_t) noexcept { free(memory); }
+#pragma GCC diagnostic pop
+
+namespace {
+
+constexpr int kBatteries = 2;
+constexpr int kRateHz = 50;
+constexpr int kSeconds = 60;
+constexpr uint32_t kIntervalUs = 1000000u / kRateHz;
+// Just below the micros() wrap
+constexpr uint32_t kStartUs = 0xFFFFFFFFu - 5000000u;
+
+// Decodes what the stream sends, like tools/telemetry_sink, and drops every
+// drop_every-th datagram before it is sent
+class ReceivingTransport : public TelemetryTransport {
+ public:
+  explicit ReceivingTransport(int drop_every) : drop_every_(drop_every) {}
+
+  bool send(const uint8_t* data, size_t length) override {
+    // The receiver's allocations are not the stream's
+    bool was_counting = counting;
+    counting = false;
+    bool sent = receive(data, length);
+    counting = was_counting;
+    return sent;
+  }
+
+  std::vector<TelemetryRecord> records;
+  int datagrams = 0;
+  int dropped = 0;
+  size_t dropped_records = 0;
+  int lost = 0;
+  int invalid = 0;
+
+ private:
+  bool receive(const uint8_t* data, size_t length) {
+    TelemetryHeader header;
+    if (!decode_telemetry_header(data, length, &header)) {
+      invalid++;
+      return true;
+    }
+    if (++count_ % drop_every_ == 0) {
+      dropped++;
+      dropped_records += header.count;
+      return false;
+    }
+    if (datagrams > 0 && header.sequence != next_sequence_) {
+      lost += static_cast<int32_t>(header.sequence - next_sequence_);
+    }
+    next_sequence_ = header.sequence + 1;
+    datagrams++;
+    for (size_t i = 0; i < header.count; i++) {
+      records.push_back(decode_telemetry_record(data, i));
+    }
+    return true;
+  }
+
+  int drop_every_;
+  int count_ = 0;
+  uint32_t next_sequence_ = 0;
+};
+
+// Deterministic values of sample i of a battery
+BatterySample test_sample(uint32_t timestamp_us, int battery, int i) {
+  BatterySample sample;
+  sample.timestamp_us = timestamp_us;
+  sample.voltage_v = 12.0f + battery * 0.5f + (i % 100) * 0.01f;
+  sample.current_a = -4.0f - battery + std::sin(i * 0.1f) * 3.0f;
+  sample.power_w = sample.voltage_v * sample.current_a;
+  return sample;
+}
+
+float test_ah(int i) { return 100.0f - i * 0.001f; }
+
+struct Result {
+  ReceivingTransport transport{10};
+  uint32_t sent_count = 0;
+  uint32_t failed_count = 0;
+  uint32_t record_count = 0;
+  size_t add_allocations = 0;
+};
+
+// A minute at 50 Hz per battery, every 10th datagram dropped
+const Result& stream_minute() {
+  static Result* result = nullptr;
+  if (result != nullptr) {
+    return *result;
+  }
+  result = new Result();
+  TelemetryStream stream(&result->transport, 0x12345678u);
+  for (int i = 0; i < kRateHz * kSeconds; i++) {
+    uint32_t t = kStartUs + static_cast<uint32_t>(i) * kIntervalUs;
+    allocations = 0;
+    counting = true;
+    for (int b = 0; b < kBatteries; b++) {
+      stream.add(static_cast<uint8_t>(b), test_sample(t + b * 100, b, i), test_ah(i));
+    }
+    stream.poll(t + 1000);
+    counting = false;
+    result->add_allocations += allocations;
+  }
+  stream.flush();
+  result->sent_count = stream.get_sent_count();
+  result->failed_count = stream.get_failed_count();
+  result->record_count = stream.get_record_count();
+  return *result;
+}
+
+}  // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_received_records_match_their_samples() {
+  const Result& result = stream_minute();
+  TEST_ASSERT_EQUAL_UINT32(kRateHz * kSeconds * kBatteries, result.record_count);
+  TEST_ASSERT_FALSE(result.transport.records.empty());
+  size_t mismatches = 0;
+  for (const TelemetryRecord& record : result.transport.records) {
+    uint32_t offset_us = record.timestamp_us - kStartUs - record.battery * 100u;
+    int i = static_cast<int>(offset_us / kIntervalUs);
+    BatterySample sample = test_sample(record.timestamp_us, record.battery, i);
+    // Voltage goes out in mV
+    if (offset_us % kIntervalUs != 0 || std::fabs(record.voltage_v - sample.voltage_v) > 0.0006f ||
+        record.current_a != sample.current_a || record.ah != test_ah(i)) {
+      mismatches++;
+    }
+  }
+  TEST_ASSERT_EQUAL_size_t(0, mismatches);
+  TEST_ASSERT_EQUAL_INT(0, result.transport.invalid);
+}
+
+void test_sequence_gaps_count_dropped_datagrams() {
+  const Result& result = stream_minute();
+  TEST_ASSERT_TRUE(result.transport.dropped > 0);
+  TEST_ASSERT_EQUAL_UINT32(result.transport.datagrams, result.sent_count);
+  TEST_ASSERT_EQUAL_UINT32(result.transport.dropped, result.failed_count);
+  TEST_ASSERT_EQUAL_INT(result.transport.dropped, result.transport.lost);
+  // Only the dropped datagrams' records are missing
+  TEST_ASSERT_EQUAL_size_t(result.record_count, result.transport.records.size() + result.transport.dropped_records);
+}
+
+void test_datagrams_batched_up_to_latency() {
+  const Result& result = stream_minute();
+  // 100 records per second, 200 ms latency: 5 datagrams per second
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(kSeconds * (1000 / BATTERY_TELEMETRY_MAX_LATENCY_MS) + 1,
+                                   result.sent_count + result.failed_count);
+}
+
+void test_adding_samples_does_not_allocate() {
+  TEST_ASSERT_EQUAL_size_t(0, stream_minute().add_allocations);
+}
+
+void test_foreign_datagram_rejected() {
+  TelemetryHeader header;
+  const uint8_t other[kTelemetryHeaderBytes] = {'X', 'Y', kTelemetryVersion, kTelemetryRecordBytes};
+  TEST_ASSERT_FALSE(decode_telemetry_header(other, sizeof(other), &header));
+  // A header announcing more records than the datagram holds
+  uint8_t truncated[kTelemetryHeaderBytes] = {'B', 'T', kTelemetryVersion, kTelemetryRecordBytes, 0, 0, 0, 0, 1};
+  TEST_ASSERT_FALSE(decode_telemetry_header(truncated, sizeof(truncated), &header));
+  TEST_ASSERT_FALSE(decode_telemetry_header(truncated, 8, &header));
+}
+
+void test_add_cost() {
+  class NullTransport : public TelemetryTransport {
+   public:
+    bool send(const uint8_t*, size_t) override { return true; }
+  } null_transport;
+  TelemetryStream stream(&null_transport, 1);
+  const int adds = 10000000;
+  BatterySample sample = test_sample(0, 0, 0);
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < adds; i++) {
+    sample.timestamp_us = static_cast<uint32_t>(i) * 1000u;
+    stream.add(static_cast<uint8_t>(i & 1), sample, 100.0f);
+  }
+  double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / adds;
+  char message[128];
+  snprintf(message, sizeof(message), "add(): %.1f ns on this host, %zu bytes per stream, %zu records per datagram",
+           ns, sizeof(stream), kTelemetryMaxRecords);
+  TEST_MESSAGE(message);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_received_records_match_their_samples);
+  RUN_TEST(test_sequence_gaps_count_dropped_datagrams);
+  RUN_TEST(test_datagrams_batched_up_to_latency);
+  RUN_TEST(test_adding_samples_does_not_allocate);
+  RUN_TEST(test_foreign_datagram_rejected);
+  RUN_TEST(test_add_cost);
+  return UNITY_END();
+}
@@ -0,0 +1,109 @@
+#include <unity.h>
+
+#include "battery_bank.h"
+#include "fake_hal.h"
+#include "fake_i2c.h"
+#include "virtual_bank.h"
+
+using namespace sensesp;
+
+namespace {
+
+constexpr BatteryConfig kBatteries[] = {
+    {"house", "house", 0x40, 0.0075f, 0.25f, 200.0f, 150.0f, -1, false, BatteryChemistry::kLeadAcid, 6},
+    {"starter", "start", 0x41, 0.0075f, 0.25f, 100.0f, 90.0f, -1, false, BatteryChemistry::kLeadAcid, 6},
+};
+constexpr const char* kMembers[] = {"house", "starter"};
+
+alignas(PipelineArena::kAlignment) uint8_t arena_storage[256 * 1024];
+
+fake_hal::FakeI2CTransport* transport;
+fake_hal::FakeINA226* chips[2];
+I2CBus* bus;
+
+// Bank, its virtual bank and the emulated chips, as setup() builds them
+VirtualBank* boot(const VirtualBankConfig& config) {
+  pipeline_arena()->set_storage(arena_storage, sizeof(arena_storage));
+  transport = new fake_hal::FakeI2CTransport();
+  for (size_t i = 0; i < 2; i++) {
+    chips[i] = new fake_hal::FakeINA226(kBatteries[i].i2c_address, kBatteries[i].shunt_resistance);
+    transport->add(chips[i]);
+  }
+  bus = new I2CBus(transport);
+  BatteryBank* bank = pipeline_arena()->create<BatteryBank>(kBatteries, 2, bus);
+  return bank->add_virtual_bank(config);
+}
+
+void shut_down() {
+  delete bus;
+  delete chips[0];
+  delete chips[1];
+  delete transport;
+}
+
+}  // namespace
+
+void setUp() { fake_hal::reset(); }
+
+void tearDown() { shut_down(); }
+
+void test_members_start_out_by_default() {
+  VirtualBankConfig config = {"combined", "combined", kMembers, 2, 0};
+  VirtualBank* bank = boot(config);
+  fake_hal::run_for_ms(3000);
+  TEST_ASSERT_FALSE(bank->aggregate().is_member(0));
+  TEST_ASSERT_FALSE(bank->aggregate().is_member(1));
+  TEST_ASSERT_EQUAL_FLOAT(0.0f, SKOutputFloat::find("electrical.batteries.combined.members.house")->get());
+}
+
+void test_initial_members_join_at_first_boot() {
+  VirtualBankConfig config = {"combined", "combined", kMembers, 2, 0b10};
+  VirtualBank* bank = boot(config);
+  TEST_ASSERT_FALSE(bank->aggregate().is_member(0));
+  TEST_ASSERT_TRUE(bank->aggregate().is_member(1));
+  TEST_ASSERT_DOUBLE_WITHIN(1e-3, 90.0, bank->aggregate().ah());
+  // Not a change: nothing to commit
+  uint32_t commits = ah_state_store()->get_commit_count();
+  ah_state_store()->flush();
+  TEST_ASSERT_EQUAL_UINT32(commits, ah_state_store()->get_commit_count());
+}
+
+void test_membership_persists_across_reboot() {
+  VirtualBankConfig config = {"combined", "combined", kMembers, 2, 0b11};
+  boot(config);
+  SKPutRequestListener<float>::find("electrical.batteries.combined.members.starter")->emit(0.0f);
+  fake_hal::run_for_ms(AH_JOURNAL_FLUSH_INTERVAL_MS);
+  shut_down();
+
+  fake_hal::reboot(false);
+  VirtualBank* bank = boot(config);
+  TEST_ASSERT_TRUE(bank->aggregate().is_member(0));
+  TEST_ASSERT_FALSE(bank->aggregate().is_member(1));
+  TEST_ASSERT_DOUBLE_WITHIN(1e-3, 150.0, bank->aggregate().ah());
+
+  // And back in
+  SKPutRequestListener<float>::find("electrical.batteries.combined.members.starter")->emit(1.0f);
+  fake_hal::run_for_ms(AH_JOURNAL_FLUSH_INTERVAL_MS);
+  shut_down();
+  fake_hal::reboot(false);
+  bank = boot(config);
+  TEST_ASSERT_TRUE(bank->aggregate().is_member(1));
+}
+
+void test_repeated_put_stages_nothing() {
+  VirtualBankConfig config = {"combined", "combined", kMembers, 2, 0b01};
+  boot(config);
+  SKPutRequestListener<float>::find("electrical.batteries.combined.members.house")->emit(1.0f);
+  uint32_t commits = ah_state_store()->get_commit_count();
+  ah_state_store()->flush();
+  TEST_ASSERT_EQUAL_UINT32(commits, ah_state_store()->get_commit_count());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_members_start_out_by_default);
+  RUN_TEST(test_initial_members_join_at_first_boot);
+  RUN_TEST(test_membership_persists_across_reboot);
+  RUN_TEST(test_repeated_put_stages_nothing);
+  return UNITY_END();
+}
@@ -0,0 +1,353 @@
+// Accelerated trace replay for the Ah integrator.
+//
+// Streams a recorded current trace through the firmware's Ah accumulator,
+// SOC calculation and persistence rules under a virtual clock, and reports
+// Ah/SOC error at reference points plus the persistence writes that would
+// have happened (staged persists, journal commits/records, sector erases on a
+// simulated journal partition).
+//
+// Build on the host from the repository root:
+//   g++ -O2 -std=c++17 -Iinclude tools/ah_replay/ah_replay.cpp src/ah_journal.cpp -o ah_replay
+//
+// Trace formats:
+//   CSV (any extension except .bin), one sample per line:
+//     timestamp_ms,current_a[,voltage_v[,reference_ah]]
+//   Lines that do not start with a number (headers, comments) are skipped.
+//   reference_ah marks a known-good Ah value (e.g. a manual reset after a full
+//   charge); the replay reports the error there and then resets to it, like
+//   an SK PUT on the ah path.
+//   Binary (.bin): packed little-endian ReplayRecord structs (see below),
+//   reference_ah = NaN when absent.
+//
+// Sweeps: --rate-hz, --interval-ms and --persist-delta accept comma-separated
+// lists; every combination is replayed and printed as one row.
+//
+// Example:
+//   ./ah_replay house.csv --capacity 200 --rate-hz 0,1,10 --persist-delta 0.1,0.5,1
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "ah_accumulator.h"
+#include "ah_journal.h"
+#include "ah_persist_policy.h"
+#include "soc.h"
+
+using namespace sensesp;
+
+namespace {
+
+struct ReplayRecord {
+  uint64_t timestamp_ms;
+  float current_a;
+  float voltage_v;
+  float reference_ah;  // NaN = no reference at this sample
+  uint32_t reserved;
+};
+
+struct Options {
+  std::string trace_path;
+  float capacity_ah = 200.0f;
+  float initial_ah = NAN;           // Default: first reference, else capacity
+  float charge_efficiency = 100.0f;
+  float discharge_efficiency = 100.0f;
+  bool fixed_point = false;
+  bool hold_mode = false;           // Timer mode: hold current for interval_ms
+  std::vector<float> rates_hz = {0.0f};  // 0 = every trace sample
+  std::vector<unsigned long> intervals_ms = {1000};
+  std::vector<float> persist_deltas = {AH_PERSIST_DELTA_AH};
+  unsigned long flush_ms = AH_JOURNAL_FLUSH_INTERVAL_MS;
+  size_t journal_bytes = 16 * 1024;
+};
+
+struct Result {
+  size_t samples = 0;
+  size_t references = 0;
+  double sum_error = 0.0;
+  double sum_sq_error = 0.0;
+  double max_abs_error = 0.0;
+  double max_abs_soc_error = 0.0;
+  uint32_t persists = 0;
+  uint32_t commits = 0;
+  uint32_t records = 0;
+  uint32_t erases = 0;
+  double wall_s = 0.0;
+};
+
+// RAM-backed journal partition with NOR semantics (writes only clear bits)
+class SimulatedFlash : public JournalFlash {
+ public:
+  explicit SimulatedFlash(size_t size) : data_(size, 0xFF) {}
+  size_t size() const override { return data_.size(); }
+  size_t sector_size() const override { return 4096; }
+  bool read(size_t offset, void* data, size_t length) override {
+    memcpy(data, &data_[offset], length);
+    return true;
+  }
+  bool write(size_t offset, const void* data, size_t length) override {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < length; i++) {
+      data_[offset + i] &= bytes[i];
+    }
+    return true;
+  }
+  bool erase_sector(size_t offset) override {
+    memset(&data_[offset], 0xFF, sector_size());
+    return true;
+  }
+
+ private:
+  std::vector<uint8_t> data_;
+};
+
+bool load_trace(const std::string& path, std::vector<ReplayRecord>* trace) {
+  FILE* file = fopen(path.c_str(), "rb");
+  if (file == nullptr) {
+    return false;
+  }
+  if (path.size() > 4 && path.compare(path.size() - 4, 4, ".bin") == 0) {
+    ReplayRecord record;
+    while (fread(&record, sizeof(record), 1, file) == 1) {
+      trace->push_back(record);
+    }
+  } else {
+    char line[256];
+    while (fgets(line, sizeof(line), file) != nullptr) {
+      char* p = line;
+      if (!(*p == '-' || (*p >= '0' && *p <= '9'))) {
+        continue;
+      }
+      ReplayRecord record = {0, 0.0f, NAN, NAN, 0};
+      record.timestamp_ms = strtoull(p, &p, 10);
+      if (*p != ',') {
+        continue;
+      }
+      record.current_a = strtof(p + 1, &p);
+      if (*p == ',') {
+        char* start = p + 1;
+        record.voltage_v = strtof(start, &p);
+        if (p == start) record.voltage_v = NAN;
+      }
+      if (*p == ',') {
+        char* start = p + 1;
+        record.reference_ah = strtof(start, &p);
+        if (p == start) record.reference_ah = NAN;
+      }
+      trace->push_back(record);
+    }
+  }
+  fclose(file);
+  return true;
+}
+
+template <typename Accumulator>
+Result replay(const std::vector<ReplayRecord>& trace, const Options& options, float rate_hz,
+              unsigned long interval_ms, float persist_delta) {
+  auto start = std::chrono::steady_clock::now();
+  Result result;
+
+  float initial_ah = options.initial_ah;
+  if (std::isnan(initial_ah)) {
+    initial_ah = options.capacity_ah;
+    for (const auto& record : trace) {
+      if (!std::isnan(record.reference_ah)) {
+        initial_ah = record.reference_ah;
+        break;
+      }
+    }
+  }
+
+  Accumulator acc;
+  acc.set_efficiencies(options.charge_efficiency, options.discharge_efficiency);
+  acc.set_capacity(options.capacity_ah);
+  acc.set_ah(initial_ah);
+
+  SimulatedFlash flash(options.journal_bytes);
+  AhJournal journal(&flash);
+  AhPersistedState state;
+  state.current_capacity_ah = options.capacity_ah;
+  state.marked_capacity_ah = options.capacity_ah;
+  state.charge_efficiency = options.charge_efficiency;
+  state.discharge_efficiency = options.discharge_efficiency;
+
+  const uint64_t t0 = trace.front().timestamp_ms;
+  AhPersistPolicy policy;
+  policy.delta_ah = persist_delta;
+  policy.mark(initial_ah, 0);
+
+  auto stage = [&](unsigned long now_ms) {
+    float ah = acc.get_ah_float();
+    state.ah = ah;
+    journal.update("house", state);
+    policy.mark(ah, now_ms);
+    result.persists++;
+  };
+
+  const uint64_t sample_period_ms = (rate_hz > 0.0f) ? static_cast<uint64_t>(1000.0f / rate_hz) : 0;
+  bool have_previous = false;
+  uint64_t previous_ms = 0;
+  float previous_a = 0.0f;
+  uint64_t next_tick_ms = t0 + interval_ms;
+  uint64_t last_flush_ms = t0;
+
+  for (const auto& record : trace) {
+    const uint64_t now = record.timestamp_ms;
+    const unsigned long now_rel = static_cast<unsigned long>(now - t0);
+    bool use = !have_previous || sample_period_ms == 0 || now - previous_ms >= sample_period_ms;
+
+    if (use) {
+      result.samples++;
+      if (options.hold_mode) {
+        // Integration timer ticks, each holding the most recent sample
+        while (have_previous && next_tick_ms <= now) {
+          acc.add_hold(previous_a, static_cast<uint32_t>(interval_ms * 1000UL));
+          if (policy.delta_reached(acc.get_ah_float())) stage(static_cast<unsigned long>(next_tick_ms - t0));
+          next_tick_ms += interval_ms;
+        }
+      } else if (have_previous) {
+        // Trapezoid per sample; very long gaps are split to keep dt in uint32 us
+        uint64_t dt_ms = now - previous_ms;
+        const uint64_t kMaxChunkMs = 3600000;
+        float from_a = previous_a;
+        uint64_t done_ms = 0;
+        while (dt_ms - done_ms > kMaxChunkMs) {
+          float to_a = previous_a + (record.current_a - previous_a) * (done_ms + kMaxChunkMs) / dt_ms;
+          acc.add_trapezoid(from_a, to_a, static_cast<uint32_t>(kMaxChunkMs * 1000));
+          from_a = to_a;
+          done_ms += kMaxChunkMs;
+        }
+        acc.add_trapezoid(from_a, record.current_a, static_cast<uint32_t>((dt_ms - done_ms) * 1000));
+        if (policy.delta_reached(acc.get_ah_float())) stage(now_rel);
+      }
+      have_previous = true;
+      previous_ms = now;
+      previous_a = record.current_a;
+    }
+
+    if (!std::isnan(record.reference_ah)) {
+      double error = acc.get_ah() - record.reference_ah;
+      double soc_error = soc_percent(acc.get_ah_float(), options.capacity_ah) -
+                         soc_percent(record.reference_ah, options.capacity_ah);
+      result.references++;
+      result.sum_error += error;
+      result.sum_sq_error += error * error;
+      result.max_abs_error = std::max(result.max_abs_error, std::fabs(error));
+      result.max_abs_soc_error = std::max(result.max_abs_soc_error, std::fabs(soc_error));
+      // Reset like an SK PUT on the ah path (staged immediately)
+      acc.set_ah(record.reference_ah);
+      stage(now_rel);
+    }
+
+    if (now - last_flush_ms >= options.flush_ms) {
+      journal.flush();
+      last_flush_ms = now;
+    }
+  }
+  journal.flush();
+
+  result.commits = journal.get_commit_count();
+  result.records = journal.get_record_count();
+  result.erases = journal.get_erase_count();
+  result.wall_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  return result;
+}
+
+template <typename T>
+std::vector<T> parse_list(const char* text) {
+  std::vector<T> values;
+  const char* p = text;
+  while (*p != '\0') {
+    char* end;
+    values.push_back(static_cast<T>(strtod(p, &end)));
+    p = (*end == ',') ? end + 1 : end;
+    if (end == p && *p != '\0') break;
+  }
+  return values;
+}
+
+void usage() {
+  fprintf(stderr,
+          "usage: ah_replay TRACE [--capacity AH] [--initial-ah AH]\n"
+          "                 [--charge-eff PCT] [--discharge-eff PCT] [--fixed] [--hold]\n"
+          "                 [--rate-hz LIST] [--interval-ms LIST] [--persist-delta LIST]\n"
+          "                 [--flush-ms MS] [--journal-kb KB]\n");
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options options;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    const char* value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+    if (arg == "--fixed") {
+      options.fixed_point = true;
+    } else if (arg == "--hold") {
+      options.hold_mode = true;
+    } else if (arg.rfind("--", 0) == 0 && value == nullptr) {
+      usage();
+      return 2;
+    } else if (arg == "--capacity") {
+      options.capacity_ah = strtof(argv[++i], nullptr);
+    } else if (arg == "--initial-ah") {
+      options.initial_ah = strtof(argv[++i], nullptr);
+    } else if (arg == "--charge-eff") {
+      options.charge_efficiency = strtof(argv[++i], nullptr);
+    } else if (arg == "--discharge-eff") {
+      options.discharge_efficiency = strtof(argv[++i], nullptr);
+    } else if (arg == "--rate-hz") {
+      options.rates_hz = parse_list<float>(argv[++i]);
+    } else if (arg == "--interval-ms") {
+      options.intervals_ms = parse_list<unsigned long>(argv[++i]);
+    } else if (arg == "--persist-delta") {
+      options.persist_deltas = parse_list<float>(argv[++i]);
+    } else if (arg == "--flush-ms") {
+      options.flush_ms = strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--journal-kb") {
+      options.journal_bytes = strtoul(argv[++i], nullptr, 10) * 1024;
+    } else if (options.trace_path.empty()) {
+      options.trace_path = arg;
+    } else {
+      usage();
+      return 2;
+    }
+  }
+  if (options.trace_path.empty()) {
+    usage();
+    return 2;
+  }
+
+  std::vector<ReplayRecord> trace;
+  if (!load_trace(options.trace_path, &trace) || trace.size() < 2) {
+    fprintf(stderr, "cannot read trace %s (need at least 2 samples)\n", options.trace_path.c_str());
+    return 1;
+  }
+  double trace_hours = (trace.back().timestamp_ms - trace.front().timestamp_ms) / 3600000.0;
+  printf("# %zu samples, %.1f h, %s core, %s integration\n", trace.size(), trace_hours,
+         options.fixed_point ? "fixed-point" : "double", options.hold_mode ? "timer/hold" : "trapezoid");
+  printf("%8s %8s %7s | %9s %5s %9s %9s %9s %8s | %8s %7s %7s %6s | %9s\n", "rate_hz", "intv_ms", "delta",
+         "samples", "refs", "mean_err", "rms_err", "max_err", "max_soc", "persists", "commits", "records",
+         "erases", "speedup");
+
+  for (float rate_hz : options.rates_hz) {
+    for (unsigned long interval_ms : options.intervals_ms) {
+      for (float persist_delta : options.persist_deltas) {
+        Result r = options.fixed_point
+                       ? replay<FixedAhAccumulator>(trace, options, rate_hz, interval_ms, persist_delta)
+                       : replay<DoubleAhAccumulator>(trace, options, rate_hz, interval_ms, persist_delta);
+        double refs = r.references > 0 ? static_cast<double>(r.references) : 1.0;
+        printf("%8.2f %8lu %7.3f | %9zu %5zu %9.4f %9.4f %9.4f %8.3f | %8u %7u %7u %6u | %8.0fx\n", rate_hz,
+               interval_ms, persist_delta, r.samples, r.references, r.sum_error / refs,
+               std::sqrt(r.sum_sq_error / refs), r.max_abs_error, r.max_abs_soc_error, r.persists, r.commits,
+               r.records, r.erases, trace_hours * 3600.0 / std::max(r.wall_s, 1e-9));
+      }
+    }
+  }
+  return 0;
+}
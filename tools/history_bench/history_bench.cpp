@@ -0,0 +1,171 @@
+// Host benchmark for the on-device battery history (include/history_ring.h).
+//
+// Feeds a synthetic or recorded signal through HistoryTiers and reports, per
+// tier, bytes per record, the time span the configured ring holds and the
+// append cost per sample. The lossless raw decode is checked by the
+// test_history_ring suite.
+//
+// Build on the host from the repository root:
+//   g++ -O2 -std=c++17 -Iinclude tools/history_bench/history_bench.cpp -o history_bench
+//
+// Usage:
+//   ./history_bench [trace.csv] [--days N] [--rate-hz N] [--noise-mv N] [--noise-ma N]
+//
+// Without a trace a house battery is simulated: a daily cycle of discharge
+// (fridge, instruments) and solar charge, plus Gaussian measurement noise.
+// A trace uses the ah_replay CSV format: timestamp_ms,current_a[,voltage_v].
+// Tier sizes follow the HISTORY_* macros, e.g. -DHISTORY_RAW_BLOCKS=64.
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "history_ring.h"
+
+using namespace sensesp;
+
+namespace {
+
+struct Sample {
+  uint64_t timestamp_ms;
+  float voltage_v;
+  float current_a;
+};
+
+struct Options {
+  std::string trace_path;
+  double days = 31.0;
+  double rate_hz = 1.0;
+  double noise_mv = 2.0;
+  double noise_ma = 30.0;
+};
+
+bool parse_args(int argc, char** argv, Options* options) {
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    auto value = [&](double* out) {
+      if (i + 1 >= argc) {
+        return false;
+      }
+      *out = atof(argv[++i]);
+      return true;
+    };
+    if (arg == "--days") {
+      if (!value(&options->days)) return false;
+    } else if (arg == "--rate-hz") {
+      if (!value(&options->rate_hz)) return false;
+    } else if (arg == "--noise-mv") {
+      if (!value(&options->noise_mv)) return false;
+    } else if (arg == "--noise-ma") {
+      if (!value(&options->noise_ma)) return false;
+    } else if (arg[0] != '-') {
+      options->trace_path = arg;
+    } else {
+      return false;
+    }
+  }
+  return options->rate_hz > 0.0 && options->days > 0.0;
+}
+
+std::vector<Sample> load_trace(const std::string& path) {
+  std::vector<Sample> samples;
+  FILE* file = fopen(path.c_str(), "r");
+  if (file == nullptr) {
+    return samples;
+  }
+  char line[256];
+  while (fgets(line, sizeof(line), file) != nullptr) {
+    if ((line[0] < '0' || line[0] > '9') && line[0] != '-') {
+      continue;
+    }
+    Sample sample = {};
+    sample.voltage_v = 12.8f;
+    double timestamp_ms = 0, current_a = 0, voltage_v = 12.8;
+    int fields = sscanf(line, "%lf,%lf,%lf", &timestamp_ms, &current_a, &voltage_v);
+    if (fields < 2) {
+      continue;
+    }
+    sample.timestamp_ms = static_cast<uint64_t>(timestamp_ms);
+    sample.current_a = static_cast<float>(current_a);
+    sample.voltage_v = static_cast<float>(voltage_v);
+    samples.push_back(sample);
+  }
+  fclose(file);
+  return samples;
+}
+
+std::vector<Sample> simulate(const Options& options) {
+  std::vector<Sample> samples;
+  std::mt19937 rng(42);
+  std::normal_distribution<double> noise(0.0, 1.0);
+  const double step_s = 1.0 / options.rate_hz;
+  const uint64_t count = static_cast<uint64_t>(options.days * 86400.0 * options.rate_hz);
+  samples.reserve(count);
+  for (uint64_t i = 0; i < count; i++) {
+    double t = i * step_s;
+    double hour = fmod(t / 3600.0, 24.0);
+    // Fridge compressor cycling (20 min period) plus a base load
+    double load = -1.5 - (fmod(t, 1200.0) < 480.0 ? 4.0 : 0.0);
+    // Solar charge around midday
+    double solar = hour > 7.0 && hour < 19.0 ? 18.0 * sin((hour - 7.0) / 12.0 * M_PI) : 0.0;
+    double current = load + solar + noise(rng) * options.noise_ma / 1000.0;
+    double voltage = 12.7 + 0.02 * current + noise(rng) * options.noise_mv / 1000.0;
+    samples.push_back({static_cast<uint64_t>(t * 1000.0), static_cast<float>(voltage), static_cast<float>(current)});
+  }
+  return samples;
+}
+
+template <typename Ring>
+void report(const char* name, const Ring& ring, double window_s) {
+  double span_s = ring.record_count() * window_s;
+  printf("%-7s %8u records %7zu B stored %7zu B allocated %6.2f B/record  holds %8.1f h\n", name,
+         ring.record_count(), ring.stored_bytes(), ring.allocated_bytes(),
+         ring.record_count() ? static_cast<double>(ring.stored_bytes()) / ring.record_count() : 0.0,
+         span_s / 3600.0);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options options;
+  if (!parse_args(argc, argv, &options)) {
+    fprintf(stderr, "usage: %s [trace.csv] [--days N] [--rate-hz N] [--noise-mv N] [--noise-ma N]\n", argv[0]);
+    return 2;
+  }
+  std::vector<Sample> samples = options.trace_path.empty() ? simulate(options) : load_trace(options.trace_path);
+  if (samples.empty()) {
+    fprintf(stderr, "no samples\n");
+    return 1;
+  }
+
+  HistoryTiers tiers;
+
+  double ah = 100.0;
+  uint64_t previous_ms = samples.front().timestamp_ms;
+  double append_ns = 0.0;
+  for (const Sample& sample : samples) {
+    ah += sample.current_a * (sample.timestamp_ms - previous_ms) / 3.6e6;
+    ah = ah < 0.0 ? 0.0 : (ah > 200.0 ? 200.0 : ah);
+    previous_ms = sample.timestamp_ms;
+    uint32_t time_s = static_cast<uint32_t>(sample.timestamp_ms / 1000);
+
+    auto start = std::chrono::steady_clock::now();
+    tiers.append(time_s, sample.voltage_v, sample.current_a, static_cast<float>(ah));
+    append_ns += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+  }
+
+  printf("%zu samples, %.1f days, append %.1f ns/sample\n", samples.size(),
+         (samples.back().timestamp_ms - samples.front().timestamp_ms) / 86400000.0, append_ns / samples.size());
+  report("raw", tiers.raw(), 1.0);
+  report("minute", tiers.minute(), 60.0);
+  report("hour", tiers.hour(), 3600.0);
+  size_t total = tiers.raw().allocated_bytes() + tiers.minute().allocated_bytes() + tiers.hour().allocated_bytes();
+  printf("total   %zu B allocated per battery\n", total);
+
+  return 0;
+}
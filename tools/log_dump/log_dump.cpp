@@ -0,0 +1,133 @@
+// Decode a battery log export to CSV.
+//
+// Reads the stream served by GET /api/batteries/log?battery=<name> (framed
+// segments, see BatteryLog::export_to) or a single segment file copied from
+// the device (--segment), and prints one CSV row per record:
+//   epoch_s,uptime_s,voltage_v,current_a,ah,soc_pct,temperature_c
+// epoch_s is empty for segments written before the clock was set.
+//
+// Build on the host from the repository root:
+//   g++ -O2 -std=c++17 -Iinclude tools/log_dump/log_dump.cpp -o log_dump
+//
+// Usage:
+//   curl -o house.blg 'http://battery-sensors.local/api/batteries/log?battery=house'
+//   ./log_dump house.blg > house.csv
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "battery_log.h"
+
+using namespace sensesp;
+
+namespace {
+
+bool read_file(const char* path, std::vector<uint8_t>* data) {
+  FILE* file = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+  if (file == nullptr) {
+    return false;
+  }
+  uint8_t buffer[4096];
+  size_t n;
+  while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    data->insert(data->end(), buffer, buffer + n);
+  }
+  if (file != stdin) {
+    fclose(file);
+  }
+  return true;
+}
+
+void print_row(const LogSegmentHeader& header, uint32_t index, int32_t voltage, int32_t current, int32_t ah,
+               int32_t soc, int32_t temperature) {
+  uint32_t offset_s = index * header.interval_s;
+  if (header.epoch_s != 0) {
+    printf("%lu,", static_cast<unsigned long>(header.epoch_s + offset_s));
+  } else {
+    printf(",");
+  }
+  printf("%lu,%.3f,%.2f,%.2f,%.1f,", static_cast<unsigned long>(header.uptime_s + offset_s), voltage / 1000.0,
+         current / 100.0, ah / 100.0, soc / 10.0);
+  if (temperature == BatteryLog::kNoTemperature) {
+    printf("\n");
+  } else {
+    printf("%.1f\n", temperature / 10.0);
+  }
+}
+
+// Returns the number of records, -1 if the segment is malformed
+int decode_segment(const uint8_t* data, size_t length) {
+  LogSegmentHeader header;
+  if (length < sizeof(header)) {
+    return -1;
+  }
+  memcpy(&header, data, sizeof(header));
+  if (memcmp(header.magic, "BLG1", 4) != 0) {
+    return -1;
+  }
+  int32_t voltage = header.voltage;
+  int32_t current = header.current;
+  int32_t ah = header.ah;
+  int32_t soc = header.soc;
+  int32_t temperature = header.temperature;
+  print_row(header, 0, voltage, current, ah, soc, temperature);
+
+  uint32_t index = 1;
+  for (size_t offset = sizeof(header); offset + sizeof(LogRecord) <= length; offset += sizeof(LogRecord)) {
+    LogRecord record;
+    memcpy(&record, data + offset, sizeof(record));
+    voltage += record.voltage;
+    current += record.current;
+    ah += record.ah;
+    soc += record.soc;
+    bool has_temperature = record.temperature != BatteryLog::kNoTemperatureDelta;
+    if (has_temperature) {
+      temperature += record.temperature;
+    }
+    print_row(header, index++, voltage, current, ah, soc,
+              has_temperature ? temperature : BatteryLog::kNoTemperature);
+  }
+  return index;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  bool single_segment = false;
+  const char* path = nullptr;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--segment") == 0) {
+      single_segment = true;
+    } else {
+      path = argv[i];
+    }
+  }
+  std::vector<uint8_t> data;
+  if (path == nullptr || !read_file(path, &data)) {
+    fprintf(stderr, "usage: %s [--segment] <export file | ->\n", argv[0]);
+    return 2;
+  }
+
+  printf("epoch_s,uptime_s,voltage_v,current_a,ah,soc_pct,temperature_c\n");
+  if (single_segment) {
+    return decode_segment(data.data(), data.size()) < 0 ? 1 : 0;
+  }
+  size_t offset = 0;
+  int segments = 0;
+  while (offset + sizeof(uint32_t) <= data.size()) {
+    uint32_t length;
+    memcpy(&length, data.data() + offset, sizeof(length));
+    offset += sizeof(length);
+    if (offset + length > data.size() || decode_segment(data.data() + offset, length) < 0) {
+      fprintf(stderr, "malformed segment %d at byte %zu\n", segments, offset);
+      return 1;
+    }
+    offset += length;
+    segments++;
+  }
+  fprintf(stderr, "%d segments\n", segments);
+  return 0;
+}
@@ -0,0 +1,135 @@
+// Host benchmark and trace replay for the Kalman filter SOC
+// (include/soc_ekf.h). The filter's accuracy checks are in test/test_soc_ekf.
+//
+// Without arguments it reports the cost of one update() on this host.
+//
+// Replay: --trace runs a recorded trace in the tools/ah_replay CSV format
+// (timestamp_ms,current_a,voltage_v[,reference_ah]) through the filter and
+// reports its SOC error at the reference points next to coulomb counting.
+//
+// Build on the host from the repository root:
+//   g++ -O2 -std=c++17 -Iinclude tools/soc_bench/soc_bench.cpp src/soc_ekf.cpp -o soc_bench
+//
+// Usage:
+//   ./soc_bench
+//   ./soc_bench --trace house.csv [--chemistry lead|lifepo4] [--cells N] [--capacity AH] [--initial-soc F]
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "soc_ekf.h"
+
+using namespace sensesp;
+
+namespace {
+
+void step_cost() {
+  SocEkf ekf(BatteryChemistry::kLeadAcid, 6, 200.0f);
+  const int steps = 10000000;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < steps; i++) {
+    ekf.update(static_cast<uint32_t>(i) * 100000u, -5.0f - (i & 7) * 0.1f, 12.4f - (i & 3) * 0.001f);
+  }
+  double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / steps;
+  printf("update(): %.1f ns on this host, %zu bytes of state (soc %.3f)\n", ns, sizeof(ekf), ekf.soc());
+}
+
+struct TraceOptions {
+  std::string path;
+  BatteryChemistry chemistry = BatteryChemistry::kLeadAcid;
+  int cells = 0;  // 0: 12 V battery of the chemistry
+  float capacity_ah = 200.0f;
+  float initial_soc = NAN;  // Default: first reference, else 1
+};
+
+int replay(const TraceOptions& options) {
+  FILE* file = fopen(options.path.c_str(), "r");
+  if (file == nullptr) {
+    fprintf(stderr, "cannot open %s\n", options.path.c_str());
+    return 2;
+  }
+  int cells = options.cells > 0 ? options.cells : (options.chemistry == BatteryChemistry::kLeadAcid ? 6 : 4);
+  SocEkf ekf(options.chemistry, static_cast<uint8_t>(cells), options.capacity_ah);
+  float coulomb_soc = NAN;
+  double last_ms = NAN;
+  int references = 0;
+  double ekf_error_sum = 0;
+  double coulomb_error_sum = 0;
+  char line[256];
+  while (fgets(line, sizeof(line), file) != nullptr) {
+    double timestamp_ms;
+    float current_a;
+    float voltage_v;
+    float reference_ah = NAN;
+    int fields = sscanf(line, "%lf,%f,%f,%f", &timestamp_ms, &current_a, &voltage_v, &reference_ah);
+    if (fields < 3) {
+      continue;  // Header, comment, or no voltage
+    }
+    float reference_soc = reference_ah / options.capacity_ah;
+    if (std::isnan(coulomb_soc)) {
+      coulomb_soc = !std::isnan(options.initial_soc) ? options.initial_soc
+                    : !std::isnan(reference_soc)     ? reference_soc
+                                                     : 1.0f;
+      ekf.reset(coulomb_soc);
+    } else {
+      coulomb_soc += current_a * static_cast<float>((timestamp_ms - last_ms) / 1000.0) / (3600.0f * options.capacity_ah);
+      coulomb_soc = coulomb_soc < 0 ? 0 : (coulomb_soc > 1 ? 1 : coulomb_soc);
+    }
+    last_ms = timestamp_ms;
+    ekf.update(static_cast<uint32_t>(static_cast<uint64_t>(timestamp_ms * 1000.0)), current_a, voltage_v);
+    if (fields == 4 && !std::isnan(reference_soc) && references++ > 0) {
+      float ekf_error = ekf.soc() - reference_soc;
+      float coulomb_error = coulomb_soc - reference_soc;
+      printf("t=%10.0f s reference %5.1f %%: EKF %+5.1f %%, coulomb %+5.1f %%\n", timestamp_ms / 1000.0,
+             reference_soc * 100, ekf_error * 100, coulomb_error * 100);
+      ekf_error_sum += std::fabs(ekf_error);
+      coulomb_error_sum += std::fabs(coulomb_error);
+      coulomb_soc = reference_soc;  // Like a PUT after a full charge; the filter keeps its own estimate
+    }
+  }
+  fclose(file);
+  if (references > 1) {
+    printf("mean error at %d references: EKF %.1f %%, coulomb %.1f %%\n", references - 1,
+           ekf_error_sum / (references - 1) * 100, coulomb_error_sum / (references - 1) * 100);
+  } else {
+    printf("no reference points after the first; final SOC %.1f %% (EKF), %.1f %% (coulomb)\n",
+           ekf.soc() * 100, coulomb_soc * 100);
+  }
+  return 0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  TraceOptions trace;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+      trace.path = argv[++i];
+    } else if (strcmp(argv[i], "--chemistry") == 0 && i + 1 < argc) {
+      i++;
+      trace.chemistry = strcmp(argv[i], "lifepo4") == 0 ? BatteryChemistry::kLiFePO4 : BatteryChemistry::kLeadAcid;
+    } else if (strcmp(argv[i], "--cells") == 0 && i + 1 < argc) {
+      trace.cells = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--capacity") == 0 && i + 1 < argc) {
+      trace.capacity_ah = static_cast<float>(atof(argv[++i]));
+    } else if (strcmp(argv[i], "--initial-soc") == 0 && i + 1 < argc) {
+      trace.initial_soc = static_cast<float>(atof(argv[++i]));
+    } else {
+      fprintf(stderr,
+              "usage: %s\n"
+              "       %s --trace FILE [--chemistry lead|lifepo4] [--cells N] [--capacity AH] [--initial-soc F]\n",
+              argv[0], argv[0]);
+      return 2;
+    }
+  }
+  if (!trace.path.empty()) {
+    return replay(trace);
+  }
+  step_cost();
+  return 0;
+}
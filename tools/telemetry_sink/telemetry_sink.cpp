@@ -0,0 +1,209 @@
+// Host receiver for the binary telemetry stream (include/telemetry_stream.h).
+//
+// Listens on a UDP port (or reads MQTT payloads as hex lines from
+// mosquitto_sub) and decodes the datagrams: prints a summary per second
+// (datagrams, records and sample rate per battery, datagrams lost by
+// sequence gaps, restarts of the node), or every record as CSV.
+// The test_telemetry_stream suite checks the stream against the same
+// decoding.
+//
+// Build on the host from the repository root:
+//   g++ -O2 -std=c++17 -Iinclude tools/telemetry_sink/telemetry_sink.cpp src/telemetry_stream.cpp -o telemetry_sink
+//
+// Usage:
+//   ./telemetry_sink [--port N] [--csv]
+//   mosquitto_sub -h BROKER -t battery-sensors/telemetry -F %x | ./telemetry_sink --hex [--csv]
+// The node sends to UDP port 4950 (BATTERY_TELEMETRY_UDP_PORT) by default.
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "telemetry_stream.h"
+
+using namespace sensesp;
+
+namespace {
+
+struct Options {
+  uint16_t port = 4950;
+  bool csv = false;
+  bool hex = false;
+};
+
+// Sequence tracking of one sender
+class Receiver {
+ public:
+  explicit Receiver(bool csv) : csv_(csv) {
+    if (csv_) {
+      printf("session,sequence,timestamp_us,battery,voltage_v,current_a,ah\n");
+    }
+  }
+
+  // False if data is not a telemetry datagram
+  bool receive(const uint8_t* data, size_t length) {
+    TelemetryHeader header;
+    if (!decode_telemetry_header(data, length, &header)) {
+      invalid_++;
+      return false;
+    }
+    if (!has_session_ || header.session != session_) {
+      if (has_session_) {
+        restarts_++;
+      }
+      has_session_ = true;
+      session_ = header.session;
+    } else if (header.sequence != next_sequence_) {
+      // Late or duplicate datagrams (sequence behind) are not losses
+      int32_t gap = static_cast<int32_t>(header.sequence - next_sequence_);
+      if (gap > 0) {
+        lost_ += gap;
+      }
+    }
+    next_sequence_ = header.sequence + 1;
+    datagrams_++;
+    for (size_t i = 0; i < header.count; i++) {
+      TelemetryRecord record = decode_telemetry_record(data, i);
+      records_.push_back(record);
+      if (record.battery < kMaxBatteries) {
+        per_battery_[record.battery]++;
+      }
+      if (csv_) {
+        printf("%08x,%u,%u,%u,%.3f,%.4f,%.3f\n", header.session, header.sequence, record.timestamp_us,
+               record.battery, record.voltage_v, record.current_a, record.ah);
+      }
+    }
+    return true;
+  }
+
+  // One summary line for the records since the last call
+  void print_summary(double seconds) {
+    if (!csv_) {
+      printf("%6ld datagrams, %6zu records, lost %ld, restarts %ld, invalid %ld |", datagrams_, records_.size(),
+             lost_, restarts_, invalid_);
+      for (int i = 0; i < kMaxBatteries; i++) {
+        if (per_battery_[i] > 0) {
+          printf(" battery %d: %.1f Hz", i, per_battery_[i] / seconds);
+        }
+      }
+      printf("\n");
+      fflush(stdout);
+    }
+    records_.clear();
+    for (int i = 0; i < kMaxBatteries; i++) {
+      per_battery_[i] = 0;
+    }
+  }
+
+ private:
+  static constexpr int kMaxBatteries = 16;
+  bool csv_;
+  bool has_session_ = false;
+  uint32_t session_ = 0;
+  uint32_t next_sequence_ = 0;
+  long datagrams_ = 0;
+  long lost_ = 0;
+  long restarts_ = 0;
+  long invalid_ = 0;
+  long per_battery_[kMaxBatteries] = {};
+  std::vector<TelemetryRecord> records_;
+};
+
+int open_socket(uint16_t port) {
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (fd < 0) {
+    perror("socket");
+    return -1;
+  }
+  int reuse = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+  // Room for a burst of datagrams
+  int size = 1 << 20;
+  setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  address.sin_port = htons(port);
+  if (bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+    perror("bind");
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+int listen_udp(const Options& options) {
+  int fd = open_socket(options.port);
+  if (fd < 0) {
+    return 1;
+  }
+  Receiver receiver(options.csv);
+  uint8_t buffer[65536];
+  auto last = std::chrono::steady_clock::now();
+  timeval timeout = {0, 200000};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  for (;;) {
+    ssize_t length = recv(fd, buffer, sizeof(buffer), 0);
+    if (length > 0) {
+      receiver.receive(buffer, static_cast<size_t>(length));
+    }
+    auto now = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(now - last).count();
+    if (seconds >= 1.0) {
+      receiver.print_summary(seconds);
+      last = now;
+    }
+  }
+}
+
+int read_hex(const Options& options) {
+  Receiver receiver(options.csv);
+  std::vector<uint8_t> data;
+  char line[8192];
+  auto last = std::chrono::steady_clock::now();
+  while (fgets(line, sizeof(line), stdin) != nullptr) {
+    data.clear();
+    for (const char* p = line; p[0] != '\0' && p[1] != '\0' && p[0] != '\n'; p += 2) {
+      char byte[3] = {p[0], p[1], '\0'};
+      data.push_back(static_cast<uint8_t>(strtoul(byte, nullptr, 16)));
+    }
+    if (!receiver.receive(data.data(), data.size())) {
+      fprintf(stderr, "not a telemetry datagram (%zu bytes)\n", data.size());
+    }
+    auto now = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(now - last).count();
+    if (seconds >= 1.0) {
+      receiver.print_summary(seconds);
+      last = now;
+    }
+  }
+  receiver.print_summary(std::chrono::duration<double>(std::chrono::steady_clock::now() - last).count());
+  return 0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options options;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--port") == 0 && i + 1 < argc) {
+      options.port = static_cast<uint16_t>(atoi(argv[++i]));
+    } else if (strcmp(argv[i], "--csv") == 0) {
+      options.csv = true;
+    } else if (strcmp(argv[i], "--hex") == 0) {
+      options.hex = true;
+    } else {
+      fprintf(stderr, "usage: %s [--port N] [--csv] [--hex]\n", argv[0]);
+      return 2;
+    }
+  }
+  return options.hex ? read_hex(options) : listen_udp(options);
+}